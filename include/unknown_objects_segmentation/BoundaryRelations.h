@@ -45,6 +45,22 @@
 namespace surface
 {
 
+/** @brief Neighbouring pixel pair on the border between two patches **/
+struct BoundaryPixel {
+  int p0, p1;                           ///< Patch ids of the border (p0 < p1)
+  int first;                            ///< Index of the scanned pixel
+  int second;                           ///< Index of the neighbour pixel with the smallest depth gap
+  int dir;                              ///< Direction to neighbour (0=left, 1=left-upper, 2=upper, 3=right-upper)
+  double depth;                         ///< Depth gap between first and second pixel
+  bool is3D;                            ///< Depth gap is inside the adaptive 3D neighbourhood
+};
+
+/** @brief Scratch buffers of BoundaryRelations::compare (one per thread) **/
+struct BoundaryScratch {
+  std::vector<double> depth_vals;       ///< Depth gaps of the border pixel pairs
+  std::vector<double> curvature_vals;   ///< Curvatures of the 3D border pixel pairs
+};
+
 class BoundaryRelations
 {
 public:
@@ -64,9 +80,11 @@ private:
   pcl::PointCloud<pcl::PointXYZRGB>::Ptr pcl_cloud_model;               ///< Input cloud projected to model
   pcl::PointCloud<pcl::Normal>::Ptr pcl_model_normals;                  ///< Normals (set from outside or from surfaces)
   surface::View *view;                                                  ///< Surface models
-  cv::Mat_<int> patches;                                                ///< Patch indices (+1 !) on 2D image grid
+  cv::Mat_<int> patches;                                                ///< Patch image (of the view, read only)
+  std::vector<BoundaryPixel> boundary;                                  ///< Border pixel pairs, sorted by patch pair
   
   void projectPts2Model();                                              ///< Project plane points to model
+  void computeBoundaryIndex();                                          ///< Collect border pixel pairs of all patches
     
 public:
   BoundaryRelations();
@@ -80,6 +98,12 @@ public:
   
   /** Compare patches **/
   bool compare(int p0, int p1, std::vector<double> &rel_value);
+
+  /** Compare patches with scratch buffers of the calling thread (thread-safe, no shared state is changed) **/
+  bool compare(int p0, int p1, std::vector<double> &rel_value, BoundaryScratch &scratch) const;
+
+  /** Get border pixel pairs between two patches: returns number of pairs **/
+  unsigned getBoundary(int p0, int p1, const BoundaryPixel *&begin) const;
 };
 
 /*************************** INLINE METHODES **************************/
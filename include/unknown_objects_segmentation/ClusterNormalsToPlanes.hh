@@ -45,6 +45,7 @@
 #include "SurfaceModel.hpp"
 
 #include "PPlane.h"
+#include "disjoint-set.h"
 
 namespace surface
 {
@@ -100,12 +101,20 @@ private:
   std::vector< std::vector<float> > srt_curvature;
   
   std::vector<unsigned char> mask;
+  std::vector<int> queue;                                               ///< Region growing queue (reused for all seeds)
+  std::vector<unsigned char> reassign;                                  ///< Pixels to reassign of CountNeighbours
+  std::vector<int> labels;                                              ///< Union-find: component root of each point
+  std::vector<int> comp_idx;                                            ///< Union-find: component number of each root
+  std::vector<int> comp_offset;                                         ///< Union-find: first point of each component in comp_pts
+  std::vector<int> comp_pts;                                            ///< Union-find: points ordered by component
   std::vector<float> p_adaptive_cosThrAngleNC;                          ///< adaptive angle
   std::vector<float> p_adaptive_inlDist;                                ///< adaptive inlier distance
   
   bool pixel_check;
+  bool parallel;                   //< Tile-parallel union-find clustering instead of greedy region growing
   int max_neighbours;              //< Maximum pixel neighbors for pixel check
   int max_nneighbours;             //< Maximum neighbouring neighbors for pixel check
+  unsigned nr_reassigned;          //< Number of reassigned pixels of the last pixel check
   cv::Mat_<int> patches;           //< Patch indices(+1) on 2D image grid
 
   void CalcAdaptive();
@@ -121,10 +130,20 @@ private:
                    pcl::PointCloud<pcl::Normal> &normals, 
                    std::vector<int> &pts,
                    pcl::Normal &normal);
+  void InitMask(pcl::PointCloud<pcl::PointXYZRGB> &cloud, const std::vector<int> &indices);
+  void ClusterRestPoints(pcl::PointCloud<pcl::PointXYZRGB> &cloud, pcl::PointCloud<pcl::Normal> &normals,
+                         std::vector<SurfaceModel::Ptr> &planes, pcl::Normal &normal);
+  template<bool adaptive>
+  bool Similar(pcl::PointCloud<pcl::PointXYZRGB> &cloud, pcl::PointCloud<pcl::Normal> &normals, int a, int b);
+  template<bool adaptive>
+  void ClusterNormalsParallel(pcl::PointCloud<pcl::PointXYZRGB> &cloud, pcl::PointCloud<pcl::Normal> &normals,
+                              const std::vector<int> &indices, std::vector<SurfaceModel::Ptr> &planes);
+  template<bool adaptive>
   void ClusterNormals(pcl::PointCloud<pcl::PointXYZRGB> &cloud, 
         pcl::PointCloud<pcl::Normal> &normals,
         const std::vector<int> &indices, 
         std::vector<SurfaceModel::Ptr> &planes); 
+  template<bool adaptive>
   void ClusterNormals(unsigned idx, pcl::PointCloud<pcl::PointXYZRGB> &cloud, 
         pcl::PointCloud<pcl::Normal> &normals, 
         std::vector<int> &pts, pcl::Normal &normal);
@@ -132,6 +151,8 @@ private:
         std::vector<SurfaceModel::Ptr> &planes);
   void AddNormals();
   
+  template<bool adaptive>
+  inline void GetThresholds(int idx, float &cos_thr, float &inl_dist) const;
   inline int GetIdx(short x, short y);
   inline short X(int idx);
   inline short Y(int idx);
@@ -154,6 +175,9 @@ public:
   /** Set parameters for plane estimation **/
   void setParameter(Parameter p);
 
+  /** Get parameters for plane estimation **/
+  const Parameter &getParameter() const {return param;}
+
   /** Set input cloud **/
   void setInputCloud(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &_cloud);
 
@@ -163,18 +187,42 @@ public:
   /** Set surface check: try to reasign single pixels to planes **/
   void setPixelCheck(bool check, int neighbors);
 
+  /** Get surface check and its neighbours threshold **/
+  bool getPixelCheck() const {return pixel_check;}
+  int getPixelCheckNeighbors() const {return max_neighbours;}
+
+  /** Use tile-parallel union-find clustering instead of the greedy region growing (default: off) **/
+  void setParallel(bool _parallel) {parallel = _parallel;}
+  bool getParallel() const {return parallel;}
+
   /** Compute planes by surface normal grouping **/
   void compute();
   
    /** Compute planes by surface normal grouping **/
   void compute(const std::vector<int> &indices);
 
+  /** Get number of pixels reassigned by the pixel check of the last compute **/
+  unsigned getNrReassigned() {return nr_reassigned;}
+
 };
 
 
 
 /*********************** INLINE METHODES **************************/
 
+/** Angle (cosine) and inlier distance threshold at point idx: fixed or from the adaptive tables **/
+template<bool adaptive>
+inline void ClusterNormalsToPlanes::GetThresholds(int idx, float &cos_thr, float &inl_dist) const
+{
+  if (adaptive) {
+    cos_thr = p_adaptive_cosThrAngleNC[idx];
+    inl_dist = p_adaptive_inlDist[idx];
+  } else {
+    cos_thr = cosThrAngleNC;
+    inl_dist = param.inlDist;
+  }
+}
+
 
 inline int ClusterNormalsToPlanes::GetIdx(short x, short y)
 {
@@ -0,0 +1,114 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file CoarseToFine.h
+ * @brief Pre-segmentation on a subsampled cloud, upsampled to full resolution.
+ */
+
+#ifndef SURFACE_COARSE_TO_FINE_H
+#define SURFACE_COARSE_TO_FINE_H
+
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "SurfaceModel.hpp"
+
+namespace surface
+{
+
+/**
+ * @brief Class CoarseToFine: Subsamples an organized cloud by 2^level (one valid point per block,
+ * the block centre if possible) and transfers normals and patches of the coarse cloud back to the
+ * full cloud. Pixels inside a coarse patch take its label, pixels at coarse patch borders are
+ * refined at full resolution: they go to the plane of the neighbouring patches with the smallest
+ * point distance. Pixels whose coarse pixel has no normal (e.g. an invalid block at the image
+ * border) take the nearest coarse neighbour with a normal.
+ */
+class CoarseToFine
+{
+private:
+  int level;                                                    ///< Pyramid level (step 2^level)
+  int step;                                                     ///< Subsampling step [px]
+  unsigned coarse_width, coarse_height;                         ///< Size of the coarse cloud
+  unsigned nr_refined;                                          ///< Border pixels refined at full resolution
+  float max_dist;                                               ///< Maximum plane distance of a refined pixel [m]
+
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;                 ///< Full resolution cloud
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr coarse;                ///< Subsampled cloud
+  pcl::PointCloud<pcl::Normal>::Ptr normals;                    ///< Upsampled normals (reused if unique)
+  std::vector<int> source;                                      ///< Full resolution index of each coarse point
+  surface::View *view;                                          ///< Full resolution view (output)
+
+  /** Coarse pixel of a full resolution pixel (clamped to the coarse cloud) **/
+  inline int coarseIndex(int u, int v) const;
+
+  /** Coarse pixel of the 3x3 neighbourhood of cidx with a valid normal, nearest to pt (-1: none) **/
+  int validNeighbour(const pcl::PointCloud<pcl::Normal> &coarse_normals, int cidx,
+                     const pcl::PointXYZRGB &pt) const;
+
+public:
+  CoarseToFine();
+  ~CoarseToFine();
+
+  /** Set pyramid level: 1 halves width and height **/
+  void setLevel(int _level);
+
+  /** Set maximum plane distance of refined border pixels (default 0.01m), pixels without a plane
+   * inside keep the label of their coarse pixel **/
+  void setMaxDistance(float _max_dist) {max_dist = _max_dist;}
+
+  /** Set full resolution cloud and create the coarse cloud **/
+  void setInputCloud(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &_cloud);
+
+  /** Set the full resolution view (receives normals and patches) **/
+  void setView(surface::View *_view);
+
+  /** Get the subsampled cloud **/
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr &getCoarseCloud() {return coarse;}
+
+  /** Upsample normals and patches of the coarse cloud to the view **/
+  void compute(const pcl::PointCloud<pcl::Normal> &coarse_normals,
+               const std::vector<SurfaceModel::Ptr> &coarse_surfaces);
+
+  /** Number of border pixels refined in the last compute() **/
+  unsigned getNrRefined() const {return nr_refined;}
+};
+
+/*************************** INLINE METHODES **************************/
+
+inline int CoarseToFine::coarseIndex(int u, int v) const
+{
+  int cu = std::min(u / step, (int) coarse_width - 1);
+  int cv = std::min(v / step, (int) coarse_height - 1);
+  return cv * coarse_width + cu;
+}
+
+} //--END--
+
+#endif
+
@@ -55,20 +55,33 @@ private:
   bool have_input_cloud;
   pcl::PointCloud<pcl::PointXYZRGB>::Ptr input_cloud;
   bool have_indices;
-  std::vector<int> indices;
+  pcl::PointIndices::Ptr pcl_indices;                         /// keeps the antiquated indices alive
+  const std::vector<int> *indices;                            /// indices of the patch (not copied)
+  const std::vector<int> *bins;                               /// bin image of the input cloud (optional, not copied)
   
-  std::vector< std::vector< std::vector<double> > > yuvHist;  /// 3D y,u,v histogram
+  std::vector<int> counts;                                    /// 3D y,u,v histogram counts (flat, y-major)
+  std::vector<double> yuvHist;                                /// 3D y,u,v histogram (flat, y-major)
+
+  /** Bin of the histogram **/
+  inline int Bin(int y, int u, int v) const {return (y*nr_bins + u)*nr_bins + v;}
   
 public:
   ColorHistogram3D(int _nr_bins, double _UVTheshold);
   
   void setInputCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr &_input_cloud);
   void setIndices(pcl::PointIndices::Ptr &_indices);
-  void setIndices(std::vector<int> _indices);
+  /** Set indices: not copied, they have to stay valid until compute() **/
+  void setIndices(const std::vector<int> &_indices);
+  /** Set bin image of the input cloud (see computeBinImage): not copied, has to stay valid until compute() **/
+  void setBinImage(const std::vector<int> &_bins);
   void compute();
-  double compare(ColorHistogram3D &ch);
+
+  /** Histogram bin of each point of the cloud (-1 for points without colour), once per frame for all patches **/
+  static void computeBinImage(const pcl::PointCloud<pcl::PointXYZRGB> &cloud, int nr_bins, double UVthreshold,
+                              std::vector<int> &bins);
+  double compare(const ColorHistogram3D &ch) const;
   
-  void printHistogram();
+  void printHistogram() const;
 };
 
 }
@@ -45,16 +45,16 @@
 namespace surface
 {
   
-/** Edgel **/
+/** Edgel: pixel with a patch change to the right (horizontal) or bottom (vertical) pixel **/
 struct aEdgel {
   int index;                            ///< index in point cloud
-  int corner_idx;                       ///< corner index in image space
+  int corner_idx;                       ///< index of the adjacent corner in image space (or -1)
+  int h_ids[2];                         ///< surface ids (left/right)
+  int v_ids[2];                         ///< surface ids (top/bottom)
   bool horizontal;                      ///< horizontal edge
   bool h_valid;                         ///< horizontal edge validity
-  int h_ids[2];                         ///< surface ids (left/right)
   bool vertical;                        ///< vertical edge
   bool v_valid;                         ///< vertical edge validity
-  int v_ids[2];                         ///< surface ids (top/bottom)
 
   void print() {
     printf("Edge: %u\n", index);
@@ -111,25 +111,28 @@ protected:
   bool have_view;
   bool initialized;
   bool have_contours;
+  bool have_edgels;
   
-  cv::Mat_<int> patches;                                                ///< Patch image
+  cv::Mat_<int> patches;                                                ///< Patch image (of the view, read only)
   cv::Mat_<int> contours;                                               ///< Contour image
-  cv::Mat_<int> contours2;                                              ///< (same) Contour image, later used for splitting
+  std::vector<unsigned char> traced;                                    ///< Contour pixel already assigned to a contour
+  std::vector<int> contour_offset;                                      ///< Start of the contour pixels of each patch
+  std::vector<int> contour_pixels;                                      ///< Contour pixels ordered by patch (and row-major)
   
-  std::vector<surface::aEdgel> pre_edgels;                              ///< detected edgels
-  std::vector<surface::aCorner> pre_corners;                            ///< detected corners
+  std::vector<surface::aEdgel> pre_edgels;                              ///< detected edgels (boundary pixels, row-major)
+  std::vector<surface::aCorner> pre_corners;                            ///< detected corners (row-major)
   
   pcl::PointCloud<pcl::PointXYZRGB>::Ptr pcl_cloud;                     ///< Input cloud
   surface::View *view;                                                  ///< Surface models
   
-  /** compute edgels and corners **/
+  /** compute patch and contour image **/
   void initialize();
+
+  /** Check for corner of three or four patches at 2x2 block **/
+  inline bool IsCorner(const int *p, int idx);
   
-  /** Recursive search of neighbouring contour pixels **/
-  void RecursiveContourClustering(int id, int start_x, int start_y,
-                                  int x, int y, int dir,
-                                  std::vector<int> &contour,
-                                  bool &end);
+  /** Iterative search of neighbouring contour pixels **/
+  bool TraceContour(int id, int start_x, int start_y, std::vector<int> &contour);
 
   inline int GetIdx(short x, short y);
   inline short X(int idx);
@@ -150,6 +153,15 @@ public:
   /** Trace contour image and create surface contours **/
   void computeContours();
 
+  /** Collect edgels and corners of the patch image (also stored in the view) **/
+  void computeEdgels();
+
+  /** Edgels of the last computeEdgels (row-major) **/
+  const std::vector<surface::aEdgel> &getEdgels() const {return pre_edgels;}
+
+  /** Corners of the last computeEdgels (row-major) **/
+  const std::vector<surface::aCorner> &getCorners() const {return pre_corners;}
+
 };
 
 
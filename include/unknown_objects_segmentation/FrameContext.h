@@ -0,0 +1,106 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file FrameContext.h
+ * @brief Per-frame intermediates shared by the processing stages.
+ */
+
+#ifndef SURFACE_FRAME_CONTEXT_H
+#define SURFACE_FRAME_CONTEXT_H
+
+#include <vector>
+#include <stdio.h>
+
+#include <opencv2/core/core.hpp>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace surface
+{
+
+class PatchTable;
+
+/**
+ * @brief Class FrameContext: Images of the frame, computed once on first use and shared by all
+ * stages. The cloud images stay valid until the next input cloud, the patch image until the
+ * patches change. The get functions may be called from parallel threads.
+ */
+class FrameContext
+{
+private:
+  pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr cloud;    ///< Input cloud of the frame
+
+  bool havePatchImage;
+  cv::Mat_<int> patchImage;                             ///< Patch ids, -1 for unassigned pixels
+
+  bool haveColorImage;
+  cv::Mat_<cv::Vec3b> colorImage;                       ///< BGR image
+
+  bool haveEdgeImage;
+  double edgeParams[3];                                 ///< Canny thresholds and kernel size of the edge image
+  cv::Mat edgeImage;                                    ///< Canny edges of the blurred gray image
+
+  bool haveColorBins;
+  int nrColorBins;                                      ///< Number of bins per YUV channel of the bin image
+  double uvThreshold;                                   ///< Minimum squared UV distance of the bin image
+  std::vector<int> colorBins;                           ///< YUV histogram bin of each point (-1: no colour)
+
+  bool checkCloud(const char *function) const;
+
+public:
+  FrameContext();
+
+  /** Set input cloud: invalidates all images for a new cloud **/
+  void setInputCloud(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &_cloud);
+
+  /** Remove input cloud and all images (the memory is kept) **/
+  void reset() {cloud.reset(); invalidate();}
+
+  /** Invalidate images of the cloud, e.g. when the cloud data has been overwritten **/
+  void invalidate();
+
+  /** Invalidate the patch image after the patches have changed **/
+  void invalidatePatches() {havePatchImage = false;}
+
+  /** Input cloud available **/
+  bool haveCloud() const {return cloud.get() != 0;}
+
+  /** Patch image (patch ids of the table, -1 otherwise) **/
+  const cv::Mat_<int> &getPatchImage(const PatchTable &table);
+
+  /** BGR image of the cloud **/
+  const cv::Mat_<cv::Vec3b> &getColorImage();
+
+  /** Canny edges (0 / 255) of the blurred gray image **/
+  const cv::Mat &getEdgeImage(double lowThreshold, double highThreshold, int kernelSize);
+
+  /** YUV histogram bin of each point (see ColorHistogram3D::computeBinImage) **/
+  const std::vector<int> &getColorBins(int nr_bins, double UVthreshold);
+};
+
+}
+
+#endif
+
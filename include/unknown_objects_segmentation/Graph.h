@@ -52,6 +52,35 @@ extern T1 Dot3(const T1 v1[3], const T2 v2[3]);
 template<typename T1,typename T2, typename T3>
 extern void Add3(const T1 v1[3], const T2 v2[3], T3 r[3]);
 
+/**
+ * @brief Class Adjacency: Neighbours of all nodes (compressed sparse rows), built once
+ * from the relations. Each relation is stored for both nodes.
+ */
+class Adjacency
+{
+private:
+  std::vector<unsigned> offset;                                 ///< First neighbour of each node (nodes+1)
+  std::vector<unsigned> neighbours;                             ///< Neighbour node ids
+  std::vector<unsigned> relation;                               ///< Relation index of each neighbour
+
+public:
+  Adjacency() {}
+  Adjacency(unsigned nrNodes, const std::vector<surface::Relation> &rel) {build(nrNodes, rel);}
+
+  /** Build adjacency from relations (node ids >= nrNodes are ignored) **/
+  void build(unsigned nrNodes, const std::vector<surface::Relation> &rel);
+
+  /** Number of nodes **/
+  unsigned size() const {return offset.empty() ? 0 : offset.size()-1;}
+
+  /** Neighbours of node i: [begin(i), end(i)) **/
+  const unsigned *begin(unsigned i) const {return &neighbours[0] + offset[i];}
+  const unsigned *end(unsigned i) const {return &neighbours[0] + offset[i+1];}
+
+  /** Relation index of the k-th entry (begin(i) - begin(0) + k) **/
+  unsigned getRelation(unsigned k) const {return relation[k];}
+};
+
 /**
  * @brief Class Graph
  */
@@ -61,7 +90,7 @@ private:
   unsigned nodes;                                               ///< number of surface patches
   std::vector<gc::Edge> edges;                                  ///< edges of the graph (wiht node numbers and probability)
 
-  std::vector<surface::Relation> relations;                     ///< relations between features
+  const std::vector<surface::Relation> *relations;              ///< relations between features
   pcl::PointCloud<pcl::PointXYZRGB>::Ptr pcl_cloud;             ///< point cloud
   pcl::PointCloud<pcl::Normal>::Ptr normals;                    ///< Normals of the point cloud
   
@@ -75,11 +104,13 @@ private:
   
 public:
   Graph();
-  Graph(unsigned nrNodes, std::vector<surface::Relation> &rel);
+  Graph(unsigned nrNodes, const std::vector<surface::Relation> &rel);
   ~Graph();
   
+  /** Edges from the relations, nodes without relation to node 0 are connected to it (edges are swapped out) **/
   void BuildFromSVM(std::vector<gc::Edge> &e, unsigned &num_edges);
-  void BuildFromPointCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr &_pcl_cloud,
+  /** Pixel graph of an organized cloud: returns false, if the normals do not match the cloud **/
+  bool BuildFromPointCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr &_pcl_cloud,
                            pcl::PointCloud<pcl::Normal>::Ptr &_normals,
                            std::vector<gc::Edge> &e, unsigned &num_edges);
 };
@@ -70,10 +70,16 @@ private:
   bool initialized;                                 ///< flag to process
   bool processed;                                   ///< flag to get results
   unsigned num_edges;                               ///< Number of edges
+  unsigned num_nodes;                               ///< Number of nodes (surfaces)
 
   surface::View *view;                              ///< View with relations
-  gc::Edge *edges;                                  ///< Edges between the nodes, representing a probability
-  universe *u;                                      ///< universe to cut graph
+  std::vector<gc::Edge> edges;                      ///< Edges between the nodes, representing a probability
+  universe *u;                                      ///< universe to cut graph (one element per node)
+  float threshold_c;                                ///< Threshold constant of the merging (c/size)
+  unsigned min_size;                                ///< Components below this size are merged at the end
+
+  /** Sort edges by weight: counting sort on the quantised weights, then by weight within the buckets **/
+  void sortEdges();
   
   public:
   GraphCut();
@@ -82,11 +88,28 @@ private:
   /** Initialize the graph cut algorithm with number of nodes and with all available relations **/
   bool init(surface::View *_view);
 
+  /** Initialize the graph cut algorithm with an edge list between nrNodes nodes, e.g. the pixel graph of
+   * Graph::BuildFromPointCloud (edges are swapped in). Results are read with getComponent. **/
+  bool init(unsigned nrNodes, std::vector<gc::Edge> &_edges);
+
+  /** Set threshold constant c (default THRESHOLD_CONSTANT) and minimum component size (default MIN_SIZE):
+   * after the threshold merging, components smaller than minSize are joined along the cheapest edges **/
+  void setThreshold(float c, unsigned minSize = MIN_SIZE) {threshold_c = c; min_size = minSize;}
+
   /** Process graph cut **/
   void process();
   
   /** Print the results of the graph cut **/
   void printResults(bool _printResults) {print = _printResults;}
+
+  /** Get number of edges of the graph **/
+  unsigned getNrEdges() {return num_edges;}
+
+  /** Component (root node) of a node after processing **/
+  int getComponent(unsigned node) {return u->find(node);}
+
+  /** Number of nodes in the component of a root node **/
+  unsigned getComponentSize(int root) const {return u->size(root);}
 };
 
 }
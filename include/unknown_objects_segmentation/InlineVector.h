@@ -0,0 +1,96 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file InlineVector.h
+ * @brief Vector with fixed inline capacity.
+ */
+
+#ifndef SURFACE_INLINE_VECTOR_H
+#define SURFACE_INLINE_VECTOR_H
+
+#include <stdexcept>
+
+namespace surface
+{
+
+/**
+ * @brief Class InlineVector: std::vector interface for short vectors of at most N values, stored
+ * inside the object (no heap memory). Exceeding the capacity throws std::runtime_error.
+ */
+template<typename T, unsigned N>
+class InlineVector
+{
+public:
+  typedef T value_type;
+  typedef T *iterator;
+  typedef const T *const_iterator;
+
+private:
+  T values[N];
+  unsigned n;
+
+  void check(unsigned m) const {
+    if(m > N)
+      throw std::runtime_error("[InlineVector] Capacity exceeded!");
+  }
+
+public:
+  InlineVector() : n(0) {}
+  InlineVector(unsigned m, const T &value) : n(0) {assign(m, value);}
+
+  unsigned size() const {return n;}
+  bool empty() const {return n == 0;}
+  unsigned capacity() const {return N;}
+
+  T &operator[](unsigned i) {return values[i];}
+  const T &operator[](unsigned i) const {return values[i];}
+  T &back() {return values[n-1];}
+  const T &back() const {return values[n-1];}
+
+  iterator begin() {return values;}
+  iterator end() {return values + n;}
+  const_iterator begin() const {return values;}
+  const_iterator end() const {return values + n;}
+
+  void clear() {n = 0;}
+  void reserve(unsigned m) {check(m);}
+  void push_back(const T &value) {check(n+1); values[n++] = value;}
+  void resize(unsigned m, const T &value = T()) {
+    check(m);
+    for(unsigned i=n; i<m; i++)
+      values[i] = value;
+    n = m;
+  }
+  void assign(unsigned m, const T &value) {
+    check(m);
+    for(unsigned i=0; i<m; i++)
+      values[i] = value;
+    n = m;
+  }
+};
+
+} //--END--
+
+#endif
+
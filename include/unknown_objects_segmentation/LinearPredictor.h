@@ -0,0 +1,96 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file LinearPredictor.h
+ * @brief Predict relations with a linear model on the features or on random Fourier
+ * features (explicit feature map approximating the RBF kernel of the SVM).
+ */
+
+#ifndef SVM_LINEAR_PREDICTOR_H
+#define SVM_LINEAR_PREDICTOR_H
+
+#include <vector>
+#include <string>
+
+#include <Eigen/Dense>
+
+#include "svm.h"
+#include "RelationClassifier.h"
+
+namespace svm
+{
+
+/**
+ * @brief Class LinearPredictor: Decision value f = w^T phi(x) + bias of the scaled feature
+ * vector x with phi(x) = x (linear) or phi(x) = sqrt(2/D) cos(omega x + phase) (rff).
+ * Probabilities with the sigmoid (probA, probB) of the SVM, two classes only.
+ * Model file (text):
+ *   model_type linear|rff
+ *   dim <dimension of the feature vector>
+ *   nr_components <D>
+ *   label <label_0> <label_1>
+ *   probA <A>
+ *   probB <B>
+ *   bias <bias>
+ *   w <D values>
+ *   omega <D x dim values, rff only>
+ *   phase <D values, rff only>
+ */
+class LinearPredictor : public RelationClassifier
+{
+public:
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> DenseMatrix;
+
+private:
+  bool rff;                                     ///< Random Fourier features instead of linear features
+  int dim;                                      ///< Dimension of the feature vector
+  int nr_components;                            ///< Number of (random Fourier) features
+  double bias;                                  ///< Bias of the decision function
+  Eigen::VectorXd w;                            ///< Weights of the decision function
+  DenseMatrix omega;                            ///< Random frequencies (nr_components x dim)
+  Eigen::VectorXd phase;                        ///< Random phases
+
+  int label[2];                                 ///< Labels of the two classes
+  double probA, probB;                          ///< Sigmoid of the probability estimates
+  struct svm_model prob_model;                  ///< Model for libsvm probability estimates
+
+  DenseMatrix features;                         ///< Feature vectors of a batch
+  DenseMatrix phi;                              ///< Mapped feature vectors of a batch
+
+  bool load(const std::string &filename);
+
+public:
+  LinearPredictor(std::string filename);
+  ~LinearPredictor();
+
+  /** Model loaded **/
+  bool valid() const {return nr_components > 0;}
+
+  /** Classification of all feature vectors of a view of a specific type (1=neighboring / 2=non-neighboring **/
+  bool classify(surface::View *view, unsigned type);
+};
+
+}
+
+#endif
@@ -34,16 +34,21 @@
 
 #include <vector>
 
+#include "InlineVector.h"
+
 namespace surface
 {
 
+typedef InlineVector<double, 16> RelationValues;        ///< Feature vector of a relation (9 structural features)
+typedef InlineVector<double, 4> RelationProbabilities;  ///< Class probabilities of a relation
+
 struct Relation
 {
   unsigned type;                                ///< Type of relation (structural level = 1 / assembly level = 2)
   unsigned id_0;                                ///< ID of first surface 
   unsigned id_1;                                ///< ID of second surface
-  std::vector<double> rel_value;                ///< relation values (feature vector)
-  std::vector<double> rel_probability;          ///< probabilities of correct prediction (two class)
+  RelationValues rel_value;                     ///< relation values (feature vector)
+  RelationProbabilities rel_probability;        ///< probabilities of correct prediction (two class)
   unsigned groundTruth;                         ///< 0=false / 1=true
   unsigned prediction;                          ///< 0=false / 1=true
   bool valid;                                   ///< validity flag
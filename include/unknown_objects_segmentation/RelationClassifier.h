@@ -0,0 +1,76 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file RelationClassifier.h
+ * @brief Base class for the classification of relations.
+ */
+
+#ifndef SVM_RELATION_CLASSIFIER_H
+#define SVM_RELATION_CLASSIFIER_H
+
+#include <vector>
+#include <string>
+#include <assert.h>
+#include <stdio.h>
+#include <float.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include "SurfaceModel.hpp"
+
+namespace svm
+{
+
+/**
+ * @brief Class RelationClassifier: Predicts the relations of a view (prediction and 
+ * rel_probability) from the (scaled) feature vectors.
+ */
+class RelationClassifier
+{
+protected:
+
+  bool scale;                                   ///< set scaling on/off
+  double lower, upper;                          ///< lower/upper limits
+  std::vector<double> feature_max;              ///< maximum feature value for scaling
+  std::vector<double> feature_min;              ///< minimum feature value for scaling
+
+  void scaleValues(surface::RelationValues &val);
+  void CheckSmallPatches(surface::View *view, unsigned max_size);
+
+public:
+  typedef boost::shared_ptr<RelationClassifier> Ptr;
+
+  RelationClassifier();
+  virtual ~RelationClassifier();
+
+  /** Set scaling of result vector **/
+  void setScaling(bool _scale, std::string filename);
+
+  /** Classification of all feature vectors of a view of a specific type (1=neighboring / 2=non-neighboring **/
+  virtual bool classify(surface::View *view, unsigned type) = 0;
+};
+
+}
+
+#endif
@@ -42,30 +42,42 @@
 #include <float.h>
 #include <ostream>
 
+#include <Eigen/Dense>
+
 #include "svm.h"
-#include "SurfaceModel.hpp"
+#include "RelationClassifier.h"
 
 namespace svm
 {
   
+/** @brief Header of the binary model file, followed by the 8-byte aligned arrays
+ * rho, probA, probB (nr_class*(nr_class-1)/2 each), sv_coef ((nr_class-1) x l),
+ * sv (l x dim), sv_norm (l), feature_min, feature_max (nr_features each),
+ * label and nSV (nr_class ints each). Native byte order.
+ */
+struct SVMBinaryHeader
+{
+  char magic[8];                                ///< "SVMBIN01"
+  int svm_type;
+  int kernel_type;
+  int nr_class;
+  int l;                                        ///< Number of support vectors
+  int dim;                                      ///< Dimension of the dense support vectors
+  int nr_features;                              ///< Number of scaling ranges (0 = no scaling)
+  double gamma;
+  double lower, upper;                          ///< Scaling limits
+};
   
 /**
  * @brief Class SVMPredictorSingle: 
  */
-class SVMPredictorSingle
+class SVMPredictorSingle : public RelationClassifier
 {
  
 public:
   
 private:
 
-  bool scale;                                   ///< set scaling on/off
-  char *scline;
-  int max_line_len;
-  double lower, upper;                          ///< lower/upper limits
-  std::vector<double> feature_max;              ///< maximum feature value for scaling
-  std::vector<double> feature_min;              ///< minimum feature value for scaling
-  
   struct svm_node *node;                        ///< node of svm
   int max_nr_attr;                              ///< Maximum attributes = maximum size of feature vector
 
@@ -73,18 +85,36 @@ private:
   
   bool predict_probability;                     ///< Predict with probability values
 
-  char* readSCline(FILE *input);
-  bool process(int type, std::vector<double> &vec, std::vector<double> &prob);
-  void scaleValues(std::vector<double> &val);
-  void CheckSmallPatches(surface::View *view, unsigned max_size);
-  bool getResult(int type, std::vector<double> &val, std::vector<double> &prob);
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> DenseMatrix;
+  bool dense;                                   ///< Batched prediction with dense RBF support vectors
+  int dim;                                      ///< Dimension of the dense support vectors
+  DenseMatrix sv;                               ///< Dense support vectors (one per row)
+  Eigen::VectorXd sv_norm;                      ///< Squared norms of the support vectors
+  const double *sv_data;                        ///< Dense support vectors (sv or mapped file)
+  const double *sv_norm_data;                   ///< Squared norms (sv_norm or mapped file)
+
+  void *mapped_data;                            ///< Memory mapped binary model file
+  size_t mapped_size;                           ///< Size of the mapped file
+  DenseMatrix features;                         ///< Dense feature vectors of a batch
+  DenseMatrix kvalue;                           ///< Kernel values of a batch
+
+  bool process(int type, surface::RelationValues &vec, surface::RelationProbabilities &prob);
+  bool getResult(int type, surface::RelationValues &val, surface::RelationProbabilities &prob);
+  void initDense();
+  int loadBinary(const std::string &filename);
+  void freeModel();
+  void processDense(surface::View *view, const std::vector<unsigned> &rels);
   
 public:
   SVMPredictorSingle(std::string filename);
   ~SVMPredictorSingle();
   
-  /** Set scaling of result vector **/
-  void setScaling(bool _scale, std::string filename);
+  /** Load the binary model (model_file + ".bin") if it is newer than the model and the scaling
+   *  parameter file, otherwise the text model with the scaling parameters **/
+  static SVMPredictorSingle *load(const std::string &model_file, const std::string &param_file);
+
+  /** Save the model (with a dense RBF kernel) and the scaling ranges as binary model file **/
+  bool saveBinary(const std::string &filename);
 
   /** Classification of all feature vectors of a view of a specific type (1=neighboring / 2=non-neighboring **/
   bool classify(surface::View *view, unsigned type);
@@ -0,0 +1,142 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file SegmenterBatch.h
+ * @brief Segment several clouds or streams in parallel
+ */
+
+#ifndef V4R_SEGMENT_SEGMENTERBATCH_H
+#define V4R_SEGMENT_SEGMENTERBATCH_H
+
+#include <vector>
+#include <string>
+#include <boost/shared_ptr.hpp>
+
+#include "SegmenterLight.h"
+
+namespace segment
+{
+
+  /**
+   * @class SegmenterBatch
+   * @brief Segments N clouds with frame and stage level parallelism on one OpenMP thread budget.
+   * Frames run in parallel on up to framesInFlight segmenters, each frame gets the remaining
+   * threads for its own parallel stages (nested OpenMP), so the total number of threads never
+   * exceeds the budget. Memory is bounded by the framesInFlight segmenters and their buffers.
+   * Results are label images as of SegmenterLight::processPointCloudLabels.
+   * The budget is shared through the OpenMP runtime instead of a separate work-stealing pool:
+   * the stages of SegmenterLight are OpenMP regions, so an outer region over the frames (dynamic
+   * schedule) runs nested regions of budget/frames threads. Idle stage threads of one frame are
+   * not lent to another frame. Without OpenMP the frames run one after another.
+   */
+  class SegmenterBatch
+  {
+  private:
+
+    std::string model_path;     ///< Path to the svm model and scaling files
+    int threads;                ///< Thread budget of all frames (0: omp_get_max_threads)
+    int framesInFlight;         ///< Maximum number of frames processed at the same time (0: threads)
+
+    SegmenterConfig config;     ///< Settings of all segmenters (temporal mode only for streams)
+
+    std::vector<boost::shared_ptr<SegmenterLight> > workers;    ///< Segmenters of the independent frames
+    std::vector<boost::shared_ptr<SegmenterLight> > streams;    ///< Segmenter of each stream (keeps its state)
+    std::vector<SegmenterStats> stats;                          ///< Statistics of each frame of the last call
+
+    /** Create a segmenter with the current settings (temporal mode only for streams) **/
+    boost::shared_ptr<SegmenterLight>
+    createSegmenter (bool stream) const;
+
+    /** Apply the current settings to all segmenters **/
+    void
+    configure ();
+
+    /** Process the clouds on up to framesInFlight frames at a time. per_worker: clouds[i] goes to the
+     * segmenter of the thread that takes it (dynamic schedule), otherwise to segmenters[i] (streams).
+     * Missing segmenters are created before the parallel region. **/
+    void
+    run (const std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &clouds,
+         std::vector<boost::shared_ptr<SegmenterLight> > &segmenters, bool per_worker,
+         std::vector<std::vector<unsigned short> > &labels, std::vector<unsigned> &nr_objects);
+
+  public:
+    /** The segmenters are created on the first call of processBatch or processStreams. Each one loads
+     * its svm models in its constructor and setConfig (again when the classifier changes), always
+     * outside the parallel region: svm_load_model is not reentrant (static line buffer of svm.cpp). **/
+    SegmenterBatch (std::string _model_path = "model/");
+
+    /** Independent clouds (e.g. a bag archive): labels[i] gets the label image of clouds[i]
+     * (width*height, 0: no object, i+1: object i), nr_objects[i] the number of objects **/
+    void
+    processBatch (const std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &clouds,
+                  std::vector<std::vector<unsigned short> > &labels, std::vector<unsigned> &nr_objects);
+
+    /** Next frame of each stream (e.g. one cloud per camera): clouds[i] always goes to the segmenter
+     * of stream i, so the temporal mode works per stream. Empty clouds skip their stream. **/
+    void
+    processStreams (const std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &clouds,
+                    std::vector<std::vector<unsigned short> > &labels, std::vector<unsigned> &nr_objects);
+
+    /** Thread budget of all frames (default 0: omp_get_max_threads) **/
+    void
+    setThreads (int _threads) {threads = _threads;}
+
+    /** Maximum number of frames at the same time (default 0: one per thread) **/
+    void
+    setFramesInFlight (int _frames);
+
+    /** Settings of all segmenters, see SegmenterLight::setConfig. The temporal mode is only used by the
+     * stream segmenters (independent clouds are always processed from scratch). **/
+    void
+    setConfig (const SegmenterConfig &_config) {config = _config; configure ();}
+
+    const SegmenterConfig &
+    getConfig () const {return config;}
+
+    void
+    setDetail (int _detail) {config.setDetail (_detail); configure ();}
+
+    void
+    setFast (bool _fast) {config.fast = _fast; configure ();}
+
+    void
+    setClassifier (int _classifier) {config.classifier = _classifier; configure ();}
+
+    void
+    setPyramid (int _levels) {config.pyramid = _levels; configure ();}
+
+    void
+    setTemporal (bool _temporal) {config.temporal = _temporal; configure ();}
+
+    void
+    setUnsupervised (bool _unsupervised) {config.unsupervised = _unsupervised; configure ();}
+
+    /** Statistics of the frames of the last call (one per cloud) **/
+    const std::vector<SegmenterStats> &
+    getStats () const {return stats;}
+  };
+
+}
+
+#endif
@@ -39,13 +39,148 @@
 #include "StructuralRelationsLight.h"
 #include "ZAdaptiveNormals.hh"
 #include "ClusterNormalsToPlanes.hh"
+#include "CoarseToFine.h"
 #include "SurfaceModeling.hh"
 #include "SVMPredictorSingle.h"
+#include "LinearPredictor.h"
 #include "GraphCut.h"
 
 namespace segment
 {
 
+  /**
+   * @brief Wall times [s] of the processing stages and counters of the last frame
+   */
+  struct SegmenterStats
+  {
+    double t_normals;           ///< Normals estimation
+    double t_clustering;        ///< Clustering of normals to planes
+    double t_modeling;          ///< Model abstraction (0 in fast mode)
+    double t_contours;          ///< Contour detection
+    double t_relations;         ///< Relation extraction
+    double t_svm;               ///< SVM classification
+    double t_graphcut;          ///< Graph cut
+    double t_total;             ///< Whole frame, including copying of the results
+
+    unsigned nr_points;         ///< Points of the input cloud
+    unsigned nr_patches;        ///< Surface patches after clustering (and modelling)
+    unsigned nr_reassigned;     ///< Pixels reassigned by the pixel check
+    unsigned nr_relations;      ///< Relations between patches
+    unsigned nr_graph_edges;    ///< Edges of the graph cut
+    unsigned nr_objects;        ///< Resulting segments
+    unsigned nr_dirty;          ///< Changed pixels against the last frame (temporal mode)
+    unsigned nr_kept;           ///< Patches kept from the last frame (temporal mode)
+    unsigned pyramid_level;     ///< Pyramid level of the pre-segmentation (0: full resolution)
+    unsigned nr_refined;        ///< Border pixels refined at full resolution (pyramid mode)
+
+    SegmenterStats () {clear ();}
+
+    /** Reset all timings and counters **/
+    void
+    clear ();
+
+    /** Print timings and counters to stdout **/
+    void
+    print () const;
+  };
+
+  /** Relation classifier of SegmenterLight **/
+  enum RelationClassifierType
+  {
+    CLASSIFIER_RBF = 0,         ///< RBF svm (default)
+    CLASSIFIER_LINEAR,          ///< Linear approximation of the svm (model file + ".linear")
+    CLASSIFIER_RFF              ///< Random Fourier feature approximation of the svm (model file + ".rff")
+  };
+
+  /**
+   * @brief Data of the view: each processing stage computes one item from the items it depends on
+   * (normals <- patches <- models, contours, edgels, relations <- classes <- objects). Only the
+   * requested outputs and their dependencies are computed.
+   */
+  enum ViewData
+  {
+    VIEW_NORMALS = 1,           ///< Normals (view.normals)
+    VIEW_PATCHES = 2,           ///< Patches of the pre-segmentation (view.surfaces)
+    VIEW_MODELS = 4,            ///< Model abstraction of the patches (not in fast mode)
+    VIEW_CONTOURS = 8,          ///< Ordered contours of each patch (SurfaceModel::contours)
+    VIEW_EDGELS = 16,           ///< Boundary edgels and corners of the patches (view.edgels, view.corners)
+    VIEW_RELATIONS = 32,        ///< Relations between neighbouring patches (view.relations)
+    VIEW_CLASSES = 64,          ///< Relation probabilities of the classifier
+    VIEW_OBJECTS = 128          ///< Graph cut groups (view.graphCutGroups, always computed)
+  };
+
+  /**
+   * @brief Parameters of all stages of SegmenterLight: a preset of a degree of detail, adjusted by the
+   * caller or loaded from a file, and applied at once with SegmenterLight::setConfig. The adaptive flags
+   * of the normals and the clustering select the specialized kernels of the two stages.
+   */
+  struct SegmenterConfig
+  {
+    int detail;                 ///< Degree of detail of the pre-segmentation (0: maximum, 2: minimum)
+    bool fast;                  ///< Skip the model abstraction
+    int classifier;             ///< Relation classifier (RelationClassifierType)
+    int pyramid;                ///< Pyramid levels of the pre-segmentation (0: off, -1: automatic)
+    bool have_intrinsic;        ///< Intrinsics set explicitly (setIntrinsic, config file): never estimated
+    bool intrinsicFromCloud;    ///< Estimate the intrinsics from each cloud (always with the pyramid)
+    double fx, fy, cx, cy;      ///< Camera intrinsics of the model abstraction (default: 525, 525, 320, 240)
+
+    surface::ZAdaptiveNormals::Parameter normals;               ///< Normals estimation
+    surface::ClusterNormalsToPlanes::Parameter clustering;      ///< Plane pre-segmentation of the detail
+    bool pixelCheck;            ///< Reassign single pixels after the clustering
+    int pixelCheckNeighbors;    ///< Neighbours threshold of the pixel check
+    bool parallelClustering;    ///< Tile-parallel union-find clustering
+    surface::SurfaceModeling::Parameter modeling;               ///< Model abstraction
+
+    bool temporal;              ///< Warm start from the last frame
+    float temporalDepth;        ///< Depth change of a dirty pixel (times z^2)
+    int temporalColor;          ///< Colour change of a dirty pixel (sum over the channels)
+    int temporalRadius;         ///< Dilation of the dirty pixels
+    float temporalMaxDirty;     ///< Maximum fraction of dirty pixels for a warm start
+
+    bool unsupervised;          ///< Segment the pixel graph without modelling, relations and svm
+    float unsupervisedThreshold;        ///< Threshold constant of the pixel graph merging
+    unsigned unsupervisedMinSize;       ///< Minimum segment size [px] of the unsupervised mode
+    float weightColor, weightNormal, weightCurvature;   ///< Edge weights of the pixel graph
+
+    /** Preset of the degree of detail (the defaults of SegmenterLight) **/
+    SegmenterConfig (int _detail = 2);
+
+    /** Change the degree of detail: resets the clustering thresholds to their preset **/
+    void
+    setDetail (int _detail);
+
+    /** Set camera intrinsics: overrides the estimation from the clouds **/
+    void
+    setIntrinsic (double _fx, double _fy, double _cx, double _cy);
+
+    /** Clustering thresholds of a degree of detail (0, 1, 2) **/
+    static surface::ClusterNormalsToPlanes::Parameter
+    clusteringPreset (int detail);
+
+    /** Read "name value" lines (# comments) over the current values, lines are applied in order: the
+     * detail resets the clustering thresholds, fx, fy, cx and cy set the intrinsics. Returns false, if
+     * the file can't be read or has unknown names. **/
+    bool
+    load (const std::string &filename);
+  };
+
+  /**
+   * @brief Last frame of the temporal mode: reference depth and colour of the normals,
+   * patches after clustering and classified relations
+   */
+  struct TemporalState
+  {
+    bool valid;                                         ///< State can be used for the next frame
+    unsigned width, height;                             ///< Size of the frame
+    std::vector<float> z;                               ///< Reference depth of each pixel
+    std::vector<uint32_t> rgb;                          ///< Reference colour of each pixel
+    pcl::PointCloud<pcl::Normal>::Ptr normals;          ///< Normals of the reference
+    std::vector<surface::SurfaceModel::Ptr> surfaces;   ///< Patches of the last frame
+    std::vector<surface::Relation> relations;           ///< Classified relations of the last frame
+
+    TemporalState() : valid(false), width(0), height(0) {}
+  };
+
   /**
    * @class SegmenterLight
    */
@@ -54,11 +189,78 @@ namespace segment
   private:
 
     bool useStructuralLevel;    ///< Use structural level svm
-    bool fast;			///< Set fast processing without modelling
+    SegmenterConfig config;     ///< Parameters of all stages (the stage objects get a copy of theirs)
     std::string model_path;     ///< path to the svm model and scaling files
-    int detail;                 ///< Degree of detail for pre-segmenter
+    bool printStats;            ///< Print the statistics after each frame
+    bool have_roi;              ///< Process only the region of interest
+    bool have_indices;          ///< Process only the point indices
+    int roi_x, roi_y, roi_width, roi_height;    ///< Region of interest
+    std::vector<int> indices;   ///< Point indices to process (set or from the region of interest)
+    SegmenterStats stats;       ///< Statistics of the last frame
+    TemporalState temporalState;        ///< Last frame of the temporal mode
+    std::vector<unsigned char> dirty;   ///< Dirty pixels of the frame (1: changed, 2: in a changed patch)
+    surface::SurfacePool surfacePool;   ///< Surface models recycled between frames
+    unsigned outputs;           ///< View data requested by the caller (ViewData)
+    unsigned stages;            ///< View data computed for each frame: outputs and their dependencies
+
+    /* Processing stages: created once and reused for every frame */
+    boost::shared_ptr<surface::ZAdaptiveNormals> nor;                   ///< Normals estimation
+    boost::shared_ptr<surface::ClusterNormalsToPlanes> clusterNormals;  ///< Plane pre-segmentation
+    boost::shared_ptr<surface::CoarseToFine> coarseToFine;              ///< Pyramid of the pre-segmentation
+    boost::shared_ptr<surface::SurfaceModeling> surfModeling;           ///< Model abstraction
+    boost::shared_ptr<surface::ContourDetector> contourDet;             ///< Contour detector
+    boost::shared_ptr<surface::StructuralRelationsLight> stRel;         ///< Structural relations
+    boost::shared_ptr<svm::RelationClassifier> svm_structural;          ///< Relation classifier with modelling
+    boost::shared_ptr<svm::RelationClassifier> svm_structural_fast;     ///< Relation classifier without modelling
+
+    /** Normals of the cloud, the region of interest or the indices **/
+    void
+    estimateNormals (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud);
+
+    /** Planes of the cloud, the region of interest or the indices **/
+    void
+    clusterPlanes (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud, surface::View &view);
+
+    /** Pyramid level of the pre-segmentation for a cloud width (0: full resolution) **/
+    int
+    pyramidLevel (unsigned width) const;
+
+    /** Normals and planes on the pyramid level, upsampled and refined to the full cloud **/
+    void
+    presegmentPyramid (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud, surface::View &view, int level);
+
+    /** Intrinsics of the model abstraction: the configured ones, estimated from the cloud with the
+     * pyramid or intrinsicFromCloud (unless set explicitly) **/
+    void
+    updateIntrinsic (const pcl::PointCloud<pcl::PointXYZRGB> &cloud);
+
+    /** Resolve the stages of the requested outputs **/
+    void
+    updateStages ();
+
+    /** Contours and edgels of the patches, if requested **/
+    void
+    computeBoundary (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud, surface::View &view);
+
+    /** Mark the pixels changed against the temporal state (dilated): returns the number of dirty pixels **/
+    unsigned
+    detectChanges (const pcl::PointCloud<pcl::PointXYZRGB> &cloud);
+
+    /** Warm start from the last frame up to the classified relations: returns false (and leaves the
+     * view untouched), if the frame has to be processed from scratch **/
+    bool
+    processTemporal (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud, surface::View &view);
+
+    /** Segment the pixel graph of the normals (unsupervised mode): one surface per segment **/
+    void
+    processUnsupervised (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud, surface::View &view);
+
+    /** Keep the frame for the next warm start (only the dirty pixels of the reference after a warm start) **/
+    void
+    storeTemporal (const pcl::PointCloud<pcl::PointXYZRGB> &cloud, const surface::View &view, bool warm);
 
   public:
+    /** The svm models are loaded once. Not thread-safe: use one instance per thread. **/
     SegmenterLight (std::string _model_path = "model/");
 
     void
@@ -79,14 +281,30 @@ namespace segment
                     std::vector<surface::SurfaceModel::Ptr> &surfaces_in_out,
                     pcl::PointCloud<pcl::PointXYZRGBL>::Ptr &cloud_out);
 
+    /** Run the pipeline on a view provided by the caller: patches, relations, graph cut groups and the
+     * outputs requested with setOutputs **/
+    void
+    process (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud, surface::View &view);
+
     /** Process a point cloud and return labeled cloud **/
     pcl::PointCloud<pcl::PointXYZRGBL>::Ptr
     processPointCloud (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud);
 
+    /** Process a point cloud into a labeled cloud: the memory of the result is reused between frames **/
+    void
+    processPointCloud (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud,
+                       pcl::PointCloud<pcl::PointXYZRGBL> &result);
+
     /** Process a point cloud and return vector of segment indices **/
     std::vector<pcl::PointIndices>
     processPointCloudV (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud);
 
+    /** Process a point cloud into a label image provided by the caller (width*height values, row major):
+     * object i gets label i+1, 0 for points without object. Returns the number of objects
+     * (labels are saturated at 65535). **/
+    unsigned
+    processPointCloudLabels (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud, unsigned short *labels);
+
     /** Change detail of pre-segmentation
      * 0: Maximum details
      * 1: medium details
@@ -94,11 +312,102 @@ namespace segment
      * The more details, the more accurate, but also slower.
      */
     void
-    setDetail(int _detail = 0) {detail = _detail;}
+    setDetail(int _detail = 0);
+
+    /** Apply the parameters of all stages at once (the svm models are only reloaded for another classifier) **/
+    void
+    setConfig(const SegmenterConfig &config);
+
+    /** Get the parameters of all stages **/
+    const SegmenterConfig &
+    getConfig() const {return config;}
 
     /** Change detail of pre-segmentation **/
     void
-    setFast(bool _fast) {fast = _fast;}
+    setFast(bool _fast) {config.fast = _fast; updateStages();}
+
+    /** Pre-screen NURBS fits of the modelling with a least squares quadric (default: off) **/
+    void
+    setPrescreen(bool _prescreen) {config.modeling.prescreen = surfModeling->param.prescreen = _prescreen;}
+
+    /** Cluster normals with tile-parallel union-find instead of greedy region growing (default: off) **/
+    void
+    setParallelClustering(bool _parallel) {config.parallelClustering = _parallel; clusterNormals->setParallel(_parallel); temporalState.valid = false;}
+
+    /** Change the relation classifier (CLASSIFIER_RBF, CLASSIFIER_LINEAR, CLASSIFIER_RFF), loads both models **/
+    void
+    setClassifier(int _classifier);
+
+    /** Process only points inside the rectangle, all other points stay unlabeled **/
+    void
+    setROI(int x, int y, int width, int height);
+
+    /** Process only the given point indices, all other points stay unlabeled **/
+    void
+    setIndices(const std::vector<int> &_indices);
+
+    /** Process the whole point cloud again **/
+    void
+    resetROI();
+
+    /** Pyramid pre-segmentation (default: 0, off): normals and clustering on a cloud subsampled by
+     * 2^levels, the patches are upsampled and refined at their borders. All later stages run at full
+     * resolution. -1: automatic, halve until the width is at most 640 (the parameters are tuned for VGA).
+     * Not used with a region of interest or indices. **/
+    void
+    setPyramid(int levels) {config.pyramid = levels; temporalState.valid = false;}
+
+    /** Set camera intrinsics of the model abstraction (default: 525, 525, 320, 240, estimated from each
+     * cloud with the pyramid): overrides the estimation **/
+    void
+    setIntrinsic(double _fx, double _fy, double _cx, double _cy);
+
+    /** Estimate intrinsics of an organized cloud (least squares of u = fx*x/z + cx, v = fy*y/z + cy):
+     * returns false and the VGA default (525, 525, 320, 240) scaled to the cloud size, if there are too
+     * few valid points **/
+    static bool
+    estimateIntrinsic(const pcl::PointCloud<pcl::PointXYZRGB> &cloud, double &fx, double &fy, double &cx, double &cy);
+
+    /** Temporal mode (default: off): consecutive frames of a static or slowly moving camera start from the
+     * last frame. Normals, clustering and relations are recomputed only around changed pixels, the graph
+     * cut runs on all patches. Only used in fast mode at full resolution without region of interest or indices. **/
+    void
+    setTemporal(bool _temporal) {config.temporal = _temporal; temporalState.valid = false;}
+
+    /** Thresholds of the temporal mode: depth change (times z^2, default 0.01), colour change (sum over
+     * r, g, b, default 45), dilation radius [px] (default 5) and maximum fraction of dirty pixels for a
+     * warm start (default 0.5) **/
+    void
+    setTemporalThresholds(float depth, int color, int radius, float max_dirty);
+
+    /** Unsupervised fallback mode (default: off): normals, then a Felzenszwalb-style merging of the pixel
+     * graph (Graph::BuildFromPointCloud) with the graph cut thresholds. Clustering, modelling, contours,
+     * relations and the svm are skipped, so the cost is the normals plus a few linear passes over the
+     * pixel edges. Segments follow depth gaps, normal and colour changes only: without the learned
+     * relations, textured or curved objects are over-segmented and touching objects of similar colour
+     * and orientation merge. Small segments are merged into a neighbour, isolated ones stay unlabeled.
+     * Pyramid and temporal mode are not used. **/
+    void
+    setUnsupervised(bool _unsupervised) {config.unsupervised = _unsupervised; temporalState.valid = false;}
+
+    /** Parameters of the unsupervised mode: threshold constant c of the merging (c/size, default 1.0),
+     * minimum segment size [px] (default 300) and weights of the edge costs, the colour distance
+     * (normalised to the image), the normal angle (per 90 deg) and the curvature (default 0.3, 0.5, 0.2) **/
+    void
+    setUnsupervisedParameters(float threshold, unsigned min_size, float w_color, float w_normal, float w_curvature);
+
+    /** View data needed by the caller besides the objects (ViewData, e.g. VIEW_CONTOURS | VIEW_EDGELS;
+     * default: VIEW_OBJECTS). The boundary of the patches is only computed, if requested. **/
+    void
+    setOutputs(unsigned _outputs) {outputs = _outputs; updateStages();}
+
+    /** Print timings and counters after each frame (default: off) **/
+    void
+    setPrintStats(bool _print) {printStats = _print;}
+
+    /** Get timings and counters of the last frame (or of the compute* steps since computeNormals) **/
+    const SegmenterStats &
+    getStats() const {return stats;}
   };
 
 }
@@ -46,6 +46,12 @@
 
 namespace surface
 {
+
+/** @brief Neighbouring patch pair (p0 < p1) of the sparse adjacency graph **/
+struct NeighborPair {
+  unsigned p0, p1;                      ///< Patch ids
+  bool is3D;                            ///< Pair is also neighbouring in 3D (depth gap < z_max)
+};
   
 class StructuralRelationsLight
 {
@@ -63,11 +69,10 @@ private:
   surface::View *view;                                          ///< View with surface models
 
   surface::BoundaryRelations boundary;
-  std::vector< std::vector< surface::Relation > > relations;
+  std::vector<NeighborPair> neighbors;                          ///< Sorted adjacency list of neighbouring patches
+  std::vector<ColorHistogram3D> hist3D;                         ///< Colour histograms of the patches
 
   void computeNeighbors();
-  void ConvertPCLCloud2Image(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud, 
-                             cv::Mat_<cv::Vec3b> &image);
   
 public:
   StructuralRelationsLight();
@@ -81,6 +86,10 @@ public:
 
   /** Compute relations for the segmenter **/
   void computeRelations();
+
+  /** Compute only the relations of pairs with at least one updated patch (update[i], one flag per
+   * patch; empty: all pairs). Neighbours and border pixel counts are updated for all patches. **/
+  void computeRelations(const std::vector<bool> &update);
   
 };
 
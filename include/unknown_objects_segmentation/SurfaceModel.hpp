@@ -30,13 +30,16 @@
 
 #include <iostream>
 #include <vector>
+#include <algorithm>
 
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/core/core.hpp>
 
 #include <pcl/surface/on_nurbs/sequential_fitter.h>
+#include <pcl/sample_consensus/model_types.h>
 
 #include "Relation.h"
+#include "FrameContext.h"
 
 #ifdef V4R_TOMGINE
   #include "v4r/TomGine/tgRenderModel.h"
@@ -89,8 +92,8 @@ class SurfaceModel
     Eigen::Matrix4d pose;                               ///< transformation from View to SurfaceModel coordinate frame
 
     std::vector<int> indices;                           ///< index list for 2D data
-    std::vector<double> error;                          ///< error of each point
-    std::vector<double> probs;                          ///< probability of each points
+    double prob_error;                                  ///< Sum of (1 - probability) of the point errors of the model
+    unsigned nr_probs;                                  ///< Number of points of prob_error
     //std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > normals;
     std::vector<Eigen::Vector3d> normals;
 
@@ -117,8 +120,35 @@ class SurfaceModel
     TomGine::tgRenderModel mesh;                        ///< mesh model for displaying @ tgTomGineThread
 #endif
 
-    SurfaceModel(): idx(-1), label(-1), label_ass(-1), used(false), selected(true) {}
-    SurfaceModel(int _idx) : idx(_idx), label(-1), label_ass(-1), used(false), selected(true) {}
+    SurfaceModel(): idx(-1), label(-1), label_ass(-1), used(false), selected(true), prob_error(0.), nr_probs(0) {}
+    SurfaceModel(int _idx) : idx(_idx), label(-1), label_ass(-1), used(false), selected(true), prob_error(0.), nr_probs(0) {}
+
+    /** Reset to a new model, but keep the memory of the vectors (recycling by the SurfacePool) **/
+    void Clear()
+    {
+      idx = label = label_ass = -1;
+      used = false;
+      selected = true;
+      indices.clear();
+      prob_error = 0.;
+      nr_probs = 0;
+      normals.clear();
+      coeffs.clear();
+      neighbors2D.clear();
+      neighbors2DNrPixel.clear();
+      neighbors3D.clear();
+      nurbs_params.clear();
+      contours.clear();
+      edges.clear();
+      concave.clear();
+      convex.clear();
+      split_pathes.clear();
+      costs.clear();
+      if(nurbs.m_cv != 0)
+        nurbs = ON_NurbsSurface();
+      curves_image.clear();
+      curves_param.clear();
+    }
 
     void AddTo(SurfaceModel &model)
     {
@@ -144,8 +174,7 @@ class SurfaceModel
       printf("  selected: %d\n  ", selected);
       printf("  savings: %f\n  ", savings);
       printf("  indices.size: %d\n  ", indices.size());
-      printf("  errors.size: %d\n  ", error.size());
-      printf("  probs.size: %d\n  ", probs.size());
+      printf("  probs.size: %u (error: %f)\n  ", nr_probs, prob_error);
       printf("  coeffs.size %d: ", coeffs.size());
       for(size_t i=0; i<coeffs.size(); i++)
         printf("%f ", coeffs[i]);
@@ -172,6 +201,133 @@ class SurfaceModel
     }
 };
 
+/**
+ * @brief Patch table: flat storage of the patch pixels and plane parameters. Derived from the
+ * surface models, which stay the owner of the patch membership: the stages add, merge and swap
+ * models and their indices, the relation stage and the patch image read the contiguous copy.
+ * View builds it on first use after the surfaces changed (GetPatchTable).
+ */
+class PatchTable
+{
+public:
+  std::vector<int> pixels;                              ///< Pixel indices of all patches (contiguous per patch)
+  std::vector<unsigned> offset;                         ///< Start of patch i in pixels (size()+1 entries)
+  std::vector<int> type;                                ///< Type of surface model of each patch
+  std::vector<int> label;                               ///< Object assignment label of each patch
+  std::vector<float> coeffs;                            ///< Plane coefficients (4 per patch, zero if not a plane)
+
+  PatchTable() {offset.push_back(0);}
+
+  /** Number of patches **/
+  unsigned size() const {return type.size();}
+
+  /** Number of pixels of patch i **/
+  unsigned count(unsigned i) const {return offset[i+1] - offset[i];}
+
+  /** Pixel indices of patch i: [begin(i), end(i)) **/
+  const int *begin(unsigned i) const {return &pixels[0] + offset[i];}
+  const int *end(unsigned i) const {return &pixels[0] + offset[i+1];}
+
+  /** Plane coefficients of patch i **/
+  const float *plane(unsigned i) const {return &coeffs[4*i];}
+
+  /** Clear the table, but keep the memory **/
+  void clear() {
+    pixels.clear();
+    offset.resize(1);
+    type.clear();
+    label.clear();
+    coeffs.clear();
+  }
+
+  /** Fill the table from the surface models (NURBS and contours stay with the surface models) **/
+  void set(const std::vector<SurfaceModel::Ptr> &surfaces) {
+    unsigned nr_pixels = 0;
+    for(unsigned i=0; i<surfaces.size(); i++)
+      nr_pixels += surfaces[i]->indices.size();
+    pixels.resize(nr_pixels);
+    offset.resize(surfaces.size()+1);
+    type.resize(surfaces.size());
+    label.resize(surfaces.size());
+    coeffs.assign(4*surfaces.size(), 0.);
+    offset[0] = 0;
+    for(unsigned i=0; i<surfaces.size(); i++) {
+      const SurfaceModel &s = *surfaces[i];
+      if(!s.indices.empty())
+        std::copy(s.indices.begin(), s.indices.end(), pixels.begin() + offset[i]);
+      offset[i+1] = offset[i] + s.indices.size();
+      type[i] = s.type;
+      label[i] = s.label;
+      if(s.type == pcl::SACMODEL_PLANE)
+        for(unsigned j=0; j<s.coeffs.size() && j<4; j++)
+          coeffs[4*i+j] = s.coeffs[j];
+    }
+  }
+
+  /** Draw patch image: patch ids (first, first+1, ...) on background **/
+  void createImage(cv::Mat_<int> &image, unsigned width, unsigned height, int background, int first = 0) const {
+    image.create(height, width);
+    image.setTo(background);
+    int *data = (int*) image.data;
+    for(unsigned i=0; i<size(); i++)
+      for(unsigned j=offset[i]; j<offset[i+1]; j++)
+        data[pixels[j]] = first + i;
+  }
+};
+
+/**
+ * @brief Surface models recycled between frames: Get() hands out the models of the pool, Reset()
+ * at the start of a frame takes back all models that are not held outside of the pool any more.
+ * Steady-state frames then create no new models and the vectors keep their memory.
+ */
+class SurfacePool
+{
+private:
+  std::vector<SurfaceModel::Ptr> models;                ///< Models of the pool, [0, used) are handed out
+  unsigned used;
+
+public:
+  SurfacePool() : used(0) {}
+
+  /** Start a new frame: recycle the models held only by the pool, release the others **/
+  void Reset() {
+    unsigned nr_free = 0;
+    for(unsigned i=0; i<models.size(); i++) {
+      if(models[i].unique()) {
+        if(nr_free != i)
+          models[nr_free].swap(models[i]);
+        nr_free++;
+      }
+    }
+    models.resize(nr_free);
+    used = 0;
+  }
+
+  /** Get a new (cleared) model (thread-safe) **/
+  SurfaceModel::Ptr Get() {
+    SurfaceModel::Ptr model;
+    bool recycled = false;
+#pragma omp critical (surface_pool)
+    {
+      if(used < models.size()) {
+        model = models[used];
+        recycled = true;
+      }
+      else {
+        model.reset(new SurfaceModel());
+        models.push_back(model);
+      }
+      used++;
+    }
+    if(recycled)
+      model->Clear();
+    return model;
+  }
+
+  /** Number of models of the pool **/
+  unsigned size() const {return models.size();}
+};
+
 /** View **/
 class View
 {
@@ -185,8 +341,10 @@ public:
   std::vector<Relation> relations;                      ///< PG relation vectors between surface patches
   std::vector< std::vector<unsigned> > graphCutGroups;  ///< Object model groups /// TODO remove later => surface->label
 
-  bool havePatchImage;
-  cv::Mat_<int> patchImage;                             ///< Patch image
+  FrameContext frame;                                   ///< Shared images of the frame (input cloud, patches)
+
+  bool havePatchTable;
+  PatchTable patchTable;                                ///< Flat copy of the surface pixels and planes (use GetPatchTable)
   
   std::vector<Edgel> edgels;                            ///< Boundary graph: Edgels
   std::vector<Corner> corners;                          ///< Boundary graph: Corners
@@ -195,10 +353,21 @@ public:
   bool haveNormals;
   pcl::PointCloud<pcl::Normal>::Ptr normals;            ///< Normals of the point cloud (similar to surface normals)
 
-  View(): havePatchImage(false), haveNormals(false) {}
+  SurfacePool *pool;                                    ///< Recycled surface models (optional, not owned)
+
+  View(): havePatchTable(false), haveNormals(false), pool(0) {}
+
+  /** New surface model: from the pool, if available **/
+  SurfaceModel::Ptr NewSurface() {
+    if(pool != 0)
+      return pool->Get();
+    return SurfaceModel::Ptr(new SurfaceModel());
+  }
 
   void Reset() {
-    havePatchImage = false;
+    frame.reset();
+    havePatchTable = false;
+    patchTable.clear();
     surfaces.clear();
     relations.clear();
     graphCutGroups.clear();
@@ -208,6 +377,31 @@ public:
     normals.reset(new pcl::PointCloud<pcl::Normal>);
   }
   
+  /** Mark the patch table and patch image as outdated after the surfaces have changed **/
+  void InvalidatePatchTable() {
+    havePatchTable = false;
+    frame.invalidatePatches();
+  }
+
+  /** Rebuild the patch table from the surfaces **/
+  void UpdatePatchTable() {
+    patchTable.set(surfaces);
+    havePatchTable = true;
+    frame.invalidatePatches();
+  }
+
+  /** Get the patch table (updated when not available) **/
+  const PatchTable &GetPatchTable() {
+    if(!havePatchTable)
+      UpdatePatchTable();
+    return patchTable;
+  }
+
+  /** Get the patch image: patch ids, -1 for unassigned pixels (needs the input cloud of the frame) **/
+  const cv::Mat_<int> &GetPatchImage() {
+    return frame.getPatchImage(GetPatchTable());
+  }
+
   void PrintEdges() {
     for(unsigned i=0; i<edges.size(); i++) {
       printf("Edge %u: \n", i);
@@ -25,6 +25,7 @@
 #define SURFACE_SURFACEMODELING_HH
 
 #include <iostream>
+#include <queue>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/core/core.hpp>
 
@@ -57,6 +58,63 @@ struct merge
   int id_1;
   int id_2;
   double savings;
+  unsigned version_1;           // versions of the surfaces when the merge was fitted
+  unsigned version_2;
+  SurfaceModel::Ptr model;      // fitted merge model
+};
+
+struct CmpMergeQueue
+{
+  bool operator()(const merge &i, const merge &j) const
+  {
+    if (i.savings != j.savings)
+      return i.savings < j.savings;
+    if (i.id_1 != j.id_1)
+      return i.id_1 > j.id_1;
+    return i.id_2 > j.id_2;
+  }
+};
+
+/** Moment sums for the least squares quadric z = f(x,y) with basis (x^2, xy, y^2, x, y, 1) **/
+struct QuadricMoments
+{
+  double A[21];                 // upper triangle of the normal matrix
+  double bz[6];                 // basis times z
+  double zz;                    // sum of z^2
+  double n;                     // number of points
+
+  QuadricMoments() {Clear();}
+
+  void Clear()
+  {
+    for (unsigned i = 0; i < 21; i++)
+      A[i] = 0.;
+    for (unsigned i = 0; i < 6; i++)
+      bz[i] = 0.;
+    zz = n = 0.;
+  }
+
+  void Add(double x, double y, double z)
+  {
+    double f[6] = {x*x, x*y, y*y, x, y, 1.};
+    for (unsigned r = 0, k = 0; r < 6; r++) {
+      bz[r] += f[r]*z;
+      for (unsigned c = r; c < 6; c++, k++)
+        A[k] += f[r]*f[c];
+    }
+    zz += z*z;
+    n += 1.;
+  }
+
+  void Add(const QuadricMoments &m)
+  {
+    for (unsigned i = 0; i < 21; i++)
+      A[i] += m.A[i];
+    for (unsigned i = 0; i < 6; i++)
+      bz[i] += m.bz[i];
+    zz += m.zz;
+    n += m.n;
+  }
 };
 
 // --------------- Surface Modeling --------------- //
@@ -77,11 +135,14 @@ public:
     double bspline_savings;   
     int planePointsFixation;  // classified planes will not be merged with b-splines anymore (5000 for 640x480)
     double z_max;             // Maximum z-value for 3D neighborhood
+    bool prescreen;           // Reject NURBS fits a priori with a least squares quadric (moment sums)
+    double prescreenFactor;   // Expected reduction of the quadric error by the NURBS (0.5)
 
     Parameter(pcl::on_nurbs::SequentialFitter::Parameter nurbs=pcl::on_nurbs::SequentialFitter::Parameter(),
        double _sigmaError=0.003, double _kappa1=0.003, double _kappa2=0.9, int _pPF=5000, double _z_max=0.01)
      : nurbsParams(nurbs), sigmaError(_sigmaError),
-       kappa1(_kappa1), kappa2(_kappa2), planePointsFixation(_pPF), z_max(_z_max) {}
+       kappa1(_kappa1), kappa2(_kappa2), planePointsFixation(_pPF), z_max(_z_max),
+       prescreen(false), prescreenFactor(0.5) {}
   };
 
 private:
@@ -98,19 +159,26 @@ private:
 
   std::vector< std::vector<unsigned> > neighbors2D;     //< Neighboring surface patches in image space
   std::vector< std::vector<unsigned> > neighbors3D;     //< Neighboring surface patches (with z_max value)
+  std::vector<QuadricMoments> moments;                  //< Quadric moment sums of the surfaces (prescreen)
 
   void ComputeLSPlane(SurfaceModel &plane);
   void FitPlane(SurfaceModel &plane);
   void FitNurbs(SurfaceModel &model);
+  bool SelectPlaneOrNurbs(unsigned i);
   void ModelSelectionParallel();
   void ModelSelection();
-  void ComputePointProbs(std::vector<double> &errs, std::vector<double> &probs);
-  static void ComputePointProbs(std::vector<double> &errs, std::vector<double> &probs, double sigmaError);
-  void ComputePointError(pcl::PointCloud<pcl::PointXYZRGB> &cloud,
-                         const std::vector<SurfaceModel::Ptr> &planes);
-  double ComputeSavings(int numParams, std::vector<double> &probs);
-  double ComputePlaneSavingsNormalized(double numParams, std::vector<double> &probs, double norm, double kappa1, double kappa2);
-  double ComputeSavingsNormalized(double numParams, std::vector<double> &probs, double norm);
+  static double SumProbError(const std::vector<double> &errs, double invSqrSigmaError);
+  double SumPlaneProbError(const std::vector<float> &coeffs, const std::vector<int> &indices) const;
+  double ComputeSavings(int numParams, const SurfaceModel &model);
+  double ComputePlaneSavingsNormalized(double numParams, const SurfaceModel &model, double norm, double kappa1, double kappa2);
+  double ComputeSavingsNormalized(double numParams, const SurfaceModel &model, double norm);
+  double ComputeModelSavings(const SurfaceModel &surface, double norm);
+  void ComputeMoments(const std::vector<int> &indices, QuadricMoments &m);
+  double ComputeQuadricError(const QuadricMoments &m);
+  bool PrescreenNurbs(const QuadricMoments &m, double savings);
+  SurfaceModel::Ptr FitMergedModel(const SurfaceModel &s1, const SurfaceModel &s2);
+  void ScoreMerges(std::vector<merge> &candidates, const std::vector<unsigned> &version,
+                   std::priority_queue<merge, std::vector<merge>, CmpMergeQueue> &merge_queue);
   void InitDataStructure();
   void AddToQueue(const std::vector<unsigned> &nbs, std::vector<unsigned> &queue);
 
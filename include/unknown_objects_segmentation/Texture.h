@@ -57,7 +57,7 @@ private:
   bool have_surfaces;
   
   pcl::PointCloud<pcl::PointXYZRGB>::Ptr pcl_cloud;                     ///< Input cloud
-  surface::View view;                                                   ///< Surface models
+  surface::View *view;                                                  ///< Surface models
   std::vector<double> textureRate;                                      ///< Texture rate for each surface
   cv::Mat_<cv::Vec3b> matImage;                                         ///< Image as cv-matrix
 
@@ -74,7 +74,7 @@ public:
   /** Set input image **/
   void setInputImage(cv::Mat_<cv::Vec3b> &_matImge);
 
-  /** Set input surface patches **/
+  /** Set input surface patches: without input cloud or image, the edges of the frame context of the view are used **/
   void setSurfaceModels(surface::View & _view);
 
   /** Compute the texture **/
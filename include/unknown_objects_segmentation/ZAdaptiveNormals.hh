@@ -35,6 +35,7 @@
 #include <pcl/common/time.h>
 #include <pcl/search/kdtree.h>
 #include <boost/shared_ptr.hpp>
+#include <vector>
 
 
 namespace surface 
@@ -54,9 +55,13 @@ public:
       bool adaptive;            // Activate z-adaptive normals calcualation
       float kappa;              // gradient
       float d;                  // constant
-      float kernel_radius[8];   // Kernel radius for each 0.5 meter intervall (0-4m)
-      Parameter(double _radius=0.02, int _kernel=5, bool _adaptive=false, float _kappa=0.005125, float _d = 0.0)
-       : radius(_radius), kernel(_kernel), adaptive(_adaptive), kappa(_kappa), d(_d) {}
+      float kernel_radius[8];   // Kernel radius for each 0.5 meter intervall (0-4m, the last one also beyond)
+      bool integral;            // Use integral images (summed-area tables) instead of the exact neighbourhood
+      float tolerance;          // Integral images: max. rms distance to the center (relative to the inlier radius)
+      Parameter(double _radius=0.02, int _kernel=5, bool _adaptive=false, float _kappa=0.005125, float _d = 0.0,
+                bool _integral=false, float _tolerance=0.5)
+       : radius(_radius), kernel(_kernel), adaptive(_adaptive), kappa(_kappa), d(_d),
+         integral(_integral), tolerance(_tolerance) {}
   };
 
 private:
@@ -70,16 +75,47 @@ private:
   pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
   pcl::PointCloud<pcl::Normal>::Ptr normals;
 
-  void ComputeCovarianceMatrix (const pcl::PointCloud<pcl::PointXYZRGB> &cloud,
-        const std::vector<int> &indices, const Eigen::Vector4f &mean, Eigen::Matrix3f &cov);
+  /** Summed-area table entry: number of points, sums of x, y, z, and xx, xy, xz, yy, yz, zz **/
+  struct IntegralCell {
+    double s[10];
+  };
+  std::vector<IntegralCell> integral;   ///< Summed-area table ((width+1) x (height+1)) of the valid points
+
+  std::vector<float> soa_x, soa_y, soa_z;                ///< Point coordinates as separate arrays
+  std::vector< std::vector<float> > kernel_dist;         ///< Center distance of the window offsets for each kernel radius
+  std::vector<unsigned char> invalid;                    ///< Points without normal, marked NaN in the cloud after the parallel loop
+
+  /** EstimateNormal specialized for adaptive or fixed kernels and inlier radius **/
+  typedef bool (ZAdaptiveNormals::*EstimateNormalFn)(pcl::PointCloud<pcl::PointXYZRGB> &cloud, 
+                                                     pcl::PointCloud<pcl::Normal> &normals, int u, int v, 
+                                                     std::vector<int> &mask, Eigen::Matrix3f &eigen_vectors);
+
+  void PrepareEstimation(pcl::PointCloud<pcl::PointXYZRGB> &cloud);
+  EstimateNormalFn NormalKernel() const;
+  template<bool adaptive>
+  bool EstimateNormal(pcl::PointCloud<pcl::PointXYZRGB> &cloud, pcl::PointCloud<pcl::Normal> &normals,
+                      int u, int v, std::vector<int> &mask, Eigen::Matrix3f &eigen_vectors);
   void EstimateNormals(pcl::PointCloud<pcl::PointXYZRGB> &cloud, pcl::PointCloud<pcl::Normal> &normals);
-  void GetIndices(pcl::PointCloud<pcl::PointXYZRGB> &cloud, int u, int v, int kernel, std::vector<int> &indices);
-  float ComputeNormal(pcl::PointCloud<pcl::PointXYZRGB> &cloud, std::vector<int> &indices, Eigen::Matrix3f &eigen_vectors);
+  void EstimateNormals(pcl::PointCloud<pcl::PointXYZRGB> &cloud, pcl::PointCloud<pcl::Normal> &normals,
+                       const std::vector<int> &indices);
+  void EstimateNormals(pcl::PointCloud<pcl::PointXYZRGB> &cloud, pcl::PointCloud<pcl::Normal> &normals,
+                       int u0, int v0, int u1, int v1);
+  bool MarkInvalid(pcl::PointCloud<pcl::PointXYZRGB> &cloud);
+  void ComputeSoA(const pcl::PointCloud<pcl::PointXYZRGB> &cloud);
+  void ComputeKernelTable(int kernel);
+  template<bool adaptive>
+  bool ComputeExactNormal(int u, int v, int kernel, std::vector<int> &mask, 
+                          Eigen::Matrix3f &eigen_vectors, float &curvature);
+  void ComputeIntegralImage(const pcl::PointCloud<pcl::PointXYZRGB> &cloud);
+  template<bool adaptive>
+  bool ComputeIntegralNormal(const pcl::PointXYZRGB &pt, int u, int v, int kernel, 
+                             Eigen::Matrix3f &eigen_vectors, float &curvature);
 
 
   inline int GetIdx(short x, short y);
   inline short X(int idx);
   inline short Y(int idx);
+  inline void SetNaN(pcl::Normal &n);
 
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -88,10 +124,16 @@ public:
   ~ZAdaptiveNormals();
 
   void setParameter(Parameter p);
+  const Parameter &getParameter() const {return param;}
   void setInputCloud(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &_cloud);
 
   void compute();
-  void compute(const std::vector<int> &mask);
+
+  /** Compute normals of the given point indices only, all other normals are NaN **/
+  void compute(const std::vector<int> &indices);
+
+  /** Compute normals inside the region of interest only, all other normals are NaN **/
+  void compute(int roi_x, int roi_y, int roi_width, int roi_height);
 
   void getNormals(pcl::PointCloud<pcl::Normal>::Ptr &_normals);
 };
@@ -113,6 +155,13 @@ inline short ZAdaptiveNormals::Y(int idx)
   return idx/width;
 }
 
+inline void ZAdaptiveNormals::SetNaN(pcl::Normal &n)
+{
+  n.normal[0] = NaN;
+  n.normal[1] = n.normal[2] = n.normal[3] = 0.;
+  n.curvature = 0.;
+}
+
 
 }
 
@@ -31,9 +31,19 @@
 
 #include <unknown_objects_segmentation/BoundaryRelations.h>
 
+#include <algorithm>
+
 namespace surface
 {
 
+/** Sort border pixel pairs by patch pair, keep image order inside a pair **/
+inline bool CmpBoundaryPair(const BoundaryPixel &a, const BoundaryPixel &b)
+{
+  if(a.p0 != b.p0)
+    return a.p0 < b.p0;
+  return a.p1 < b.p1;
+}
+
 
 /************************************************************************************
  * Constructor/Destructor
@@ -59,7 +69,8 @@ BoundaryRelations::~BoundaryRelations()
 /** Project the datapoints of the plane surfaces to the model surface **/
 void BoundaryRelations::projectPts2Model()
 {
-  pcl_cloud_model.reset(new pcl::PointCloud<pcl::PointXYZRGB>); 
+  if(pcl_cloud_model.get() == 0 || !pcl_cloud_model.unique())
+    pcl_cloud_model.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
   pcl::copyPointCloud(*pcl_cloud, *pcl_cloud_model);
 
   #pragma omp parallel for
@@ -84,6 +95,67 @@ void BoundaryRelations::projectPts2Model()
 }
 
 
+/**
+ * Collect the neighbouring pixel pairs of all patch borders in one pass over
+ * the patch image. For each pixel and each neighbouring patch the neighbour
+ * with the smallest depth gap is stored (left-upper, right-upper, left, upper).
+ */
+void BoundaryRelations::computeBoundaryIndex()
+{
+  static const int dirs[4] = {1, 3, 0, 2};
+  int cols = patches.cols;
+  int offsets[4] = {-cols-1, -cols+1, -1, -cols};
+  const int *p = (const int*) patches.data;
+
+  boundary.clear();
+  for(int row=1; row<patches.rows; row++) {
+    for(int col=1; col<patches.cols; col++) {
+      int idx = row*cols + col;
+      int id = p[idx];
+      if(id < 0)
+        continue;
+
+      int nb[4];
+      for(unsigned k=0; k<4; k++)
+        nb[k] = p[idx + offsets[k]];
+
+      for(unsigned k=0; k<4; k++) {
+        if(nb[k] < 0 || nb[k] == id)
+          continue;
+        bool done = false;
+        for(unsigned l=0; l<k; l++)
+          if(nb[l] == nb[k])
+            done = true;
+        if(done)
+          continue;
+
+        BoundaryPixel bp;
+        bp.p0 = std::min(id, nb[k]);
+        bp.p1 = std::max(id, nb[k]);
+        bp.first = 0;
+        bp.second = 0;
+        bp.depth = 10.;
+        for(unsigned l=k; l<4; l++) {
+          if(nb[l] != nb[k])
+            continue;
+          double distance = fabs(pcl_cloud->points[idx].z - pcl_cloud->points[idx + offsets[l]].z);
+          if(distance < bp.depth) {
+            bp.first = idx;
+            bp.second = idx + offsets[l];
+            bp.depth = distance;
+          }
+          bp.dir = dirs[l];
+        }
+        double adaptive_distance = max3DDistancePerMeter*pcl_cloud->points[idx].z;
+        bp.is3D = (bp.depth < adaptive_distance);
+        boundary.push_back(bp);
+      }
+    }
+  }
+  std::stable_sort(boundary.begin(), boundary.end(), CmpBoundaryPair);
+}
+
+
 // ================================= Public functions ================================= //
 
 void BoundaryRelations::setInputCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr & _pcl_cloud)
@@ -101,25 +173,46 @@ void BoundaryRelations::setView(surface::View *_view)
   if (projectPts)
     projectPts2Model();
 
-  if(view->havePatchImage) {
-    patches = cv::Mat_<int>(pcl_cloud->height, pcl_cloud->width);
-    view->patchImage.copyTo(patches);
-  }
-  else {
-    patches = cv::Mat_<int>(pcl_cloud->height, pcl_cloud->width);
-    patches.setTo(-1);
-    for(unsigned i=0; i<view->surfaces.size(); i++)
-      for(unsigned j=0; j<view->surfaces[i]->indices.size(); j++)
-        patches.at<int>(view->surfaces[i]->indices[j] / pcl_cloud->width, view->surfaces[i]->indices[j] % pcl_cloud->width) = i;
-    patches.copyTo(view->patchImage);
-  }
+  view->frame.setInputCloud(pcl_cloud);
+  patches = view->GetPatchImage();                      // shared with the other stages, read only
+  computeBoundaryIndex();
   
   pcl_model_normals = view->normals;
   have_surfaces = true;
 }
 
 
+unsigned BoundaryRelations::getBoundary(int p0, int p1, const BoundaryPixel *&begin) const
+{
+  BoundaryPixel key;
+  key.p0 = std::min(p0, p1);
+  key.p1 = std::max(p0, p1);
+  std::pair<std::vector<BoundaryPixel>::const_iterator, std::vector<BoundaryPixel>::const_iterator> range;
+  range = std::equal_range(boundary.begin(), boundary.end(), key, CmpBoundaryPair);
+  begin = (range.first == boundary.end() ? 0 : &(*range.first));
+  return range.second - range.first;
+}
+
+
 bool BoundaryRelations::compare(int p0, int p1, std::vector<double> &rel_value)
+{
+  BoundaryScratch scratch;
+  if(!compare(p0, p1, rel_value, scratch))
+    return false;
+
+  // Write number of neighbours into Surface model
+  const BoundaryPixel *ngbr = 0;
+  unsigned nr_ngbr = getBoundary(p0, p1, ngbr);
+  for(unsigned i=0; i<(unsigned)view->surfaces[p0]->neighbors2D.size(); i++)
+    if((int)view->surfaces[p0]->neighbors2D[i] == p1)
+      view->surfaces[p0]->neighbors2DNrPixel[i] = nr_ngbr;
+  for(unsigned i=0; i<(unsigned)view->surfaces[p1]->neighbors2D.size(); i++)
+    if((int)view->surfaces[p1]->neighbors2D[i] == p0)
+      view->surfaces[p1]->neighbors2DNrPixel[i] = nr_ngbr;
+  return true;
+}
+
+bool BoundaryRelations::compare(int p0, int p1, std::vector<double> &rel_value, BoundaryScratch &scratch) const
 {
   if(!have_cloud) {
     printf("[BoundaryRelations::compute] Error: No input cloud set.\n");
@@ -133,113 +226,32 @@ bool BoundaryRelations::compare(int p0, int p1, std::vector<double> &rel_value)
 
   rel_value.resize(0);
   
-  int first = 0;
-  int second = 0;
-  std::vector<int> first_ngbr;
-  std::vector<int> second_ngbr;
-  std::vector<int> first_3D_ngbr;
-  std::vector<int> second_3D_ngbr;
-  std::vector<int> dir_3D_ngbr;
-  
   // get neighbouring pixel-pairs in 2D and in 3D
-  for(int row=1; row<patches.rows; row++) {
-    for(int col=1; col<patches.cols; col++) {
-      bool found = false;
-      double distance = 10.;
-      double z_dist = pcl_cloud->points[row*pcl_cloud->width + col].z;
-      int b_first = 0, b_second = 0;
-      double b_distance = 10.;
-      int dir_3D = 0;
-      if((patches.at<int>(row, col) == p0 && patches.at<int>(row-1, col-1) == p1) ||  // left-upper pixel
-         (patches.at<int>(row, col) == p1 && patches.at<int>(row-1, col-1) == p0)) {
-        first = row*patches.cols + col;
-        second = (row-1)*patches.cols + col-1;
-        distance = fabs(pcl_cloud->points[first].z - pcl_cloud->points[second].z);
-        if(distance < b_distance) {
-          b_first = first;
-          b_second = second;
-          b_distance = distance;
-        }
-        dir_3D = 1;
-        found = true;
-      }
-      if((patches.at<int>(row, col) == p0 && patches.at<int>(row-1, col+1) == p1) ||  // right-upper pixel
-         (patches.at<int>(row, col) == p1 && patches.at<int>(row-1, col+1) == p0)) {
-        first = row*patches.cols + col;
-        second = (row-1)*patches.cols + col+1;
-        distance = fabs(pcl_cloud->points[first].z - pcl_cloud->points[second].z);
-        if(distance < b_distance) {
-          b_first = first;
-          b_second = second;
-          b_distance = distance;
-        }
-        dir_3D = 3;
-        found = true;
-      }
-      if((patches.at<int>(row, col) == p0 && patches.at<int>(row, col-1) == p1) ||    // left pixel
-         (patches.at<int>(row, col) == p1 && patches.at<int>(row, col-1) == p0)) {
-        first = row*patches.cols + col;
-        second = row*patches.cols + col-1;
-        distance = fabs(pcl_cloud->points[first].z - pcl_cloud->points[second].z);
-        if(distance < b_distance) {
-          b_first = first;
-          b_second = second;
-          b_distance = distance;
-        }
-        dir_3D = 0;
-        found = true;
-      }
-      if((patches.at<int>(row, col) == p0 && patches.at<int>(row-1, col) == p1) ||    // upper pixel
-         (patches.at<int>(row, col) == p1 && patches.at<int>(row-1, col) == p0)) {
-        first = row*patches.cols + col;
-        second = (row-1)*patches.cols + col;
-        distance = fabs(pcl_cloud->points[first].z - pcl_cloud->points[second].z);
-        if(distance < b_distance) {
-          b_first = first;
-          b_second = second;
-          b_distance = distance;
-        }
-        dir_3D = 2;
-        found = true;
-      }
-      if(found) {
-        first_ngbr.push_back(b_first);
-        second_ngbr.push_back(b_second);
-        double adaptive_distance = max3DDistancePerMeter*z_dist;
-        if(b_distance < adaptive_distance) {
-          first_3D_ngbr.push_back(b_first);
-          second_3D_ngbr.push_back(b_second);
-          dir_3D_ngbr.push_back(dir_3D);
-        }
-      }
-    }
-  }
-  
-  // Write number of neighbours into Surface model
-  for(unsigned i=0; i<(unsigned)view->surfaces[p0]->neighbors2D.size(); i++)
-    if((int)view->surfaces[p0]->neighbors2D[i] == p1)
-      view->surfaces[p0]->neighbors2DNrPixel[i] = first_ngbr.size();
-  for(unsigned i=0; i<(unsigned)view->surfaces[p1]->neighbors2D.size(); i++)
-    if((int)view->surfaces[p1]->neighbors2D[i] == p0)
-      view->surfaces[p1]->neighbors2DNrPixel[i] = first_ngbr.size();
-    
+  const BoundaryPixel *ngbr = 0;
+  unsigned nr_ngbr = getBoundary(p0, p1, ngbr);
+  unsigned nr_3D_ngbr = 0;
+  for(unsigned i=0; i<nr_ngbr; i++)
+    if(ngbr[i].is3D)
+      nr_3D_ngbr++;
+
   int nr_valid_points_color = 0;
   int nr_valid_points_depth = 0;
   double sum_uv_color_distance = 0.0f;
   double sum_2D_curvature = 0.0f;
   double sum_depth = 0.0f;
   double sum_depth_var = 0.0f;
-  std::vector<double> depth_vals;
+  std::vector<double> &depth_vals = scratch.depth_vals;
+  depth_vals.clear();
   
   // calculate mean depth
-  for(unsigned i=0; i<first_ngbr.size(); i++) {
+  for(unsigned i=0; i<nr_ngbr; i++) {
     double p0_z, p1_z;
     if (projectPts) {
-      p0_z = pcl_cloud_model->points[first_ngbr[i]].z;
-      p1_z = pcl_cloud_model->points[second_ngbr[i]].z;
+      p0_z = pcl_cloud_model->points[ngbr[i].first].z;
+      p1_z = pcl_cloud_model->points[ngbr[i].second].z;
     } else {
-      p0_z = pcl_cloud->points[first_ngbr[i]].z;
-      p1_z = pcl_cloud->points[second_ngbr[i]].z;
+      p0_z = pcl_cloud->points[ngbr[i].first].z;
+      p1_z = pcl_cloud->points[ngbr[i].second].z;
     }
     double depth = fabs(p0_z - p1_z);
     depth_vals.push_back(depth);
@@ -270,26 +282,32 @@ bool BoundaryRelations::compare(int p0, int p1, std::vector<double> &rel_value)
   int nr_valid_points_curvature3D = 0;
   double sum_3D_curvature = 0.0f;
   double sum_3D_curvature_var = 0.0f;
-  std::vector<double> curvature_vals;  // single curvature values
-  for(unsigned i=0; i<first_3D_ngbr.size(); i++)
+  std::vector<double> &curvature_vals = scratch.curvature_vals;  // single curvature values
+  curvature_vals.clear();
+  for(unsigned n=0; n<nr_ngbr; n++)
   {
+    if(!ngbr[n].is3D)
+      continue;
+    const pcl::PointXYZRGB &c0 = pcl_cloud->points[ngbr[n].first];
+    const pcl::PointXYZRGB &c1 = pcl_cloud->points[ngbr[n].second];
+
     /// calculate color similarity on 3D border
     nr_valid_points_color++;
 
     //double p0_Y =  (0.257 * p0_color.b) + (0.504 * p0_color.g) + (0.098 * p0_color.r) + 16;
-    double p0_U = -(0.148 * pcl_cloud->points[first_3D_ngbr[i]].b) - 
-                   (0.291 * pcl_cloud->points[first_3D_ngbr[i]].g) + 
-                   (0.439 * pcl_cloud->points[first_3D_ngbr[i]].r) + 128;    // use bgr
-    double p0_V =  (0.439 * pcl_cloud->points[first_3D_ngbr[i]].b) - 
-                   (0.368 * pcl_cloud->points[first_3D_ngbr[i]].g) - 
-                   (0.071 * pcl_cloud->points[first_3D_ngbr[i]].r) + 128;
+    double p0_U = -(0.148 * c0.b) - 
+                   (0.291 * c0.g) + 
+                   (0.439 * c0.r) + 128;    // use bgr
+    double p0_V =  (0.439 * c0.b) - 
+                   (0.368 * c0.g) - 
+                   (0.071 * c0.r) + 128;
     //double p1_Y =  (0.257 * p1_color.b) + (0.504 * p1_color.g) + (0.098 * p1_color.r) + 16;
-    double p1_U = -(0.148 * pcl_cloud->points[second_3D_ngbr[i]].b) - 
-                   (0.291 * pcl_cloud->points[second_3D_ngbr[i]].g) + 
-                   (0.439 * pcl_cloud->points[second_3D_ngbr[i]].r) + 128;
-    double p1_V =  (0.439 * pcl_cloud->points[second_3D_ngbr[i]].b) - 
-                   (0.368 * pcl_cloud->points[second_3D_ngbr[i]].g) - 
-                   (0.071 * pcl_cloud->points[second_3D_ngbr[i]].r) + 128;
+    double p1_U = -(0.148 * c1.b) - 
+                   (0.291 * c1.g) + 
+                   (0.439 * c1.r) + 128;
+    double p1_V =  (0.439 * c1.b) - 
+                   (0.368 * c1.g) - 
+                   (0.071 * c1.r) + 128;
     
     double u_1 = p0_U/255 - p1_U/255;
     double u_2 = u_1 * u_1;
@@ -301,43 +319,43 @@ bool BoundaryRelations::compare(int p0, int p1, std::vector<double> &rel_value)
     /// calculate mean 3D curvature
     cv::Vec3f pt0, pt1;
     if (projectPts) {
-      pt0[0]= pcl_cloud_model->points[first_3D_ngbr[i]].x;
-      pt0[1]= pcl_cloud_model->points[first_3D_ngbr[i]].y;
-      pt0[2]= pcl_cloud_model->points[first_3D_ngbr[i]].z;
-      pt1[0]= pcl_cloud_model->points[second_3D_ngbr[i]].x;
-      pt1[1]= pcl_cloud_model->points[second_3D_ngbr[i]].y;
-      pt1[2]= pcl_cloud_model->points[second_3D_ngbr[i]].z;
+      pt0[0]= pcl_cloud_model->points[ngbr[n].first].x;
+      pt0[1]= pcl_cloud_model->points[ngbr[n].first].y;
+      pt0[2]= pcl_cloud_model->points[ngbr[n].first].z;
+      pt1[0]= pcl_cloud_model->points[ngbr[n].second].x;
+      pt1[1]= pcl_cloud_model->points[ngbr[n].second].y;
+      pt1[2]= pcl_cloud_model->points[ngbr[n].second].z;
     } else {
-      pt0[0]= pcl_cloud->points[first_3D_ngbr[i]].x;
-      pt0[1]= pcl_cloud->points[first_3D_ngbr[i]].y;
-      pt0[2]= pcl_cloud->points[first_3D_ngbr[i]].z;
-      pt1[0]= pcl_cloud->points[second_3D_ngbr[i]].x;
-      pt1[1]= pcl_cloud->points[second_3D_ngbr[i]].y;
-      pt1[2]= pcl_cloud->points[second_3D_ngbr[i]].z;
+      pt0[0]= c0.x;
+      pt0[1]= c0.y;
+      pt0[2]= c0.z;
+      pt1[0]= c1.x;
+      pt1[1]= c1.y;
+      pt1[2]= c1.z;
     }
     
     if(pt0 == pt0 || pt1 == pt1)
     {
       cv::Vec3f p0_normal;
-      p0_normal[0] = pcl_model_normals->points[first_3D_ngbr[i]].normal_x;
-      p0_normal[1] = pcl_model_normals->points[first_3D_ngbr[i]].normal_y;
-      p0_normal[2] = pcl_model_normals->points[first_3D_ngbr[i]].normal_z;
+      p0_normal[0] = pcl_model_normals->points[ngbr[n].first].normal_x;
+      p0_normal[1] = pcl_model_normals->points[ngbr[n].first].normal_y;
+      p0_normal[2] = pcl_model_normals->points[ngbr[n].first].normal_z;
       cv::Vec3f p1_normal;
-      p1_normal[0] = pcl_model_normals->points[second_3D_ngbr[i]].normal_x;
-      p1_normal[1] = pcl_model_normals->points[second_3D_ngbr[i]].normal_y;
-      p1_normal[2] = pcl_model_normals->points[second_3D_ngbr[i]].normal_z;
+      p1_normal[0] = pcl_model_normals->points[ngbr[n].second].normal_x;
+      p1_normal[1] = pcl_model_normals->points[ngbr[n].second].normal_y;
+      p1_normal[2] = pcl_model_normals->points[ngbr[n].second].normal_z;
 
       cv::Vec3f pp;
-      if(dir_3D_ngbr[i] == 0) {
+      if(ngbr[n].dir == 0) {
         pp[0] = -1.0; pp[1] = 0.0; pp[2] = 0.0;
       }
-      else if(dir_3D_ngbr[i] == 1) {
+      else if(ngbr[n].dir == 1) {
         pp[0] = -1.0; pp[1] = -1.0; pp[2] = 0.0;
       }
-      else if(dir_3D_ngbr[i] == 2) {
+      else if(ngbr[n].dir == 2) {
         pp[0] = 0.0; pp[1] = -1.0; pp[2] = 0.0;
       }
-      else if(dir_3D_ngbr[i] == 3) {
+      else if(ngbr[n].dir == 3) {
         pp[0] = 1.0; pp[1] = -1.0; pp[2] = 0.0;
       }
       cv::Vec3f pp_dir = cv::normalize(pp);
@@ -384,7 +402,7 @@ bool BoundaryRelations::compare(int p0, int p1, std::vector<double> &rel_value)
   rel_value.push_back(sum_2D_curvature);            /// TODO We do not use that: Remove that at one point
   rel_value.push_back(sum_3D_curvature);
   rel_value.push_back(sum_3D_curvature_var);
-  rel_value.push_back((double)first_3D_ngbr.size() / (double) first_ngbr.size());
+  rel_value.push_back((double)nr_3D_ngbr / (double)nr_ngbr);
 
   return true;
 }
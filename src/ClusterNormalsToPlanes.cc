@@ -23,6 +23,10 @@
 
 
 #include <unknown_objects_segmentation/ClusterNormalsToPlanes.hh>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace surface 
 {
@@ -56,6 +60,8 @@ ClusterNormalsToPlanes::ClusterNormalsToPlanes(Parameter p)
 {
   setParameter(p);
   pixel_check = false;
+  parallel = false;
+  nr_reassigned = 0;
   max_neighbours = 4;
   max_nneighbours = 2*max_neighbours;
   
@@ -70,7 +76,7 @@ ClusterNormalsToPlanes::~ClusterNormalsToPlanes()
 
 void ClusterNormalsToPlanes::CreatePatchImage()
 {
-  patches = cv::Mat_<int>(cloud->height, cloud->width);
+  patches.create(cloud->height, cloud->width);
   patches.setTo(0);
   for(unsigned i=0; i<view->surfaces.size(); i++) {
     for(unsigned j=0; j<view->surfaces[i]->indices.size(); j++) {
@@ -92,6 +98,7 @@ void ClusterNormalsToPlanes::CountNeighbours(std::vector< std::vector<int> > &re
 {
   reassign_idxs.clear();
   reassign_idxs.resize(view->surfaces.size());
+  reassign.assign(patches.rows*patches.cols, 0);
   
   #pragma omp parallel for
   for(int row=1; row<patches.rows-1; row++) {
@@ -119,14 +126,17 @@ void ClusterNormalsToPlanes::CountNeighbours(std::vector< std::vector<int> > &re
 
       if(nb_counter <= nb && (nb_counter+nnb_counter) <= nnb)
         if(mask[row*patches.cols + col] == 0) {
-          #pragma omp critical 
-          {
-            mask[row*patches.cols + col] = 1;
-            reassign_idxs[patches(row, col) - 1].push_back(row*patches.cols + col);
-          }
+          mask[row*patches.cols + col] = 1;
+          reassign[row*patches.cols + col] = 1;
         }
     }
   }
+
+  // row-major order of the points, independent of the threads
+  for(int row=1; row<patches.rows-1; row++)
+    for(int col=1; col<patches.cols-1; col++)
+      if(reassign[row*patches.cols + col])
+        reassign_idxs[patches(row, col) - 1].push_back(row*patches.cols + col);
 }
 
 /**
@@ -181,6 +191,7 @@ bool ClusterNormalsToPlanes::ReasignPoints(std::vector< std::vector<int> > &reas
           if(max_neighbors > 0) {
             have_assigned = true;
             assigned = true;
+            nr_reassigned++;
             view->surfaces[most_id]->indices.push_back(idx);
 
             std::vector<int> surfaces_indices_copy;
@@ -207,18 +218,17 @@ bool ClusterNormalsToPlanes::ReasignPoints(std::vector< std::vector<int> > &reas
 
 void ClusterNormalsToPlanes::DeleteEmptyPlanes()
 { 
-  std::vector<surface::SurfaceModel::Ptr> planes_copy;
-  for(int su=0; su<(int)view->surfaces.size(); su++) {
+  unsigned nr_planes = 0;
+  for(unsigned su=0; su<view->surfaces.size(); su++) {
     if((int)view->surfaces[su]->indices.size() > 0) {
-      if((int)view->surfaces[su]->indices.size() < param.minPoints) {
+      if((int)view->surfaces[su]->indices.size() < param.minPoints)
         view->surfaces[su]->type = -1;
-        planes_copy.push_back(view->surfaces[su]);
-      }
-      else
-        planes_copy.push_back(view->surfaces[su]);
+      if(nr_planes != su)
+        view->surfaces[nr_planes].swap(view->surfaces[su]);
+      nr_planes++;
     }
   }
-  view->surfaces = planes_copy;
+  view->surfaces.resize(nr_planes);
 }
 
 /* Reasign single pixels (line-ends) */
@@ -290,8 +300,7 @@ void ClusterNormalsToPlanes::ClusterRest(unsigned idx,
   pts.push_back(idx);
   
   int queue_idx = 0;
-  std::vector<int> queue;
-  queue.reserve(cloud.width*cloud.height);
+  queue.clear();
   queue.push_back(idx);       
   
   while ((int)queue.size() > queue_idx) {
@@ -341,6 +350,7 @@ void ClusterNormalsToPlanes::CalcAdaptive()
 /**
  * ClusterNormals
  */
+template<bool adaptive>
 void ClusterNormalsToPlanes::ClusterNormals(unsigned idx, 
                                             pcl::PointCloud<pcl::PointXYZRGB> &cloud, 
                                             pcl::PointCloud<pcl::Normal> &normals, 
@@ -357,40 +367,32 @@ void ClusterNormalsToPlanes::ClusterNormals(unsigned idx,
   pts.push_back(idx);
   
   int queue_idx = 0;
-  std::vector<int> queue;
-  queue.reserve(cloud.width*cloud.height);
+  queue.clear();
   queue.push_back(idx);
   
   EIGEN_ALIGN16 Eigen::Vector3f pt = cloud.points[idx].getVector3fMap();
 
+  // 4-neighbourhood (left and right neighbours wrap around the image rows)
+  const int size = width*height;
+  const int n4offset[4] = {-1, 1, width, -width};
+
   while ((int)queue.size() > queue_idx) {
-    idx = queue[queue_idx];
+    int cur = queue[queue_idx];
     queue_idx++;
 
-    std::vector<int> n4ind;
-    n4ind.push_back(idx-1);
-    n4ind.push_back(idx+1);
-    n4ind.push_back(idx+width);
-    n4ind.push_back(idx-width);
-    for(unsigned i=0; i<n4ind.size(); i++) {
-      int u = n4ind[i] % width;
-      int v = n4ind[i] / width;
-
-      if (v>=0 && u>=0 && v<height && u<width) {
-        idx = GetIdx(u,v);
+    for(unsigned i=0; i<4; i++) {
+      int nb = cur + n4offset[i];
+
+      if (nb >= 0 && nb < size) {
+        idx = nb;
         if (mask[idx]==0) {
           const float *n = &normals.points[idx].normal[0];
 
           if (n[0]!= n[0])
             continue;
 
-          float newCosThrAngleNC = cosThrAngleNC;
-          float newInlDist = param.inlDist;
-          if(param.adaptive) {
-            newCosThrAngleNC = p_adaptive_cosThrAngleNC[idx];
-            newInlDist = p_adaptive_inlDist[idx];
-          }
-          
+          float newCosThrAngleNC, newInlDist;
+          GetThresholds<adaptive>(idx, newCosThrAngleNC, newInlDist);
           if (Dot3(&normal.normal[0], n) > newCosThrAngleNC && 
               fabs(Plane::NormalPointDist(&pt[0], &normal.normal[0], &cloud.points[idx].x)) < newInlDist)
           {
@@ -414,27 +416,21 @@ void ClusterNormalsToPlanes::ClusterNormals(unsigned idx,
   }
 
   // check if all points are on the plane 
-  unsigned ptsSize = pts.size();
   if( (int) pts.size() >= param.minPoints) {
-    for(unsigned i=0; i<ptsSize; i++) {
+    unsigned nr_inl = 0;
+    for(unsigned i=0; i<pts.size(); i++) {
       const float *n = &normals.points[pts[i]].normal[0];
 
-      float newCosThrAngleNC = cosThrAngleNC;
-      float newInlDist = param.inlDist;
-      if(param.adaptive) {
-        newCosThrAngleNC = p_adaptive_cosThrAngleNC[idx];
-        newInlDist = p_adaptive_inlDist[idx];
-      }          
-            
+      float newCosThrAngleNC, newInlDist;
+      GetThresholds<adaptive>(idx, newCosThrAngleNC, newInlDist);
+
       if (Dot3(&normal.normal[0], n) < newCosThrAngleNC && 
           fabs(Plane::NormalPointDist(&pt[0], &normal.normal[0], &cloud.points[pts[i]].x)) > newInlDist)
-      {
         mask[pts[i]]=0;
-        pts.erase(pts.begin()+i);
-        ptsSize--;
-        i--;
-      }
+      else
+        pts[nr_inl++] = pts[i];
     }
+    pts.resize(nr_inl);
 
     // recalculate plane normal
     if(pts.size() > 0) {
@@ -451,17 +447,11 @@ void ClusterNormalsToPlanes::ClusterNormals(unsigned idx,
 
 
 /**
- * ClusterNormals
+ * InitMask: all points (or the indices) without nans
  */
-void ClusterNormalsToPlanes::ClusterNormals(pcl::PointCloud<pcl::PointXYZRGB> &cloud, 
-                                            pcl::PointCloud<pcl::Normal> &normals, 
-                                            const std::vector<int> &indices, 
-                                            std::vector<SurfaceModel::Ptr> &planes)
+void ClusterNormalsToPlanes::InitMask(pcl::PointCloud<pcl::PointXYZRGB> &cloud, 
+                                      const std::vector<int> &indices)
 {
-  pcl::Normal normal;
-  SurfaceModel::Ptr plane;
-  
-  // init mask (without nans)
   mask.clear();
   if (indices.size()==0) {
     mask.resize(cloud.width*cloud.height,0);
@@ -471,9 +461,25 @@ void ClusterNormalsToPlanes::ClusterNormals(pcl::PointCloud<pcl::PointXYZRGB> &c
   } else {
     mask.resize(cloud.width*cloud.height,1);
     for (unsigned i=0; i<indices.size(); i++)
-      if(!isnan(cloud.points[i].x))
+      if(!isnan(cloud.points[indices[i]].x))
         mask[indices[i]] = 0;
   }
+}
+
+/**
+ * ClusterNormals
+ */
+template<bool adaptive>
+void ClusterNormalsToPlanes::ClusterNormals(pcl::PointCloud<pcl::PointXYZRGB> &cloud, 
+                                            pcl::PointCloud<pcl::Normal> &normals, 
+                                            const std::vector<int> &indices, 
+                                            std::vector<SurfaceModel::Ptr> &planes)
+{
+  pcl::Normal normal;
+  SurfaceModel::Ptr plane;
+  queue.reserve(cloud.width*cloud.height);
+  
+  InitMask(cloud, indices);
   
   for(unsigned i=0; i< srt_curvature.size(); i++)
     srt_curvature[i].clear();
@@ -500,10 +506,11 @@ void ClusterNormalsToPlanes::ClusterNormals(pcl::PointCloud<pcl::PointXYZRGB> &c
       for(unsigned j=0; j<srt_curvature[i].size(); j++) {
         unsigned idx = srt_curvature[i][j]; 
         if (mask[idx]==0) {
-          plane.reset(new SurfaceModel());
+          if (plane.get() == 0)   // reuse the model of a rejected seed
+            plane = view->NewSurface();
           plane->type = pcl::SACMODEL_PLANE;
 
-          ClusterNormals(idx, cloud, normals, plane->indices, normal);
+          ClusterNormals<adaptive>(idx, cloud, normals, plane->indices, normal);
 
           if (((int)plane->indices.size()) >= param.minPoints) {
             morePlanes = true;
@@ -513,6 +520,7 @@ void ClusterNormalsToPlanes::ClusterNormals(pcl::PointCloud<pcl::PointXYZRGB> &c
             n[0]=normal.normal[0];
             n[1]=normal.normal[1];
             n[2]=normal.normal[2];
+            plane.reset();
           }
           else {
             std::vector<int> &pts = plane->indices;
@@ -524,12 +532,23 @@ void ClusterNormalsToPlanes::ClusterNormals(pcl::PointCloud<pcl::PointXYZRGB> &c
     }
   }
   
-  // cluster rest of unclustered point cloud in 2D
+  ClusterRestPoints(cloud, normals, planes, normal);
+}
+
+/**
+ * ClusterRestPoints: cluster rest of unclustered point cloud in 2D
+ */
+void ClusterNormalsToPlanes::ClusterRestPoints(pcl::PointCloud<pcl::PointXYZRGB> &cloud, 
+                                               pcl::PointCloud<pcl::Normal> &normals,
+                                               std::vector<SurfaceModel::Ptr> &planes,
+                                               pcl::Normal &normal)
+{
+  SurfaceModel::Ptr plane;
   for (unsigned v=0; v<cloud.height; v++) {
     for (unsigned u=0; u<cloud.width; u++) {
       unsigned idx = GetIdx(u,v);
       if (mask[idx] == 0) {
-        plane.reset(new SurfaceModel());
+        plane = view->NewSurface();
         plane->type = -1; // No model
         plane->coeffs.resize(3);
         float *n = &plane->coeffs[0];
@@ -544,6 +563,197 @@ void ClusterNormalsToPlanes::ClusterNormals(pcl::PointCloud<pcl::PointXYZRGB> &c
   }
 }
 
+/**
+ * Similar: neighbouring points a and b (both unmasked) belong to the same plane,
+ * if their normals agree and each point lies on the tangent plane of the other.
+ */
+template<bool adaptive>
+bool ClusterNormalsToPlanes::Similar(pcl::PointCloud<pcl::PointXYZRGB> &cloud, 
+                                            pcl::PointCloud<pcl::Normal> &normals, int a, int b)
+{
+  if (mask[a] != 0 || mask[b] != 0)
+    return false;
+  const float *na = &normals.points[a].normal[0];
+  const float *nb = &normals.points[b].normal[0];
+  if (na[0] != na[0] || nb[0] != nb[0])
+    return false;
+
+  float newCosThrAngleNC = cosThrAngleNC;
+  float newInlDist = param.inlDist;
+  if(adaptive) {
+    newCosThrAngleNC = std::max(p_adaptive_cosThrAngleNC[a], p_adaptive_cosThrAngleNC[b]);
+    newInlDist = std::min(p_adaptive_inlDist[a], p_adaptive_inlDist[b]);
+  }
+
+  return Dot3(na, nb) > newCosThrAngleNC &&
+         fabs(Plane::NormalPointDist(&cloud.points[a].x, na, &cloud.points[b].x)) < newInlDist &&
+         fabs(Plane::NormalPointDist(&cloud.points[b].x, nb, &cloud.points[a].x)) < newInlDist;
+}
+
+/**
+ * ClusterNormalsParallel
+ * Tile-parallel union-find clustering: the image is split into row tiles, which are
+ * clustered in parallel with the pairwise Similar predicate (4-neighbourhood). The 
+ * components are merged across the tile borders. As in the greedy region growing,
+ * points deviating from the mean normal and plane of their component are removed,
+ * components with less than minPoints become unclustered rest.
+ */
+template<bool adaptive>
+void ClusterNormalsToPlanes::ClusterNormalsParallel(pcl::PointCloud<pcl::PointXYZRGB> &cloud, 
+                                                    pcl::PointCloud<pcl::Normal> &normals, 
+                                                    const std::vector<int> &indices, 
+                                                    std::vector<SurfaceModel::Ptr> &planes)
+{
+  pcl::Normal normal;
+  int size = width*height;
+  queue.reserve(size);
+  labels.resize(size);
+
+  InitMask(cloud, indices);
+
+#ifdef _OPENMP
+  int nr_threads = omp_get_max_threads();
+#else
+  int nr_threads = 1;
+#endif
+  int nr_tiles = std::max(1, std::min(height, 4*nr_threads));
+  int tile_rows = (height + nr_tiles - 1) / nr_tiles;
+  nr_tiles = (height + tile_rows - 1) / tile_rows;
+
+  // union-find inside the tiles
+  #pragma omp parallel for schedule(dynamic)
+  for (int t=0; t<nr_tiles; t++) {
+    int v0 = t*tile_rows;
+    int v1 = std::min(v0 + tile_rows, height);
+    int offset = v0*width;
+    gc::universe u((v1-v0)*width);
+    for (int v=v0; v<v1; v++) {
+      for (int x=0; x<width; x++) {
+        int idx = GetIdx(x,v);
+        if (x+1 < width && Similar<adaptive>(cloud, normals, idx, idx+1)) {
+          int a = u.find(idx-offset);
+          int b = u.find(idx+1-offset);
+          if (a != b)
+            u.join(a, b);
+        }
+        if (v+1 < v1 && Similar<adaptive>(cloud, normals, idx, idx+width)) {
+          int a = u.find(idx-offset);
+          int b = u.find(idx+width-offset);
+          if (a != b)
+            u.join(a, b);
+        }
+      }
+    }
+    for (int i=offset; i<v1*width; i++)
+      labels[i] = offset + u.find(i-offset);
+  }
+
+  // merge components across tile borders
+  gc::universe border(size);
+  for (int t=1; t<nr_tiles; t++) {
+    int v = t*tile_rows;
+    for (int x=0; x<width; x++) {
+      int idx = GetIdx(x,v);
+      if (Similar<adaptive>(cloud, normals, idx-width, idx)) {
+        int a = border.find(labels[idx-width]);
+        int b = border.find(labels[idx]);
+        if (a != b)
+          border.join(a, b);
+      }
+    }
+  }
+
+  // points ordered by component
+  int nr_comps = 0;
+  comp_idx.assign(size, -1);
+  comp_offset.clear();
+  for (int i=0; i<size; i++) {
+    if (mask[i] != 0)
+      continue;
+    int r = border.find(labels[i]);
+    if (comp_idx[r] < 0) {
+      comp_idx[r] = nr_comps++;
+      comp_offset.push_back(0);
+    }
+    labels[i] = comp_idx[r];
+    comp_offset[labels[i]]++;
+  }
+  int nr_pts = 0;
+  for (int c=0; c<nr_comps; c++) {
+    int n = comp_offset[c];
+    comp_offset[c] = nr_pts;
+    nr_pts += n;
+  }
+  comp_offset.push_back(nr_pts);
+  comp_pts.resize(nr_pts);
+  std::vector<int> &fill = comp_idx;      // reuse as fill position
+  for (int c=0; c<nr_comps; c++)
+    fill[c] = comp_offset[c];
+  for (int i=0; i<size; i++)
+    if (mask[i] == 0)
+      comp_pts[fill[labels[i]]++] = i;
+
+  // check if all points are on the plane (comp_offset[c+1] is set to the new end)
+  std::vector<float> comp_normal(3*nr_comps, 0.);
+  #pragma omp parallel for schedule(dynamic)
+  for (int c=0; c<nr_comps; c++) {
+    int begin = comp_offset[c];
+    int end = comp_offset[c+1];
+    fill[c] = begin;
+    if (end - begin < param.minPoints)
+      continue;
+
+    EIGEN_ALIGN16 Eigen::Vector3f n = Eigen::Vector3f::Zero();
+    EIGEN_ALIGN16 Eigen::Vector3f pt = Eigen::Vector3f::Zero();
+    for (int i=begin; i<end; i++) {
+      n += normals.points[comp_pts[i]].getNormalVector3fMap();
+      pt += cloud.points[comp_pts[i]].getVector3fMap();
+    }
+    n.normalize();
+    pt /= (float) (end - begin);
+
+    int nr_inl = begin;
+    for (int i=begin; i<end; i++) {
+      int idx = comp_pts[i];
+      float newCosThrAngleNC, newInlDist;
+      GetThresholds<adaptive>(idx, newCosThrAngleNC, newInlDist);
+      if (!(Dot3(&n[0], &normals.points[idx].normal[0]) < newCosThrAngleNC && 
+            fabs(Plane::NormalPointDist(&pt[0], &n[0], &cloud.points[idx].x)) > newInlDist))
+        comp_pts[nr_inl++] = idx;
+    }
+    fill[c] = nr_inl;
+
+    // recalculate plane normal
+    n.setZero();
+    for (int i=begin; i<nr_inl; i++)
+      n += normals.points[comp_pts[i]].getNormalVector3fMap();
+    n.normalize();
+    comp_normal[3*c] = n[0];
+    comp_normal[3*c+1] = n[1];
+    comp_normal[3*c+2] = n[2];
+  }
+
+  for (int c=0; c<nr_comps; c++) {
+    int begin = comp_offset[c];
+    int end = fill[c];
+    if (end - begin < param.minPoints)
+      continue;
+    SurfaceModel::Ptr plane = view->NewSurface();
+    plane->type = pcl::SACMODEL_PLANE;
+    plane->indices.assign(comp_pts.begin()+begin, comp_pts.begin()+end);
+    for (int i=begin; i<end; i++)
+      mask[comp_pts[i]] = 1;
+    plane->coeffs.resize(3);
+    float *n = &plane->coeffs[0];
+    n[0] = normal.normal[0] = comp_normal[3*c];
+    n[1] = normal.normal[1] = comp_normal[3*c+1];
+    n[2] = normal.normal[2] = comp_normal[3*c+2];
+    planes.push_back(plane);
+  }
+
+  ClusterRestPoints(cloud, normals, planes, normal);
+}
+
 /**
  * ComputeLSPlanes to check plane models
  */
@@ -666,10 +876,19 @@ void ClusterNormalsToPlanes::compute(const std::vector<int> &indices)
   if (cloud.get()==0 || view->normals.get()==0)
     throw std::runtime_error("[ClusterNormalsToPlanes::compute] Point cloud or view not set!"); 
 
+  nr_reassigned = 0;
   if(param.adaptive)
     CalcAdaptive();
 
-  ClusterNormals(*cloud, *(view->normals), indices, view->surfaces);
+  // kernels specialized for adaptive or fixed thresholds
+  if(parallel && param.adaptive)
+    ClusterNormalsParallel<true>(*cloud, *(view->normals), indices, view->surfaces);
+  else if(parallel)
+    ClusterNormalsParallel<false>(*cloud, *(view->normals), indices, view->surfaces);
+  else if(param.adaptive)
+    ClusterNormals<true>(*cloud, *(view->normals), indices, view->surfaces);
+  else
+    ClusterNormals<false>(*cloud, *(view->normals), indices, view->surfaces);
   
   if(pixel_check)
     PixelCheck();
@@ -677,6 +896,7 @@ void ClusterNormalsToPlanes::compute(const std::vector<int> &indices)
   ComputeLSPlanes(cloud, view->surfaces);
 
   AddNormals();
+  view->InvalidatePatchTable();
 }
 
 /**
@@ -0,0 +1,268 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file CoarseToFine.cpp
+ * @brief Pre-segmentation on a subsampled cloud, upsampled to full resolution.
+ */
+
+#include <unknown_objects_segmentation/CoarseToFine.h>
+
+#include <math.h>
+#include <limits>
+#include <stdexcept>
+
+namespace surface
+{
+
+/************************************************************************************
+ * Constructor/Destructor
+ */
+
+CoarseToFine::CoarseToFine()
+ : level(1), step(2), coarse_width(0), coarse_height(0), nr_refined(0), max_dist(0.01), view(0)
+{
+  coarse.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
+}
+
+CoarseToFine::~CoarseToFine()
+{
+}
+
+// ================================ Private functions ================================= //
+
+int CoarseToFine::validNeighbour(const pcl::PointCloud<pcl::Normal> &coarse_normals, int cidx,
+                                 const pcl::PointXYZRGB &pt) const
+{
+  int cw = coarse_width, ch = coarse_height;
+  int cu = cidx % cw, cv = cidx / cw;
+  int best = -1;
+  float best_dist = std::numeric_limits<float>::max();
+  for(int dv=-1; dv<=1; dv++) {
+    for(int du=-1; du<=1; du++) {
+      int nu = cu + du, nv = cv + dv;
+      if(nu < 0 || nv < 0 || nu >= cw || nv >= ch)
+        continue;
+      int nidx = nv*cw + nu;
+      if(isnan(coarse_normals.points[nidx].normal_x))
+        continue;
+      const pcl::PointXYZRGB &c = coarse->points[nidx];
+      float dist = (c.x-pt.x)*(c.x-pt.x) + (c.y-pt.y)*(c.y-pt.y) + (c.z-pt.z)*(c.z-pt.z);
+      if(dist < best_dist) {
+        best_dist = dist;
+        best = nidx;
+      }
+    }
+  }
+  return best;
+}
+
+// ================================= Public functions ================================= //
+
+void CoarseToFine::setLevel(int _level)
+{
+  level = std::max(_level, 0);
+  step = 1 << level;
+}
+
+void CoarseToFine::setInputCloud(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &_cloud)
+{
+  if (!_cloud->isOrganized())
+    throw std::runtime_error ("[CoarseToFine::setInputCloud] Need an organized point cloud!");
+
+  cloud = _cloud;
+  int width = cloud->width, height = cloud->height;
+  while(step > 1 && (width / step == 0 || height / step == 0))
+    step /= 2;
+  coarse_width = width / step;
+  coarse_height = height / step;
+
+  // one valid point per block: the centre, else the first valid point
+  coarse->header = cloud->header;
+  coarse->width = coarse_width;
+  coarse->height = coarse_height;
+  coarse->is_dense = cloud->is_dense;
+  coarse->points.resize(coarse_width * coarse_height);
+  source.resize(coarse_width * coarse_height);
+#pragma omp parallel for
+  for(int cv=0; cv<(int)coarse_height; cv++) {
+    for(int cu=0; cu<(int)coarse_width; cu++) {
+      int center = (cv*step + step/2) * width + cu*step + step/2;
+      int idx = center;
+      for(int v=cv*step; v<(cv+1)*step && isnan(cloud->points[idx].z); v++)
+        for(int u=cu*step; u<(cu+1)*step; u++)
+          if(!isnan(cloud->points[v*width+u].z)) {
+            idx = v*width+u;
+            break;
+          }
+      coarse->points[cv*coarse_width + cu] = cloud->points[idx];
+      source[cv*coarse_width + cu] = idx;
+    }
+  }
+}
+
+void CoarseToFine::setView(surface::View *_view)
+{
+  view = _view;
+}
+
+void CoarseToFine::compute(const pcl::PointCloud<pcl::Normal> &coarse_normals,
+                           const std::vector<SurfaceModel::Ptr> &coarse_surfaces)
+{
+  if(cloud.get() == 0 || view == 0)
+    throw std::runtime_error ("[CoarseToFine::compute] Point cloud or view not set!");
+  if(coarse_normals.points.size() != coarse->points.size())
+    throw std::runtime_error ("[CoarseToFine::compute] Normals do not match the coarse cloud!");
+
+  int width = cloud->width, height = cloud->height;
+  int cw = coarse_width, ch = coarse_height;
+
+  // coarse patch image
+  std::vector<int> coarse_labels(coarse->points.size(), -1);
+  for(unsigned i=0; i<coarse_surfaces.size(); i++)
+    for(unsigned j=0; j<coarse_surfaces[i]->indices.size(); j++)
+      coarse_labels[coarse_surfaces[i]->indices[j]] = i;
+
+  // upsampled normals: reuse the normals of the last frame, if nobody else holds them
+  if(normals.get() == 0 || !normals.unique())
+    normals.reset(new pcl::PointCloud<pcl::Normal>);
+  normals->points.resize(cloud->points.size());
+  normals->width = cloud->width;
+  normals->height = cloud->height;
+  normals->is_dense = cloud->is_dense;
+
+  // labels: coarse label inside the patches, nearest plane of the coarse 3x3 neighbourhood at borders
+  std::vector<int> labels(cloud->points.size(), -1);
+  float nan = std::numeric_limits<float>::quiet_NaN();
+  unsigned refined = 0;
+#pragma omp parallel for reduction(+:refined)
+  for(int v=0; v<height; v++) {
+    for(int u=0; u<width; u++) {
+      int idx = v*width + u;
+      const pcl::PointXYZRGB &pt = cloud->points[idx];
+      pcl::Normal &n = normals->points[idx];
+      if(isnan(pt.z)) {
+        n.normal_x = n.normal_y = n.normal_z = n.curvature = nan;
+        continue;
+      }
+      int cidx = coarseIndex(u, v);
+      if(isnan(coarse_normals.points[cidx].normal_x)) {
+        cidx = validNeighbour(coarse_normals, cidx, pt);
+        if(cidx == -1) {
+          n.normal_x = n.normal_y = n.normal_z = n.curvature = nan;
+          continue;
+        }
+      }
+      n = coarse_normals.points[cidx];
+      int l0 = coarse_labels[cidx];
+
+      int cu = cidx % cw, cv = cidx / cw;
+      bool border = false;
+      for(int dv=-1; dv<=1 && !border; dv++)
+        for(int du=-1; du<=1; du++) {
+          int nu = cu + du, nv = cv + dv;
+          if(nu >= 0 && nv >= 0 && nu < cw && nv < ch && coarse_labels[nv*cw + nu] != l0) {
+            border = true;
+            break;
+          }
+        }
+      if(!border) {
+        labels[idx] = l0;
+        continue;
+      }
+
+      int best = l0;
+      float best_dist = max_dist;
+      for(int dv=-1; dv<=1; dv++) {
+        for(int du=-1; du<=1; du++) {
+          int nu = cu + du, nv = cv + dv;
+          if(nu < 0 || nv < 0 || nu >= cw || nv >= ch)
+            continue;
+          int l = coarse_labels[nv*cw + nu];
+          if(l == -1 || coarse_surfaces[l]->type != pcl::SACMODEL_PLANE || coarse_surfaces[l]->coeffs.size() < 4)
+            continue;
+          const std::vector<float> &c = coarse_surfaces[l]->coeffs;
+          float dist = fabs(c[0]*pt.x + c[1]*pt.y + c[2]*pt.z + c[3]);
+          if(dist < best_dist) {
+            best_dist = dist;
+            best = l;
+          }
+        }
+      }
+      labels[idx] = best;
+      if(best != l0)
+        refined++;
+    }
+  }
+  nr_refined = refined;
+
+  // full resolution patches (empty patches are removed)
+  std::vector<unsigned> count(coarse_surfaces.size(), 0);
+  for(unsigned i=0; i<labels.size(); i++)
+    if(labels[i] != -1)
+      count[labels[i]]++;
+  view->surfaces.clear();
+  std::vector<int> new_id(coarse_surfaces.size(), -1);
+  for(unsigned i=0; i<coarse_surfaces.size(); i++) {
+    if(count[i] == 0)
+      continue;
+    // copy: the coarse view keeps its patches
+    new_id[i] = view->surfaces.size();
+    SurfaceModel::Ptr s = view->NewSurface();
+    *s = *coarse_surfaces[i];
+    s->idx = view->surfaces.size();
+    s->indices.clear();
+    s->normals.clear();
+    s->indices.reserve(count[i]);
+    view->surfaces.push_back(s);
+  }
+  for(unsigned i=0; i<labels.size(); i++)
+    if(labels[i] != -1)
+      view->surfaces[new_id[labels[i]]]->indices.push_back(i);
+
+  // normals of the patches: plane normals (copied to the view as well) or point normals
+  for(unsigned i=0; i<view->surfaces.size(); i++) {
+    SurfaceModel &s = *view->surfaces[i];
+    s.normals.resize(s.indices.size());
+    bool plane = (s.type == pcl::SACMODEL_PLANE && s.coeffs.size() >= 3);
+    for(unsigned j=0; j<s.indices.size(); j++) {
+      if(plane) {
+        s.normals[j] = Eigen::Vector3d(s.coeffs[0], s.coeffs[1], s.coeffs[2]);
+        pcl::Normal &n = normals->points[s.indices[j]];
+        n.normal_x = s.coeffs[0];
+        n.normal_y = s.coeffs[1];
+        n.normal_z = s.coeffs[2];
+      }
+      else {
+        const pcl::Normal &n = normals->points[s.indices[j]];
+        s.normals[j] = Eigen::Vector3d(n.normal_x, n.normal_y, n.normal_z);
+      }
+    }
+  }
+
+  view->normals = normals;
+  view->InvalidatePatchTable();
+}
+
+} //-- THE END --
+
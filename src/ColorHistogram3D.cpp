@@ -40,6 +40,8 @@ ColorHistogram3D::ColorHistogram3D(int _nr_bins, double _UVTheshold)
   computed = false;
   have_input_cloud = false;
   have_indices = false;
+  indices = NULL;
+  bins = NULL;
   UVthreshold = _UVTheshold;
 }
 
@@ -57,70 +59,95 @@ void ColorHistogram3D::setIndices(pcl::PointIndices::Ptr &_indices)
     printf("[ColorHistogram3D::setIndices] Error: No input cloud available.\n");
     return;
   }
-  indices = _indices->indices;
+  pcl_indices = _indices;
+  indices = &pcl_indices->indices;
   have_indices = true;
 }
 
-void ColorHistogram3D::setIndices(std::vector<int> _indices)
+void ColorHistogram3D::setIndices(const std::vector<int> &_indices)
 {
   if(!have_input_cloud) {
     printf("[ColorHistogram3D::setIndices] Error: No input cloud available.\n");
     return;
   }
-  indices = _indices;
+  indices = &_indices;
   have_indices = true;
 }
 
+void ColorHistogram3D::setBinImage(const std::vector<int> &_bins)
+{
+  bins = &_bins;
+}
+
+/** Histogram bin of a point: Y, U, V are integer as in the YUV conversion **/
+static inline int ColorBin(const pcl::PointXYZRGB &pt, int nr_bins, double UVthreshold)
+{
+  int Y =  (0.257 * pt.r) + (0.504 * pt.g) + (0.098 * pt.b) + 16;
+  int U = -(0.148 * pt.r) - (0.291 * pt.g) + (0.439 * pt.b) + 128;
+  int V =  (0.439 * pt.r) - (0.368 * pt.g) - (0.071 * pt.b) + 128;
+
+  int U2 = U-128;        // shifted to the middle
+  int V2 = V-128;        // shifted to the middle
+  if((U2*U2 + V2*V2) < UVthreshold)
+    return -1;
+
+  int yBin = Y*(double)nr_bins/255.;
+  int uBin = U*(double)nr_bins/255.;
+  int vBin = V*(double)nr_bins/255.;
+  return (yBin*nr_bins + uBin)*nr_bins + vBin;
+}
+
+void ColorHistogram3D::computeBinImage(const pcl::PointCloud<pcl::PointXYZRGB> &cloud, int nr_bins, double UVthreshold,
+                                       std::vector<int> &bins)
+{
+  bins.resize(cloud.points.size());
+  #pragma omp parallel for
+  for(int i=0; i<(int)cloud.points.size(); i++)
+    bins[i] = ColorBin(cloud.points[i], nr_bins, UVthreshold);
+}
+
 void ColorHistogram3D::compute()
 {
-  yuvHist.clear();
-  for(int i=0; i< nr_bins; i++) {
-    std::vector< std::vector<double> > hist;
-    for(int j=0; j< nr_bins; j++) {
-      std::vector<double> yHist;
-      for(int k=0; k< nr_bins; k++)
-        yHist.push_back(0.0f);
-      hist.push_back(yHist);
-    }
-    yuvHist.push_back(hist);
+  counts.assign(nr_bins*nr_bins*nr_bins, 0);
+  yuvHist.assign(nr_bins*nr_bins*nr_bins, 0.);
+  if(!have_indices) {
+    computed = true;
+    return;
   }
+  const std::vector<int> &indices = *this->indices;
 
+  // gather and count: from bin image or from the colour of the points
   int noCol = 0;
-  for(unsigned i=0; i<indices.size(); i++) {
-    //pcl::RGBValue color = ....   // out of date! instead use PointXYZRGB::r directly
-    pcl::PointXYZRGB &pt = input_cloud->points[indices[i]];
-    double yBin = 0.;
-    double uBin = 0.;
-    double vBin = 0.;
-    int Y =  (0.257 * pt.r) + (0.504 * pt.g) + (0.098 * pt.b) + 16;
-    int U = -(0.148 * pt.r) - (0.291 * pt.g) + (0.439 * pt.b) + 128;
-    int V =  (0.439 * pt.r) - (0.368 * pt.g) - (0.071 * pt.b) + 128;
-
-    int U2 = U-128;        // shifted to the middle
-    int V2 = V-128;        // shifted to the middle
-    if((U2*U2 + V2*V2) < UVthreshold) {
-      noCol++;
+  if(bins != NULL) {
+    const int *b = &(*bins)[0];
+    for(unsigned i=0; i<indices.size(); i++) {
+      int bin = b[indices[i]];
+      if(bin < 0)
+        noCol++;
+      else
+        counts[bin]++;
     }
-    else {
-        yBin = Y*(double)nr_bins/255.;
-        uBin = U*(double)nr_bins/255.;
-        vBin = V*(double)nr_bins/255.;
-        yuvHist[(int)yBin][(int)uBin][(int)vBin] += 1.;
+  }
+  else {
+    for(unsigned i=0; i<indices.size(); i++) {
+      int bin = ColorBin(input_cloud->points[indices[i]], nr_bins, UVthreshold);
+      if(bin < 0)
+        noCol++;
+      else
+        counts[bin]++;
     }
-  } 
+  }
   
   double normalization = indices.size() - noCol;
   if(normalization != 0)
-    for(int i=0; i<nr_bins; i++)
-      for(int j=0; j<nr_bins; j++)
-        for(int k=0; k<nr_bins; k++)
-          yuvHist[i][j][k] /= normalization;
+    for(unsigned i=0; i<yuvHist.size(); i++)
+      yuvHist[i] = counts[i] / normalization;
 
   computed = true;
 }
 
 
-double ColorHistogram3D::compare(ColorHistogram3D &ch)
+double ColorHistogram3D::compare(const ColorHistogram3D &ch) const
 {
   if(nr_bins != ch.nr_bins) {
     printf("[ColorHistogram3D::Compare] Error: Cannot compare histograms with different bin sizes.\n");
@@ -133,10 +160,10 @@ double ColorHistogram3D::compare(ColorHistogram3D &ch)
   
   // YUV: Fidelity d=(SUM(sqrt(Pi*Qi)))
   double overall_sum = 0;
-  for(int i=0; i<nr_bins; i++)
-    for(int j=0; j<nr_bins; j++)
-      for(int k=0; k<nr_bins; k++)
-        overall_sum += sqrt(yuvHist[i][j][k]*ch.yuvHist[i][j][k]);
+  const double *p = &yuvHist[0];
+  const double *q = &ch.yuvHist[0];
+  for(int i=0; i<(int)yuvHist.size(); i++)
+    overall_sum += sqrt(p[i]*q[i]);
       
   double fidelity = overall_sum;
 //   double bhattacharyya = -log(overall_sum);
@@ -150,14 +177,14 @@ double ColorHistogram3D::compare(ColorHistogram3D &ch)
   return fidelity;
 }
 
-void ColorHistogram3D::printHistogram()
+void ColorHistogram3D::printHistogram() const
 {
   printf("Print histogram:\n");
   for(int i=0; i<nr_bins; i++) {
     printf("y = %u\n", i);
     for(int j=0; j<nr_bins; j++) {
       for(int k=0; k<nr_bins; k++) {
-        printf("  %4.3f", yuvHist[i][j][k]);
+        printf("  %4.3f", yuvHist[Bin(i, j, k)]);
       }
       printf("\n");
     }
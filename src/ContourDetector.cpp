@@ -45,6 +45,7 @@ ContourDetector::ContourDetector()
   have_view = false;
   initialized = false;
   have_contours = false;
+  have_edgels = false;
 }
 
 ContourDetector::~ContourDetector()
@@ -60,9 +61,7 @@ void ContourDetector::setInputCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr & _pc
   have_view = false;
   initialized = false;
   have_contours = false;
-  
-  pre_corners.resize(pcl_cloud->width * pcl_cloud->height);
-  pre_edgels.resize(pcl_cloud->width * pcl_cloud->height);
+  have_edgels = false;
 }
 
 
@@ -79,132 +78,72 @@ void ContourDetector::setView(surface::View *_view)
   have_view = true;
 }
 
-void ContourDetector::RecursiveContourClustering(int id, int start_x, int start_y,
-                                                  int x, int y, int dir, 
-                                                  std::vector<int> &contour,
-                                                  bool &end)
+/**
+ * @brief Trace the contour of patch id iteratively (Moore neighbourhood) from the start
+ * pixel: The search for the next contour pixel starts with the direction 5 steps after
+ * the last direction (0=top, 1=top-right, ... clockwise). Pixels of already traced
+ * contours are skipped.
+ * @return True, if the contour is closed.
+ */
+bool ContourDetector::TraceContour(int id, int start_x, int start_y, std::vector<int> &contour)
 {
-  if(end) {
-    printf("[ContourDetector::RecursiveContourClustering] Warning: Unexpected end found.\n");
-    return;
-  }
-  
-  bool found = false;
-  dir += 5;     // change direction
-  for(unsigned i=0; i<8; i++) {
-    int di = i + dir;
-    di = di%8;
-
-    if(di == 0 && !found) {
-      if(y-1 >= 0 && contours.at<int>(y-1, x) == id) {  // top pixel
-        found = true;
-        if(x == start_x && y-1 == start_y && contour.size() > 3) {
-          end = true;
-          return;
-        }
-        else {
-          contour.push_back(GetIdx(x, y-1));
-          RecursiveContourClustering(id, start_x, start_y, x, y-1, 0, contour, end);
-        }
-      }  
-    }
-    else if (di == 1 && !found) {
-      if(y-1 >= 0 && x+1 < (int) pcl_cloud->width && contours.at<int>(y-1, x+1) == id) {  // top right pixel
-        found = true;
-        if(x+1 == start_x && y-1 == start_y && contour.size() > 3) {
-          end = true;
-          return;
-        }
-        else {
-          contour.push_back(GetIdx(x+1, y-1));
-          RecursiveContourClustering(id, start_x, start_y, x+1, y-1, 1, contour, end);
-        }
-      }
-    }
-    else if (di == 2 && !found) {
-      if(x+1 < (int) pcl_cloud->width && contours.at<int>(y, x+1) == id) {  // right pixel
+  static const int dx[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+  static const int dy[8] = {-1, -1, 0, 1, 1, 1, 0, -1};
+  int width = pcl_cloud->width;
+  int height = pcl_cloud->height;
+  int max_size = width*height;
+  int x = start_x;
+  int y = start_y;
+  int dir = 4;
+
+  while((int) contour.size() <= max_size) {
+    bool found = false;
+    dir += 5;     // change direction
+    for(unsigned i=0; i<8 && !found; i++) {
+      int di = (i + dir) % 8;
+      int nx = x + dx[di];
+      int ny = y + dy[di];
+      if(nx < 0 || ny < 0 || nx >= width || ny >= height)
+        continue;
+      int idx = GetIdx(nx, ny);
+      if(contours.at<int>(ny, nx) == id && !traced[idx]) {
         found = true;
-        if(x+1 == start_x && y == start_y && contour.size() > 3) {
-          end = true;
-          return;
-        }
-        else {
-          contour.push_back(GetIdx(x+1, y));
-          RecursiveContourClustering(id, start_x, start_y, x+1, y, 2, contour, end);
-        }
-      }
-    }
-    else if (di == 3 && !found) {
-      if(x+1 < (int) pcl_cloud->width && y+1 < (int) pcl_cloud->height && contours.at<int>(y+1, x+1) == id) { // right bottom pixel
-        found = true;
-        if(x+1 == start_x && y+1 == start_y && contour.size() > 3) {
-          end = true;
-          return;
-        }
-        else {
-          contour.push_back(GetIdx(x+1, y+1));
-          RecursiveContourClustering(id, start_x, start_y, x+1, y+1, 3, contour, end);
-        }
-      }  
-    }
-    else if (di == 4 && !found) {
-      if(y+1 < (int) pcl_cloud->height && contours.at<int>(y+1, x) == id) { // bottom pixel
-        found = true;
-        if(x == start_x && y+1 == start_y && contour.size() > 3) {
-          end = true;
-          return;
-        }
-        else {
-          contour.push_back(GetIdx(x, y+1));
-          RecursiveContourClustering(id, start_x, start_y, x, y+1, 4, contour, end);
-        }
-      }  
-    }
-    else if (di == 5 && !found) {
-      if(x-1 >= 0 && y+1 < (int) pcl_cloud->height && contours.at<int>(y+1, x-1) == id) { // bottom left pixel
-        found = true;
-        if(x-1 == start_x && y+1 == start_y && contour.size() > 3) {
-          end = true;
-          return;
-        }
-        else {
-          contour.push_back(GetIdx(x-1, y+1));
-          RecursiveContourClustering(id, start_x, start_y, x-1, y+1, 5, contour, end);
-        }
-      }    
-    }
-    else if (di == 6 && !found) {
-      if(x-1 >= 0 && contours.at<int>(y, x-1) == id) { // left pixel
-        found = true;
-        if(x-1 == start_x && y == start_y && contour.size() > 3) {
-          end = true;
-          return;
-        }
-        else {
-          contour.push_back(GetIdx(x-1, y));
-          RecursiveContourClustering(id, start_x, start_y, x-1, y, 6, contour, end);
-        }
-      }
-    }
-    else if (di == 7 && !found) {
-      if(x-1 >= 0 && y-1 >= 0 && contours.at<int>(y-1, x-1) == id) { // top left pixel
-        found = true;
-        if(x-1 == start_x && y-1 == start_y && contour.size() > 3) {
-          end = true;
-          return;
-        }
-        else {
-          contour.push_back(GetIdx(x-1, y-1));
-          RecursiveContourClustering(id, start_x, start_y, x-1, y-1, 7, contour, end);
-        }
+        if(nx == start_x && ny == start_y && contour.size() > 3)
+          return true;
+        contour.push_back(idx);
+        x = nx;
+        y = ny;
+        dir = di;
       }
     }
+    if(!found)
+      return false;
   }
+  printf("[ContourDetector::TraceContour] Warning: Contour of patch %u does not end.\n", id);
+  return false;
 }
 
+/**
+ * @brief Check if the pixel (left/top of 2x2 block) is a corner of three or four patches
+ */
+inline bool ContourDetector::IsCorner(const int *p, int idx)
+{
+  int w = pcl_cloud->width;
+  unsigned found = 0;
+  if(p[idx] != p[idx+1])
+    found++;
+  if(p[idx+1] != p[idx+w+1])
+    found++;
+  if(p[idx+w+1] != p[idx+w])
+    found++;
+  if(p[idx+w] != p[idx])
+    found++;
+  return found >= 3;
+}
 
 /**
- * @brief Construct patch and contour image. Initialize pre_edgels and pre_corners
+ * @brief Construct patch and contour image (pixels with a patch change to a 4-neighbour
+ * and patch pixels at the left and top image border).
  */
 void ContourDetector::initialize()
 {
@@ -218,148 +157,114 @@ void ContourDetector::initialize()
     exit(0);
   }
     
-  if(view->havePatchImage) {
-    patches = cv::Mat_<int>(pcl_cloud->height, pcl_cloud->width);
-    view->patchImage.copyTo(patches);
-  }
-  else {
-    patches = cv::Mat_<int>(pcl_cloud->height, pcl_cloud->width);
-    patches.setTo(-1);
-    for(unsigned i=0; i<view->surfaces.size(); i++)
-      for(unsigned j=0; j<view->surfaces[i]->indices.size(); j++)
-        patches.at<int>(Y(view->surfaces[i]->indices[j]), X(view->surfaces[i]->indices[j])) = i;
-    patches.copyTo(view->patchImage);
-    view->havePatchImage = true;
-  }
+  view->frame.setInputCloud(pcl_cloud);
+  patches = view->GetPatchImage();                      // shared with the other stages, read only
   
-  contours = cv::Mat_<int>(pcl_cloud->height, pcl_cloud->width);
+  contours.create(pcl_cloud->height, pcl_cloud->width);
   contours.setTo(-1);
-  contours2 = cv::Mat_<int>(pcl_cloud->height, pcl_cloud->width);
-  contours2.setTo(-1);
-  
-  #pragma omp parallel for      // => 4ms
+
+  int w = patches.cols;
+  const int *p = (const int*) patches.data;
+  int *c = (int*) contours.data;
   for(int row=0; row<patches.rows; row++) {
     for(int col=0; col<patches.cols; col++) {
       int idx = GetIdx(col, row);
-
-      // initialize corner
-      pre_corners[idx].index = -1;
-      
-      // initialize edge
-      pre_edgels[idx].index = -1;
-      pre_edgels[idx].corner_idx = -1;
-      pre_edgels[idx].horizontal = false;
-      pre_edgels[idx].h_valid = false;
-      pre_edgels[idx].vertical = false;
-      pre_edgels[idx].v_valid = false;
+      int id = p[idx];
 
       // contour at image border
-      if((row == 0 || row == (int) pcl_cloud->height) && patches.at<int>(row, col) != -1)   
-        contours.at<int>(row, col) = patches.at<int>(row, col);
-      if((col == 0  || col == (int) pcl_cloud->width) && patches.at<int>(row, col) != -1)
-        contours.at<int>(row,col) = patches.at<int>(row,col);
-      
-      if(col < patches.cols-1) {
-        if(patches.at<int>(row, col) != patches.at<int>(row, col+1)) {    // horizontal edge
-          contours.at<int>(row, col) = patches.at<int>(row, col);
-          contours.at<int>(row, col+1) = patches.at<int>(row, col+1);
-        }
+      if((row == 0 || col == 0) && id != -1)
+        c[idx] = id;
+
+      if(col < patches.cols-1 && id != p[idx+1]) {
+        c[idx] = id;
+        c[idx+1] = p[idx+1];
       }
-        
-      if(row < patches.rows-1) {
-        if(patches.at<int>(row, col) != patches.at<int>(row+1, col)) {    // vertical edge
-          contours.at<int>(row, col) = patches.at<int>(row,col);
-          contours.at<int>(row+1, col) = patches.at<int>(row+1, col);
-        }
+      if(row < patches.rows-1 && id != p[idx+w]) {
+        c[idx] = id;
+        c[idx+w] = p[idx+w];
       }
     }
   }
-  contours.copyTo(contours2);
-  
+  traced.assign(pcl_cloud->width * pcl_cloud->height, 0);
+  initialized = true;
+}
+
+/**
+ * @brief Collect the edgels (pixels with a patch change to the right or bottom pixel) and
+ * the corners in one scan of the patch image. The view gets their image positions: pixel
+ * coordinates for edgels, centre of the 2x2 block for corners. Pixels of the last row and
+ * column are edgels only next to a corner of the row above or the column to the left.
+ */
+void ContourDetector::computeEdgels()
+{
+  if(!initialized)
+    initialize();
+
+  pre_edgels.clear();
+  pre_corners.clear();
+  view->edgels.clear();
+  view->corners.clear();
 
-  #pragma omp parallel for     // => 7ms
+  int w = patches.cols;
+  const int *p = (const int*) patches.data;
   for(int row=0; row<patches.rows; row++) {
     for(int col=0; col<patches.cols; col++) {
       int idx = GetIdx(col, row);
+      int id = p[idx];
+      bool horizontal = col < patches.cols-1 && id != p[idx+1];
+      bool vertical = row < patches.rows-1 && id != p[idx+w];
+
+      bool corner = col < patches.cols-1 && row < patches.rows-1 && IsCorner(p, idx);
+      if(corner) {
+        aCorner co;
+        co.index = idx;
+        co.ids[0] = id;
+        co.ids[1] = p[idx+1];
+        co.ids[2] = p[idx+w];
+        co.ids[3] = p[idx+w+1];
+        pre_corners.push_back(co);
+        surface::Corner vc;
+        vc.x = col + 0.5f;
+        vc.y = row + 0.5f;
+        view->corners.push_back(vc);
+      }
 
-      unsigned found = 0;
-      if(col < patches.cols-1)
-        if(patches.at<int>(row, col) != patches.at<int>(row, col+1))
-          found++;
-      if(col < patches.cols-1 && row < patches.rows-1)
-        if(patches.at<int>(row, col+1) != patches.at<int>(row+1, col+1))
-          found++;
-      if(col < patches.cols-1 && row < patches.rows-1)
-        if(patches.at<int>(row+1, col+1) != patches.at<int>(row+1, col))
-          found++;
-      if(row < patches.rows-1)
-        if(patches.at<int>(row+1, col) != patches.at<int>(row, col))
-          found++;
-      
-      if(col < patches.cols-1 && row < patches.rows-1) {
-        if(found >= 3) {
-          pre_corners[idx].index = idx;
-          pre_corners[idx].ids[0] = patches.at<int>(row, col);
-          pre_corners[idx].ids[1] = patches.at<int>(row, col+1);
-          pre_corners[idx].ids[2] = patches.at<int>(row+1, col);
-          pre_corners[idx].ids[3] = patches.at<int>(row+1, col+1);
-
-          if(patches.at<int>(row, col) != patches.at<int>(row, col+1)) {
-            pre_edgels[idx].corner_idx = idx;
-            pre_edgels[idx].index = idx;
-            pre_edgels[idx].horizontal = true;
-            pre_edgels[idx].h_valid = true;
-            pre_edgels[idx].h_ids[0] = patches.at<int>(row, col);
-            pre_edgels[idx].h_ids[1] = patches.at<int>(row, col+1);
-          }
-          if(patches.at<int>(row+1, col) != patches.at<int>(row+1, col+1)) {
-            int idx2 = GetIdx(col, row+1);
-            pre_edgels[idx2].corner_idx = idx;
-            pre_edgels[idx2].index = idx;
-            pre_edgels[idx2].horizontal = true;
-            pre_edgels[idx2].h_valid = true;
-            pre_edgels[idx2].h_ids[0] = patches.at<int>(row+1, col);
-            pre_edgels[idx2].h_ids[1] = patches.at<int>(row+1, col+1);
-          }
-          
-          if(patches.at<int>(row, col) != patches.at<int>(row+1, col)) {
-            pre_edgels[idx].corner_idx = idx;
-            pre_edgels[idx].index = idx;
-            pre_edgels[idx].vertical = true;
-            pre_edgels[idx].v_valid = true;
-            pre_edgels[idx].v_ids[0] = patches.at<int>(row, col);
-            pre_edgels[idx].v_ids[1] = patches.at<int>(row+1, col);
-          }
-          if(patches.at<int>(row, col+1) != patches.at<int>(row+1, col+1)) {
-            int idx2 = GetIdx(col+1, row);
-            pre_edgels[idx2].corner_idx = idx;
-            pre_edgels[idx2].index = idx;
-            pre_edgels[idx2].vertical = true;
-            pre_edgels[idx2].v_valid = true;
-            pre_edgels[idx2].v_ids[0] = patches.at<int>(row, col+1);
-            pre_edgels[idx2].v_ids[1] = patches.at<int>(row+1, col+1);
-          }
+      if(horizontal || vertical) {
+        // adjacent corner: the own one, else the left one (vertical edge), else the upper one (horizontal edge)
+        int corner_idx = -1;
+        if(corner)
+          corner_idx = idx;
+        else if(vertical && col > 0 && IsCorner(p, idx-1))
+          corner_idx = idx-1;
+        else if(horizontal && row > 0 && IsCorner(p, idx-w))
+          corner_idx = idx-w;
+
+        // last row and column: only the edgels continuing a corner of the row above or the column to the left
+        if(corner_idx == -1 && (col == patches.cols-1 || row == patches.rows-1))
+          continue;
+
+        aEdgel e;
+        e.index = idx;
+        e.corner_idx = corner_idx;
+        e.horizontal = e.h_valid = horizontal;
+        e.vertical = e.v_valid = vertical;
+        if(horizontal) {
+          e.h_ids[0] = id;
+          e.h_ids[1] = p[idx+1];
         }
-        else {  // if no corner, create also pre_edgel
-          if(patches.at<int>(row, col) != patches.at<int>(row, col+1)) {
-            pre_edgels[idx].index = idx;
-            pre_edgels[idx].horizontal = true;
-            pre_edgels[idx].h_valid = true;
-            pre_edgels[idx].h_ids[0] = patches.at<int>(row, col);
-            pre_edgels[idx].h_ids[1] = patches.at<int>(row, col+1);
-          }
-          if(patches.at<int>(row, col) != patches.at<int>(row+1, col)) {
-            pre_edgels[idx].index = idx;
-            pre_edgels[idx].vertical = true;
-            pre_edgels[idx].v_valid = true;
-            pre_edgels[idx].v_ids[0] = patches.at<int>(row, col);
-            pre_edgels[idx].v_ids[1] = patches.at<int>(row+1, col);
-          }        
+        if(vertical) {
+          e.v_ids[0] = id;
+          e.v_ids[1] = p[idx+w];
         }
+        pre_edgels.push_back(e);
+        surface::Edgel ve;
+        ve.x = col;
+        ve.y = row;
+        view->edgels.push_back(ve);
       }
     }
   }
-  initialized = true;
+  have_edgels = true;
 }
 
 
@@ -369,37 +274,52 @@ void ContourDetector::computeContours()
     initialize();
   
   size_t min_contour_size = 5;
-//   std::vector<int> empty_contour;
-
-  // start at top left and go through contours
-  for(int row=0; row<contours.rows; row++) {
-    for(int col=0; col<contours.cols; col++) {
-      if(contours.at<int>(row,col) != -1) {
-        int id = contours.at<int>(row,col);
-        std::vector<int> new_contour;
+  int nr_surfaces = view->surfaces.size();
+
+  // contour pixels of each patch in row-major order
+  contour_offset.assign(nr_surfaces+1, 0);
+  const int *c = (const int*) contours.data;
+  int size = contours.rows*contours.cols;
+  for(int i=0; i<size; i++)
+    if(c[i] != -1)
+      contour_offset[c[i]+1]++;
+  for(int i=0; i<nr_surfaces; i++)
+    contour_offset[i+1] += contour_offset[i];
+  contour_pixels.resize(contour_offset[nr_surfaces]);
+  std::vector<int> pos(contour_offset.begin(), contour_offset.end()-1);
+  for(int i=0; i<size; i++)
+    if(c[i] != -1)
+      contour_pixels[pos[c[i]]++] = i;
+
+  // start at top left and go through contours (patches are independent)
+  #pragma omp parallel for schedule(dynamic)
+  for(int id=0; id<nr_surfaces; id++) {
+    std::vector<int> new_contour;
+    for(int j=contour_offset[id]; j<contour_offset[id+1]; j++) {
+      int idx = contour_pixels[j];
+      if(traced[idx])
+        continue;
         
-        new_contour.push_back(GetIdx(col, row));
-        bool end = false;
-        RecursiveContourClustering(id, col, row, col, row, 4, new_contour, end);
-        
-        if(!end && new_contour.size() > 6)
-          printf("[ContourDetector::computeContours] This has found NO end: %u => size: %d\n", id, new_contour.size());
-        
-        // save contour
-        if(new_contour.size() > min_contour_size) {
-          view->surfaces[id]->contours.push_back(new_contour);
-        }
-        else {
-          #ifdef DEBUG      
-          printf("[ContourDetector::computeContours] Warning: Contour %u with too less points: %lu\n", id, new_contour.size());
-          #endif
-//           view->surfaces[id]->contours.push_back(empty_contour);  // push back a empty contour!
-        }
-        
-        // delete contour points from contours map!
-        for(unsigned i=0; i<new_contour.size(); i++)
-          contours.at<int>(Y(new_contour[i]), X(new_contour[i])) = -1;
+      new_contour.clear();
+      new_contour.push_back(idx);
+      bool end = TraceContour(id, X(idx), Y(idx), new_contour);
+      
+      if(!end && new_contour.size() > 6)
+        printf("[ContourDetector::computeContours] This has found NO end: %u => size: %d\n", id, new_contour.size());
+      
+      // save contour
+      if(new_contour.size() > min_contour_size) {
+        view->surfaces[id]->contours.push_back(new_contour);
       }
+      else {
+        #ifdef DEBUG      
+        printf("[ContourDetector::computeContours] Warning: Contour %u with too less points: %lu\n", id, new_contour.size());
+        #endif
+      }
+      
+      // delete contour points from contours map!
+      for(unsigned i=0; i<new_contour.size(); i++)
+        traced[new_contour[i]] = 1;
     }
   }
   
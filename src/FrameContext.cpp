@@ -0,0 +1,137 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file FrameContext.cpp
+ * @brief Per-frame intermediates shared by the processing stages.
+ */
+
+#include <unknown_objects_segmentation/FrameContext.h>
+#include <unknown_objects_segmentation/SurfaceModel.hpp>
+#include <unknown_objects_segmentation/ColorHistogram3D.h>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace surface
+{
+
+FrameContext::FrameContext()
+{
+  nrColorBins = 0;
+  uvThreshold = 0.;
+  edgeParams[0] = edgeParams[1] = edgeParams[2] = 0.;
+  invalidate();
+}
+
+bool FrameContext::checkCloud(const char *function) const
+{
+  if(cloud.get() == 0) {
+    printf("[FrameContext::%s] Error: No input cloud set.\n", function);
+    return false;
+  }
+  return true;
+}
+
+void FrameContext::setInputCloud(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &_cloud)
+{
+  if(_cloud == cloud)
+    return;
+  cloud = _cloud;
+  invalidate();
+}
+
+void FrameContext::invalidate()
+{
+  havePatchImage = false;
+  haveColorImage = false;
+  haveEdgeImage = false;
+  haveColorBins = false;
+}
+
+const cv::Mat_<int> &FrameContext::getPatchImage(const PatchTable &table)
+{
+#pragma omp critical(frame_context_patches)
+  {
+    if(!havePatchImage && checkCloud("getPatchImage")) {
+      table.createImage(patchImage, cloud->width, cloud->height, -1);
+      havePatchImage = true;
+    }
+  }
+  return patchImage;
+}
+
+const cv::Mat_<cv::Vec3b> &FrameContext::getColorImage()
+{
+#pragma omp critical(frame_context_color)
+  {
+    if(!haveColorImage && checkCloud("getColorImage")) {
+      colorImage.create(cloud->height, cloud->width);
+      for(unsigned row = 0; row < cloud->height; row++) {
+        cv::Vec3b *cvp = colorImage[row];
+        const pcl::PointXYZRGB *pt = &cloud->points[row * cloud->width];
+        for(unsigned col = 0; col < cloud->width; col++) {
+          cvp[col][2] = pt[col].r;
+          cvp[col][1] = pt[col].g;
+          cvp[col][0] = pt[col].b;
+        }
+      }
+      haveColorImage = true;
+    }
+  }
+  return colorImage;
+}
+
+const cv::Mat &FrameContext::getEdgeImage(double lowThreshold, double highThreshold, int kernelSize)
+{
+  const cv::Mat_<cv::Vec3b> &image = getColorImage();
+#pragma omp critical(frame_context_edges)
+  {
+    if(!haveEdgeImage || edgeParams[0] != lowThreshold || edgeParams[1] != highThreshold || edgeParams[2] != kernelSize) {
+      cv::Mat gray_image;
+      cv::cvtColor(image, gray_image, CV_BGR2GRAY);
+      cv::blur(gray_image, edgeImage, cv::Size(3,3));
+      cv::Canny(edgeImage, edgeImage, lowThreshold, highThreshold, kernelSize);
+      edgeParams[0] = lowThreshold;
+      edgeParams[1] = highThreshold;
+      edgeParams[2] = kernelSize;
+      haveEdgeImage = true;
+    }
+  }
+  return edgeImage;
+}
+
+const std::vector<int> &FrameContext::getColorBins(int nr_bins, double UVthreshold)
+{
+#pragma omp critical(frame_context_bins)
+  {
+    if((!haveColorBins || nrColorBins != nr_bins || uvThreshold != UVthreshold) && checkCloud("getColorBins")) {
+      ColorHistogram3D::computeBinImage(*cloud, nr_bins, UVthreshold, colorBins);
+      nrColorBins = nr_bins;
+      uvThreshold = UVthreshold;
+      haveColorBins = true;
+    }
+  }
+  return colorBins;
+}
+
+}
@@ -31,6 +31,10 @@
 
 #include <unknown_objects_segmentation/Graph.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #ifndef GC_DEBUG
 #define GC_DEBUG false
 #endif
@@ -38,6 +42,36 @@
 namespace gc
 {
 
+/** Threads of the parallel regions (1 without OpenMP) **/
+static inline int MaxThreads()
+{
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+/** Thread number inside a parallel region (0 without OpenMP) **/
+static inline int ThreadNum()
+{
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+/** Threads of the current parallel region (1 without OpenMP) **/
+static inline int NumThreads()
+{
+#ifdef _OPENMP
+  return omp_get_num_threads();
+#else
+  return 1;
+#endif
+}
+
 template<typename T1,typename T2>
 inline T1 Dot3(const T1 v1[3], const T2 v2[3])
 {
@@ -52,22 +86,54 @@ inline void Add3(const T1 v1[3], const T2 v2[3], T3 r[3])
   r[2] = v1[2]+v2[2];
 }
 
+/**
+ * @brief Build the adjacency of all nodes (counting sort of the relations by node id).
+ * @param nrNodes Number of nodes
+ * @param rel Relations between the nodes
+ */
+void Adjacency::build(unsigned nrNodes, const std::vector<surface::Relation> &rel)
+{
+  offset.assign(nrNodes+1, 0);
+  for(unsigned i=0; i<rel.size(); i++) {
+    if(rel[i].id_0 < nrNodes && rel[i].id_1 < nrNodes) {
+      offset[rel[i].id_0+1]++;
+      offset[rel[i].id_1+1]++;
+    }
+  }
+  for(unsigned i=0; i<nrNodes; i++)
+    offset[i+1] += offset[i];
+
+  neighbours.resize(offset[nrNodes]);
+  relation.resize(offset[nrNodes]);
+  std::vector<unsigned> pos(offset.begin(), offset.end()-1);
+  for(unsigned i=0; i<rel.size(); i++) {
+    unsigned a = rel[i].id_0;
+    unsigned b = rel[i].id_1;
+    if(a < nrNodes && b < nrNodes) {
+      neighbours[pos[a]] = b;
+      relation[pos[a]++] = i;
+      neighbours[pos[b]] = a;
+      relation[pos[b]++] = i;
+    }
+  }
+}
+
 /**
  * @brief Constructor of Graph
  */
 Graph::Graph()
 {
   nodes = 0;
-  relations.clear();
+  relations = NULL;
 }
   
 /**
  * @brief Constructor of Graph
  */
-Graph::Graph(unsigned nrNodes, std::vector<surface::Relation> &rel)
+Graph::Graph(unsigned nrNodes, const std::vector<surface::Relation> &rel)
 {
   nodes = nrNodes;
-  relations = rel;
+  relations = &rel;
 }
 
 
@@ -85,298 +151,161 @@ Graph::~Graph()
  */
 void Graph::BuildFromSVM(std::vector<gc::Edge> &e, unsigned &num_edges)
 {
+  const std::vector<surface::Relation> &rel = *relations;
   if(GC_DEBUG) {
     printf("[Graph::BuildFromSVM] Number of nodes: %u\n", nodes);
-    for(unsigned i=0; i<relations.size(); i++)
-      printf("[Graph::BuildFromSVM] Relation %u: %u-%u\n", i, relations[i].id_0, relations[i].id_1);
+    for(unsigned i=0; i<rel.size(); i++)
+      printf("[Graph::BuildFromSVM] Relation %u: %u-%u\n", i, rel[i].id_0, rel[i].id_1);
   }
-      
-  // Connectivity check for graph
-  for(unsigned i=1; i<nodes; i++) {
-    bool node_found = false;
-    for(unsigned j=0; j<relations.size(); j++)
-      if(relations[j].id_0 == 0 && relations[j].id_1 == i)
-        node_found = true;
-    if(!node_found) {
-      if(GC_DEBUG) 
-        printf("[Graph::BuildFromSVM] Warning: Node without relation: Add relation: %u-%u.\n", 0, i);
 
-      surface::Relation r;
-      r.id_0 = 0;
-      r.id_1 = i;
-      r.groundTruth = -1;
-      r.type = 1;
-      r.rel_probability.push_back(1.0);
-      r.rel_probability.push_back(0.0);
-      relations.push_back(r);
-    }
-  }
-    
-  if(GC_DEBUG) {
-    for(unsigned i=0; i<relations.size(); i++)
-      printf("[Graph::BuildFromSVM] Relation %u: %u-%u\n", i, relations[i].id_0, relations[i].id_1);
-  }    
+  edges.clear();
+  edges.reserve(rel.size() + nodes);
+  std::vector<bool> connected(nodes, false);
+  for(unsigned i=0; i< rel.size(); i++) {
+    if(rel[i].id_0 == 0 && rel[i].id_1 < nodes)
+      connected[rel[i].id_1] = true;
 
-  for(unsigned i=0; i< relations.size(); i++) {
     gc::Edge e;
-    e.a = relations[i].id_0;
-    e.b = relations[i].id_1;
+    e.a = rel[i].id_0;
+    e.b = rel[i].id_1;
     e.type = 1;
-    e.w = relations[i].rel_probability[0];
+    e.w = rel[i].rel_probability[0];
     if(GC_DEBUG)
       printf("[Graph::BuildFromSVM] New edge (type: %i): %i-%i: %8.8f\n", e.type, e.a, e.b, e.w);
     edges.push_back(e);
   }
+
+  // Connectivity check for graph: weakest edge to node 0 for nodes without relation
+  for(unsigned i=1; i<nodes; i++) {
+    if(!connected[i]) {
+      if(GC_DEBUG) 
+        printf("[Graph::BuildFromSVM] Warning: Node without relation: Add relation: %u-%u.\n", 0, i);
+
+      gc::Edge e;
+      e.a = 0;
+      e.b = i;
+      e.type = 1;
+      e.w = 1.0;
+      edges.push_back(e);
+    }
+  }
     
-  num_edges = edges.size();
-  e = edges;
-  
   if(GC_DEBUG)
-    printf("[Graph::BuildFromSVM] Created %d edges from %d relations\n", edges.size(), relations.size());
+    printf("[Graph::BuildFromSVM] Created %lu edges from %lu relations\n", edges.size(), rel.size());
 
+  num_edges = edges.size();
+  e.swap(edges);
 }
 
 /**
- * @brief Build graph from point cloud with 4-neighborhood.
- * @param pcl_cloud
+ * @brief Build graph from point cloud with 8-neighborhood.
+ * Edges to the right, bottom, bottom-right and bottom-left neighbour of each pixel, if both
+ * points are valid and their depth gap is below 1% of the depth. The weight w is the RGB
+ * distance, normalised with the maximum distance of all neighbouring pixels, w2 is the angle
+ * between the normals (1.57 if undefined). Each thread builds the edges of a contiguous block
+ * of rows and the blocks are concatenated in row order: the edges do not depend on the number
+ * of threads.
+ * @param _pcl_cloud Organized point cloud
+ * @param _normals Normals of the point cloud
  * @param e Vector of edges
  * @param num_edges Number of created edges.
+ * @return Returns false, if the normals do not match the point cloud.
  */
-void Graph::BuildFromPointCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr &_pcl_cloud,
+bool Graph::BuildFromPointCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr &_pcl_cloud,
                                 pcl::PointCloud<pcl::Normal>::Ptr &_normals,
                                 std::vector<gc::Edge> &e, unsigned &num_edges)
 {
-  float z_adapt = 0.01;
+  const float z_adapt = 0.01;
   pcl_cloud = _pcl_cloud;
   normals = _normals;
   edges.clear();
-  
-  // normalization of curvature
-  float max_curv = 0.0;
-  for(unsigned i=0; i<normals->points.size(); i++)
-    if(!isnan(pcl_cloud->points[i].z))
-      if(normals->points[i].curvature > max_curv)
-        max_curv = normals->points[i].curvature;
-  printf("[Graph::BuildFromPointCloud] Max curvature: %5.5f\n", max_curv);
-      
-  // pre-calculate color distance
-  float color_dist[pcl_cloud->points.size()][4];
-  float max_color = 0.0f;
-// #pragma omp parallel for
-  for(unsigned row=0; row < pcl_cloud->height-1; row++) {
-    for(unsigned col=0; col < pcl_cloud->width-1; col++) {
-      int idx = GetIdx(col, row);
-      pcl::PointXYZRGB pt_0 = pcl_cloud->points[idx];                                           // Check also the distance of the points!
-      pcl::PointXYZRGB pt_1 = pcl_cloud->points[idx+1];
-      color_dist[idx][0] = sqrt(((float)pt_0.r/255.-(float)pt_1.r/255.)*((float)pt_0.r/255.-(float)pt_1.r/255.) + 
-                                ((float)pt_0.g/255.-(float)pt_1.g/255.)*((float)pt_0.g/255.-(float)pt_1.g/255.) +
-                                ((float)pt_0.b/255.-(float)pt_1.b/255.)*((float)pt_0.b/255.-(float)pt_1.b/255.));
-      if(color_dist[idx][0] > max_color)
-        max_color = color_dist[idx][0];
-// printf("color dist[0]: %4.3f\n", color_dist[idx][0]);
-      pt_0 = pcl_cloud->points[idx];
-      pt_1 = pcl_cloud->points[idx+pcl_cloud->width];
-      color_dist[idx][1] = sqrt(((float)pt_0.r/255.-(float)pt_1.r/255.)*((float)pt_0.r/255.-(float)pt_1.r/255.) + 
-                                ((float)pt_0.g/255.-(float)pt_1.g/255.)*((float)pt_0.g/255.-(float)pt_1.g/255.) +
-                                ((float)pt_0.b/255.-(float)pt_1.b/255.)*((float)pt_0.b/255.-(float)pt_1.b/255.));
-      if(color_dist[idx][1] > max_color)
-        max_color = color_dist[idx][1];
-// printf("color dist[1]: %4.3f\n", color_dist[idx][1]);
-      pt_0 = pcl_cloud->points[idx];
-      pt_1 = pcl_cloud->points[idx+pcl_cloud->width+1];
-      color_dist[idx][2] = sqrt(((float)pt_0.r/255.-(float)pt_1.r/255.)*((float)pt_0.r/255.-(float)pt_1.r/255.) + 
-                                ((float)pt_0.g/255.-(float)pt_1.g/255.)*((float)pt_0.g/255.-(float)pt_1.g/255.) +
-                                ((float)pt_0.b/255.-(float)pt_1.b/255.)*((float)pt_0.b/255.-(float)pt_1.b/255.));
-      if(color_dist[idx][2] > max_color)
-        max_color = color_dist[idx][2];
-// printf("color dist[2]: %4.3f\n", color_dist[idx][2]);
-      if(col != 0) {
-        pt_0 = pcl_cloud->points[idx];
-        pt_1 = pcl_cloud->points[idx+pcl_cloud->width-1];
-        color_dist[idx][3] = sqrt(((float)pt_0.r/255.-(float)pt_1.r/255.)*((float)pt_0.r/255.-(float)pt_1.r/255.) + 
-                                  ((float)pt_0.g/255.-(float)pt_1.g/255.)*((float)pt_0.g/255.-(float)pt_1.g/255.) +
-                                  ((float)pt_0.b/255.-(float)pt_1.b/255.)*((float)pt_0.b/255.-(float)pt_1.b/255.));
-      if(color_dist[idx][3] > max_color)
-        max_color = color_dist[idx][3];
-      }
-      else
-        color_dist[idx][3] = 1.0;
-// printf("color dist[3]: %4.3f\n", color_dist[idx][3]);
-    }
+  e.clear();
+  num_edges = 0;
+
+  if(normals->points.size() != pcl_cloud->points.size()) {
+    printf("[Graph::BuildFromPointCloud] Error: Number of normals and points differ.\n");
+    return false;
   }
-  
-  
-//   /// YUV conversion
-//   for(unsigned i=0; i < pcl_cloud->points.size(); i++) {
-//     pcl::PointXYZRGB pt_o = pcl_cloud->points[i];
-//     pcl::PointXYZRGB pt_n;
-//     pt_n.r =  (0.257 * pt_o.r) + (0.504 * pt_o.g) + (0.098 * pt_o.b) + 16;     // R = Y
-//     pt_n.g = -(0.148 * pt_o.r) - (0.291 * pt_o.g) + (0.439 * pt_o.b) + 128;    // G = U
-//     pt_n.b =  (0.439 * pt_o.r) - (0.368 * pt_o.g) - (0.071 * pt_o.b) + 128;    // B = V
-//   }
-//   
-//     // pre-calculate color distance
-//   float color_dist[pcl_cloud->points.size()][4];
-//   float max_color = 0.0f;
-// // #pragma omp parallel for
-//   for(unsigned row=0; row < pcl_cloud->height-1; row++) {
-//     for(unsigned col=0; col < pcl_cloud->width-1; col++) {
-//       int idx = GetIdx(col, row);
-//       pcl::PointXYZRGB pt_0 = pcl_cloud->points[idx];                                           // Check also the distance of the points!
-//       pcl::PointXYZRGB pt_1 = pcl_cloud->points[idx+1];
-//       color_dist[idx][0] = sqrt(((float)pt_0.g/255.-(float)pt_1.g/255.)*((float)pt_0.g/255.-(float)pt_1.g/255.) +
-//                                 ((float)pt_0.b/255.-(float)pt_1.b/255.)*((float)pt_0.b/255.-(float)pt_1.b/255.));
-//       if(color_dist[idx][0] > max_color)
-//         max_color = color_dist[idx][0];
-// // printf("color dist[0]: %4.3f\n", color_dist[idx][0]);
-//       pt_0 = pcl_cloud->points[idx];
-//       pt_1 = pcl_cloud->points[idx+pcl_cloud->width];
-//       color_dist[idx][1] = sqrt(((float)pt_0.g/255.-(float)pt_1.g/255.)*((float)pt_0.g/255.-(float)pt_1.g/255.) +
-//                                 ((float)pt_0.b/255.-(float)pt_1.b/255.)*((float)pt_0.b/255.-(float)pt_1.b/255.));
-//       if(color_dist[idx][1] > max_color)
-//         max_color = color_dist[idx][1];
-// // printf("color dist[1]: %4.3f\n", color_dist[idx][1]);
-//       pt_0 = pcl_cloud->points[idx];
-//       pt_1 = pcl_cloud->points[idx+pcl_cloud->width+1];
-//       color_dist[idx][2] = sqrt(((float)pt_0.g/255.-(float)pt_1.g/255.)*((float)pt_0.g/255.-(float)pt_1.g/255.) +
-//                                 ((float)pt_0.b/255.-(float)pt_1.b/255.)*((float)pt_0.b/255.-(float)pt_1.b/255.));
-//       if(color_dist[idx][2] > max_color)
-//         max_color = color_dist[idx][2];
-// // printf("color dist[2]: %4.3f\n", color_dist[idx][2]);
-//       if(col != 0) {
-//         pt_0 = pcl_cloud->points[idx];
-//         pt_1 = pcl_cloud->points[idx+pcl_cloud->width-1];
-//         color_dist[idx][3] = sqrt(((float)pt_0.g/255.-(float)pt_1.g/255.)*((float)pt_0.g/255.-(float)pt_1.g/255.) +
-//                                   ((float)pt_0.b/255.-(float)pt_1.b/255.)*((float)pt_0.b/255.-(float)pt_1.b/255.));
-//       if(color_dist[idx][3] > max_color)
-//         max_color = color_dist[idx][3];
-//       }
-//       else
-//         color_dist[idx][3] = 1.0;
-// // printf("color dist[3]: %4.3f\n", color_dist[idx][3]);
-//     }
-//   }
-  
-  
-  
-  // Create Graph
-  for(unsigned row=0; row < pcl_cloud->height-1; row++) {                       /// TODO Könnte man auch parallelisieren
-    for(unsigned col=0; col < pcl_cloud->width-1; col++) {
-      int idx = GetIdx(col, row);
-      
-      /// RIGHT
-      gc::Edge e;
-      e.a = idx;
-      e.b = idx+1;
-      e.type = 1;
-      e.w = color_dist[idx][0]/max_color;
-// printf("color distance: %4.3f\n", e.w);      
-      // normals angle 
-      double angle = 0.0;
-      if(isnan(pcl_cloud->points[idx].z))
-        angle = 1.57;
-      else
-        angle = acos( Dot3(&normals->points[idx].normal[0], &normals->points[idx+1].normal[0]) );
-      if(!isnan(angle))
-        e.w2 = angle;
-      else
-        e.w2 = 1.57;
-      
-      float z_dist = fabs(pcl_cloud->points[idx].z - pcl_cloud->points[idx+1].z);
-      if(!isnan(pcl_cloud->points[idx].z) && !isnan(pcl_cloud->points[idx+1].z) && z_dist < (z_adapt*pcl_cloud->points[idx].z))
-        edges.push_back(e);
-
-      /// BOTTOM
-      e.a = idx;
-      e.b = idx+pcl_cloud->width;
-      e.type = 1;
-      e.w = color_dist[idx][1]/max_color;
-// printf("color distance: %4.3f\n", e.w);      
-      
-      // normals angle 
-      angle = 0.0;
-      if(isnan(pcl_cloud->points[idx].z))
-        angle = 1.57;
-      else
-        angle = acos( Dot3(&normals->points[idx].normal[0], &normals->points[idx+pcl_cloud->width].normal[0]) );
-      if(!isnan(angle))
-        e.w2 = angle;
-      else
-        e.w2 = 1.57;      
-
-      z_dist = fabs(pcl_cloud->points[idx].z - pcl_cloud->points[idx+pcl_cloud->width].z);
-      if(!isnan(pcl_cloud->points[idx].z) && !isnan(pcl_cloud->points[idx+pcl_cloud->width].z) && z_dist < (z_adapt*pcl_cloud->points[idx].z))
-        edges.push_back(e);
-      
-      /// BOTTOM-RIGHT
-      e.a = idx;
-      e.b = idx+pcl_cloud->width+1;
-      e.type = 1;
-      e.w = color_dist[idx][2]/max_color;
-// printf("color distance: %4.3f\n", e.w);      
-      
-      // normals angle 
-      angle = 0.0;
-      if(isnan(pcl_cloud->points[idx].z))
-        angle = 1.57;
-      else
-        angle = acos( Dot3(&normals->points[idx].normal[0], &normals->points[idx+pcl_cloud->width+1].normal[0]) );
-      if(!isnan(angle))
-        e.w2 = angle;
-      else
-        e.w2 = 1.57;      
-      
-      z_dist = fabs(pcl_cloud->points[idx].z - pcl_cloud->points[idx+pcl_cloud->width+1].z);
-      if(!isnan(pcl_cloud->points[idx].z) && !isnan(pcl_cloud->points[idx+pcl_cloud->width+1].z) && z_dist < (z_adapt*pcl_cloud->points[idx].z))
-        edges.push_back(e);
-      
-      /// BOTTOM-LEFT
-      if(idx%pcl_cloud->width != 0) {
-        e.a = idx;
-        e.b = idx+pcl_cloud->width-1;
-        e.type = 1;
-        e.w = color_dist[idx][3]/max_color;
-// printf("color distance: %4.3f\n", e.w);      
-       
-        // normals angle 
-        angle = 0.0;
-        if(isnan(pcl_cloud->points[idx].z))
-          angle = 1.57;
-        else
-          angle = acos( Dot3(&normals->points[idx].normal[0], &normals->points[idx+pcl_cloud->width-1].normal[0]) );
-        if(!isnan(angle))
-          e.w2 = angle;
-        else
-          e.w2 = 1.57;      
-
-        z_dist = fabs(pcl_cloud->points[idx].z - pcl_cloud->points[idx+pcl_cloud->width-1].z);
-        if(!isnan(pcl_cloud->points[idx].z) && !isnan(pcl_cloud->points[idx+pcl_cloud->width-1].z) && z_dist < (z_adapt*pcl_cloud->points[idx].z))
-          edges.push_back(e);
+  const int width = pcl_cloud->width;
+  const int height = pcl_cloud->height;
+  if(width < 2 || height < 2)
+    return true;
+
+  const int offset[4] = {1, width, width+1, width-1};           // right, bottom, bottom-right, bottom-left
+  std::vector< std::vector<gc::Edge> > parts(MaxThreads());
+  std::vector<unsigned> start(parts.size()+1, 0);
+  float max_color = 0.0f;
+
+#pragma omp parallel
+  {
+    std::vector<gc::Edge> &part = parts[ThreadNum()];
+    part.reserve(4*(width-1)*((height-1)/NumThreads()+1));
+    std::vector<float> color_dist(4*width);                     // colour distances of one row
+    float max_local = 0.0f;
+
+#pragma omp for schedule(static)
+    for(int row=0; row < height-1; row++) {
+      const pcl::PointXYZRGB *pt = &pcl_cloud->points[row*width];
+      const pcl::Normal *n = &normals->points[row*width];
+
+      // colour distances of all neighbouring pixels (from the exact integer differences)
+      for(int k=0; k<4; k++) {
+        const pcl::PointXYZRGB *nb = pt + offset[k];
+        float *dist = &color_dist[k*width];
+        for(int col=(k == 3 ? 1 : 0); col < width-1; col++) {
+          int dr = (int) pt[col].r - (int) nb[col].r;
+          int dg = (int) pt[col].g - (int) nb[col].g;
+          int db = (int) pt[col].b - (int) nb[col].b;
+          dist[col] = sqrtf((float) (dr*dr + dg*dg + db*db));
+        }
+        for(int col=(k == 3 ? 1 : 0); col < width-1; col++)
+          if(dist[col] > max_local)
+            max_local = dist[col];
       }
-      else {
-        e.w = 1.0;
-        z_dist = fabs(pcl_cloud->points[idx].z - pcl_cloud->points[idx+pcl_cloud->width-1].z);
-        if(!isnan(pcl_cloud->points[idx].z) && !isnan(pcl_cloud->points[idx+pcl_cloud->width-1].z) && z_dist < (z_adapt*pcl_cloud->points[idx].z))
-          edges.push_back(e);
+
+      // edges (colour distance is normalised after the reduction)
+      for(int col=0; col < width-1; col++) {
+        float z = pt[col].z;
+        if(isnan(z))
+          continue;
+        for(int k=0; k < (col == 0 ? 3 : 4); k++) {
+          const int nb = col + offset[k];
+          if(isnan(pt[nb].z) || !(fabs(z - pt[nb].z) < z_adapt*z))
+            continue;
+          double angle = acos( Dot3(&n[col].normal[0], &n[nb].normal[0]) );
+          gc::Edge edge;
+          edge.type = 1;
+          edge.a = row*width + col;
+          edge.b = row*width + nb;
+          edge.w = color_dist[k*width + col];
+          edge.w2 = (isnan(angle) ? 1.57 : angle);
+          part.push_back(edge);
+        }
       }
     }
-  }
-  num_edges = edges.size();
-  e = edges;
-  
-  
-/// HACK: OLD STUFF
-/// curvature
-//       float curv = normals->points[idx].curvature;
-//       e.w = curv / max_curv;
-//       if(isnan(pcl_cloud->points[idx].z) || z_dist > 0.004)
-//         e.w = 1.0f;
-/// curvature
-//       curv = normals->points[idx].curvature;
-//       e.w = curv * 10.;
-//       if(isnan(pcl_cloud->points[idx].z) || z_dist > 0.004)
-//         e.w = 1.0f;
 
+#pragma omp critical (graph_max_color)
+    if(max_local > max_color)
+      max_color = max_local;
+#pragma omp barrier
+
+#pragma omp single
+    {
+      for(unsigned i=0; i<parts.size(); i++)
+        start[i+1] = start[i] + parts[i].size();
+      e.resize(start.back());
+    }
+
+    // concatenate in row order
+    gc::Edge *dst = (e.empty() ? 0 : &e[start[ThreadNum()]]);
+    for(unsigned i=0; i<part.size(); i++) {
+      dst[i] = part[i];
+      if(max_color > 0.0f)
+        dst[i].w /= max_color;
+    }
+  }
+  num_edges = e.size();
+  return true;
 }
 
 } 
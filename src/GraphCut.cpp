@@ -46,8 +46,14 @@ GraphCut::GraphCut()
 {
   initialized = false;
   processed = false;
+  num_edges = 0;
+  num_nodes = 0;
+  view = NULL;
+  u = NULL;
   createAllRelations = false;     // create fully connected graph to avoid segmentation fault
   print = false;
+  threshold_c = THRESHOLD_CONSTANT;
+  min_size = MIN_SIZE;
 }
 
 
@@ -55,16 +61,27 @@ GraphCut::GraphCut()
  * @brief Destructor of GraphCut
  */
 GraphCut::~GraphCut()
-{}
+{
+  delete u;
+}
 
 
 bool GraphCut::init(surface::View *_view)
 {
   view = _view;
+  initialized = false;
   if(view->relations.size() < 1) {
     printf("[GraphCut::init] Warning: No relations available!\n");
     return false;
   }
+
+  num_nodes = view->surfaces.size();
+  for(unsigned i=0; i<view->relations.size(); i++) {
+    if(view->relations[i].id_0 >= num_nodes)
+      num_nodes = view->relations[i].id_0 + 1;
+    if(view->relations[i].id_1 >= num_nodes)
+      num_nodes = view->relations[i].id_1 + 1;
+  }
   
   if(createAllRelations) {
     unsigned maxID = 0;
@@ -74,15 +91,13 @@ bool GraphCut::init(surface::View *_view)
       if(view->relations[i].id_1 > maxID)
         maxID = view->relations[i].id_1;
     }
+    Adjacency adjacency(maxID+1, view->relations);
+    std::vector<unsigned> related(maxID+1, 0);          // i+1, if related to node i
     for(unsigned i=0; i<maxID; i++) {
+      for(const unsigned *n = adjacency.begin(i); n != adjacency.end(i); n++)
+        related[*n] = i+1;
       for(unsigned j=i+1; j<=maxID; j++) {
-        bool foundRelation = false;
-        for(int k=0; k<(int)view->relations.size(); k++) {
-          if((view->relations[k].id_0 == i && view->relations[k].id_1 == j) ||
-             (view->relations[k].id_1 == i && view->relations[k].id_0 == j))
-            foundRelation = true;
-        }
-        if(!foundRelation) {
+        if(related[j] != i+1) {
           surface::Relation r;
           r.id_0 = i; 
           r.id_1 = j;
@@ -95,24 +110,34 @@ bool GraphCut::init(surface::View *_view)
     }
   }
   
-  std::vector<gc::Edge> e;
   Graph graph(view->surfaces.size(), view->relations);
-  graph.BuildFromSVM(e, num_edges);
+  graph.BuildFromSVM(edges, num_edges);
 
-  edges = new gc::Edge[num_edges];
-  for(unsigned i=0; i<num_edges; i++)
-    edges[i] = e[i];
+  if(num_edges == 0)
+    return false;
 
-  if(num_edges == 0) { 
-    initialized = false;
+  delete u;
+  u = new universe(num_nodes);
+  initialized = true;
+  if(GC_DEBUG) 
+    printf("[GraphCut::Initialize] num_edges: %u\n", num_edges);
+  return true;
+}
+
+bool GraphCut::init(unsigned nrNodes, std::vector<gc::Edge> &_edges)
+{
+  view = NULL;
+  initialized = false;
+  edges.clear();
+  edges.swap(_edges);
+  num_edges = edges.size();
+  num_nodes = nrNodes;
+  if(num_edges == 0 || num_nodes == 0)
     return false;
-  } 
-  else {
-    u = new universe(num_edges);
-    initialized = true;
-    if(GC_DEBUG) 
-      printf("[GraphCut::Initialize] num_edges: %u\n", num_edges);
-  }
+
+  delete u;
+  u = new universe(num_nodes);
+  initialized = true;
   return true;
 }
 
@@ -127,6 +152,48 @@ bool smallerEdge(const gc::Edge &a, const gc::Edge &b)
   return a.w < b.w;
 }
 
+/**
+ * @brief Sort the edges by weight in linear expected time: Counting sort into one bucket
+ * per edge on the quantised weight, the few edges of each bucket are sorted by weight.
+ */
+void GraphCut::sortEdges()
+{
+  if(num_edges < 2)
+    return;
+
+  float w_min = edges[0].w, w_max = edges[0].w;
+  for(unsigned i=1; i<num_edges; i++) {
+    if(edges[i].w < w_min) w_min = edges[i].w;
+    if(edges[i].w > w_max) w_max = edges[i].w;
+  }
+  if(!(w_max > w_min)) {          // all equal (or not a number)
+    std::stable_sort(edges.begin(), edges.end(), smallerEdge);
+    return;
+  }
+
+  unsigned nr_buckets = num_edges;
+  float scale = (nr_buckets - 1) / (w_max - w_min);
+  std::vector<unsigned> bucket(num_edges);
+  std::vector<unsigned> start(nr_buckets+1, 0);
+  for(unsigned i=0; i<num_edges; i++) {
+    float q = (edges[i].w - w_min) * scale;
+    bucket[i] = (q >= 0.f ? std::min((unsigned) q, nr_buckets-1) : 0);
+    start[bucket[i]+1]++;
+  }
+  for(unsigned i=0; i<nr_buckets; i++)
+    start[i+1] += start[i];
+
+  std::vector<gc::Edge> sorted(num_edges);
+  std::vector<unsigned> pos(start.begin(), start.end()-1);
+  for(unsigned i=0; i<num_edges; i++)
+    sorted[pos[bucket[i]]++] = edges[i];
+
+  for(unsigned i=0; i<nr_buckets; i++)
+    if(start[i+1] - start[i] > 1)
+      std::stable_sort(sorted.begin() + start[i], sorted.begin() + start[i+1], smallerEdge);
+  edges.swap(sorted);
+}
+
 /**
  * @brief Graph Cutting
  */
@@ -140,12 +207,10 @@ void GraphCut::process()
   if(GC_DEBUG) printf("[GraphCut::process] Start processing.\n");
 
   // sort edges by weight  
-  std::sort(edges, edges + num_edges, smallerEdge);
+  sortEdges();
 
-  // init thresholds
-  float *threshold = new float[num_edges];
-  for (unsigned i = 0; i < num_edges; i++)
-    threshold[i] = THRESHOLD(1, THRESHOLD_CONSTANT);
+  // init thresholds (per component, indexed by node)
+  std::vector<float> threshold(num_nodes, THRESHOLD(1, threshold_c));
   
   if(GC_DEBUG) printf("THRESHOLD: %4.3f\n", threshold[0]);
   
@@ -157,7 +222,7 @@ void GraphCut::process()
         printf("get edge %i\n", j);
         gc::Edge *pedge = &edges[j];
         printf("  all edges: %u:", j);
-        printf("  %u-%u with thrd: %4.3f", pedge->a, pedge->b, threshold[j]);
+        printf("  %u-%u", pedge->a, pedge->b);
         printf("  => universe: %u-%u\n", u->find(pedge->a), u->find(pedge->b));
       }
     }
@@ -178,35 +243,51 @@ void GraphCut::process()
         a = u->find(a);
         if(GC_DEBUG)
           printf("  => join: threshold[%u] = w(%4.3f) + %4.3f => ", a, pedge->w, threshold[a]);
-        threshold[a] = pedge->w + THRESHOLD(u->size(a), THRESHOLD_CONSTANT);
+        threshold[a] = pedge->w + THRESHOLD(u->size(a), threshold_c);
         if(GC_DEBUG)
           printf("%4.3f (size: %u)\n", threshold[a], u->size(a));
       }
     }
   }
 
+  // join small components along the cheapest edges
+  if(min_size > 1) {
+    for (unsigned i = 0; i < num_edges; i++) {
+      int a = u->find(edges[i].a);
+      int b = u->find(edges[i].b);
+      if (a != b && ((unsigned) u->size(a) < min_size || (unsigned) u->size(b) < min_size))
+        u->join(a, b);
+    }
+  }
+
   int num_components = u->num_sets();
-  if(GC_DEBUG) printf("[GraphCut::process] Number of components: %u => What does that mean?\n", num_components);
+  if(GC_DEBUG) printf("[GraphCut::process] Number of components: %u\n", num_components);
 
-  // copy graph cut groups
-  view->graphCutGroups.clear();
-  unsigned cut_labels[view->surfaces.size()];             // cut-ids for all models
-  std::set<unsigned> graphCutLabels;                      // all graph cut labels
-  for(unsigned i=0; i<view->surfaces.size(); i++) {
-    int cut_id = u->find(i);
-    cut_labels[i] = cut_id;
-    if(graphCutLabels.find(cut_id) == graphCutLabels.end())
-      graphCutLabels.insert(cut_id);
+  // edge list without view: components are read with getComponent
+  if(view == NULL) {
+    edges.clear();
+    initialized = false;
+    processed = true;
+    return;
   }
-  
-  std::set<unsigned>::iterator it;
-  for(it = graphCutLabels.begin(); it != graphCutLabels.end(); it++) {
-    std::vector<unsigned> cluster;
-    for(unsigned i=0; i< view->surfaces.size(); i++)
-      if(*it == cut_labels[i])
-        cluster.push_back(i);
-    view->graphCutGroups.push_back(cluster);
+
+  // copy graph cut groups, ordered by the id of the component root
+  unsigned nr_surfaces = view->surfaces.size();
+  std::vector<int> cut_labels(nr_surfaces);               // cut-ids for all models
+  std::vector<int> group(num_nodes, -1);                  // group of each cut-id (0 = used)
+  for(unsigned i=0; i<nr_surfaces; i++) {
+    cut_labels[i] = u->find(i);
+    group[cut_labels[i]] = 0;
   }
+  int nr_groups = 0;
+  for(unsigned i=0; i<num_nodes; i++)
+    if(group[i] == 0)
+      group[i] = nr_groups++;
+
+  view->graphCutGroups.clear();
+  view->graphCutGroups.resize(nr_groups);
+  for(unsigned i=0; i<nr_surfaces; i++)
+    view->graphCutGroups[group[cut_labels[i]]].push_back(i);
     
   for(unsigned i=0; i<view->graphCutGroups.size(); i++)
     for(unsigned j=0; j<view->graphCutGroups[i].size(); j++)
@@ -228,8 +309,7 @@ void GraphCut::process()
     }
   }
       
-  delete threshold;
-  delete []edges;
+  edges.clear();
   initialized = false;
   processed = true;
 }
@@ -0,0 +1,189 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file LinearPredictor.cpp
+ * @brief Predict relations with a linear model on the features or on random Fourier
+ * features (explicit feature map approximating the RBF kernel of the SVM).
+ */
+
+#include <unknown_objects_segmentation/LinearPredictor.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+namespace svm
+{
+
+/**
+ * @brief Constructor of LinearPredictor
+ * @param filename Model file
+ */
+LinearPredictor::LinearPredictor(std::string filename)
+{
+  assert(filename.size() != 0);
+
+  rff = false;
+  dim = 0;
+  nr_components = 0;
+  bias = 0.;
+  label[0] = 0;
+  label[1] = 1;
+  probA = probB = 0.;
+  if(!load(filename)) {
+    printf("[LinearPredictor::LinearPredictor] Error: Can't read model file: %s\n", filename.c_str());
+    nr_components = 0;
+  }
+
+  memset(&prob_model, 0, sizeof(prob_model));
+  prob_model.nr_class = 2;
+  prob_model.label = label;
+  prob_model.probA = &probA;
+  prob_model.probB = &probB;
+}
+
+LinearPredictor::~LinearPredictor()
+{
+}
+
+/**
+ * @brief Read the model file
+ */
+bool LinearPredictor::load(const std::string &filename)
+{
+  FILE *fp = fopen(filename.c_str(), "r");
+  if(fp == NULL)
+    return false;
+
+  char cmd[81];
+  bool ok = true;
+  while(ok && fscanf(fp, "%80s", cmd) == 1) {
+    if(strcmp(cmd, "model_type") == 0) {
+      ok = fscanf(fp, "%80s", cmd) == 1;
+      rff = strcmp(cmd, "rff") == 0;
+      ok = ok && (rff || strcmp(cmd, "linear") == 0);
+    }
+    else if(strcmp(cmd, "dim") == 0)
+      ok = fscanf(fp, "%d", &dim) == 1 && dim > 0;
+    else if(strcmp(cmd, "nr_components") == 0)
+      ok = fscanf(fp, "%d", &nr_components) == 1 && nr_components > 0;
+    else if(strcmp(cmd, "label") == 0)
+      ok = fscanf(fp, "%d %d", &label[0], &label[1]) == 2;
+    else if(strcmp(cmd, "probA") == 0)
+      ok = fscanf(fp, "%lf", &probA) == 1;
+    else if(strcmp(cmd, "probB") == 0)
+      ok = fscanf(fp, "%lf", &probB) == 1;
+    else if(strcmp(cmd, "bias") == 0)
+      ok = fscanf(fp, "%lf", &bias) == 1;
+    else if(strcmp(cmd, "w") == 0) {
+      ok = nr_components > 0;
+      w.resize(nr_components > 0 ? nr_components : 0);
+      for(int i=0; ok && i<nr_components; i++)
+        ok = fscanf(fp, "%lf", &w[i]) == 1;
+    }
+    else if(strcmp(cmd, "omega") == 0) {
+      ok = nr_components > 0 && dim > 0;
+      omega.resize(ok ? nr_components : 0, ok ? dim : 0);
+      for(int i=0; ok && i<nr_components; i++)
+        for(int j=0; ok && j<dim; j++)
+          ok = fscanf(fp, "%lf", &omega(i, j)) == 1;
+    }
+    else if(strcmp(cmd, "phase") == 0) {
+      ok = nr_components > 0;
+      phase.resize(nr_components > 0 ? nr_components : 0);
+      for(int i=0; ok && i<nr_components; i++)
+        ok = fscanf(fp, "%lf", &phase[i]) == 1;
+    }
+    else {
+      printf("[LinearPredictor::load] Error: Unknown text in model file: %s\n", cmd);
+      ok = false;
+    }
+  }
+  fclose(fp);
+
+  if(!ok || w.size() != nr_components)
+    return false;
+  if(rff)
+    return omega.rows() == nr_components && omega.cols() == dim && phase.size() == nr_components;
+  return nr_components == dim;
+}
+
+/** 
+ * @brief Classify all feature vectors of a view
+ * @param view View with surface models 
+ * @param type Type of relations to process (1=structural / 2= assembly level)
+ */
+bool LinearPredictor::classify(surface::View *view, unsigned type)
+{
+  if(!valid())
+    return false;
+
+  std::vector<unsigned> rels;
+  for(unsigned i=0; i<view->relations.size(); i++) {
+    if(view->relations[i].type == type) {
+      if(scale)
+        scaleValues(view->relations[i].rel_value);
+      rels.push_back(i);
+    }
+  }
+  int n = rels.size();
+  if(n == 0) {
+    CheckSmallPatches(view, 30);
+    return true;
+  }
+
+  features.setZero(n, dim);
+  for(int i=0; i<n; i++) {
+    const surface::RelationValues &vec = view->relations[rels[i]].rel_value;
+    for(unsigned k=0; k<vec.size() && (int) k<dim; k++)
+      features(i, k) = vec[k];
+  }
+
+  Eigen::VectorXd dec;
+  if(rff) {
+    phi.noalias() = features * omega.transpose();
+    double norm = sqrt(2. / nr_components);
+    for(int i=0; i<n; i++)
+      for(int j=0; j<nr_components; j++)
+        phi(i, j) = norm * cos(phi(i, j) + phase[j]);
+    dec.noalias() = phi * w;
+  }
+  else
+    dec.noalias() = features * w;
+
+  for(int i=0; i<n; i++) {
+    double dec_value = dec[i] + bias;
+    double prob_estimates[2];
+    surface::Relation &rel = view->relations[rels[i]];
+    rel.prediction = (bool) svm_predict_probability_values(&prob_model, &dec_value, prob_estimates);
+    rel.rel_probability.push_back(prob_estimates[0]);
+    rel.rel_probability.push_back(prob_estimates[1]);
+  }
+
+  CheckSmallPatches(view, 30);
+  return true;
+}
+
+} 
+
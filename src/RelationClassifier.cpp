@@ -0,0 +1,176 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file RelationClassifier.cpp
+ * @brief Base class for the classification of relations: Scaling of feature vectors.
+ */
+
+#include <unknown_objects_segmentation/RelationClassifier.h>
+
+namespace svm
+{
+
+/**
+ * @brief Constructor of RelationClassifier
+ */
+RelationClassifier::RelationClassifier()
+{
+  scale = false;
+  lower = -1.0;
+  upper = 1.0;
+}
+
+RelationClassifier::~RelationClassifier()
+{
+}
+
+/**
+ * @brief Set scaling for structural level with supplied model.
+ * @param _scale on/off
+ */
+void RelationClassifier::setScaling(bool _scale, std::string filename)
+{
+   assert(filename.size() != 0);
+
+  scale = _scale;
+  if(!scale)
+    return;
+  
+  double y_lower, y_upper;
+  double y_max, y_min;
+
+  lower = -1.0;
+  upper = 1.0;
+  y_max = -DBL_MAX;
+  y_min = DBL_MAX;
+  
+  int idx, c;
+  double fmin, fmax;
+  std::FILE *fp_restore = NULL;
+
+  fp_restore = fopen(filename.c_str(), "r");
+  if(fp_restore==NULL) {
+    printf("[RelationClassifier::setScaling] Error: Can't open file: %s.\n", filename.c_str());
+    scale = false;
+    return;
+  }
+#ifdef DEBUG
+  else
+    printf("[RelationClassifier] Opened scaling parameter file: %s\n", filename.c_str());
+#endif
+
+  if((c = fgetc(fp_restore)) == 'y') {
+    fscanf(fp_restore, "%lf %lf\n", &y_lower, &y_upper);
+    fscanf(fp_restore, "%lf %lf\n", &y_min, &y_max);
+  }
+  else
+    ungetc(c, fp_restore);
+
+  // feature ranges in one pass, features without range stay unscaled
+  feature_max.clear();
+  feature_min.clear();
+  if (fgetc(fp_restore) == 'x') {
+    fscanf(fp_restore, "%lf %lf\n", &lower, &upper);
+    while(fscanf(fp_restore,"%d %lf %lf\n",&idx,&fmin,&fmax)==3)
+    {
+      if(idx < 1)
+        continue;
+      if(idx > (int) feature_max.size()) {
+        feature_max.resize(idx, -DBL_MAX);
+        feature_min.resize(idx, DBL_MAX);
+      }
+      feature_min[idx-1] = fmin;
+      feature_max[idx-1] = fmax;
+    }
+  }
+  fclose(fp_restore);
+}
+
+void RelationClassifier::scaleValues(surface::RelationValues &val)
+{
+  //    printf("feature_max.size: %d  feature_min.size: %d val.size: %d\n",
+  //       feature_max.size(), feature_min.size(), val.size());
+  // if feature_max and feature_min are not prepared, skip
+  if(val.size() != feature_max.size() || val.size() != feature_min.size())
+  {
+      printf("[RelationClassifier::scaleValues] Warning: feature_max.size() != feature_min.size() != val.size()");
+      return;
+  }
+
+  for(unsigned index=0; index<val.size(); index++)
+  {
+    if(feature_max[index] == feature_min[index]) {
+      printf("[RelationClassifier::scaleValues] Warning: feature_max[index] == feature_min[index]: %4.3f\n", feature_max[index]);
+      return;
+    }
+  }
+
+  // scale in place
+  for(unsigned index=0; index<val.size(); index++)
+  {
+    double value = val[index];
+    if(value == feature_min[index])
+      value = lower;
+    else if(value == feature_max[index])
+      value = upper;
+    else
+      value = lower + (upper-lower) * 
+        (value-feature_min[index])/
+        (feature_max[index]-feature_min[index]);
+
+    val[index] = value;
+  }
+}
+
+/** HACK: We do not allow small patches to be connected to two big patches. **/
+void RelationClassifier::CheckSmallPatches(surface::View *view, unsigned max_size)
+{
+  for(unsigned i=0; i<view->surfaces.size(); i++) {
+    if(view->surfaces[i]->indices.size() < max_size) {
+      int biggest = -1;
+      double biggest_value = 0.0;
+      for(unsigned j=0; j<view->relations.size(); j++) {
+        if(view->relations[j].id_0 == i || view->relations[j].id_1 == i) {
+          if(view->relations[j].rel_probability[1] < biggest_value) {
+            view->relations[j].rel_probability[0] = 0.999;
+            view->relations[j].rel_probability[1] = 0.001;
+          }
+          else {
+            biggest_value = view->relations[j].rel_probability[1];
+            if(biggest != -1) {
+              view->relations[biggest].rel_probability[0] = 0.999;
+              view->relations[biggest].rel_probability[1] = 0.001;
+            }
+            biggest = j;
+          }
+        }
+      }
+    }
+  }      
+}
+
+
+
+} 
+
@@ -32,6 +32,11 @@
 #include <unknown_objects_segmentation/SVMPredictorSingle.h>
 #include <iostream>
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 namespace svm
 {
 
@@ -46,11 +51,25 @@ SVMPredictorSingle::SVMPredictorSingle(std::string filename)
 {
   assert(filename.size() != 0);
   
+  dense = false;
+  node = NULL;
+  model = NULL;
+  mapped_data = NULL;
+  mapped_size = 0;
   max_nr_attr = 64;
   predict_probability = true;
 
-  if((model = svm_load_model(filename.c_str())) == 0)
+  int binary = loadBinary(filename);
+  if(binary != 0) {
+    if(binary < 0)
+      printf("[SVMPredictorSingle::SVMPredictorSingle] Error: Can't load binary model file: %s\n", filename.c_str());
+    return;
+  }
+
+  if((model = svm_load_model(filename.c_str())) == 0) {
     printf("[SVMPredictorSingle::SVMPredictorSingle] Error: Can't open model file: %s\n", filename.c_str());
+    return;
+  }
   
 #ifdef DEBUG
   else
@@ -70,40 +89,210 @@ SVMPredictorSingle::SVMPredictorSingle(std::string filename)
     if(svm_check_probability_model(model) == 0)
       printf("[SVMPredictorSingle::SVMPredictorSingle] Warning: Model supports probability estimates, but disabled in prediction.");
   }
+  initDense();
 }
 
 /**
- * @brief Destructor of SVMPredictorSingle
+ * @brief Copy the support vectors of a probability RBF model to a dense matrix with
+ * precomputed squared norms for batched prediction.
  */
-SVMPredictorSingle::~SVMPredictorSingle()
+void SVMPredictorSingle::initDense()
 {
-  svm_free_and_destroy_model(&model);
-  free(node);
+  int svm_type = svm_get_svm_type(model);
+  dense = predict_probability && (svm_type == C_SVC || svm_type == NU_SVC) &&
+          model->param.kernel_type == RBF && svm_check_probability_model(model) != 0;
+  if(!dense)
+    return;
+
+  dim = 0;
+  for(int i=0; i<model->l; i++)
+    for(const svm_node *n = model->SV[i]; n->index != -1; n++)
+      dim = max(dim, n->index);
+
+  sv = DenseMatrix::Zero(model->l, dim);
+  for(int i=0; i<model->l; i++)
+    for(const svm_node *n = model->SV[i]; n->index != -1; n++)
+      sv(i, n->index-1) = n->value;
+  sv_norm = sv.rowwise().squaredNorm();
+  sv_data = sv.data();
+  sv_norm_data = sv_norm.data();
 }
 
+/**
+ * @brief Map a binary model file (see SVMBinaryHeader): The support vectors, norms and
+ * coefficients are used directly from the mapped memory.
+ * @return Returns 1 for a loaded binary model, 0 if the file is no binary model, -1 on error.
+ */
+int SVMPredictorSingle::loadBinary(const std::string &filename)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if(fd < 0)
+    return 0;
+
+  struct stat st;
+  char magic[8];
+  if(fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(SVMBinaryHeader) ||
+     read(fd, magic, 8) != 8 || memcmp(magic, "SVMBIN01", 8) != 0) {
+    close(fd);
+    return 0;
+  }
+
+  mapped_size = st.st_size;
+  mapped_data = mmap(NULL, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(mapped_data == MAP_FAILED) {
+    mapped_data = NULL;
+    return -1;
+  }
+
+  const SVMBinaryHeader &h = *(const SVMBinaryHeader*) mapped_data;
+  int k = h.nr_class;
+  int np = k*(k-1)/2;
+  size_t nr_doubles = 3*np + (k-1)*h.l + h.l*h.dim + h.l + 2*h.nr_features;
+  if(k < 2 || h.l <= 0 || h.dim <= 0 || h.nr_features < 0 || 
+     mapped_size != sizeof(SVMBinaryHeader) + nr_doubles*sizeof(double) + 2*k*sizeof(int)) {
+    freeModel();
+    return -1;
+  }
+
+  const double *d = (const double*) ((const char*) mapped_data + sizeof(SVMBinaryHeader));
+  model = (struct svm_model *) calloc(1, sizeof(struct svm_model));
+  model->param.svm_type = h.svm_type;
+  model->param.kernel_type = h.kernel_type;
+  model->param.gamma = h.gamma;
+  model->nr_class = k;
+  model->l = h.l;
+  model->rho = (double*) d;
+  model->probA = (double*) d + np;
+  model->probB = (double*) d + 2*np;
+  d += 3*np;
+  model->sv_coef = (double **) malloc((k-1)*sizeof(double*));
+  for(int i=0; i<k-1; i++)
+    model->sv_coef[i] = (double*) d + i*h.l;
+  d += (k-1)*h.l;
+  sv_data = d;
+  d += h.l*h.dim;
+  sv_norm_data = d;
+  d += h.l;
+  feature_min.assign(d, d + h.nr_features);
+  d += h.nr_features;
+  feature_max.assign(d, d + h.nr_features);
+  d += h.nr_features;
+  model->label = (int*) d;
+  model->nSV = (int*) d + k;
+  model->free_sv = 0;
+
+  dim = h.dim;
+  dense = true;
+  lower = h.lower;
+  upper = h.upper;
+  scale = h.nr_features > 0;
+  return 1;
+}
 
 /**
- * @brief Read a line from file.
- * @param input File to read from.
- * @return Returns one line of the file.
+ * @brief Free the (text or mapped) model
  */
-char* SVMPredictorSingle::readSCline(FILE *input)
+void SVMPredictorSingle::freeModel()
 {
-  int len;
-  
-  if(fgets(scline, max_line_len, input) == NULL)
-    return NULL;
-
-  while(strrchr(scline,'\n') == NULL) {
-    max_line_len *= 2;
-    scline = (char *) realloc(scline, max_line_len);
-    len = (int) strlen(scline);
-    if(fgets(scline+len,max_line_len-len,input) == NULL)
-      break;
+  if(mapped_data != NULL) {
+    if(model != NULL) {
+      free(model->sv_coef);
+      free(model);
+    }
+    munmap(mapped_data, mapped_size);
+    mapped_data = NULL;
+  }
+  else if(model != NULL)
+    svm_free_and_destroy_model(&model);
+  model = NULL;
+}
+
+/**
+ * @brief Load the binary model file (model_file + ".bin", with scaling), if available. A binary
+ * model older than the model or the scaling parameter file is stale: the text model is loaded.
+ * @param model_file Text model file
+ * @param param_file Scaling parameter file of the text model
+ */
+SVMPredictorSingle *SVMPredictorSingle::load(const std::string &model_file, const std::string &param_file)
+{
+  std::string binary_file = model_file + ".bin";
+  struct stat bin, txt;
+  if(stat(binary_file.c_str(), &bin) == 0) {
+    bool stale = (stat(model_file.c_str(), &txt) == 0 && txt.st_mtime > bin.st_mtime) ||
+                 (stat(param_file.c_str(), &txt) == 0 && txt.st_mtime > bin.st_mtime);
+    if(!stale)
+      return new SVMPredictorSingle(binary_file);
+    printf("[SVMPredictorSingle::load] Warning: Binary model %s is older than the model or the scaling parameters, loading %s.\n",
+           binary_file.c_str(), model_file.c_str());
   }
-  return scline;
+  SVMPredictorSingle *predictor = new SVMPredictorSingle(model_file);
+  predictor->setScaling(true, param_file);
+  return predictor;
 }
 
+/**
+ * @brief Save the dense model and the scaling ranges as binary model file.
+ * @param filename Binary model file
+ * @return Returns false for models without dense RBF kernel.
+ */
+bool SVMPredictorSingle::saveBinary(const std::string &filename)
+{
+  if(model == NULL || !dense) {
+    printf("[SVMPredictorSingle::saveBinary] Error: Only probability models with RBF kernel are supported.\n");
+    return false;
+  }
+
+  SVMBinaryHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, "SVMBIN01", 8);
+  h.svm_type = model->param.svm_type;
+  h.kernel_type = model->param.kernel_type;
+  h.nr_class = model->nr_class;
+  h.l = model->l;
+  h.dim = dim;
+  h.nr_features = (scale ? feature_min.size() : 0);
+  h.gamma = model->param.gamma;
+  h.lower = (scale ? lower : -1.);
+  h.upper = (scale ? upper : 1.);
+
+  FILE *fp = fopen(filename.c_str(), "wb");
+  if(fp == NULL) {
+    printf("[SVMPredictorSingle::saveBinary] Error: Can't open file: %s.\n", filename.c_str());
+    return false;
+  }
+  int k = h.nr_class;
+  int np = k*(k-1)/2;
+  bool ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+  ok = ok && fwrite(model->rho, sizeof(double), np, fp) == (size_t) np;
+  ok = ok && fwrite(model->probA, sizeof(double), np, fp) == (size_t) np;
+  ok = ok && fwrite(model->probB, sizeof(double), np, fp) == (size_t) np;
+  for(int i=0; i<k-1; i++)
+    ok = ok && fwrite(model->sv_coef[i], sizeof(double), h.l, fp) == (size_t) h.l;
+  ok = ok && fwrite(sv_data, sizeof(double), h.l*h.dim, fp) == (size_t) (h.l*h.dim);
+  ok = ok && fwrite(sv_norm_data, sizeof(double), h.l, fp) == (size_t) h.l;
+  if(h.nr_features > 0) {
+    ok = ok && fwrite(&feature_min[0], sizeof(double), h.nr_features, fp) == (size_t) h.nr_features;
+    ok = ok && fwrite(&feature_max[0], sizeof(double), h.nr_features, fp) == (size_t) h.nr_features;
+  }
+  ok = ok && fwrite(model->label, sizeof(int), k, fp) == (size_t) k;
+  ok = ok && fwrite(model->nSV, sizeof(int), k, fp) == (size_t) k;
+  fclose(fp);
+  if(!ok)
+    printf("[SVMPredictorSingle::saveBinary] Error: Can't write file: %s.\n", filename.c_str());
+  return ok;
+}
+
+/**
+ * @brief Destructor of SVMPredictorSingle
+ */
+SVMPredictorSingle::~SVMPredictorSingle()
+{
+  freeModel();
+  free(node);
+}
+
+
 /**
  * @brief Predict with SVM for a given vector.
  * @param type Type of feature vector: Type of svm-model (1, 2, ...)
@@ -111,7 +300,7 @@ char* SVMPredictorSingle::readSCline(FILE *input)
  * @param prob Probability of correct prediction for each class.
  * @return Returns the prediction label
  */
-bool SVMPredictorSingle::process(int type, std::vector<double> &vec, std::vector<double> &prob)
+bool SVMPredictorSingle::process(int type, surface::RelationValues &vec, surface::RelationProbabilities &prob)
 {
   int svm_type = svm_get_svm_type(model);
   int nr_class = svm_get_nr_class(model);
@@ -148,150 +337,6 @@ bool SVMPredictorSingle::process(int type, std::vector<double> &vec, std::vector
 }
 
 
-/**
- * @brief Set scaling for structural level with supplied model.
- * @param _scale on/off
- */
-void SVMPredictorSingle::setScaling(bool _scale, std::string filename)
-{
-   assert(filename.size() != 0);
-
-  if(!scale)
-      return;
-
-  scale = _scale;
-  
-  double y_lower, y_upper;
-  double y_max, y_min;
-
-  scline = NULL;
-  max_line_len = 1024;
-  lower = -1.0;
-  upper = 1.0;
-  y_max = -DBL_MAX;
-  y_min = DBL_MAX;
-  
-  int idx, c;
-  int max_index = 0;
-  double fmin, fmax;
-  std::FILE *fp_restore = NULL;
-
-  scline = (char *) malloc(max_line_len*sizeof(char)); // allocate line memory
-
-  fp_restore = fopen(filename.c_str(), "r");
-  if(fp_restore==NULL) {
-    printf("[SVMPredictorSingle::setScaling] Error: Can't open file: %s.\n", filename.c_str());
-    scale = false;
-    return;
-  }
-#ifdef DEBUG
-  else
-    printf("[SVMPredictorSingle] Opened scaling parameter file: %s\n", filename.c_str());
-#endif
-  c = fgetc(fp_restore);
-  if(c == 'y') {
-    readSCline(fp_restore);
-    readSCline(fp_restore);
-    readSCline(fp_restore);
-  }
-  readSCline(fp_restore);
-  readSCline(fp_restore);
-
-  while(fscanf(fp_restore,"%d %*f %*f\n",&idx) == 1)
-    max_index = max(idx,max_index);
-  rewind(fp_restore);
-  
-  feature_max.resize(max_index);
-  feature_min.resize(max_index);
-
-  for(int i=0;i<max_index;i++) {
-    feature_max[i]=-DBL_MAX;
-    feature_min[i]=DBL_MAX;
-  }
-  
-  if((c = fgetc(fp_restore)) == 'y') {
-    fscanf(fp_restore, "%lf %lf\n", &y_lower, &y_upper);
-    fscanf(fp_restore, "%lf %lf\n", &y_min, &y_max);
-  }
-  else
-    ungetc(c, fp_restore);
-
-  if (fgetc(fp_restore) == 'x') {
-    fscanf(fp_restore, "%lf %lf\n", &lower, &upper);
-    while(fscanf(fp_restore,"%d %lf %lf\n",&idx,&fmin,&fmax)==3)
-    {
-      if(idx<=max_index) {
-        feature_min[idx-1] = fmin;
-        feature_max[idx-1] = fmax;
-      }
-    }
-  }
-  fclose(fp_restore);
-  free(scline);
-}
-
-void SVMPredictorSingle::scaleValues(std::vector<double> &val)
-{
-  std::vector<double> scaled_val;
-  //    printf("feature_max.size: %d  feature_min.size: %d val.size: %d\n",
-  //       feature_max.size(), feature_min.size(), val.size());
-  // if feature_max and feature_min are not prepared, skip
-  if(val.size() != feature_max.size() || val.size() != feature_min.size())
-  {
-      printf("[SVMPredictorSingle::scaleValues] Warning: feature_max.size() != feature_min.size() != val.size()");
-      return;
-  }
-
-  for(unsigned index=0; index<val.size(); index++)
-  {
-    double value = val[index];
-    if(feature_max[index] == feature_min[index]) {
-      printf("[SVMPredictorSingle::scaleValues] Warning: feature_max[index] == feature_min[index]: %4.3f\n", feature_max[index]);
-      return;
-    }
-
-    if(value == feature_min[index])
-      value = lower;
-    else if(value == feature_max[index])
-      value = upper;
-    else
-      value = lower + (upper-lower) * 
-        (value-feature_min[index])/
-        (feature_max[index]-feature_min[index]);
-
-    scaled_val.push_back(value);
-  }
-  val = scaled_val;
-}
-
-/** HACK: We do not allow small patches to be connected to two big patches. **/
-void SVMPredictorSingle::CheckSmallPatches(surface::View *view, unsigned max_size)
-{
-  for(unsigned i=0; i<view->surfaces.size(); i++) {
-    if(view->surfaces[i]->indices.size() < max_size) {
-      int biggest = -1;
-      double biggest_value = 0.0;
-      for(unsigned j=0; j<view->relations.size(); j++) {
-        if(view->relations[j].id_0 == i || view->relations[j].id_1 == i) {
-          if(view->relations[j].rel_probability[1] < biggest_value) {
-            view->relations[j].rel_probability[0] = 0.999;
-            view->relations[j].rel_probability[1] = 0.001;
-          }
-          else {
-            biggest_value = view->relations[j].rel_probability[1];
-            if(biggest != -1) {
-              view->relations[biggest].rel_probability[0] = 0.999;
-              view->relations[biggest].rel_probability[1] = 0.001;
-            }
-            biggest = j;
-          }
-        }
-      }
-    }
-  }      
-}
-
-
 /**
  * @brief Process the relation extraction algorithm
  * @param type Type of SVM relation
@@ -299,8 +344,8 @@ void SVMPredictorSingle::CheckSmallPatches(surface::View *view, unsigned max_siz
  * @param prob Probability for correct predicton
  */
 bool SVMPredictorSingle::getResult(int type,
-                             std::vector<double> &val,
-                             std::vector<double> &prob)
+                             surface::RelationValues &val,
+                             surface::RelationProbabilities &prob)
 {
   if(scale)
     scaleValues(val);
@@ -308,6 +353,70 @@ bool SVMPredictorSingle::getResult(int type,
   return process(type, val, prob);
 }
 
+/**
+ * @brief Predict the relations of a batch with the dense model: RBF kernel values of all
+ * feature vectors and support vectors with one matrix product (||x||^2 + ||sv||^2 - 2 x*sv).
+ * @param view View with the relations
+ * @param rels Indices of the (scaled) relations to predict
+ */
+void SVMPredictorSingle::processDense(surface::View *view, const std::vector<unsigned> &rels)
+{
+  int n = rels.size();
+  int nr_class = model->nr_class;
+  double gamma = model->param.gamma;
+
+  Eigen::VectorXd f_norm(n);
+  features.setZero(n, dim);
+  for(int i=0; i<n; i++) {
+    const surface::RelationValues &vec = view->relations[rels[i]].rel_value;
+    f_norm[i] = 0.;
+    for(unsigned k=0; k<vec.size(); k++) {
+      if((int) k < dim)
+        features(i, k) = vec[k];
+      f_norm[i] += vec[k]*vec[k];
+    }
+  }
+  Eigen::Map<const DenseMatrix> SV(sv_data, model->l, dim);
+  kvalue.noalias() = features * SV.transpose();
+
+  std::vector<int> start(nr_class);
+  start[0] = 0;
+  for(int i=1; i<nr_class; i++)
+    start[i] = start[i-1]+model->nSV[i-1];
+
+#pragma omp parallel
+  {
+    // decision values and probabilities (same order as svm_predict_values), one buffer per thread
+    std::vector<double> dec_values(nr_class*(nr_class-1)/2);
+    std::vector<double> prob_estimates(nr_class);
+
+#pragma omp for
+    for(int r=0; r<n; r++) {
+      double *kv = &kvalue(r, 0);
+      for(int k=0; k<model->l; k++)
+        kv[k] = exp(-gamma*max(f_norm[r] + sv_norm_data[k] - 2.*kv[k], 0.));
+
+      int p = 0;
+      for(int i=0; i<nr_class; i++)
+        for(int j=i+1; j<nr_class; j++) {
+          double sum = 0;
+          double *coef1 = model->sv_coef[j-1];
+          double *coef2 = model->sv_coef[i];
+          for(int k=start[i]; k<start[i]+model->nSV[i]; k++)
+            sum += coef1[k] * kv[k];
+          for(int k=start[j]; k<start[j]+model->nSV[j]; k++)
+            sum += coef2[k] * kv[k];
+          dec_values[p] = sum - model->rho[p];
+          p++;
+        }
+      surface::Relation &rel = view->relations[rels[r]];
+      rel.prediction = (bool) svm_predict_probability_values(model, &dec_values[0], &prob_estimates[0]);
+      for(int j=0; j<nr_class; j++)
+        rel.rel_probability.push_back(prob_estimates[j]);
+    }
+  }
+}
+
 /** 
  * @brief Classify all feature vectors of a view
  * @param view View with surface models 
@@ -315,12 +424,29 @@ bool SVMPredictorSingle::getResult(int type,
  */
 bool SVMPredictorSingle::classify(surface::View *view, unsigned type)
 {
-  for(unsigned i=0; i<view->relations.size(); i++) {
-    if(view->relations[i].type == type)
-      view->relations[i].prediction = getResult(view->relations[i].type, 
-                                                view->relations[i].rel_value, 
-                                                view->relations[i].rel_probability);
-  }  
+  if(model == 0)
+    return false;
+
+  if(dense) {
+    std::vector<unsigned> rels;
+    for(unsigned i=0; i<view->relations.size(); i++) {
+      if(view->relations[i].type == type) {
+        if(scale)
+          scaleValues(view->relations[i].rel_value);
+        rels.push_back(i);
+      }
+    }
+    if(rels.size() > 0)
+      processDense(view, rels);
+  }
+  else {
+    for(unsigned i=0; i<view->relations.size(); i++) {
+      if(view->relations[i].type == type)
+        view->relations[i].prediction = getResult(view->relations[i].type, 
+                                                  view->relations[i].rel_value, 
+                                                  view->relations[i].rel_probability);
+    }  
+  }
   CheckSmallPatches(view, 30);
   return true;
 }
@@ -0,0 +1,153 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file SegmenterBatch.cpp
+ * @brief Segment several clouds or streams in parallel
+ */
+
+#include <unknown_objects_segmentation/SegmenterBatch.h>
+
+#include <stdio.h>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace segment
+{
+
+  SegmenterBatch::SegmenterBatch (std::string _model_path)
+    : model_path(_model_path)
+    , threads(0)
+    , framesInFlight(0)
+  {
+  }
+
+  void
+  SegmenterBatch::setFramesInFlight (int _frames)
+  {
+    framesInFlight = std::max(_frames, 0);
+    if (framesInFlight > 0 && (int) workers.size () > framesInFlight)
+      workers.resize (framesInFlight);       // release the memory of the unused segmenters
+  }
+
+  boost::shared_ptr<SegmenterLight>
+  SegmenterBatch::createSegmenter (bool stream) const
+  {
+    boost::shared_ptr<SegmenterLight> segmenter (new SegmenterLight (model_path));
+    SegmenterConfig c = config;
+    c.temporal = config.temporal && stream;
+    segmenter->setConfig (c);
+    return segmenter;
+  }
+
+  void
+  SegmenterBatch::configure ()
+  {
+    std::vector<boost::shared_ptr<SegmenterLight> > *all[2] = {&workers, &streams};
+    for (unsigned k = 0; k < 2; k++) {
+      SegmenterConfig c = config;
+      c.temporal = config.temporal && k == 1;
+      for (unsigned i = 0; i < all[k]->size (); i++)
+        (*all[k])[i]->setConfig (c);
+    }
+  }
+
+  void
+  SegmenterBatch::run (const std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &clouds,
+                       std::vector<boost::shared_ptr<SegmenterLight> > &segmenters, bool per_worker,
+                       std::vector<std::vector<unsigned short> > &labels, std::vector<unsigned> &nr_objects)
+  {
+    int nr_clouds = clouds.size ();
+    labels.resize (nr_clouds);
+    nr_objects.assign (nr_clouds, 0);
+    stats.assign (nr_clouds, SegmenterStats ());
+    if (nr_clouds == 0)
+      return;
+
+    // frames in parallel, the rest of the budget for the stages of each frame
+#ifdef _OPENMP
+    int budget = (threads > 0 ? threads : omp_get_max_threads ());
+#else
+    int budget = 1;                         // frames one after another
+#endif
+    int outer = std::min (nr_clouds, std::min (budget, framesInFlight > 0 ? framesInFlight : budget));
+    int inner = std::max (1, budget / outer);
+
+    // segmenters (and their svm models) outside the parallel region: svm_load_model is not reentrant
+    if (per_worker) {
+      while ((int) segmenters.size () < outer)
+        segmenters.push_back (createSegmenter (false));
+    }
+    else {
+      while ((int) segmenters.size () < nr_clouds)
+        segmenters.push_back (createSegmenter (true));
+    }
+
+#ifdef _OPENMP
+    int max_levels = omp_get_max_active_levels ();
+    omp_set_max_active_levels (2);
+#endif
+#pragma omp parallel num_threads(outer)
+    {
+#ifdef _OPENMP
+      omp_set_num_threads (inner);          // threads of the nested stage regions of this frame
+      int worker = omp_get_thread_num ();
+#else
+      int worker = 0;
+#endif
+
+#pragma omp for schedule(dynamic, 1)
+      for (int i = 0; i < nr_clouds; i++) {
+        pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = clouds[i];
+        if (cloud.get () == 0 || cloud->points.empty ()) {
+          labels[i].clear ();
+          continue;
+        }
+        SegmenterLight &segmenter = *segmenters[per_worker ? worker : i];
+        labels[i].resize (cloud->points.size ());
+        nr_objects[i] = segmenter.processPointCloudLabels (cloud, &labels[i][0]);
+        stats[i] = segmenter.getStats ();
+      }
+    }
+#ifdef _OPENMP
+    omp_set_max_active_levels (max_levels);
+#endif
+  }
+
+  void
+  SegmenterBatch::processBatch (const std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &clouds,
+                                std::vector<std::vector<unsigned short> > &labels, std::vector<unsigned> &nr_objects)
+  {
+    run (clouds, workers, true, labels, nr_objects);
+  }
+
+  void
+  SegmenterBatch::processStreams (const std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &clouds,
+                                  std::vector<std::vector<unsigned short> > &labels, std::vector<unsigned> &nr_objects)
+  {
+    run (clouds, streams, false, labels, nr_objects);
+  }
+
+} // end segment
@@ -32,31 +32,499 @@
 #include <unknown_objects_segmentation/SegmenterLight.h>
 
 #include <stdio.h>
+#include <algorithm>
 #include <pcl/io/pcd_io.h>
 
 namespace segment
 {
   
+  /* --------------- SegmenterStats --------------- */
+
+  /** Seconds since ticksBefore **/
+  static inline double
+  elapsed (double ticksBefore)
+  {
+    return (cv::getTickCount() - ticksBefore)/cv::getTickFrequency();
+  }
+
+  /** Load relation classifier of type (model file + ".linear" or ".rff" for the approximations) **/
+  static svm::RelationClassifier *
+  loadClassifier (int type, const std::string &model_file, const std::string &param_file)
+  {
+    if (type == CLASSIFIER_RBF)
+      return svm::SVMPredictorSingle::load (model_file, param_file);
+    svm::LinearPredictor *predictor = new svm::LinearPredictor (model_file + (type == CLASSIFIER_RFF ? ".rff" : ".linear"));
+    predictor->setScaling (true, param_file);
+    return predictor;
+  }
+
+  void
+  SegmenterStats::clear ()
+  {
+    t_normals = t_clustering = t_modeling = t_contours = 0.;
+    t_relations = t_svm = t_graphcut = t_total = 0.;
+    nr_points = nr_patches = nr_reassigned = 0;
+    nr_relations = nr_graph_edges = nr_objects = 0;
+    nr_dirty = nr_kept = 0;
+    pyramid_level = nr_refined = 0;
+  }
+
+  void
+  SegmenterStats::print () const
+  {
+    printf("[SegmenterLight] normals: %f clustering: %f modeling: %f contours: %f\n", t_normals, t_clustering, t_modeling, t_contours);
+    printf("[SegmenterLight] relations: %f svm: %f graphcut: %f => total: %f\n", t_relations, t_svm, t_graphcut, t_total);
+    printf("[SegmenterLight] points: %u patches: %u reassigned: %u relations: %u edges: %u objects: %u\n",
+           nr_points, nr_patches, nr_reassigned, nr_relations, nr_graph_edges, nr_objects);
+    if (nr_dirty > 0 || nr_kept > 0)
+      printf("[SegmenterLight] temporal: dirty: %u kept patches: %u\n", nr_dirty, nr_kept);
+    if (pyramid_level > 0)
+      printf("[SegmenterLight] pyramid: level: %u refined: %u\n", pyramid_level, nr_refined);
+  }
+
+  /* --------------- SegmenterConfig --------------- */
+
+  SegmenterConfig::SegmenterConfig (int _detail)
+    : fast(true)
+    , classifier(CLASSIFIER_RBF)
+    , pyramid(0)
+    , have_intrinsic(false)
+    , intrinsicFromCloud(false)
+    , fx(525.), fy(525.), cx(320.), cy(240.)
+    , pixelCheck(true)
+    , pixelCheckNeighbors(5)
+    , parallelClustering(false)
+    , temporal(false)
+    , temporalDepth(0.01)
+    , temporalColor(45)
+    , temporalRadius(5)
+    , temporalMaxDirty(0.5)
+    , unsupervised(false)
+    , unsupervisedThreshold(1.0)
+    , unsupervisedMinSize(300)
+    , weightColor(0.3), weightNormal(0.5), weightCurvature(0.2)
+  {
+    normals.adaptive = true;
+    const float kernel_radius[8] = {3, 3, 3, 3, 4, 5, 6, 7};
+    for (unsigned i = 0; i < 8; i++)
+      normals.kernel_radius[i] = kernel_radius[i];
+
+    setDetail (_detail);
+
+    pcl::on_nurbs::SequentialFitter::Parameter &nurbsParams = modeling.nurbsParams;
+    nurbsParams.order = 3;
+    nurbsParams.refinement = 0;
+    nurbsParams.iterationsQuad = 0;
+    nurbsParams.iterationsBoundary = 0;
+    nurbsParams.iterationsAdjust = 0;
+    nurbsParams.iterationsInterior = 3;
+    nurbsParams.forceBoundary = 100.0;
+    nurbsParams.forceBoundaryInside = 300.0;
+    nurbsParams.forceInterior = 1.0;
+    nurbsParams.stiffnessBoundary = 0.1;
+    nurbsParams.stiffnessInterior = 0.1;
+    nurbsParams.resolution = 16;
+    modeling.sigmaError = 0.003;
+    modeling.kappa1 = 0.008;
+    modeling.kappa2 = 1.0;
+    modeling.planePointsFixation = 8000;
+    modeling.z_max = 0.01;
+  }
+
+  void
+  SegmenterConfig::setDetail (int _detail)
+  {
+    detail = _detail;
+    clustering = clusteringPreset (detail);
+  }
+
+  void
+  SegmenterConfig::setIntrinsic (double _fx, double _fy, double _cx, double _cy)
+  {
+    have_intrinsic = true;
+    fx = _fx;
+    fy = _fy;
+    cx = _cx;
+    cy = _cy;
+  }
+
+  surface::ClusterNormalsToPlanes::Parameter
+  SegmenterConfig::clusteringPreset (int detail)
+  {
+    surface::ClusterNormalsToPlanes::Parameter param;
+    param.adaptive = true;
+    if(detail == 1) {
+      param.epsilon_c = 0.58;
+      param.omega_c = -0.002;
+    } else if (detail == 2) {
+      param.epsilon_c = 0.62;
+      param.omega_c = 0.0;
+    } 
+    return param;
+  }
+
+  /** Set the parameter name of the config file: returns false for unknown names **/
+  static bool
+  setConfigValue (SegmenterConfig &c, const std::string &name, double value)
+  {
+    if (name == "detail") c.setDetail ((int) value);
+    else if (name == "fast") c.fast = (value != 0.);
+    else if (name == "classifier") c.classifier = (int) value;
+    else if (name == "pyramid") c.pyramid = (int) value;
+    else if (name == "fx") {c.fx = value; c.have_intrinsic = true;}
+    else if (name == "fy") {c.fy = value; c.have_intrinsic = true;}
+    else if (name == "cx") {c.cx = value; c.have_intrinsic = true;}
+    else if (name == "cy") {c.cy = value; c.have_intrinsic = true;}
+    else if (name == "intrinsic_from_cloud") c.intrinsicFromCloud = (value != 0.);
+    else if (name == "normals_adaptive") c.normals.adaptive = (value != 0.);
+    else if (name == "normals_integral") c.normals.integral = (value != 0.);
+    else if (name == "normals_radius") c.normals.radius = value;
+    else if (name == "normals_kernel") c.normals.kernel = (int) value;
+    else if (name == "normals_kappa") c.normals.kappa = value;
+    else if (name == "normals_d") c.normals.d = value;
+    else if (name == "clustering_adaptive") c.clustering.adaptive = (value != 0.);
+    else if (name == "clustering_angle") c.clustering.thrAngle = value;
+    else if (name == "clustering_inlier_dist") c.clustering.inlDist = value;
+    else if (name == "clustering_min_points") c.clustering.minPoints = (int) value;
+    else if (name == "epsilon_c") c.clustering.epsilon_c = value;
+    else if (name == "epsilon_g") c.clustering.epsilon_g = value;
+    else if (name == "omega_c") c.clustering.omega_c = value;
+    else if (name == "omega_g") c.clustering.omega_g = value;
+    else if (name == "d_c") c.clustering.d_c = value;
+    else if (name == "pixel_check") c.pixelCheck = (value != 0.);
+    else if (name == "pixel_check_neighbors") c.pixelCheckNeighbors = (int) value;
+    else if (name == "parallel_clustering") c.parallelClustering = (value != 0.);
+    else if (name == "sigma_error") c.modeling.sigmaError = value;
+    else if (name == "kappa1") c.modeling.kappa1 = value;
+    else if (name == "kappa2") c.modeling.kappa2 = value;
+    else if (name == "plane_points_fixation") c.modeling.planePointsFixation = (int) value;
+    else if (name == "z_max") c.modeling.z_max = value;
+    else if (name == "prescreen") c.modeling.prescreen = (value != 0.);
+    else if (name == "temporal") c.temporal = (value != 0.);
+    else if (name == "temporal_depth") c.temporalDepth = value;
+    else if (name == "temporal_color") c.temporalColor = (int) value;
+    else if (name == "temporal_radius") c.temporalRadius = (int) value;
+    else if (name == "temporal_max_dirty") c.temporalMaxDirty = value;
+    else if (name == "unsupervised") c.unsupervised = (value != 0.);
+    else if (name == "unsupervised_threshold") c.unsupervisedThreshold = value;
+    else if (name == "unsupervised_min_size") c.unsupervisedMinSize = (unsigned) std::max (value, 1.);
+    else if (name == "weight_color") c.weightColor = value;
+    else if (name == "weight_normal") c.weightNormal = value;
+    else if (name == "weight_curvature") c.weightCurvature = value;
+    else return false;
+    return true;
+  }
+
+  bool
+  SegmenterConfig::load (const std::string &filename)
+  {
+    FILE *fp = fopen (filename.c_str (), "r");
+    if (fp == NULL) {
+      printf ("[SegmenterConfig::load] Error: Can't open %s.\n", filename.c_str ());
+      return false;
+    }
+    bool ok = true;
+    char line[256], name[64];
+    double value;
+    while (fgets (line, sizeof (line), fp) != NULL) {
+      if (sscanf (line, " %63s", name) != 1 || name[0] == '#')
+        continue;
+      if (sscanf (line, " %63s %lf", name, &value) != 2 || !setConfigValue (*this, name, value)) {
+        printf ("[SegmenterConfig::load] Warning: Unknown line in %s: %s", filename.c_str (), line);
+        ok = false;
+      }
+    }
+    fclose (fp);
+    return ok;
+  }
+
   /* --------------- SegmenterLight --------------- */
 
   SegmenterLight::SegmenterLight (std::string _model_path)
     : useStructuralLevel(true)
-    , fast(true)
     , model_path(_model_path)
-    , detail(2)
-  {}
+    , printStats(false)
+    , have_roi(false)
+    , have_indices(false)
+    , roi_x(0), roi_y(0), roi_width(0), roi_height(0)
+    , outputs(VIEW_OBJECTS)
+  {
+    nor.reset (new surface::ZAdaptiveNormals ());
+    clusterNormals.reset (new surface::ClusterNormalsToPlanes ());
+    coarseToFine.reset (new surface::CoarseToFine ());
+    surfModeling.reset (new surface::SurfaceModeling ());
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity ();
+    surfModeling->setExtrinsic (pose);
+
+    contourDet.reset (new surface::ContourDetector ());
+    stRel.reset (new surface::StructuralRelationsLight ());
+
+    setConfig (SegmenterConfig ());
+  }
+
+  void
+  SegmenterLight::setConfig (const SegmenterConfig &_config)
+  {
+    bool reload = (svm_structural.get () == 0 || _config.classifier != config.classifier);
+    config = _config;
+    setTemporalThresholds (config.temporalDepth, config.temporalColor, config.temporalRadius, config.temporalMaxDirty);
+    setUnsupervisedParameters (config.unsupervisedThreshold, config.unsupervisedMinSize,
+                               config.weightColor, config.weightNormal, config.weightCurvature);
+
+    nor->setParameter (config.normals);
+    clusterNormals->setParameter (config.clustering);
+    clusterNormals->setPixelCheck (config.pixelCheck, config.pixelCheckNeighbors);
+    clusterNormals->setParallel (config.parallelClustering);
+    surfModeling->param = config.modeling;
+    surfModeling->setIntrinsic (config.fx, config.fy, config.cx, config.cy);     // updated for each cloud
+
+    temporalState.valid = false;
+    updateStages ();
+    if (reload)
+      setClassifier (config.classifier);
+  }
+
+  void
+  SegmenterLight::setClassifier (int _classifier)
+  {
+    if (_classifier < CLASSIFIER_RBF || _classifier > CLASSIFIER_RFF) {
+      printf ("[SegmenterLight::setClassifier] Warning: Unknown classifier type %d, using the RBF svm.\n", _classifier);
+      _classifier = CLASSIFIER_RBF;
+    }
+    config.classifier = _classifier;
+    temporalState.valid = false;
+
+    // load both models once, the fast flag may change between frames
+    svm_structural.reset (loadClassifier (config.classifier, model_path + "/PP-Trainingsset.txt.scaled.model", model_path + "/param.txt"));
+    svm_structural_fast.reset (loadClassifier (config.classifier, model_path + "/PP-Trainingsset.txt.scaled.model.fast", model_path + "/param.txt.fast"));
+  }
+
+  void
+  SegmenterLight::setDetail (int _detail)
+  {
+    config.setDetail (_detail);
+    temporalState.valid = false;
+    clusterNormals->setParameter (config.clustering);
+  }
+
+  void
+  SegmenterLight::setTemporalThresholds (float depth, int color, int radius, float max_dirty)
+  {
+    config.temporalDepth = depth;
+    config.temporalColor = color;
+    config.temporalRadius = std::max(radius, 0);
+    config.temporalMaxDirty = max_dirty;
+    temporalState.valid = false;
+  }
+
+  void
+  SegmenterLight::updateStages ()
+  {
+    // dependencies of each item (bit i of ViewData), all on lower bits
+    unsigned relations_needs = VIEW_PATCHES | (config.fast ? 0 : VIEW_MODELS);
+    const unsigned needs[8] = {0, VIEW_NORMALS, VIEW_PATCHES, VIEW_PATCHES, VIEW_PATCHES,
+                               relations_needs, VIEW_RELATIONS, VIEW_CLASSES};
+    stages = outputs | VIEW_OBJECTS;
+    if (config.fast)
+      stages &= ~VIEW_MODELS;
+    for (int i = 7; i >= 0; i--)
+      if (stages & (1u << i))
+        stages |= needs[i];
+  }
+
+  void
+  SegmenterLight::computeBoundary (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud, surface::View &view)
+  {
+    if (!(stages & (VIEW_CONTOURS | VIEW_EDGELS)))
+      return;
+    contourDet->setInputCloud(pcl_cloud);
+    contourDet->setView(&view);
+    if (stages & VIEW_CONTOURS)
+      contourDet->computeContours();
+    if (stages & VIEW_EDGELS)
+      contourDet->computeEdgels();
+  }
+
+  void
+  SegmenterLight::setUnsupervisedParameters (float threshold, unsigned min_size, float w_color, float w_normal, float w_curvature)
+  {
+    config.unsupervisedThreshold = threshold;
+    config.unsupervisedMinSize = std::max(min_size, 1u);
+    config.weightColor = w_color;
+    config.weightNormal = w_normal;
+    config.weightCurvature = w_curvature;
+  }
+
+  void
+  SegmenterLight::setIntrinsic (double _fx, double _fy, double _cx, double _cy)
+  {
+    config.setIntrinsic (_fx, _fy, _cx, _cy);
+  }
+
+  bool
+  SegmenterLight::estimateIntrinsic (const pcl::PointCloud<pcl::PointXYZRGB> &cloud,
+                                     double &fx, double &fy, double &cx, double &cy)
+  {
+    // VGA default scaled to the cloud
+    double scale = cloud.width / 640.;
+    fx = fy = 525. * scale;
+    cx = cloud.width / 2.;
+    cy = cloud.height / 2.;
+    if (!cloud.isOrganized ())
+      return false;
+
+    // linear regression of the pixel coordinates on x/z and y/z (every 4th row and column)
+    double n = 0., sa = 0., su = 0., saa = 0., sau = 0., sb = 0., sv = 0., sbb = 0., sbv = 0.;
+    for (unsigned v = 0; v < cloud.height; v += 4) {
+      for (unsigned u = 0; u < cloud.width; u += 4) {
+        const pcl::PointXYZRGB &pt = cloud.points[v * cloud.width + u];
+        if (isnan (pt.z) || pt.z <= 0.)
+          continue;
+        double a = pt.x / pt.z, b = pt.y / pt.z;
+        n += 1.;
+        sa += a; su += u; saa += a * a; sau += a * u;
+        sb += b; sv += v; sbb += b * b; sbv += b * v;
+      }
+    }
+    double var_a = n * saa - sa * sa, var_b = n * sbb - sb * sb;
+    if (n < 100. || var_a < 1e-6 * n * n || var_b < 1e-6 * n * n)
+      return false;
+    fx = (n * sau - sa * su) / var_a;
+    cx = (su - fx * sa) / n;
+    fy = (n * sbv - sb * sv) / var_b;
+    cy = (sv - fy * sb) / n;
+    return true;
+  }
+
+  void
+  SegmenterLight::updateIntrinsic (const pcl::PointCloud<pcl::PointXYZRGB> &cloud)
+  {
+    // the configured intrinsics stay untouched: the estimate is for this cloud only
+    double fx = config.fx, fy = config.fy, cx = config.cx, cy = config.cy;
+    if (!config.have_intrinsic && (config.intrinsicFromCloud || pyramidLevel (cloud.width) > 0))
+      estimateIntrinsic (cloud, fx, fy, cx, cy);
+    surfModeling->setIntrinsic (fx, fy, cx, cy);
+  }
+
+  void
+  SegmenterLight::setROI (int x, int y, int width, int height)
+  {
+    have_roi = true;
+    have_indices = false;
+    roi_x = x;
+    roi_y = y;
+    roi_width = width;
+    roi_height = height;
+  }
+
+  void
+  SegmenterLight::setIndices (const std::vector<int> &_indices)
+  {
+    have_roi = false;
+    have_indices = true;
+    indices = _indices;
+  }
+
+  void
+  SegmenterLight::resetROI ()
+  {
+    have_roi = false;
+    have_indices = false;
+    indices.clear();
+  }
+
+  void
+  SegmenterLight::estimateNormals (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud)
+  {
+    nor->setInputCloud (pcl_cloud);
+    if(have_roi) {
+      nor->compute (roi_x, roi_y, roi_width, roi_height);
+      
+      // indices of the region of interest for the next stages
+      int u0 = std::max(roi_x, 0);
+      int v0 = std::max(roi_y, 0);
+      int u1 = std::min(roi_x + roi_width, (int) pcl_cloud->width);
+      int v1 = std::min(roi_y + roi_height, (int) pcl_cloud->height);
+      indices.clear();
+      for (int v = v0; v < v1; v++)
+        for (int u = u0; u < u1; u++)
+          indices.push_back(v*pcl_cloud->width + u);
+    }
+    else if(have_indices)
+      nor->compute (indices);
+    else
+      nor->compute ();
+  }
+
+  void
+  SegmenterLight::clusterPlanes (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud, surface::View &view)
+  {
+    clusterNormals->setInputCloud (pcl_cloud);
+    clusterNormals->setView (&view);
+    if(have_roi || have_indices) {
+      if(indices.size() == 0)     // empty region of interest: no planes
+        return;
+      clusterNormals->compute (indices);
+    }
+    else
+      clusterNormals->compute ();
+  }
+
+  int
+  SegmenterLight::pyramidLevel (unsigned width) const
+  {
+    if (have_roi || have_indices)
+      return 0;
+    if (config.pyramid >= 0)
+      return config.pyramid;
+    int level = 0;
+    while ((width >> level) > 640)
+      level++;
+    return level;
+  }
+
+  void
+  SegmenterLight::presegmentPyramid (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud, surface::View &view, int level)
+  {
+    double ticksBefore = cv::getTickCount();
+    coarseToFine->setLevel (level);
+    coarseToFine->setInputCloud (pcl_cloud);
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr &coarse = coarseToFine->getCoarseCloud ();
+    surface::View coarse_view;
+    coarse_view.pool = &surfacePool;
+    coarse_view.width = coarse->width;
+    coarse_view.height = coarse->height;
+    nor->setInputCloud (coarse);
+    nor->compute ();
+    nor->getNormals (coarse_view.normals);
+    stats.t_normals = elapsed(ticksBefore);
+
+    ticksBefore = cv::getTickCount();
+    clusterNormals->setInputCloud (coarse);
+    clusterNormals->setView (&coarse_view);
+    clusterNormals->compute ();
+    coarseToFine->setView (&view);
+    coarseToFine->compute (*coarse_view.normals, coarse_view.surfaces);
+    stats.t_clustering = elapsed(ticksBefore);
+    stats.nr_reassigned = clusterNormals->getNrReassigned();
+    stats.pyramid_level = level;
+    stats.nr_refined = coarseToFine->getNrRefined();
+  }
 
   void
   SegmenterLight::computeNormals (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &cloud_in,
                              pcl::PointCloud<pcl::Normal>::Ptr &normals_out)
   {
-    normals_out.reset (new pcl::PointCloud<pcl::Normal>);
-    surface::ZAdaptiveNormals::Parameter za_param;
-    za_param.adaptive = true;
-    surface::ZAdaptiveNormals nor (za_param);
-    nor.setInputCloud (cloud_in);
-    nor.compute ();
-    nor.getNormals (normals_out);
+    // first step of a new frame
+    surfacePool.Reset();
+    stats.clear();
+    stats.nr_points = cloud_in->points.size();
+
+    double ticksBefore = cv::getTickCount();
+    estimateNormals (cloud_in);
+    nor->getNormals (normals_out);
+    stats.t_normals = elapsed(ticksBefore);
+    stats.t_total += stats.t_normals;
   }
 
   void
@@ -64,59 +532,34 @@ namespace segment
                             pcl::PointCloud<pcl::Normal>::Ptr &normals_in,
                             std::vector<surface::SurfaceModel::Ptr> &surfaces_out)
   {
+    double ticksBefore = cv::getTickCount();
     surface::View view;
+    view.pool = &surfacePool;
     view.normals = normals_in;
-    surface::ClusterNormalsToPlanes::Parameter param;
-    param.adaptive = true;
-    if(detail == 1) {
-      param.epsilon_c = 0.58;
-      param.omega_c = -0.002;
-    } else if (detail == 2) {
-      param.epsilon_c = 0.62;
-      param.omega_c = 0.0;
-    } 
-    surface::ClusterNormalsToPlanes clusterNormals (param);
-    clusterNormals.setInputCloud (cloud_in);
-    clusterNormals.setView (&view);
-    clusterNormals.setPixelCheck (true, 5);
-    clusterNormals.compute ();
+    clusterPlanes (cloud_in, view);
     surfaces_out = view.surfaces;
+    stats.t_clustering = elapsed(ticksBefore);
+    stats.t_total += stats.t_clustering;
+    stats.nr_patches = surfaces_out.size();
+    stats.nr_reassigned = clusterNormals->getNrReassigned();
   }
 
   void
   SegmenterLight::computeSurfaces (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &cloud_in,
                               std::vector<surface::SurfaceModel::Ptr> &surfaces_in_out)
   {
+    double ticksBefore = cv::getTickCount();
     surface::View view;
+    view.pool = &surfacePool;
     view.surfaces = surfaces_in_out;
-    pcl::on_nurbs::SequentialFitter::Parameter nurbsParams;
-    nurbsParams.order = 3;
-    nurbsParams.refinement = 0;
-    nurbsParams.iterationsQuad = 0;
-    nurbsParams.iterationsBoundary = 0;
-    nurbsParams.iterationsAdjust = 0;
-    nurbsParams.iterationsInterior = 3;
-    nurbsParams.forceBoundary = 100.0;
-    nurbsParams.forceBoundaryInside = 300.0;
-    nurbsParams.forceInterior = 1.0;
-    nurbsParams.stiffnessBoundary = 0.1;
-    nurbsParams.stiffnessInterior = 0.1;
-    nurbsParams.resolution = 16;
-    surface::SurfaceModeling::Parameter sfmParams;
-    sfmParams.nurbsParams = nurbsParams;
-    sfmParams.sigmaError = 0.003;
-    sfmParams.kappa1 = 0.008;
-    sfmParams.kappa2 = 1.0;
-    sfmParams.planePointsFixation = 8000;
-    sfmParams.z_max = 0.01;
-    surface::SurfaceModeling surfModeling (sfmParams);
-    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity ();
-    surfModeling.setIntrinsic (525., 525., 320., 240.);
-    surfModeling.setExtrinsic (pose);
-    surfModeling.setInputCloud (cloud_in);
-    surfModeling.setView (&view);
-    surfModeling.compute ();
+    updateIntrinsic (*cloud_in);
+    surfModeling->setInputCloud (cloud_in);
+    surfModeling->setView (&view);
+    surfModeling->compute ();
     surfaces_in_out = view.surfaces;
+    stats.t_modeling = elapsed(ticksBefore);
+    stats.t_total += stats.t_modeling;
+    stats.nr_patches = surfaces_in_out.size();
   }
 
   void
@@ -124,38 +567,36 @@ namespace segment
                              std::vector<surface::SurfaceModel::Ptr> &surfaces_in_out,
                              pcl::PointCloud<pcl::PointXYZRGBL>::Ptr &cloud_out)
   {
-    // contour detector
+    double ticksBefore = cv::getTickCount();
+    double ticksStart = ticksBefore;
+
+    // contour detector (if requested)
     surface::View view;
     view.width = cloud_in->width;
     view.height = cloud_in->height;
     view.surfaces = surfaces_in_out;
     
-    surface::ContourDetector contourDet;
-    contourDet.setInputCloud(cloud_in);
-    contourDet.setView(&view);
-    contourDet.computeContours();
+    computeBoundary(cloud_in, view);
+    stats.t_contours = elapsed(ticksBefore);
     
-    surface::StructuralRelationsLight stRel;
-    stRel.setInputCloud(cloud_in);
-    stRel.setView(&view);
-    stRel.computeRelations();
-
-    // init model path
-    std::string svmStructuralModel;
-    std::string svmStructuralScaling;
-    svmStructuralModel = "PP-Trainingsset.txt.scaled.model";
-    svmStructuralScaling = "param.txt";
-  
-    svm::SVMPredictorSingle svm_structural(model_path + "/" + svmStructuralModel);
-    svm_structural.setScaling(true, model_path + "/" + svmStructuralScaling);
-    svm_structural.classify(&view, 1);
+    ticksBefore = cv::getTickCount();
+    stRel->setInputCloud(cloud_in);
+    stRel->setView(&view);
+    stRel->computeRelations();
+    stats.t_relations = elapsed(ticksBefore);
+
+    ticksBefore = cv::getTickCount();
+    svm_structural->classify(&view, 1);
+    stats.t_svm = elapsed(ticksBefore);
     
+    ticksBefore = cv::getTickCount();
     gc::GraphCut graphCut;
     #ifdef DEBUG
       graphCut.printResults(true);
     #endif
     if(graphCut.init(&view))
       graphCut.process();
+    stats.t_graphcut = elapsed(ticksBefore);
     
      for (unsigned i = 0; i < view.graphCutGroups.size (); i++)
        for (unsigned j = 0; j < view.graphCutGroups[i].size (); j++)
@@ -166,256 +607,479 @@ namespace segment
        for (unsigned j = 0; j < s->indices.size (); j++)
          cloud_out->at (s->indices[j]).label = s->label;
      }
+
+    stats.t_total += elapsed(ticksStart);
+    stats.nr_patches = view.surfaces.size();
+    stats.nr_relations = view.relations.size();
+    stats.nr_graph_edges = graphCut.getNrEdges();
+    stats.nr_objects = view.graphCutGroups.size();
+    if(printStats)
+      stats.print();
   }
 
-  pcl::PointCloud<pcl::PointXYZRGBL>::Ptr
-  SegmenterLight::processPointCloud (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud)
+  void
+  SegmenterLight::process (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud, surface::View &view)
   {
     double ticksBefore;
 
-    surface::View view;
+    stats.clear();
+    stats.nr_points = pcl_cloud->points.size();
+
+    // surface models of the last frame are recycled
+    surfacePool.Reset();
+    view.pool = &surfacePool;
     view.width = pcl_cloud->width;
     view.height = pcl_cloud->height;
 
-    pcl::PointCloud<pcl::PointXYZRGBL>::Ptr result (new pcl::PointCloud<pcl::PointXYZRGBL>);
-    pcl::copyPointCloud (*pcl_cloud, *result);
-
-    // calcuate normals
-    printf("Calculate normals\n"); ticksBefore = cv::getTickCount();
-    view.normals.reset (new pcl::PointCloud<pcl::Normal>);
-    surface::ZAdaptiveNormals::Parameter za_param;
-    za_param.adaptive = true;
-    surface::ZAdaptiveNormals nor (za_param);
-    nor.setInputCloud (pcl_cloud);
-    nor.compute ();
-    nor.getNormals (view.normals);
-    printf("It took: %f\n", (cv::getTickCount() - ticksBefore)/cv::getTickFrequency());
-
-    // adaptive clustering
-    printf("Adaptive clustering \n"); ticksBefore = cv::getTickCount();
-    surface::ClusterNormalsToPlanes::Parameter param;
-    param.adaptive = true;
-    if(detail == 1) {
-      param.epsilon_c = 0.58;
-      param.omega_c = -0.002;
-    } else if (detail == 2) {
-      param.epsilon_c = 0.62;
-      param.omega_c = 0.0;
-    } 
-    surface::ClusterNormalsToPlanes clusterNormals (param);
-    clusterNormals.setInputCloud (pcl_cloud);
-    clusterNormals.setView (&view);
-    clusterNormals.setPixelCheck (true, 5);
-    clusterNormals.compute ();
-    printf("It took: %f\n", (cv::getTickCount() - ticksBefore)/cv::getTickFrequency());
-
-    // model abstraction
-    printf("Model abstraction: %d \n", fast); ticksBefore = cv::getTickCount();
-    if(!fast) {
-      pcl::on_nurbs::SequentialFitter::Parameter nurbsParams;
-      nurbsParams.order = 3;
-      nurbsParams.refinement = 0;
-      nurbsParams.iterationsQuad = 0;
-      nurbsParams.iterationsBoundary = 0;
-      nurbsParams.iterationsAdjust = 0;
-      nurbsParams.iterationsInterior = 3;
-      nurbsParams.forceBoundary = 100.0;
-      nurbsParams.forceBoundaryInside = 300.0;
-      nurbsParams.forceInterior = 1.0;
-      nurbsParams.stiffnessBoundary = 0.1;
-      nurbsParams.stiffnessInterior = 0.1;
-      nurbsParams.resolution = 16;
-      surface::SurfaceModeling::Parameter sfmParams;
-      sfmParams.nurbsParams = nurbsParams;
-      sfmParams.sigmaError = 0.003;
-      sfmParams.kappa1 = 0.008;
-      sfmParams.kappa2 = 1.0;
-      sfmParams.planePointsFixation = 8000;
-      sfmParams.z_max = 0.01;
-      surface::SurfaceModeling surfModeling (sfmParams);
-      Eigen::Matrix4d pose = Eigen::Matrix4d::Identity ();
-      surfModeling.setIntrinsic (525., 525., 320., 240.);
-      surfModeling.setExtrinsic (pose);
-      surfModeling.setInputCloud (pcl_cloud);
-      surfModeling.setView (&view);
-      surfModeling.compute ();
+    if(config.unsupervised) {
+      processUnsupervised (pcl_cloud, view);
+      return;
     }
-    printf("It took: %f\n", (cv::getTickCount() - ticksBefore)/cv::getTickFrequency());
-
-    // contour detector
-    printf("Contour detector\n"); ticksBefore = cv::getTickCount();
-    surface::ContourDetector contourDet;
-    contourDet.setInputCloud(pcl_cloud);
-    contourDet.setView(&view);
-    contourDet.computeContours();
-    printf("It took: %f\n", (cv::getTickCount() - ticksBefore)/cv::getTickFrequency());
-    
-    // relations
-    printf("Relations\n"); ticksBefore = cv::getTickCount();
-    surface::StructuralRelationsLight stRel;
-    stRel.setInputCloud(pcl_cloud);
-    stRel.setView(&view);
-    stRel.computeRelations();
-    printf("It took: %f\n", (cv::getTickCount() - ticksBefore)/cv::getTickFrequency());
- 
-    // init svm model
-    printf("Init SVM model\n"); ticksBefore = cv::getTickCount();
-    std::string svmStructuralModel;
-    std::string svmStructuralScaling;
-    if(!fast) {
-      svmStructuralModel = "PP-Trainingsset.txt.scaled.model";
-      svmStructuralScaling = "param.txt";
-    } else {
-      svmStructuralModel = "PP-Trainingsset.txt.scaled.model.fast";
-      svmStructuralScaling = "param.txt.fast";
+
+    // warm start from the last frame or all stages from scratch
+    bool warm = config.temporal && processTemporal (pcl_cloud, view);
+    if(!warm) {
+      int level = pyramidLevel (pcl_cloud->width);
+      if(level > 0)
+        presegmentPyramid (pcl_cloud, view, level);
+      else {
+        // calcuate normals
+        ticksBefore = cv::getTickCount();
+        estimateNormals (pcl_cloud);
+        nor->getNormals (view.normals);
+        stats.t_normals = elapsed(ticksBefore);
+
+        // adaptive clustering
+        ticksBefore = cv::getTickCount();
+        clusterPlanes (pcl_cloud, view);
+        stats.t_clustering = elapsed(ticksBefore);
+        stats.nr_reassigned = clusterNormals->getNrReassigned();
+      }
+
+      // model abstraction
+      ticksBefore = cv::getTickCount();
+      if(stages & VIEW_MODELS) {
+        updateIntrinsic (*pcl_cloud);
+        surfModeling->setInputCloud (pcl_cloud);
+        surfModeling->setView (&view);
+        surfModeling->compute ();
+      }
+      stats.t_modeling = elapsed(ticksBefore);
+      stats.nr_patches = view.surfaces.size();
+
+      // contour detector (only for the caller, the relations use the patch image)
+      ticksBefore = cv::getTickCount();
+      computeBoundary (pcl_cloud, view);
+      stats.t_contours = elapsed(ticksBefore);
+
+      // relations
+      ticksBefore = cv::getTickCount();
+      stRel->setInputCloud(pcl_cloud);
+      stRel->setView(&view);
+      stRel->computeRelations();
+      stats.t_relations = elapsed(ticksBefore);
+
+      // svm classification
+      ticksBefore = cv::getTickCount();
+      if(!config.fast)
+        svm_structural->classify(&view, 1);
+      else
+        svm_structural_fast->classify(&view, 1);
+      stats.t_svm = elapsed(ticksBefore);
     }
-    printf("It took: %f\n", (cv::getTickCount() - ticksBefore)/cv::getTickFrequency());
-
-    // svm classification
-    printf("SVM classification\n"); ticksBefore = cv::getTickCount();
-    svm::SVMPredictorSingle svm_structural(model_path + "/" + svmStructuralModel);
-    svm_structural.setScaling(true, model_path + "/" + svmStructuralScaling);
-    svm_structural.classify(&view, 1);
-    printf("It took: %f\n", (cv::getTickCount() - ticksBefore)/cv::getTickFrequency());
-    
-    // graph cut
-    printf("Graphcut\n"); ticksBefore = cv::getTickCount();
+    if(config.temporal)
+      storeTemporal (*pcl_cloud, view, warm);
+
+    // graph cut (adds the missing relations, if graph is not fully connected)
+    ticksBefore = cv::getTickCount();
     gc::GraphCut graphCut;
     #ifdef DEBUG
       graphCut.printResults(true);
     #endif
     if(graphCut.init(&view))
       graphCut.process();
-    printf("It took: %f\n", (cv::getTickCount() - ticksBefore)/cv::getTickFrequency());
+    stats.t_graphcut = elapsed(ticksBefore);
+    stats.nr_relations = view.relations.size();
+    stats.nr_graph_edges = graphCut.getNrEdges();
+    stats.nr_objects = view.graphCutGroups.size();
+  }
 
-    // copy results
-    printf("Copy results\n"); ticksBefore = cv::getTickCount();
+  void
+  SegmenterLight::processUnsupervised (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud, surface::View &view)
+  {
+    double ticksBefore;
+
+    // calcuate normals
+    ticksBefore = cv::getTickCount();
+    estimateNormals (pcl_cloud);
+    nor->getNormals (view.normals);
+    stats.t_normals = elapsed(ticksBefore);
+    if((have_roi || have_indices) && indices.size() == 0)
+      return;
+
+    // pixel graph, edge costs from colour, normal angle and curvature (at most 1/3)
+    ticksBefore = cv::getTickCount();
+    std::vector<gc::Edge> edges;
+    unsigned nr_edges = 0;
+    gc::Graph graph;
+    if (!graph.BuildFromPointCloud (pcl_cloud, view.normals, edges, nr_edges))
+      return;
+    const pcl::PointCloud<pcl::Normal> &normals = *view.normals;
+#pragma omp parallel for
+    for (int i = 0; i < (int) nr_edges; i++) {
+      gc::Edge &e = edges[i];
+      float curv = std::max(normals.points[e.a].curvature, normals.points[e.b].curvature);
+      float c = (isnan(curv) ? 1.0f : std::min(3.0f*curv, 1.0f));
+      float n = std::min(e.w2/1.57f, 1.0f);
+      e.w = config.weightColor*e.w + config.weightNormal*n + config.weightCurvature*c;
+    }
+
+    // only edges inside the region of interest or the indices
+    std::vector<unsigned char> mask;
+    if(have_roi || have_indices) {
+      mask.assign(pcl_cloud->points.size(), 0);
+      for (unsigned i = 0; i < indices.size(); i++)
+        if(indices[i] >= 0 && indices[i] < (int) mask.size())
+          mask[indices[i]] = 1;
+      unsigned nr = 0;
+      for (unsigned i = 0; i < nr_edges; i++)
+        if(mask[edges[i].a] && mask[edges[i].b])
+          edges[nr++] = edges[i];
+      edges.resize(nr);
+    }
+    stats.t_clustering = elapsed(ticksBefore);
+    stats.nr_graph_edges = edges.size();
+
+    // merging and segments (ordered by their first pixel)
+    ticksBefore = cv::getTickCount();
+    gc::GraphCut graphCut;
+    graphCut.setThreshold(config.unsupervisedThreshold, config.unsupervisedMinSize);
+    if(graphCut.init(pcl_cloud->points.size(), edges)) {
+      graphCut.process();
+      std::vector<int> segment(pcl_cloud->points.size(), -1);             // segment of each component root
+      for (unsigned i = 0; i < pcl_cloud->points.size(); i++) {
+        if(isnan(pcl_cloud->points[i].z) || (!mask.empty() && !mask[i]))
+          continue;
+        int root = graphCut.getComponent(i);
+        if(graphCut.getComponentSize(root) < config.unsupervisedMinSize)
+          continue;
+        if(segment[root] < 0) {
+          segment[root] = view.surfaces.size();
+          view.surfaces.push_back(view.NewSurface());
+          view.surfaces.back()->idx = segment[root];
+          view.surfaces.back()->label = segment[root];
+        }
+        view.surfaces[segment[root]]->indices.push_back(i);
+      }
+    }
+    view.graphCutGroups.resize(view.surfaces.size());
+    for (unsigned i = 0; i < view.surfaces.size(); i++)
+      view.graphCutGroups[i].assign(1, i);
+    stats.t_graphcut = elapsed(ticksBefore);
+    stats.nr_patches = view.surfaces.size();
+    stats.nr_objects = view.graphCutGroups.size();
+  }
+
+  unsigned
+  SegmenterLight::detectChanges (const pcl::PointCloud<pcl::PointXYZRGB> &cloud)
+  {
+    const TemporalState &st = temporalState;
+    int width = cloud.width, height = cloud.height;
+    unsigned nr_pixels = cloud.points.size ();
+
+    // changed pixels: depth (noise grows with z^2), valid/invalid or colour
+    std::vector<unsigned char> changed (nr_pixels, 0);
+#pragma omp parallel for
+    for (int i = 0; i < (int) nr_pixels; i++) {
+      const pcl::PointXYZRGB &pt = cloud.points[i];
+      float z0 = st.z[i];
+      bool valid = !isnan (pt.z), valid0 = !isnan (z0);
+      if (valid != valid0)
+        changed[i] = 1;
+      else if (valid && fabs (pt.z - z0) > config.temporalDepth * pt.z * pt.z)
+        changed[i] = 1;
+      else {
+        uint32_t c = pt.rgba, c0 = st.rgb[i];
+        int diff = abs ((int) ((c >> 16) & 0xff) - (int) ((c0 >> 16) & 0xff)) +
+                   abs ((int) ((c >> 8) & 0xff) - (int) ((c0 >> 8) & 0xff)) +
+                   abs ((int) (c & 0xff) - (int) (c0 & 0xff));
+        changed[i] = (diff > config.temporalColor);
+      }
+    }
+
+    // dilate with a separable box: the normals and borders of the neighbourhood change as well
+    int r = config.temporalRadius;
+    std::vector<unsigned char> rows (nr_pixels, 0);
+#pragma omp parallel for
+    for (int v = 0; v < height; v++) {
+      const unsigned char *c = &changed[v * width];
+      unsigned char *d = &rows[v * width];
+      int count = 0;
+      for (int u = 0; u < std::min (r, width); u++)
+        count += c[u];
+      for (int u = 0; u < width; u++) {
+        if (u + r < width)
+          count += c[u + r];
+        if (u - r - 1 >= 0)
+          count -= c[u - r - 1];
+        d[u] = (count > 0);
+      }
+    }
+    dirty.assign (nr_pixels, 0);
+    unsigned nr_dirty = 0;
+#pragma omp parallel for reduction(+:nr_dirty)
+    for (int u = 0; u < width; u++) {
+      int count = 0;
+      for (int v = 0; v < std::min (r, height); v++)
+        count += rows[v * width + u];
+      for (int v = 0; v < height; v++) {
+        if (v + r < height)
+          count += rows[(v + r) * width + u];
+        if (v - r - 1 >= 0)
+          count -= rows[(v - r - 1) * width + u];
+        if (count > 0) {
+          dirty[v * width + u] = 1;
+          nr_dirty++;
+        }
+      }
+    }
+    return nr_dirty;
+  }
+
+  bool
+  SegmenterLight::processTemporal (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud, surface::View &view)
+  {
+    TemporalState &st = temporalState;
+    if (!st.valid || !config.fast || have_roi || have_indices || pyramidLevel (pcl_cloud->width) > 0 ||
+        st.width != pcl_cloud->width || st.height != pcl_cloud->height)
+      return false;
 
-    printf("graphCutGroups.size(): %d \n", view.graphCutGroups.size());
+    // dirty pixels: too many changes are faster from scratch
+    double ticksBefore = cv::getTickCount();
+    unsigned nr_pixels = pcl_cloud->points.size ();
+    unsigned nr_dirty = detectChanges (*pcl_cloud);
+    if (nr_dirty > config.temporalMaxDirty * nr_pixels)
+      return false;
+    stats.nr_dirty = nr_dirty;
 
+    // normals of the dirty pixels, all other normals are kept (copy: the last view keeps its normals)
+    view.normals.reset (new pcl::PointCloud<pcl::Normal> (*st.normals));
+    std::vector<int> dirty_indices;
+    dirty_indices.reserve (nr_dirty);
+    for (unsigned i = 0; i < nr_pixels; i++)
+      if (dirty[i])
+        dirty_indices.push_back (i);
+    if (!dirty_indices.empty ()) {
+      pcl::PointCloud<pcl::Normal>::Ptr dirty_normals;
+      nor->setInputCloud (pcl_cloud);
+      nor->compute (dirty_indices);
+      nor->getNormals (dirty_normals);
+      for (unsigned i = 0; i < dirty_indices.size (); i++)
+        view.normals->points[dirty_indices[i]] = dirty_normals->points[dirty_indices[i]];
+    }
+    stats.t_normals = elapsed(ticksBefore);
+
+    // keep the patches without dirty pixels, cluster the rest again (dirty pixels and changed patches)
+    ticksBefore = cv::getTickCount();
+    std::vector<int> new_id (st.surfaces.size (), -1);
+    std::vector<bool> update;
+    for (unsigned i = 0; i < st.surfaces.size (); i++) {
+      const std::vector<int> &indices = st.surfaces[i]->indices;
+      bool changed = false;
+      for (unsigned j = 0; j < indices.size () && !changed; j++)
+        changed = (dirty[indices[j]] == 1);
+      if (!changed) {
+        // copy: the ids and neighbours are rewritten for this view
+        new_id[i] = view.surfaces.size ();
+        view.surfaces.push_back (view.NewSurface ());
+        *view.surfaces.back () = *st.surfaces[i];
+        update.push_back (false);
+      }
+      else
+        for (unsigned j = 0; j < indices.size (); j++)
+          if (dirty[indices[j]] == 0)
+            dirty[indices[j]] = 2;
+    }
+    stats.nr_kept = view.surfaces.size ();
+    std::vector<int> region;
+    for (unsigned i = 0; i < nr_pixels; i++)
+      if (dirty[i])
+        region.push_back (i);
+    if (!region.empty ()) {
+      surface::View reclustered;
+      reclustered.pool = &surfacePool;
+      reclustered.width = view.width;
+      reclustered.height = view.height;
+      reclustered.normals = view.normals;
+      clusterNormals->setInputCloud (pcl_cloud);
+      clusterNormals->setView (&reclustered);
+      clusterNormals->compute (region);
+      stats.nr_reassigned = clusterNormals->getNrReassigned();
+      view.surfaces.insert (view.surfaces.end (), reclustered.surfaces.begin (), reclustered.surfaces.end ());
+      update.resize (view.surfaces.size (), true);
+    }
+    for (unsigned i = 0; i < view.surfaces.size (); i++)
+      view.surfaces[i]->idx = i;
+    view.InvalidatePatchTable ();
+    stats.t_clustering = elapsed(ticksBefore);
+    stats.nr_patches = view.surfaces.size();
+
+    // contours of all patches (if requested), relations only of pairs with a new patch
+    ticksBefore = cv::getTickCount();
+    computeBoundary (pcl_cloud, view);
+    stats.t_contours = elapsed(ticksBefore);
+
+    ticksBefore = cv::getTickCount();
+    stRel->setInputCloud(pcl_cloud);
+    stRel->setView(&view);
+    stRel->computeRelations(update);
+    stats.t_relations = elapsed(ticksBefore);
+
+    // classify the new relations, the relations between kept patches are copied with their probabilities
+    ticksBefore = cv::getTickCount();
+    if (!view.relations.empty ())
+      svm_structural_fast->classify(&view, 1);
+    for (unsigned i = 0; i < st.relations.size (); i++) {
+      const surface::Relation &r = st.relations[i];
+      if (new_id[r.id_0] < 0 || new_id[r.id_1] < 0)
+        continue;
+      view.relations.push_back (r);
+      view.relations.back ().id_0 = new_id[r.id_0];
+      view.relations.back ().id_1 = new_id[r.id_1];
+    }
+    stats.t_svm = elapsed(ticksBefore);
+    return true;
+  }
+
+  void
+  SegmenterLight::storeTemporal (const pcl::PointCloud<pcl::PointXYZRGB> &cloud, const surface::View &view, bool warm)
+  {
+    TemporalState &st = temporalState;
+    if (!config.fast || have_roi || have_indices || pyramidLevel (cloud.width) > 0) {
+      st.valid = false;
+      return;
+    }
+
+    // reference of the normals: pixels with recomputed normals
+    unsigned nr_pixels = cloud.points.size ();
+    if (!warm) {
+      st.z.resize (nr_pixels);
+      st.rgb.resize (nr_pixels);
+    }
+    for (unsigned i = 0; i < nr_pixels; i++) {
+      if (!warm || dirty[i] == 1) {
+        st.z[i] = cloud.points[i].z;
+        st.rgb[i] = cloud.points[i].rgba;
+      }
+    }
+    st.width = cloud.width;
+    st.height = cloud.height;
+    st.normals = view.normals;
+    st.surfaces = view.surfaces;
+    st.relations = view.relations;
+    st.valid = true;
+  }
+
+  pcl::PointCloud<pcl::PointXYZRGBL>::Ptr
+  SegmenterLight::processPointCloud (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud)
+  {
+    pcl::PointCloud<pcl::PointXYZRGBL>::Ptr result (new pcl::PointCloud<pcl::PointXYZRGBL>);
+    processPointCloud (pcl_cloud, *result);
+    return result;
+  }
+
+  void
+  SegmenterLight::processPointCloud (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud,
+                                     pcl::PointCloud<pcl::PointXYZRGBL> &result)
+  {
+    double ticksBefore = cv::getTickCount();
+
+    // copy points, all labels 0 (the result may hold the labels of the last frame)
+    result.header = pcl_cloud->header;
+    result.width = pcl_cloud->width;
+    result.height = pcl_cloud->height;
+    result.is_dense = pcl_cloud->is_dense;
+    result.points.resize (pcl_cloud->points.size ());
+    for (unsigned i = 0; i < pcl_cloud->points.size (); i++) {
+      const pcl::PointXYZRGB &pt = pcl_cloud->points[i];
+      pcl::PointXYZRGBL &res = result.points[i];
+      res.x = pt.x;
+      res.y = pt.y;
+      res.z = pt.z;
+      res.rgba = pt.rgba;
+      res.label = 0;
+    }
+
+    surface::View view;
+    process (pcl_cloud, view);
+
+    // copy results
     for (unsigned i = 0; i < view.graphCutGroups.size(); i++)
       for (unsigned j = 0; j < view.graphCutGroups[i].size (); j++)
         view.surfaces[view.graphCutGroups[i][j]]->label = i;
     for (unsigned i = 0; i < view.surfaces.size(); i++) {
       for (unsigned j = 0; j < view.surfaces[i]->indices.size (); j++) {
-        result->points[view.surfaces[i]->indices[j]].label = view.surfaces[i]->label;
+        result.points[view.surfaces[i]->indices[j]].label = view.surfaces[i]->label;
       }
     }
-    printf("It took: %f\n", (cv::getTickCount() - ticksBefore)/cv::getTickFrequency());
 
-    return result;
+    stats.t_total = elapsed(ticksBefore);
+    if(printStats)
+      stats.print();
   }
 
   
   std::vector<pcl::PointIndices>
   SegmenterLight::processPointCloudV (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud)
   {
+    double ticksBefore = cv::getTickCount();
+
     surface::View view;
-    view.width = pcl_cloud->width;
-    view.height = pcl_cloud->height;
-    
-    pcl::PointCloud<pcl::PointXYZRGBL>::Ptr result (new pcl::PointCloud<pcl::PointXYZRGBL>);
-    pcl::copyPointCloud (*pcl_cloud, *result);
+    process (pcl_cloud, view);
 
-    // calcuate normals
-    view.normals.reset (new pcl::PointCloud<pcl::Normal>);
-    surface::ZAdaptiveNormals::Parameter za_param;
-    za_param.adaptive = true;
-    surface::ZAdaptiveNormals nor (za_param);
-    nor.setInputCloud (pcl_cloud);
-    nor.compute ();
-    nor.getNormals (view.normals);
-
-    // adaptive clustering
-    surface::ClusterNormalsToPlanes::Parameter param;
-    param.adaptive = true;
-    if(detail == 1) {
-      param.epsilon_c = 0.58;
-      param.omega_c = -0.002;
-    } else if (detail == 2) {
-      param.epsilon_c = 0.62;
-      param.omega_c = 0.0;
-    } 
-    surface::ClusterNormalsToPlanes clusterNormals (param);
-    clusterNormals.setInputCloud (pcl_cloud);
-    clusterNormals.setView (&view);
-    clusterNormals.setPixelCheck (true, 5);
-    clusterNormals.compute ();
-
-    // model abstraction
-    if(!fast) {
-      pcl::on_nurbs::SequentialFitter::Parameter nurbsParams;
-      nurbsParams.order = 3;
-      nurbsParams.refinement = 0;
-      nurbsParams.iterationsQuad = 0;
-      nurbsParams.iterationsBoundary = 0;
-      nurbsParams.iterationsAdjust = 0;
-      nurbsParams.iterationsInterior = 3;
-      nurbsParams.forceBoundary = 100.0;
-      nurbsParams.forceBoundaryInside = 300.0;
-      nurbsParams.forceInterior = 1.0;
-      nurbsParams.stiffnessBoundary = 0.1;
-      nurbsParams.stiffnessInterior = 0.1;
-      nurbsParams.resolution = 16;
-      surface::SurfaceModeling::Parameter sfmParams;
-      sfmParams.nurbsParams = nurbsParams;
-      sfmParams.sigmaError = 0.003;
-      sfmParams.kappa1 = 0.008;
-      sfmParams.kappa2 = 1.0;
-      sfmParams.planePointsFixation = 8000;
-      sfmParams.z_max = 0.01;
-      surface::SurfaceModeling surfModeling (sfmParams);
-      Eigen::Matrix4d pose = Eigen::Matrix4d::Identity ();
-      surfModeling.setIntrinsic (525., 525., 320., 240.);
-      surfModeling.setExtrinsic (pose);
-      surfModeling.setInputCloud (pcl_cloud);
-      surfModeling.setView (&view);
-      surfModeling.compute ();
+    std::vector<pcl::PointIndices> results;
+    results.resize (view.graphCutGroups.size ());
+    for (unsigned i = 0; i < view.graphCutGroups.size (); i++) {
+      const std::vector<unsigned> &group = view.graphCutGroups[i];
+      unsigned nr_points = 0;
+      for (unsigned j = 0; j < group.size (); j++)
+        nr_points += view.surfaces[group[j]]->indices.size ();
+      std::vector<int> &indices = results[i].indices;
+      indices.reserve (nr_points);
+      for (unsigned j = 0; j < group.size (); j++) {
+        const std::vector<int> &surface_indices = view.surfaces[group[j]]->indices;
+        indices.insert (indices.end (), surface_indices.begin (), surface_indices.end ());
+      }
     }
 
-    // contour detector
-    surface::ContourDetector contourDet;
-    contourDet.setInputCloud(pcl_cloud);
-    contourDet.setView(&view);
-    contourDet.computeContours();
-    
-    // relations
-    surface::StructuralRelationsLight stRel;
-    stRel.setInputCloud(pcl_cloud);
-    stRel.setView(&view);
-    stRel.computeRelations();
- 
-    // init svm model
-    std::string svmStructuralModel;
-    std::string svmStructuralScaling;
-    if(!fast) {
-      svmStructuralModel = "PP-Trainingsset.txt.scaled.model";
-      svmStructuralScaling = "param.txt";
-    } else {
-      svmStructuralModel = "PP-Trainingsset.txt.scaled.model.fast";
-      svmStructuralScaling = "param.txt.fast";
+    stats.t_total = elapsed(ticksBefore);
+    if(printStats)
+      stats.print();
+    return results;
+  }
+
+  unsigned
+  SegmenterLight::processPointCloudLabels (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud, unsigned short *labels)
+  {
+    double ticksBefore = cv::getTickCount();
+
+    surface::View view;
+    process (pcl_cloud, view);
+
+    std::fill (labels, labels + pcl_cloud->points.size (), 0);
+    for (unsigned i = 0; i < view.graphCutGroups.size (); i++) {
+      unsigned short label = (unsigned short) std::min (i + 1, 65535u);
+      for (unsigned j = 0; j < view.graphCutGroups[i].size (); j++) {
+        const std::vector<int> &indices = view.surfaces[view.graphCutGroups[i][j]]->indices;
+        for (unsigned k = 0; k < indices.size (); k++)
+          labels[indices[k]] = label;
+      }
     }
-    
-    // svm classification
-    svm::SVMPredictorSingle svm_structural(model_path + "/" + svmStructuralModel);
-    svm_structural.setScaling(true, model_path + "/" + svmStructuralScaling);
-    svm_structural.classify(&view, 1);
-    
-    // graph cut
-    gc::GraphCut graphCut;
-    #ifdef DEBUG
-      graphCut.printResults(true);
-    #endif
-    if(graphCut.init(&view))
-      graphCut.process();
 
-    std::vector<pcl::PointIndices> results;
-    results.resize (view.graphCutGroups.size ());
-    for (unsigned i = 0; i < view.graphCutGroups.size (); i++)
-      for (unsigned j = 0; j < view.graphCutGroups[i].size (); j++)
-        for (unsigned k = 0; k < view.surfaces[view.graphCutGroups[i][j]]->indices.size (); k++)
-          results[i].indices.push_back(view.surfaces[view.graphCutGroups[i][j]]->indices[k]);
-    return results;
+    stats.t_total = elapsed(ticksBefore);
+    if(printStats)
+      stats.print();
+    return view.graphCutGroups.size ();
   }
 
 } // end segment
@@ -31,9 +31,19 @@
 
 #include <unknown_objects_segmentation/StructuralRelationsLight.h>
 
+#include <algorithm>
+
 namespace surface
 {
 
+/** Sort neighbouring patch pairs by p0, p1 **/
+inline bool CmpNeighborPair(const NeighborPair &a, const NeighborPair &b)
+{
+  if(a.p0 != b.p0)
+    return a.p0 < b.p0;
+  return a.p1 < b.p1;
+}
+
 
 /************************************************************************************
  * Constructor/Destructor
@@ -58,111 +68,58 @@ void StructuralRelationsLight::computeNeighbors()
 {
   double z_max = 0.01;
   
-  cv::Mat_<int> patches;
-  if(view->havePatchImage) {
-    patches = cv::Mat_<int>(pcl_cloud->height, pcl_cloud->width);
-    view->patchImage.copyTo(patches);
-  }
-  else {
-    patches = cv::Mat_<int>(pcl_cloud->height, pcl_cloud->width);
-    patches.setTo(-1);
-    for(unsigned i=0; i<view->surfaces.size(); i++)
-      for(unsigned j=0; j<view->surfaces[i]->indices.size(); j++)
-        patches.at<int>(view->surfaces[i]->indices[j] / pcl_cloud->width, view->surfaces[i]->indices[j] % pcl_cloud->width) = i;
-    patches.copyTo(view->patchImage);
-  }
+  const cv::Mat_<int> &patches = view->GetPatchImage();
   unsigned nr_patches = view->surfaces.size();
 
-  bool nbgh_matrix3D[nr_patches][nr_patches];
-  bool nbgh_matrix2D[nr_patches][nr_patches];
-  for(unsigned i=0; i<nr_patches; i++)
-    for(unsigned j=0; j<nr_patches; j++) {
-      nbgh_matrix3D[i][j] = false;
-      nbgh_matrix2D[i][j] = false;
-    }
-  
+  // collect neighbouring pairs (upper, left, upper-left pixel)
+  int offsets[3] = {-(int)pcl_cloud->width, -1, -(int)pcl_cloud->width-1};
+  const int *p = (const int*) patches.data;
+  std::vector<NeighborPair> pairs;
   for(int row=1; row<patches.rows; row++) { //1ms
     for(int col=1; col<patches.cols; col++) {
-      if(patches.at<int>(row, col) != -1) {
-        if(patches.at<int>(row-1, col) != -1) {
-          if(patches.at<int>(row, col) != patches.at<int>(row-1, col)) {
-            int pos_0 = row*pcl_cloud->width+col;
-            int pos_1 = (row-1)*pcl_cloud->width+col;
-            double dis = fabs(pcl_cloud->points[pos_0].z - pcl_cloud->points[pos_1].z);
-            if( dis < z_max) {
-              nbgh_matrix3D[patches.at<int>(row-1, col)][patches.at<int>(row, col)] = true;
-              nbgh_matrix3D[patches.at<int>(row, col)][patches.at<int>(row-1, col)] = true;
-            }
-            nbgh_matrix2D[patches.at<int>(row-1, col)][patches.at<int>(row, col)] = true;
-            nbgh_matrix2D[patches.at<int>(row, col)][patches.at<int>(row-1, col)] = true;
-          }
-        }
-        if(patches.at<int>(row, col-1) != -1) {
-          if(patches.at<int>(row, col) != patches.at<int>(row, col-1)) {
-            int pos_0 = row*pcl_cloud->width+col;
-            int pos_1 = row*pcl_cloud->width+col-1;
-            double dis = fabs(pcl_cloud->points[pos_0].z - pcl_cloud->points[pos_1].z);
-            if( dis < z_max) {
-              nbgh_matrix3D[patches.at<int>(row, col-1)][patches.at<int>(row, col)] = true;
-              nbgh_matrix3D[patches.at<int>(row, col)][patches.at<int>(row, col-1)] = true;
-            }
-            nbgh_matrix2D[patches.at<int>(row, col-1)][patches.at<int>(row, col)] = true;
-            nbgh_matrix2D[patches.at<int>(row, col)][patches.at<int>(row, col-1)] = true;
-          }
-        }
-        if(patches.at<int>(row-1, col-1) != -1) {
-          if(patches.at<int>(row, col) != patches.at<int>(row-1, col-1)) {
-            int pos_0 = row*pcl_cloud->width+col;
-            int pos_1 = (row-1)*pcl_cloud->width+col-1;
-            double dis = fabs(pcl_cloud->points[pos_0].z - pcl_cloud->points[pos_1].z);
-            if( dis < z_max) {
-              nbgh_matrix3D[patches.at<int>(row-1, col-1)][patches.at<int>(row, col)] = true;
-              nbgh_matrix3D[patches.at<int>(row, col)][patches.at<int>(row-1, col-1)] = true;
-            }
-            nbgh_matrix2D[patches.at<int>(row-1, col-1)][patches.at<int>(row, col)] = true;
-            nbgh_matrix2D[patches.at<int>(row, col)][patches.at<int>(row-1, col-1)] = true;
-          }
-        }
+      int pos_0 = row*pcl_cloud->width+col;
+      int id_0 = p[pos_0];
+      if(id_0 == -1)
+        continue;
+      for(unsigned k=0; k<3; k++) {
+        int pos_1 = pos_0 + offsets[k];
+        int id_1 = p[pos_1];
+        if(id_1 == -1 || id_0 == id_1)
+          continue;
+        NeighborPair np;
+        np.p0 = std::min(id_0, id_1);
+        np.p1 = std::max(id_0, id_1);
+        double dis = fabs(pcl_cloud->points[pos_0].z - pcl_cloud->points[pos_1].z);
+        np.is3D = (dis < z_max);
+        if(pairs.size() > 0 && pairs.back().p0 == np.p0 && pairs.back().p1 == np.p1)
+          pairs.back().is3D = pairs.back().is3D || np.is3D;
+        else
+          pairs.push_back(np);
       }
     }
   }
 
+  // sort and merge duplicates
+  std::sort(pairs.begin(), pairs.end(), CmpNeighborPair);
+  neighbors.clear();
+  for(unsigned i=0; i<pairs.size(); i++) {
+    if(neighbors.size() > 0 && neighbors.back().p0 == pairs[i].p0 && neighbors.back().p1 == pairs[i].p1)
+      neighbors.back().is3D = neighbors.back().is3D || pairs[i].is3D;
+    else
+      neighbors.push_back(pairs[i]);
+  }
+
   for(unsigned i=0; i<nr_patches; i++){
     view->surfaces[i]->neighbors2D.clear();
     view->surfaces[i]->neighbors2DNrPixel.clear();
-    for(unsigned j=i+1; j<nr_patches; j++)
-      if(nbgh_matrix2D[i][j]) {
-        view->surfaces[i]->neighbors2D.push_back(j);
-        view->surfaces[i]->neighbors2DNrPixel.push_back(0);
-      }
-  }
-  
-  for(unsigned i=0; i<nr_patches; i++){
     view->surfaces[i]->neighbors3D.clear();
-    for(unsigned j=i+1; j<nr_patches; j++)
-      if(nbgh_matrix3D[i][j])
-        view->surfaces[i]->neighbors3D.push_back(j);
   }
-}
-
-void StructuralRelationsLight::ConvertPCLCloud2Image(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pcl_cloud, 
-                                                cv::Mat_<cv::Vec3b> &image)
-{
-  unsigned pcWidth = pcl_cloud->width;
-  unsigned pcHeight = pcl_cloud->height;
-  unsigned position = 0;
-  
-  image = cv::Mat_<cv::Vec3b>(pcHeight, pcWidth);
-
-  for (unsigned row = 0; row < pcHeight; row++) {
-    for (unsigned col = 0; col < pcWidth; col++) {
-      cv::Vec3b &cvp = image.at<cv::Vec3b> (row, col);
-      position = row * pcWidth + col;
-      const pcl::PointXYZRGB &pt = pcl_cloud->points[position];
-      cvp[2] = pt.r;
-      cvp[1] = pt.g;
-      cvp[0] = pt.b;
-    }
+  for(unsigned i=0; i<neighbors.size(); i++) {
+    SurfaceModel &s = *view->surfaces[neighbors[i].p0];
+    s.neighbors2D.push_back(neighbors[i].p1);
+    s.neighbors2DNrPixel.push_back(0);
+    if(neighbors[i].is3D)
+      s.neighbors3D.push_back(neighbors[i].p1);
   }
 }
 
@@ -183,103 +140,124 @@ void StructuralRelationsLight::setView(surface::View *_view)
 
 void StructuralRelationsLight::computeRelations()
 {
-printf("StructuralRelationsLight::computeRelations start!\n");
+  computeRelations(std::vector<bool>());
+}
+
+void StructuralRelationsLight::computeRelations(const std::vector<bool> &update)
+{
+#ifdef DEBUG
+  printf("[StructuralRelationsLight::computeRelations] Start.\n");
+#endif
 
   if(!have_input_cloud || !have_patches) {
     printf("[StructuralRelationsLight::computeRelations] Error: No input cloud and patches available.\n");
     return;
   }
   view->relations.clear();
-  
-  cv::Mat_<cv::Vec3b> matImage;
-  ConvertPCLCloud2Image(pcl_cloud, matImage);
+  const PatchTable &table = view->GetPatchTable();    // update before the parallel sections
+  view->frame.setInputCloud(pcl_cloud);
 
-  std::vector<ColorHistogram3D> hist3D;
+  // one task per stage and per patch histogram, a thread picks the next task when it is idle
+  unsigned nr_patches = view->surfaces.size();
+  int nr_hist_bins = 4;
+  double uvThreshold = 0.0f;
+  hist3D.resize(nr_patches, ColorHistogram3D(nr_hist_bins, uvThreshold));     // memory reused between frames
+  const std::vector<int> &colorBins = view->frame.getColorBins(nr_hist_bins, uvThreshold);
   surface::Texture texture;
 
-  relations.resize(view->surfaces.size());
+  // partial update: histograms only for the patches of updated pairs
+  bool partial = !update.empty();
+  std::vector<bool> need_hist(nr_patches, !partial);
+  if(partial) {
+    if(update.size() != nr_patches) {
+      printf("[StructuralRelationsLight::computeRelations] Error: %lu update flags for %u patches.\n", update.size(), nr_patches);
+      return;
+    }
+    computeNeighbors();
+    for(unsigned i=0; i<neighbors.size(); i++)
+      if(neighbors[i].is3D && (update[neighbors[i].p0] || update[neighbors[i].p1]))
+        need_hist[neighbors[i].p0] = need_hist[neighbors[i].p1] = true;
+  }
 
-#pragma omp parallel sections
+#pragma omp parallel
   {
-
-    #pragma omp section
+#pragma omp single nowait
     {
-      computeNeighbors();
-    }
+      if(!partial) {
+        #pragma omp task
+        computeNeighbors();
+      }
 
-    #pragma omp section 
-    {
-      for(unsigned i=0; i<view->surfaces.size(); i++) { 
-        int nr_hist_bins = 4;
-        double uvThreshold = 0.0f;
-        hist3D.push_back(ColorHistogram3D(nr_hist_bins, uvThreshold));                               
-        hist3D[i].setInputCloud(pcl_cloud);
-        hist3D[i].setIndices(view->surfaces[i]->indices);
-        hist3D[i].compute();
+      #pragma omp task
+      {
+        texture.setSurfaceModels(*view);              // edges of the frame context
+        texture.compute();
       }
-    }
 
-    #pragma omp section 
-    {
-      texture.setInputImage(matImage);
-      texture.setSurfaceModels(*view);
-      texture.compute();
-    }      
-      
-    #pragma omp section 
-    {
-      boundary.setInputCloud(pcl_cloud);
-      boundary.setView(view);
-    }
+      #pragma omp task
+      {
+        boundary.setInputCloud(pcl_cloud);
+        boundary.setView(view);
+      }
 
-//     #pragma omp section 
-//     {
-//       surface::Relation rel;
-//       rel.valid = false;
-//       relations.clear();
-//       for(unsigned i=0; i<view->surfaces.size(); i++)
-//         for(unsigned j=0; j<view->surfaces.size(); j++)
-//           relations[i].push_back(rel);
-//     }
-  } // end parallel sections
+      for(unsigned i=0; i<nr_patches; i++) {
+        if(!need_hist[i])
+          continue;
+        #pragma omp task firstprivate(i)
+        {
+          hist3D[i].setInputCloud(pcl_cloud);
+          hist3D[i].setIndices(view->surfaces[i]->indices);
+          hist3D[i].setBinImage(colorBins);
+          hist3D[i].compute();
+        }
+      }
+    }
+  } // end parallel tasks
+
+  // relations of all 3D neighbours, ordered by patch pair
+  std::vector<NeighborPair> pairs;
+  for(unsigned i=0; i<neighbors.size(); i++)
+    if(neighbors[i].is3D)
+      pairs.push_back(neighbors[i]);
+  std::vector<surface::Relation> relations(pairs.size());
+  std::vector<unsigned> nr_boundary(pairs.size(), 0);
+
+  // the boundary length varies a lot between pairs: dynamic scheduling, scratch buffers per thread
+#pragma omp parallel
+  {
+    BoundaryScratch scratch;
+    std::vector<double> boundary_relations;
 
-  
-  surface::Relation relations[view->surfaces.size()][view->surfaces.size()];
-  surface::Relation rel;
-  rel.valid = false;
-  for(unsigned i=0; i<view->surfaces.size(); i++)
-    for(unsigned j=i+1; j<view->surfaces.size(); j++)
-      relations[i][j] = rel;
-  
-#pragma omp parallel for
-  for(int i=0; i<(int)view->surfaces.size(); i++) {
-    for(int j=0; j<(int)view->surfaces[i]->neighbors3D.size(); j++) {
+#pragma omp for schedule(dynamic, 8)
+    for(int i=0; i<(int)pairs.size(); i++) {
       bool valid_relation = true;
-      int p0 = i;
-      int p1 = view->surfaces[i]->neighbors3D[j];
-            
-      if(p0 > p1)
+      int p0 = pairs[i].p0;
+      int p1 = pairs[i].p1;
+      relations[i].valid = false;
+      const BoundaryPixel *ngbr = 0;
+      nr_boundary[i] = boundary.getBoundary(p0, p1, ngbr);
+      if(partial && !update[p0] && !update[p1])
         continue;
-      
+        
       double colorSimilarity = hist3D[p0].compare(hist3D[p1]);
       double textureRate = texture.compare(p0, p1);
-      double relSize = std::min((double)view->surfaces[p0]->indices.size()/(double)view->surfaces[p1]->indices.size(), 
-                                (double)view->surfaces[p1]->indices.size()/(double)view->surfaces[p0]->indices.size());
+      double relSize = std::min((double)table.count(p0)/(double)table.count(p1), 
+                                (double)table.count(p1)/(double)table.count(p0));
       
-      std::vector<double> boundary_relations;
-      if(!boundary.compare(p0, p1, boundary_relations)) {
+      if(!boundary.compare(p0, p1, boundary_relations, scratch)) {
         valid_relation = false;
         printf("[StructuralRelationsLight::computeRelations] Warning: Boundary relation invalid.\n");
       }
     
       if(valid_relation) {
-          Relation r;
+          Relation &r = relations[i];
           r.groundTruth = -1;
           r.prediction = -1;
           r.type = 1;                                     // structural level = 1
           r.id_0 = p0;
           r.id_1 = p1;
 
+          r.rel_value.reserve(9);
           r.rel_value.push_back(colorSimilarity);         // r_co ... color similarity (histogram) of the patch
           r.rel_value.push_back(textureRate);             // r_tr ... difference of texture rate
           r.rel_value.push_back(relSize);                 // r_rs ... relative patch size difference
@@ -292,24 +270,31 @@ printf("StructuralRelationsLight::computeRelations start!\n");
           r.rel_value.push_back(boundary_relations[6]);     // r_3d2 ... relation 3D neighbors / 2D neighbors
 
           r.valid = true;
-          relations[p0][p1] = r;
       }
     }
   }
+
+  // number of border pixels of the neighbours (pairs are ordered by p0: binary search in neighbors2D)
+  for(unsigned i=0; i<pairs.size(); i++) {
+    SurfaceModel &s = *view->surfaces[pairs[i].p0];
+    std::vector<unsigned>::iterator it = std::lower_bound(s.neighbors2D.begin(), s.neighbors2D.end(), pairs[i].p1);
+    if(it != s.neighbors2D.end() && *it == pairs[i].p1)
+      s.neighbors2DNrPixel[it - s.neighbors2D.begin()] = nr_boundary[i];
+  }
   
   // copy relations to view
-  for(unsigned i=0; i<view->surfaces.size(); i++)
-    for(unsigned j=i+1; j<view->surfaces.size(); j++) {
-      if(relations[i][j].valid) {
-        view->relations.push_back(relations[i][j]);
+  view->relations.reserve(relations.size());
+  for(unsigned i=0; i<relations.size(); i++) {
+    if(relations[i].valid) {
+      view->relations.push_back(relations[i]);
 #ifdef DEBUG
-        printf("r_st_l: [%u][%u]: ", relations[i][j].id_0, relations[i][j].id_1);
-        for(unsigned ridx=0; ridx<relations[i][j].rel_value.size(); ridx++)
-          printf("%4.3f ", relations[i][j].rel_value[ridx]);
-        printf("\n");
+      printf("r_st_l: [%u][%u]: ", relations[i].id_0, relations[i].id_1);
+      for(unsigned ridx=0; ridx<relations[i].rel_value.size(); ridx++)
+        printf("%4.3f ", relations[i].rel_value[ridx]);
+      printf("\n");
 #endif
-      }
     }
+  }
 }
 
 } // end surface models
@@ -27,7 +27,6 @@
 // #define TRY_MERGING_PLANES      // Merge planes before merging planes to b-splines
 #define TRY_MERGING             // Try merging of patches
 #define MS_PARALLEL             // parallel plane/NURBS calculation and merging
-// #define NO_MS_CHECK             // do not check model merging (not suggested!)
 
 namespace surface {
 
@@ -65,17 +64,46 @@ SurfaceModeling::~SurfaceModeling()
 /************************** PRIVATE ************************/
 
 /**
- * ComputeSavings
+ * SumProbError: Sum of (1 - p) of the point errors with p = exp(-err^2/sigma^2), in single
+ * precision per point (error -> probability -> savings term in one pass, no buffers)
  */
-double SurfaceModeling::ComputeSavings(int numParams, std::vector<double> &probs)
+double SurfaceModeling::SumProbError(const std::vector<double> &errs, double invSqrSigmaError)
 {
-  double savings = probs.size() - param.kappa1 * (double) numParams;
-  double err = 0.;
+  const float inv = invSqrSigmaError;
+  double sum = 0.;
+  for (unsigned i = 0; i < errs.size(); i++) {
+    float e = errs[i];
+    sum += 1.f - expf(-(e*e) * inv);
+  }
+  return sum;
+}
 
-  for (unsigned i = 0; i < probs.size(); i++)
-    err += (1. - probs[i]);
+/**
+ * SumPlaneProbError: SumProbError of the point-to-plane distances of the points with
+ * indices (any subset of the cloud)
+ */
+double SurfaceModeling::SumPlaneProbError(const std::vector<float> &coeffs, const std::vector<int> &indices) const
+{
+  const float n = 1.f / sqrtf(coeffs[0]*coeffs[0] + coeffs[1]*coeffs[1] + coeffs[2]*coeffs[2]);
+  const float a = coeffs[0]*n, b = coeffs[1]*n, c = coeffs[2]*n, d = coeffs[3]*n;
+  const float inv = invSqrSigmaError;
+  const pcl::PointXYZRGB *pts = &cloud->points[0];
+  double sum = 0.;
+  for (unsigned i = 0; i < indices.size(); i++) {
+    const pcl::PointXYZRGB &pt = pts[indices[i]];
+    float e = a*pt.x + b*pt.y + c*pt.z + d;
+    sum += 1.f - expf(-(e*e) * inv);
+  }
+  return sum;
+}
 
-  savings -= param.kappa2 * err;
+/**
+ * ComputeSavings
+ */
+double SurfaceModeling::ComputeSavings(int numParams, const SurfaceModel &model)
+{
+  double savings = model.nr_probs - param.kappa1 * (double) numParams;
+  savings -= param.kappa2 * model.prob_error;
 
   return (savings > 0 ? savings : 0);
 }
@@ -84,17 +112,11 @@ double SurfaceModeling::ComputeSavings(int numParams, std::vector<double> &probs
 /**
  * ComputePlaneSavingsNormalized
  */
-double SurfaceModeling::ComputePlaneSavingsNormalized(double numParams, std::vector<double> &probs, double norm, double kappa1, double kappa2)
+double SurfaceModeling::ComputePlaneSavingsNormalized(double numParams, const SurfaceModel &model, double norm, double kappa1, double kappa2)
 {
-  norm = 1. / norm;
   double savings = /*norm * (double) probs.size() 1.0 */ - kappa1 * numParams;
-  double err = 0.;
-
-  for (unsigned i = 0; i < probs.size(); i++)
-    err += (1. - probs[i]);
-
-  double probs_size = 1./(double) probs.size();
-  savings -= probs_size * kappa2 * err;
+  double probs_size = 1./(double) model.nr_probs;
+  savings -= probs_size * kappa2 * model.prob_error;
 
 //   return (savings > 0 ? savings : 0);
   return savings;
@@ -103,16 +125,11 @@ double SurfaceModeling::ComputePlaneSavingsNormalized(double numParams, std::vec
 /**
  * ComputeSavingsNormalized
  */
-double SurfaceModeling::ComputeSavingsNormalized(double numParams, std::vector<double> &probs, double norm)
+double SurfaceModeling::ComputeSavingsNormalized(double numParams, const SurfaceModel &model, double norm)
 {
   norm = 1. / norm;
-  double savings = norm * (double) probs.size() - param.kappa1 * numParams;
-  double err = 0.;
-
-  for (unsigned i = 0; i < probs.size(); i++)
-    err += (1. - probs[i]);
-
-  savings -= norm * param.kappa2 * err;
+  double savings = norm * (double) model.nr_probs - param.kappa1 * numParams;
+  savings -= norm * param.kappa2 * model.prob_error;
 
   return savings;
 //   return (savings > 0 ? savings : 0);
@@ -151,11 +168,8 @@ void SurfaceModeling::ComputeLSPlane(SurfaceModel &plane)
       printf("[SurfaceModeling::ComputeLSPlanes] Warning: Problematic plane found.\n");
     
     // compute error
-    float a, b, c, d;
-    plane.error.resize(plane.indices.size());
-    a=plane.coeffs[0], b=plane.coeffs[1], c=plane.coeffs[2], d=plane.coeffs[3];
-    for (unsigned i=0; i<plane.indices.size(); i++)
-      plane.error[i] = Plane::ImpPointDist(a,b,c,d, &cloud->points[plane.indices[i]].x);
+    plane.prob_error = SumPlaneProbError(plane.coeffs, plane.indices);
+    plane.nr_probs = plane.indices.size();
   }
 }
   
@@ -165,7 +179,6 @@ void SurfaceModeling::ComputeLSPlane(SurfaceModel &plane)
 void SurfaceModeling::FitPlane(SurfaceModel &plane)
 {
   ComputeLSPlane(plane);
-  ComputePointProbs(plane.error, plane.probs);
 }  
   
 /**
@@ -187,95 +200,89 @@ void SurfaceModeling::FitNurbs(SurfaceModel &surface)
   nurbsFitter->setInputCloud(cloud);
   nurbsFitter->setInterior(points);
   nurbsFitter->compute();
-  nurbsFitter->getInteriorError(surface.error);
+  std::vector<double> error;
+  nurbsFitter->getInteriorError(error);
+  surface.prob_error = SumProbError(error, invSqrSigmaError);
+  surface.nr_probs = error.size();
   surface.nurbs = nurbsFitter->getNurbs();
   nurbsFitter->getInteriorNormals(surface.normals);
   nurbsFitter->getInteriorParams(surface.nurbs_params);
 
-  // check orientation of normals and calculate probabilities
+  // check orientation of normals
   for (unsigned i = 0; i < surface.normals.size(); i++) {
     Eigen::Vector3d &n = surface.normals[i];
     if (Dot3(&n[0], &cloud->points[surface.indices[surface.indices.size()/2]].x) > 0)
       Mul3(&n[0], -1, &n[0]);
   }
-
-  ComputePointProbs(surface.error, surface.probs);
 }
 
 /**
- * ModelSelection with omp parallel
+ * SelectPlaneOrNurbs: Replace plane i by a NURBS, if the NURBS has higher savings.
+ * Returns true, if a NURBS was fitted (false for planes kept by the prescreen).
  */
-void SurfaceModeling::ModelSelectionParallel()
+bool SurfaceModeling::SelectPlaneOrNurbs(unsigned i)
 {
-  /// HACK: Call FitNurbs once, otherwise parallelization wont work. Why?
-  int i = 0;
-  if (view->surfaces[i]->selected && !view->surfaces[i]->used  && view->surfaces[i]->type == pcl::SACMODEL_PLANE) {
-    if((int)view->surfaces[i]->indices.size() < param.planePointsFixation) {
-      SurfaceModel::Ptr model;
-      model.reset(new SurfaceModel());
-      model->indices = view->surfaces[i]->indices;
-      model->type = view->surfaces[i]->type;
-      model->idx = view->surfaces.size();
-      model->selected = true;
-      model->used = false;
-      model->neighbors3D = view->surfaces[i]->neighbors3D;
+  if (!view->surfaces[i]->selected || view->surfaces[i]->used || view->surfaces[i]->type != pcl::SACMODEL_PLANE)
+    return false;
+  if ((int)view->surfaces[i]->indices.size() >= param.planePointsFixation)
+    return false;
+  if (param.prescreen) {
+    view->surfaces[i]->savings = ComputeSavingsNormalized(COSTS_PLANE_PARAMS, *view->surfaces[i], view->surfaces[i]->indices.size());
+    if (!PrescreenNurbs(moments[i], view->surfaces[i]->savings))
+      return false;   // keep the plane
+  }
+  SurfaceModel::Ptr model;
+  model = view->NewSurface();
+  model->indices = view->surfaces[i]->indices;
+  model->type = view->surfaces[i]->type;
+  model->idx = view->surfaces.size();
+  model->selected = true;
+  model->used = false;
+  model->neighbors3D = view->surfaces[i]->neighbors3D;
 
-      if(model->indices.size() > 3)
-        FitNurbs(*model);
+  if(model->indices.size() > 3)
+    FitNurbs(*model);
 
-      view->surfaces[i]->savings = ComputeSavingsNormalized(COSTS_PLANE_PARAMS, view->surfaces[i]->probs, view->surfaces[i]->indices.size());
-      model->savings = ComputeSavingsNormalized(model->nurbs.m_cv_count[0] * model->nurbs.m_cv_count[1] * COSTS_NURBS_PARAMS, model->probs, view->surfaces[i]->indices.size());
+  view->surfaces[i]->savings = ComputeSavingsNormalized(COSTS_PLANE_PARAMS, *view->surfaces[i], view->surfaces[i]->indices.size());
+  model->savings = ComputeSavingsNormalized(model->nurbs.m_cv_count[0] * model->nurbs.m_cv_count[1] * COSTS_NURBS_PARAMS, *model, view->surfaces[i]->indices.size());
 
 #ifdef DEBUG
-      cout << "[SurfaceModeling::ModelSelectionParallel] Savings plane/NURBS id=" << i << ": " << view->surfaces[i]->savings << "/" << model->savings;
+  cout << "[SurfaceModeling::ModelSelectionParallel] Savings plane/NURBS id=" << i << ": " << view->surfaces[i]->savings << "/" << model->savings;
 #endif
-      
-      if (model->savings > view->surfaces[i]->savings) { // => create NURBS
-        model->type = MODEL_NURBS;
-        model->savings = view->surfaces[i]->savings;
-        view->surfaces[i] = model;
-      }
+  
+  if (model->savings > view->surfaces[i]->savings) { // => create NURBS
+    model->type = MODEL_NURBS;
+    model->savings = view->surfaces[i]->savings;
+    view->surfaces[i] = model;
+  }
 #ifdef DEBUG
-      cout << " -> " << (model->type == MODEL_NURBS ? "NURBS" : "PLANE") << endl;
+  cout << " -> " << (model->type == MODEL_NURBS ? "NURBS" : "PLANE") << endl;
 #endif
-    }
+  return true;
+}
+
+/**
+ * ModelSelection with omp parallel
+ */
+void SurfaceModeling::ModelSelectionParallel()
+{
+  if (param.prescreen) {
+    moments.resize(view->surfaces.size());
+    #pragma omp parallel for
+    for (int i = 0; i < (int) view->surfaces.size(); i++)
+      ComputeMoments(view->surfaces[i]->indices, moments[i]);
   }
 
+  /// HACK: The first NURBS fit runs serially, it initialises the static data of the
+  /// NURBS fitting. The surfaces up to it get the same checks (prescreen) as the others.
+  unsigned first = 0;
+  while (first < view->surfaces.size() && !SelectPlaneOrNurbs(first))
+    first++;
+
   /// HACK END: Than we can do that parall
   #pragma omp parallel for 
-  for (unsigned i = 1; i < view->surfaces.size(); i++) {
-    if (view->surfaces[i]->selected && !view->surfaces[i]->used  && view->surfaces[i]->type == pcl::SACMODEL_PLANE) {
-      if((int)view->surfaces[i]->indices.size() < param.planePointsFixation) {
-        SurfaceModel::Ptr model;
-        model.reset(new SurfaceModel());
-        model->indices = view->surfaces[i]->indices;
-        model->type = view->surfaces[i]->type;
-        model->idx = view->surfaces.size();
-        model->selected = true;
-        model->used = false;
-        model->neighbors3D = view->surfaces[i]->neighbors3D;
-
-        if(model->indices.size() > 3)
-          FitNurbs(*model);
-
-        view->surfaces[i]->savings = ComputeSavingsNormalized(COSTS_PLANE_PARAMS, view->surfaces[i]->probs, view->surfaces[i]->indices.size());
-        model->savings = ComputeSavingsNormalized(model->nurbs.m_cv_count[0] * model->nurbs.m_cv_count[1] * COSTS_NURBS_PARAMS, model->probs, view->surfaces[i]->indices.size());
-
-#ifdef DEBUG
-        cout << "[SurfaceModeling::ModelSelectionParallel] Savings plane/NURBS id=" << i << ": " << view->surfaces[i]->savings << "/" << model->savings;
-#endif
-        
-        if (model->savings > view->surfaces[i]->savings) { // => create NURBS
-          model->type = MODEL_NURBS;
-          model->savings = view->surfaces[i]->savings;
-          view->surfaces[i] = model;
-        }
-#ifdef DEBUG
-        cout << " -> " << (model->type == MODEL_NURBS ? "NURBS" : "PLANE") << endl;
-#endif
-      }
-    }
-  }
+  for (int i = first+1; i < (int) view->surfaces.size(); i++)
+    SelectPlaneOrNurbs(i);
 
 #ifdef TRY_MERGING_PLANES
 #ifdef DEBUG
@@ -289,7 +296,7 @@ void SurfaceModeling::ModelSelectionParallel()
         unsigned idx = view->surfaces[i]->neighbors3D[j];
         if(idx > i && view->surfaces[i]->type == pcl::SACMODEL_PLANE && view->surfaces[idx]->type == pcl::SACMODEL_PLANE) {
           SurfaceModel::Ptr mergedModel;
-          mergedModel.reset(new SurfaceModel());
+          mergedModel = view->NewSurface();
           (*mergedModel) = *view->surfaces[i];         
           view->surfaces[idx]->AddTo(*mergedModel);
           
@@ -297,9 +304,9 @@ void SurfaceModeling::ModelSelectionParallel()
             FitPlane(*mergedModel);
           mergedModel->type = pcl::SACMODEL_PLANE;
 
-          mergedModel->savings = ComputePlaneSavingsNormalized(0., mergedModel->probs, mergedModel->indices.size(), 0.003, 0.9);
-          view->surfaces[i]->savings = ComputePlaneSavingsNormalized(0., view->surfaces[i]->probs, mergedModel->indices.size(), 0.003, 0.9)/2.;
-          view->surfaces[idx]->savings = ComputePlaneSavingsNormalized(0., view->surfaces[idx]->probs, mergedModel->indices.size(), 0.003, 0.9)/2.;
+          mergedModel->savings = ComputePlaneSavingsNormalized(0., *mergedModel, mergedModel->indices.size(), 0.003, 0.9);
+          view->surfaces[i]->savings = ComputePlaneSavingsNormalized(0., *view->surfaces[i], mergedModel->indices.size(), 0.003, 0.9)/2.;
+          view->surfaces[idx]->savings = ComputePlaneSavingsNormalized(0., *view->surfaces[idx], mergedModel->indices.size(), 0.003, 0.9)/2.;
           
           if (mergedModel->savings > (view->surfaces[i]->savings + view->surfaces[idx]->savings)) {
 #ifdef DEBUG
@@ -316,118 +323,197 @@ void SurfaceModeling::ModelSelectionParallel()
 #endif
 
 #ifdef TRY_MERGING
-  // Merge nurbs
-  std::vector<merge> merge_pairs;
-  
-#pragma omp parallel for shared(merge_pairs)
-  for (unsigned i = 0; i < view->surfaces.size(); i++) {
+  // Merge nurbs: candidate pairs of neighbouring patches
+  unsigned nr_surfaces = view->surfaces.size();
+  std::vector<merge> candidates;
+  for (unsigned i = 0; i < nr_surfaces; i++) {
     if (view->surfaces[i]->selected && !view->surfaces[i]->used) {
       if(view->surfaces[i]->indices.size() < (size_t) param.planePointsFixation) {
         for(unsigned j =0; j<view->surfaces[i]->neighbors3D.size(); j++) {
           unsigned idx = view->surfaces[i]->neighbors3D[j];
-          if(idx > i) {
-            SurfaceModel::Ptr mergedModel;
-            mergedModel.reset(new SurfaceModel());
-            (*mergedModel) = *view->surfaces[i];
-            view->surfaces[idx]->AddTo(*mergedModel);
-
-            if(mergedModel->indices.size() > 3)
-              FitNurbs(*mergedModel);
-            
-            mergedModel->savings = ComputeSavingsNormalized(mergedModel->nurbs.m_cv_count[0] * mergedModel->nurbs.m_cv_count[1] * COSTS_NURBS_PARAMS, 
-                                                            mergedModel->probs, mergedModel->indices.size());
-            view->surfaces[i]->savings = ComputeSavingsNormalized(
-                    (view->surfaces[i]->type == MODEL_NURBS ? view->surfaces[i]->nurbs.m_cv_count[0] * view->surfaces[i]->nurbs.m_cv_count[1] * COSTS_NURBS_PARAMS : COSTS_PLANE_PARAMS), 
-                    view->surfaces[i]->probs, mergedModel->indices.size());
-            view->surfaces[idx]->savings = ComputeSavingsNormalized(
-                    (view->surfaces[idx]->type == MODEL_NURBS ? view->surfaces[idx]->nurbs.m_cv_count[0] * view->surfaces[idx]->nurbs.m_cv_count[1] * COSTS_NURBS_PARAMS : COSTS_PLANE_PARAMS),
-                     view->surfaces[idx]->probs, mergedModel->indices.size());
-
-            if (mergedModel->savings > (view->surfaces[i]->savings + view->surfaces[idx]->savings)) {
-              merge m;
-              m.id_1 = i;
-              m.id_2 = idx;
-              m.savings = mergedModel->savings;
-
-#pragma omp critical
-              {
-                merge_pairs.push_back(m);
-#ifdef DEBUG
-  cout << "[SurfaceModeling::ModelSelectionParallel] -> Merge candidates: " << m.id_1 << "-" << m.id_2 << endl;
-#endif
-              }
-            }
+          if(idx > i && view->surfaces[idx]->selected && !view->surfaces[idx]->used) {
+            merge m;
+            m.id_1 = i;
+            m.id_2 = idx;
+            candidates.push_back(m);
           }
         }
       }
     }
   }
 
-  // merge the surfaces from the best to the weakest connection
-  std::sort(merge_pairs.begin(), merge_pairs.end(), CmpSavings);
+  // merge the surfaces from the best to the weakest connection: the fitted merge models
+  // are cached in the queue, after a merge only the neighbours of the new surface are re-scored
+  std::vector<unsigned> version(nr_surfaces, 0);
+  std::vector<int> owner(nr_surfaces);
+  std::vector<unsigned> visited(nr_surfaces, 0);
+  unsigned nr_merges = 0;
+  for (unsigned i = 0; i < nr_surfaces; i++)
+    owner[i] = i;
+  std::priority_queue<merge, std::vector<merge>, CmpMergeQueue> merge_queue;
+  ScoreMerges(candidates, version, merge_queue);
+
+  while(!merge_queue.empty()) {
+    merge m = merge_queue.top();
+    merge_queue.pop();
+    if(!view->surfaces[m.id_1]->selected || !view->surfaces[m.id_2]->selected ||
+       version[m.id_1] != m.version_1 || version[m.id_2] != m.version_2)
+      continue;   // outdated candidate
 
-  for(unsigned i=0; i<merge_pairs.size(); i++) {
-    if(merge_pairs[i].id_1 != merge_pairs[i].id_2) {
+#ifdef DEBUG        
+    printf("[SurfaceModeling::ModelSelectionParallel]  => MERGED: %u-%u (%1.5f)\n", m.id_1, m.id_2, m.savings);
+#endif
+    view->surfaces[m.id_1] = m.model;
+    view->surfaces[m.id_2]->selected = false;
+    owner[m.id_2] = m.id_1;
+    version[m.id_1]++;
+    if (param.prescreen)
+      moments[m.id_1].Add(moments[m.id_2]);
+    nr_merges++;
+
+    // re-score the merged surface with its (merged) neighbours
+    candidates.clear();
+    const std::vector<unsigned> &nbs = m.model->neighbors3D;
+    for(unsigned j=0; j<nbs.size(); j++) {
+      int idx = nbs[j];
+      while(owner[idx] != idx)
+        idx = owner[idx];
+      if(idx != m.id_1 && visited[idx] != nr_merges && 
+         view->surfaces[idx]->selected && !view->surfaces[idx]->used) {
+        visited[idx] = nr_merges;
+        merge c;
+        c.id_1 = m.id_1;
+        c.id_2 = idx;
+        candidates.push_back(c);
+      }
+    }
+    ScoreMerges(candidates, version, merge_queue);
+  }
+#endif // TRY_MERGING
+}
 
-#ifdef NO_MS_CHECK
-      view->surfaces[merge_pairs[i].id_2]->AddTo(*view->surfaces[merge_pairs[i].id_1]);
-      FitNurbs(*view->surfaces[merge_pairs[i].id_1]);
-      view->surfaces[merge_pairs[i].id_2]->selected = false;
+/**
+ * ComputeMoments: Moment sums of the quadric z = f(x,y) of the points
+ */
+void SurfaceModeling::ComputeMoments(const std::vector<int> &indices, QuadricMoments &m)
+{
+  m.Clear();
+  for (unsigned i = 0; i < indices.size(); i++) {
+    const pcl::PointXYZRGB &pt = cloud->points[indices[i]];
+    m.Add(pt.x, pt.y, pt.z);
+  }
+}
 
-  #ifdef DEBUG        
-      printf("[SurfaceModeling::ModelSelectionParallel]  => MERGED: %u-%u\n", merge_pairs[i].id_1, merge_pairs[i].id_2);
-  #endif
+/**
+ * ComputeQuadricError: Mean squared depth error of the least squares quadric of the moments
+ */
+double SurfaceModeling::ComputeQuadricError(const QuadricMoments &m)
+{
+  if (m.n < 6.)
+    return 0.;
+
+  Eigen::Matrix<double, 6, 6> A;
+  Eigen::Matrix<double, 6, 1> b, theta;
+  for (unsigned r = 0, k = 0; r < 6; r++) {
+    b[r] = m.bz[r];
+    for (unsigned c = r; c < 6; c++, k++)
+      A(r, c) = A(c, r) = m.A[k];
+  }
+  theta = A.ldlt().solve(b);
+  double mse = (m.zz - theta.dot(b)) / m.n;
+  return (mse > 0. ? mse : 0.);
+}
 
-      for(unsigned j=i+1; j < merge_pairs.size(); j++) {
-        if(merge_pairs[j].id_1 == merge_pairs[i].id_2)
-          merge_pairs[j].id_1 = merge_pairs[i].id_1;
-        if(merge_pairs[j].id_2 == merge_pairs[i].id_2)
-          merge_pairs[j].id_2 = merge_pairs[i].id_1;
-      }
-#else
+/**
+ * PrescreenNurbs: Check if a NURBS on the points of the moments may beat the given savings
+ * (normalized to the number of points). The NURBS savings are bounded by an error-free fit
+ * with the minimum number of control points. The quadric error estimates the fitting error,
+ * reduced by prescreenFactor to allow for the more flexible B-spline.
+ */
+bool SurfaceModeling::PrescreenNurbs(const QuadricMoments &m, double savings)
+{
+  double minParams = param.nurbsParams.order * param.nurbsParams.order * COSTS_NURBS_PARAMS;
+  double maxSavings = 1. - param.kappa1 * minParams;
+  if (maxSavings <= savings)
+    return false;
 
-      SurfaceModel::Ptr mergedModel;
-      mergedModel.reset(new SurfaceModel());
-      (*mergedModel) = *view->surfaces[merge_pairs[i].id_1];
-      view->surfaces[merge_pairs[i].id_2]->AddTo(*mergedModel);
-      if(mergedModel->indices.size() > 3)
-        FitNurbs(*mergedModel);
-      mergedModel->type = MODEL_NURBS;
-      mergedModel->savings = ComputeSavingsNormalized(
-                mergedModel->nurbs.m_cv_count[0] * mergedModel->nurbs.m_cv_count[1] * COSTS_NURBS_PARAMS, mergedModel->probs, mergedModel->indices.size());
-      view->surfaces[merge_pairs[i].id_1]->savings = ComputeSavingsNormalized(
-                (view->surfaces[merge_pairs[i].id_1]->type == MODEL_NURBS ? view->surfaces[merge_pairs[i].id_1]->nurbs.m_cv_count[0] * 
-                 view->surfaces[merge_pairs[i].id_1]->nurbs.m_cv_count[1] * COSTS_NURBS_PARAMS : COSTS_PLANE_PARAMS),
-                view->surfaces[merge_pairs[i].id_1]->probs, mergedModel->indices.size());
-      view->surfaces[merge_pairs[i].id_2]->savings = ComputeSavingsNormalized(
-                (view->surfaces[merge_pairs[i].id_2]->type == MODEL_NURBS ? view->surfaces[merge_pairs[i].id_2]->nurbs.m_cv_count[0] * 
-                view->surfaces[merge_pairs[i].id_2]->nurbs.m_cv_count[1] * COSTS_NURBS_PARAMS : COSTS_PLANE_PARAMS),
-                view->surfaces[merge_pairs[i].id_2]->probs, mergedModel->indices.size());
+  double err = 1. - exp(-param.prescreenFactor * ComputeQuadricError(m) * invSqrSigmaError);
+  return (maxSavings - param.kappa2 * err > savings);
+}
 
-#ifdef DEBUG        
-      printf("[SurfaceModeling::ModelSelectionParallel] Try merging %u and %u (%1.5f > %1.5f)\n", merge_pairs[i].id_1, merge_pairs[i].id_2, mergedModel->savings, 
-             view->surfaces[merge_pairs[i].id_1]->savings + view->surfaces[merge_pairs[i].id_2]->savings);
-#endif
+/**
+ * FitMergedModel: Fit a NURBS to the union of two surfaces
+ */
+SurfaceModel::Ptr SurfaceModeling::FitMergedModel(const SurfaceModel &s1, const SurfaceModel &s2)
+{
+  SurfaceModel::Ptr model = view->NewSurface();
+  model->idx = s1.idx;
+  model->label = s1.label;
+  model->type = MODEL_NURBS;
+  model->indices.reserve(s1.indices.size() + s2.indices.size());
+  model->indices.insert(model->indices.end(), s1.indices.begin(), s1.indices.end());
+  model->indices.insert(model->indices.end(), s2.indices.begin(), s2.indices.end());
+  model->neighbors3D.reserve(s1.neighbors3D.size() + s2.neighbors3D.size());
+  model->neighbors3D.insert(model->neighbors3D.end(), s1.neighbors3D.begin(), s1.neighbors3D.end());
+  model->neighbors3D.insert(model->neighbors3D.end(), s2.neighbors3D.begin(), s2.neighbors3D.end());
+  model->neighbors2D.reserve(s1.neighbors2D.size() + s2.neighbors2D.size());
+  model->neighbors2D.insert(model->neighbors2D.end(), s1.neighbors2D.begin(), s1.neighbors2D.end());
+  model->neighbors2D.insert(model->neighbors2D.end(), s2.neighbors2D.begin(), s2.neighbors2D.end());
+
+  if(model->indices.size() > 3)
+    FitNurbs(*model);
+  model->savings = ComputeSavingsNormalized(model->nurbs.m_cv_count[0] * model->nurbs.m_cv_count[1] * COSTS_NURBS_PARAMS, 
+                                            *model, model->indices.size());
+  return model;
+}
 
-      if (mergedModel->savings > (view->surfaces[merge_pairs[i].id_1]->savings + view->surfaces[merge_pairs[i].id_2]->savings)) {
+/**
+ * ComputeModelSavings: Savings of a surface, normalized by the given number of points
+ */
+double SurfaceModeling::ComputeModelSavings(const SurfaceModel &surface, double norm)
+{
+  return ComputeSavingsNormalized(
+          (surface.type == MODEL_NURBS ? surface.nurbs.m_cv_count[0] * surface.nurbs.m_cv_count[1] * COSTS_NURBS_PARAMS : COSTS_PLANE_PARAMS),
+          surface, norm);
+}
 
-#ifdef DEBUG        
-        printf("[SurfaceModeling::ModelSelectionParallel]  => MERGED: %u-%u\n", merge_pairs[i].id_1, merge_pairs[i].id_2);
+/**
+ * ScoreMerges: Fit the merge candidates (in parallel) and queue the ones with higher savings.
+ */
+void SurfaceModeling::ScoreMerges(std::vector<merge> &candidates, const std::vector<unsigned> &version,
+                                  std::priority_queue<merge, std::vector<merge>, CmpMergeQueue> &merge_queue)
+{
+  std::vector<char> accept(candidates.size(), 0);
+
+#pragma omp parallel for schedule(dynamic)
+  for (int i = 0; i < (int) candidates.size(); i++) {
+    merge &m = candidates[i];
+    const SurfaceModel &s1 = *view->surfaces[m.id_1];
+    const SurfaceModel &s2 = *view->surfaces[m.id_2];
+    m.version_1 = version[m.id_1];
+    m.version_2 = version[m.id_2];
+    double norm = s1.indices.size() + s2.indices.size();
+    double savings = ComputeModelSavings(s1, norm) + ComputeModelSavings(s2, norm);
+    if (param.prescreen) {
+      QuadricMoments merged = moments[m.id_1];
+      merged.Add(moments[m.id_2]);
+      if (!PrescreenNurbs(merged, savings))
+        continue;
+    }
+    m.model = FitMergedModel(s1, s2);
+    m.savings = m.model->savings;
+    if (m.savings > savings)
+      accept[i] = 1;
+  }
+
+  for (unsigned i = 0; i < candidates.size(); i++) {
+    if (accept[i]) {
+#ifdef DEBUG
+      cout << "[SurfaceModeling::ModelSelectionParallel] -> Merge candidates: " << candidates[i].id_1 << "-" << candidates[i].id_2 << endl;
 #endif
-        view->surfaces[merge_pairs[i].id_1] = mergedModel;
-        view->surfaces[merge_pairs[i].id_2]->selected = false;
-
-        for(unsigned j=i+1; j < merge_pairs.size(); j++) {
-          if(merge_pairs[j].id_1 == merge_pairs[i].id_2)
-            merge_pairs[j].id_1 = merge_pairs[i].id_1;
-          if(merge_pairs[j].id_2 == merge_pairs[i].id_2)
-            merge_pairs[j].id_2 = merge_pairs[i].id_1;
-        }
-      }
-#endif // NO_MS_CHECK
+      merge_queue.push(candidates[i]);
     }
   }
-#endif // TRY_MERGING
 }
 
 
@@ -442,13 +528,13 @@ void SurfaceModeling::ModelSelection()
   for (unsigned i = 0; i < view->surfaces.size(); i++) {
     // compare single model
     if (view->surfaces[i]->selected && !view->surfaces[i]->used) {
-      model.reset(new SurfaceModel());
+      model = view->NewSurface();
       model->indices = view->surfaces[i]->indices;
 
       FitNurbs(*model);
 
-      view->surfaces[i]->savings = ComputeSavingsNormalized(COSTS_PLANE_PARAMS, view->surfaces[i]->probs, view->surfaces[i]->indices.size());
-      model->savings = ComputeSavingsNormalized(model->nurbs.m_cv_count[0] * model->nurbs.m_cv_count[1] * COSTS_NURBS_PARAMS, model->probs,
+      view->surfaces[i]->savings = ComputeSavingsNormalized(COSTS_PLANE_PARAMS, *view->surfaces[i], view->surfaces[i]->indices.size());
+      model->savings = ComputeSavingsNormalized(model->nurbs.m_cv_count[0] * model->nurbs.m_cv_count[1] * COSTS_NURBS_PARAMS, *model,
           view->surfaces[i]->indices.size());
 #ifdef DEBUG
       cout << "[SurfaceModeling::ModelSelection] Savings plane/NURBS id=" << i << ": " << view->surfaces[i]->savings << "/" << model->savings;
@@ -480,19 +566,19 @@ void SurfaceModeling::ModelSelection()
         while (queue.size() > 0) {
           idx = queue.back();
           if (view->surfaces[idx]->selected && !view->surfaces[idx]->used) {
-            mergedModel.reset(new SurfaceModel());
+            mergedModel = view->NewSurface();
             (*mergedModel) = *model;
             view->surfaces[idx]->AddTo(*mergedModel);
 
             FitNurbs(*mergedModel);
 
             mergedModel->savings = ComputeSavingsNormalized(mergedModel->nurbs.m_cv_count[0] * mergedModel->nurbs.m_cv_count[1] * COSTS_NURBS_PARAMS, 
-                                                            mergedModel->probs, mergedModel->indices.size());
+                                                            *mergedModel, mergedModel->indices.size());
             model->savings = ComputeSavingsNormalized((model->type == MODEL_NURBS ? model->nurbs.m_cv_count[0] * model->nurbs.m_cv_count[1] * COSTS_NURBS_PARAMS : COSTS_PLANE_PARAMS), 
-                                                      model->probs, mergedModel->indices.size());
+                                                      *model, mergedModel->indices.size());
             view->surfaces[idx]->savings = ComputeSavingsNormalized(
                     (view->surfaces[idx]->type == MODEL_NURBS ? view->surfaces[idx]->nurbs.m_cv_count[0] * view->surfaces[idx]->nurbs.m_cv_count[1] * COSTS_NURBS_PARAMS : COSTS_PLANE_PARAMS),
-                    view->surfaces[idx]->probs, mergedModel->indices.size());
+                    *view->surfaces[idx], mergedModel->indices.size());
 #ifdef DEBUG
             cout << "[SurfaceModeling::ModelSelection] Try merging ids " << i << "-" << idx << ": " << model->savings << "+" << view->surfaces[idx]->savings << "="
                 << model->savings + view->surfaces[idx]->savings << " / " << mergedModel->savings;
@@ -538,58 +624,19 @@ void SurfaceModeling::ModelSelection()
 
 
 /**
- * ComputePointProbs
- */
-void SurfaceModeling::ComputePointProbs(std::vector<double> &errs, std::vector<double> &probs)
-{
-  probs.resize(errs.size());
-  for (unsigned i = 0; i < errs.size(); i++)
-    probs[i] = exp(-((errs[i]*errs[i]) * invSqrSigmaError));
-}
-
-void SurfaceModeling::ComputePointProbs(std::vector<double> &errs, std::vector<double> &probs, double sigmaError)
-{
-  double invSqrSigmaError = 1.0 / (sigmaError*sigmaError);
-  probs.resize(errs.size());
-  for (unsigned i = 0; i < errs.size(); i++)
-    probs[i] = exp(-((errs[i]*errs[i]) * invSqrSigmaError));
-}
-
-/**
- * ComputePointError
- */
-void SurfaceModeling::ComputePointError(pcl::PointCloud<pcl::PointXYZRGB> &cloud,
-                                        const std::vector<SurfaceModel::Ptr> &planes/*,
-                                        std::vector< std::vector<double> > &error*/)
-{
-  for (unsigned j=0; j<planes.size(); j++) {
-    planes[j]->error.clear();
-    SurfaceModel &plane = *planes[j];
-    planes[j]->error.resize(plane.indices.size());
-
-    if(plane.type == pcl::SACMODEL_PLANE) {
-      float a, b, c, d;
-      a=plane.coeffs[0], b=plane.coeffs[1], c=plane.coeffs[2], d=plane.coeffs[3];
-
-      for (unsigned i=0; i<plane.indices.size(); i++)
-        planes[j]->error[i] = Plane::ImpPointDist(a,b,c,d, &cloud.points[plane.indices[i]].x);
-    }
-    else {
-      for(unsigned i=0; i<plane.indices.size(); i++)
-        planes[j]->error[i] = 0.0f;  // no error, if we do not have the model
-    }
-  }
-}
-
-/**
- * InitDataStructure
+ * InitDataStructure: Savings terms of the point errors of the pre-segmented planes
  */
 void SurfaceModeling::InitDataStructure()
 {
-  ComputePointError(*cloud, view->surfaces/*, error*/);
-
-  for (unsigned i = 0; i < view->surfaces.size(); i++)
-    ComputePointProbs(view->surfaces[i]->error, view->surfaces[i]->probs);
+#pragma omp parallel for schedule(dynamic)
+  for (int j = 0; j < (int) view->surfaces.size(); j++) {
+    SurfaceModel &plane = *view->surfaces[j];
+    if(plane.type == pcl::SACMODEL_PLANE)
+      plane.prob_error = SumPlaneProbError(plane.coeffs, plane.indices);
+    else
+      plane.prob_error = 0.;    // no error, if we do not have the model
+    plane.nr_probs = plane.indices.size();
+  }
 }
 
 /**
@@ -617,16 +664,8 @@ cv::Point SurfaceModeling::ComputeMean(std::vector<int> &_indices)
  */
 void SurfaceModeling::computeNeighbors()
 {
-  cv::Mat_<int> patches;
-  patches = cv::Mat_<int>(cloud->height, cloud->width);
-  patches.setTo(-1);
-  for(unsigned i=0; i<view->surfaces.size(); i++) {
-    for(unsigned j=0; j<view->surfaces[i]->indices.size(); j++) {
-      int row = view->surfaces[i]->indices[j] / cloud->width;
-      int col = view->surfaces[i]->indices[j] % cloud->width;
-      patches.at<int>(row, col) = i;
-    }
-  }
+  view->frame.setInputCloud(cloud);
+  const cv::Mat_<int> &patches = view->GetPatchImage();
   unsigned nr_patches = view->surfaces.size();
 
   bool nbgh_matrix3D[nr_patches][nr_patches];
@@ -707,22 +746,18 @@ void SurfaceModeling::copySurfaces(bool addUnknownData)
     view->surfaces[i]->neighbors2D.clear();
     view->surfaces[i]->neighbors3D.clear();
   }
-  std::vector<SurfaceModel::Ptr> surfaces;
+  unsigned nr_surfaces = 0;
   for (unsigned i = 0; i < view->surfaces.size(); i++) {
     if (view->surfaces[i]->selected) {
-      if(addUnknownData) {
-        view->surfaces[i]->idx = surfaces.size();
-        surfaces.push_back(view->surfaces[i]);
-      }
-      else {
-        if(view->surfaces[i]->type == pcl::SACMODEL_PLANE || view->surfaces[i]->type == MODEL_NURBS) {
-          view->surfaces[i]->idx = surfaces.size();
-          surfaces.push_back(view->surfaces[i]);
-        }
+      if(addUnknownData || view->surfaces[i]->type == pcl::SACMODEL_PLANE || view->surfaces[i]->type == MODEL_NURBS) {
+        view->surfaces[i]->idx = nr_surfaces;
+        if(nr_surfaces != i)
+          view->surfaces[nr_surfaces].swap(view->surfaces[i]);
+        nr_surfaces++;
       }
     }
   }
-  view->surfaces = surfaces;
+  view->surfaces.resize(nr_surfaces);
 
   // copy surface normals to view
   for(unsigned s=0; s<view->surfaces.size(); s++)
@@ -732,6 +767,7 @@ void SurfaceModeling::copySurfaces(bool addUnknownData)
       pt.normal_y = view->surfaces[s]->normals[i][1];
       pt.normal_z = view->surfaces[s]->normals[i][2];
     }  
+  view->InvalidatePatchTable();
 }
 
 /************************** PUBLIC *************************/
@@ -841,16 +877,10 @@ void SurfaceModeling::compute()
 double SurfaceModeling::computeSavingsNormalized(int numParams, std::vector<double> &errs, double norm,
                                                  double kappa1, double kappa2, double sigmaError)
 {
-  std::vector<double> probs;
-  ComputePointProbs(errs, probs, sigmaError);
+  double err = SumProbError(errs, 1.0 / (sigmaError*sigmaError));
 
   norm = 1. / norm;
-  double savings = norm * (double) probs.size() - kappa1 * (double) numParams;
-  double err = 0.;
-
-  for (unsigned i = 0; i < probs.size(); i++)
-    err += (1. - probs[i]);
-
+  double savings = norm * (double) errs.size() - kappa1 * (double) numParams;
   savings -= norm * kappa2 * err;
 
   return (savings > 0 ? savings : 0);
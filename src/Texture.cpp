@@ -43,6 +43,7 @@ Texture::Texture()
 {
   have_cloud = false;
   have_surfaces = false;
+  view = NULL;
 }
 
 Texture::~Texture()
@@ -91,43 +92,48 @@ void Texture::setInputImage(cv::Mat_<cv::Vec3b> & _matImge)
 
 void Texture::setSurfaceModels(surface::View & _view)
 {
-  view = _view;
+  view = &_view;
   have_surfaces = true;
 }
 
 void Texture::compute()
 {
-  if(!have_cloud) {
-    printf("[Texture::compute] Error: No input cloud set.\n");
+  if(!have_surfaces) {
+    printf("[Texture::compute] Error: No surface models set.\n");
     exit(0);
   }
 
-  if(!have_surfaces) {
-    printf("[Texture::compute] Error: No surface models set.\n");
+  if(!have_cloud && !view->frame.haveCloud()) {
+    printf("[Texture::compute] Error: No input cloud set.\n");
     exit(0);
   }
 
   double lowThreshold = 5.;
   double highThreshold = 140.;
   int kernel_size = 3;
-  cv::Mat gray_image;
   cv::Mat edges;
   
-  cv::cvtColor(matImage, gray_image, CV_BGR2GRAY );
-  cv::blur(gray_image, edges, cv::Size(3,3));
-  cv::Canny(edges, edges, lowThreshold, highThreshold, kernel_size);
+  if(have_cloud) {
+    cv::Mat gray_image;
+    cv::cvtColor(matImage, gray_image, CV_BGR2GRAY );
+    cv::blur(gray_image, edges, cv::Size(3,3));
+    cv::Canny(edges, edges, lowThreshold, highThreshold, kernel_size);
+  }
+  else
+    edges = view->frame.getEdgeImage(lowThreshold, highThreshold, kernel_size);
 
-  textureRate.resize(view.surfaces.size());
-  for(unsigned i=0; i<view.surfaces.size(); i++) {
+  const std::vector<SurfaceModel::Ptr> &surfaces = view->surfaces;
+  textureRate.resize(surfaces.size());
+  for(unsigned i=0; i<surfaces.size(); i++) {
     int tex_area = 0;
-    for(unsigned j=0; j<view.surfaces[i]->indices.size(); j++) {
-      if(edges.data[view.surfaces[i]->indices[j]] == 255)
+    for(unsigned j=0; j<surfaces[i]->indices.size(); j++) {
+      if(edges.data[surfaces[i]->indices[j]] == 255)
         tex_area++;
     }
-    if(view.surfaces[i]->indices.size() == 0) 
+    if(surfaces[i]->indices.size() == 0) 
       textureRate[i] = 0.0f;
     else
-      textureRate[i] = (double) ((double)tex_area / view.surfaces[i]->indices.size());
+      textureRate[i] = (double) ((double)tex_area / surfaces[i]->indices.size());
   }
 }
 
@@ -26,6 +26,12 @@
 
 #include <unknown_objects_segmentation/ZAdaptiveNormals.hh>
 #include <pcl/common/eigen.h>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace surface 
 {
@@ -60,152 +66,493 @@ ZAdaptiveNormals::~ZAdaptiveNormals()
 
 
 /**
- * ComputeCovarianceMatrix
+ * InlierRow
+ * Euclidean inlier test of one kernel row (m points) against the center point c.
+ * Stores the inlier mask (-1/0) to w and adds number of inliers and the sums of
+ * x, y, z to s[0..3]. NaN points fail the test. The inlier radius is fixed
+ * (sqr_radius) or adaptive (kappa * dist * z + d), resolved at compile time.
  */
-void ZAdaptiveNormals::ComputeCovarianceMatrix (const pcl::PointCloud<pcl::PointXYZRGB> &cloud,
-      const std::vector<int> &indices, const Eigen::Vector4f &mean, Eigen::Matrix3f &cov)
+template<bool adaptive>
+static inline void InlierRow(const float *x, const float *y, const float *z, const float *dist, int m,
+                             const float c[3], float kappa, float d, float sqr_radius,
+                             int *w, float s[4])
 {
-  cov.setZero ();
+  int i = 0;
+#if defined(__SSE2__)
+  __m128 vcx = _mm_set1_ps(c[0]), vcy = _mm_set1_ps(c[1]), vcz = _mm_set1_ps(c[2]);
+  __m128 vkappa = _mm_set1_ps(kappa), vd = _mm_set1_ps(d), vsqr = _mm_set1_ps(sqr_radius);
+  __m128 vone = _mm_set1_ps(1.f);
+  __m128 vn = _mm_setzero_ps(), vsx = _mm_setzero_ps(), vsy = _mm_setzero_ps(), vsz = _mm_setzero_ps();
+  for (; i+4 <= m; i+=4) {
+    __m128 px = _mm_loadu_ps(x+i);
+    __m128 py = _mm_loadu_ps(y+i);
+    __m128 pz = _mm_loadu_ps(z+i);
+    __m128 dx = _mm_sub_ps(px, vcx);
+    __m128 dy = _mm_sub_ps(py, vcy);
+    __m128 dz = _mm_sub_ps(pz, vcz);
+    __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    __m128 r2 = vsqr;
+    if (adaptive) {
+      __m128 r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(vkappa, _mm_loadu_ps(dist+i)), pz), vd);
+      r2 = _mm_mul_ps(r, r);
+    }
+    __m128 mask = _mm_cmplt_ps(d2, r2);
+    _mm_storeu_si128((__m128i*) (w+i), _mm_castps_si128(mask));
+    vn = _mm_add_ps(vn, _mm_and_ps(mask, vone));
+    vsx = _mm_add_ps(vsx, _mm_and_ps(mask, px));
+    vsy = _mm_add_ps(vsy, _mm_and_ps(mask, py));
+    vsz = _mm_add_ps(vsz, _mm_and_ps(mask, pz));
+  }
+  EIGEN_ALIGN16 float t[4][4];
+  _mm_store_ps(t[0], vn);
+  _mm_store_ps(t[1], vsx);
+  _mm_store_ps(t[2], vsy);
+  _mm_store_ps(t[3], vsz);
+  for (unsigned j=0; j<4; j++)
+    s[j] += (t[j][0] + t[j][1]) + (t[j][2] + t[j][3]);
+#endif
+  for (; i<m; i++) {
+    float dx = x[i]-c[0];
+    float dy = y[i]-c[1];
+    float dz = z[i]-c[2];
+    float r2 = sqr_radius;
+    if (adaptive) {
+      float r = kappa * dist[i] * z[i] + d;
+      r2 = r*r;
+    }
+    if (dx*dx + dy*dy + dz*dz < r2) {
+      w[i] = -1;
+      s[0] += 1.f;
+      s[1] += x[i];
+      s[2] += y[i];
+      s[3] += z[i];
+    }
+    else
+      w[i] = 0;
+  }
+}
 
-  for (unsigned i = 0; i < indices.size (); ++i)
-  {
-    Eigen::Vector4f pt = cloud.points[indices[i]].getVector4fMap () - mean;
+/**
+ * CovarianceRow
+ * Adds the centered second-order products of the inliers (mask w) of one kernel
+ * row to cov = {xx, xy, xz, yy, yz, zz}.
+ */
+static inline void CovarianceRow(const float *x, const float *y, const float *z, const int *w, int m,
+                                 const float mean[3], float cov[6])
+{
+  int i = 0;
+#if defined(__SSE2__)
+  __m128 vmx = _mm_set1_ps(mean[0]), vmy = _mm_set1_ps(mean[1]), vmz = _mm_set1_ps(mean[2]);
+  __m128 vc[6];
+  for (unsigned j=0; j<6; j++)
+    vc[j] = _mm_setzero_ps();
+  for (; i+4 <= m; i+=4) {
+    __m128 mask = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*) (w+i)));
+    __m128 dx = _mm_and_ps(mask, _mm_sub_ps(_mm_loadu_ps(x+i), vmx));
+    __m128 dy = _mm_and_ps(mask, _mm_sub_ps(_mm_loadu_ps(y+i), vmy));
+    __m128 dz = _mm_and_ps(mask, _mm_sub_ps(_mm_loadu_ps(z+i), vmz));
+    vc[0] = _mm_add_ps(vc[0], _mm_mul_ps(dx, dx));
+    vc[1] = _mm_add_ps(vc[1], _mm_mul_ps(dx, dy));
+    vc[2] = _mm_add_ps(vc[2], _mm_mul_ps(dx, dz));
+    vc[3] = _mm_add_ps(vc[3], _mm_mul_ps(dy, dy));
+    vc[4] = _mm_add_ps(vc[4], _mm_mul_ps(dy, dz));
+    vc[5] = _mm_add_ps(vc[5], _mm_mul_ps(dz, dz));
+  }
+  EIGEN_ALIGN16 float t[4];
+  for (unsigned j=0; j<6; j++) {
+    _mm_store_ps(t, vc[j]);
+    cov[j] += (t[0] + t[1]) + (t[2] + t[3]);
+  }
+#endif
+  for (; i<m; i++) {
+    if (w[i] == 0)
+      continue;
+    float dx = x[i]-mean[0];
+    float dy = y[i]-mean[1];
+    float dz = z[i]-mean[2];
+    cov[0] += dx*dx;
+    cov[1] += dx*dy;
+    cov[2] += dx*dz;
+    cov[3] += dy*dy;
+    cov[4] += dy*dz;
+    cov[5] += dz*dz;
+  }
+}
 
-    cov(1,1) += pt.y () * pt.y ();
-    cov(1,2) += pt.y () * pt.z ();
+/**
+ * ComputeSoA
+ * Copy the point coordinates to x, y and z arrays for the row kernels.
+ */
+void ZAdaptiveNormals::ComputeSoA(const pcl::PointCloud<pcl::PointXYZRGB> &cloud)
+{
+  int size = width*height;
+  soa_x.resize(size);
+  soa_y.resize(size);
+  soa_z.resize(size);
+
+  #pragma omp parallel for
+  for (int i=0; i<size; i++) {
+    const pcl::PointXYZRGB &pt = cloud.points[i];
+    soa_x[i] = pt.x;
+    soa_y[i] = pt.y;
+    soa_z[i] = pt.z;
+  }
+}
 
-    cov(2,2) += pt.z () * pt.z ();
+/**
+ * MarkInvalid
+ * Mark the points without normal as NaN in the cloud (pt.x), once all normals are
+ * estimated. Returns true, if there are such points.
+ */
+bool ZAdaptiveNormals::MarkInvalid(pcl::PointCloud<pcl::PointXYZRGB> &cloud)
+{
+  bool havenan = false;
+  for (unsigned i=0; i<invalid.size(); i++) {
+    if (invalid[i]) {
+      cloud.points[i].x = NaN;
+      havenan = true;
+    }
+  }
+  return havenan;
+}
 
-    pt *= pt.x ();
-    cov(0,0) += pt.x ();
-    cov(0,1) += pt.y ();
-    cov(0,2) += pt.z ();
+/**
+ * ComputeKernelTable
+ * Distance of every window offset to the center, row by row: the row kernels
+ * need no sqrt for the adaptive inlier radius.
+ */
+void ZAdaptiveNormals::ComputeKernelTable(int kernel)
+{
+  if (kernel < 0)
+    return;
+  if ((int) kernel_dist.size() <= kernel)
+    kernel_dist.resize(kernel+1);
+  std::vector<float> &dist = kernel_dist[kernel];
+  if (!dist.empty())
+    return;
+
+  int size = 2*kernel+1;
+  dist.resize(size*size);
+  for (int vkernel=0-kernel; vkernel<=kernel; vkernel++)
+    for (int ukernel=0-kernel; ukernel<=kernel; ukernel++)
+      dist[(vkernel+kernel)*size + ukernel+kernel] =  sqrt(vkernel*vkernel + ukernel*ukernel);
+}
+
+/**
+ * ComputeExactNormal
+ * Normal of the euclidean inliers of the kernel window around (u,v).
+ * Returns false, if there are less than 4 inliers.
+ */
+template<bool adaptive>
+bool ZAdaptiveNormals::ComputeExactNormal(int u, int v, int kernel, std::vector<int> &mask,
+                                          Eigen::Matrix3f &eigen_vectors, float &curvature)
+{
+  int size = 2*kernel+1;
+  const float *dist = &kernel_dist[kernel][0];
+  mask.resize(size*size);
+
+  int idx = GetIdx(u,v);
+  float c[3] = {soa_x[idx], soa_y[idx], soa_z[idx]};
+
+  // first row and column of the image are not used
+  int u0 = std::max(u-kernel, 1);
+  int u1 = std::min(u+kernel, width-1);
+  int v0 = std::max(v-kernel, 1);
+  int v1 = std::min(v+kernel, height-1);
+  int m = u1-u0+1;
+  if (m <= 0 || v1 < v0)
+    return false;
+
+  float s[4] = {0., 0., 0., 0.};
+  for (int y=v0; y<=v1; y++) {
+    int row = GetIdx(u0,y);
+    int k = (y-v+kernel)*size + u0-u+kernel;
+    InlierRow<adaptive>(&soa_x[row], &soa_y[row], &soa_z[row], dist+k, m, c,
+                        param.kappa, param.d, sqr_radius, &mask[k], s);
+  }
+  if (s[0] < 4.f)
+    return false;
+
+  float mean[3] = {s[1]/s[0], s[2]/s[0], s[3]/s[0]};
+  float sums[6] = {0., 0., 0., 0., 0., 0.};
+  for (int y=v0; y<=v1; y++) {
+    int row = GetIdx(u0,y);
+    int k = (y-v+kernel)*size + u0-u+kernel;
+    CovarianceRow(&soa_x[row], &soa_y[row], &soa_z[row], &mask[k], m, mean, sums);
   }
 
+  Eigen::Matrix3f cov;
+  cov(0,0) = sums[0];
+  cov(0,1) = sums[1];
+  cov(0,2) = sums[2];
+  cov(1,1) = sums[3];
+  cov(1,2) = sums[4];
+  cov(2,2) = sums[5];
   cov(1,0) = cov(0,1);
   cov(2,0) = cov(0,2);
   cov(2,1) = cov(1,2);
+
+  Eigen::Vector3f eigen_values;
+  pcl::eigen33 (cov, eigen_vectors, eigen_values);
+  float eigsum = eigen_values.sum();
+  curvature = (eigsum != 0 ? fabs (eigen_values[0] / eigsum) : NaN);
+  return true;
 }
 
 /**
- * GetIndices
+ * ComputeIntegralImage
+ * Summed-area table of the valid points and their second-order products.
+ * Entry (v+1, u+1) holds the sums over all points with x<=u and y<=v.
  */
-void ZAdaptiveNormals::GetIndices(pcl::PointCloud<pcl::PointXYZRGB> &cloud, 
-                                  int u, int v, int kernel, 
-                                  std::vector<int> &indices)
+void ZAdaptiveNormals::ComputeIntegralImage(const pcl::PointCloud<pcl::PointXYZRGB> &cloud)
 {
-  int idx;
-  pcl::PointXYZRGB &pt = cloud.points[GetIdx(u,v)]; 
-
-  for (int vkernel=0-kernel; vkernel<=kernel; vkernel++) {
-    for (int ukernel=0-kernel; ukernel<=kernel; ukernel++) {
-      int y = v + vkernel;
-      int x = u + ukernel;
-      
-      float center_dist = sqrt(vkernel*vkernel + ukernel*ukernel);
-      if (x>0 && y>0 && x<width && y<height) {
-        idx = GetIdx(x,y);
-        pcl::PointXYZRGB &pt1 = cloud.points[idx];
-        if(!isnan(pt1.z)) {
-          float new_sqr_radius = sqr_radius;
-          if(param.adaptive) {
-            float val = param.kappa * center_dist * pt1.z + param.d;
-            new_sqr_radius = val*val;
-          }
-        
-          if ((pt.getVector3fMap()-pt1.getVector3fMap()).squaredNorm() < new_sqr_radius)
-            indices.push_back(idx);
-        }
+  int w1 = width+1;
+  integral.resize(w1*(height+1));
+  memset(&integral[0], 0, w1*sizeof(IntegralCell));
+
+  for (int v=0; v<height; v++) {
+    double row[10] = {0., 0., 0., 0., 0., 0., 0., 0., 0., 0.};
+    IntegralCell *above = &integral[v*w1];
+    IntegralCell *cur = &integral[(v+1)*w1];
+    memset(cur, 0, sizeof(IntegralCell));
+    for (int u=0; u<width; u++) {
+      const pcl::PointXYZRGB &pt = cloud.points[GetIdx(u,v)];
+      if (!isnan(pt.x) && !isnan(pt.y) && !isnan(pt.z)) {
+        double x = pt.x, y = pt.y, z = pt.z;
+        row[0] += 1.;
+        row[1] += x;   row[2] += y;   row[3] += z;
+        row[4] += x*x; row[5] += x*y; row[6] += x*z;
+        row[7] += y*y; row[8] += y*z; row[9] += z*z;
       }
+      for (unsigned i=0; i<10; i++)
+        cur[u+1].s[i] = above[u+1].s[i] + row[i];
     }
   }
 }
 
 /**
- * ComputeNormal
+ * ComputeIntegralNormal
+ * Normal of the whole (2*kernel+1)^2 window from the summed-area table. The window
+ * is rejected (return false), if the rms distance of its points to the center point
+ * exceeds tolerance * inlier radius at the window border, i.e. if the window probably
+ * contains points which the euclidean inlier test of the exact path would remove.
  */
-float ZAdaptiveNormals::ComputeNormal(pcl::PointCloud<pcl::PointXYZRGB> &cloud, 
-                                      std::vector<int> &indices, 
-                                      Eigen::Matrix3f &eigen_vectors)
+template<bool adaptive>
+bool ZAdaptiveNormals::ComputeIntegralNormal(const pcl::PointXYZRGB &pt, int u, int v, int kernel, 
+                                             Eigen::Matrix3f &eigen_vectors, float &curvature)
 {
-  if (indices.size()<4)
-    return NaN;
-
-  Eigen::Vector4f mean;
-  mean.setZero();
-  for (unsigned j=0; j<indices.size(); j++)
-    mean += cloud.points[indices[j]].getVector4fMap();
-  mean /= (float)indices.size();
-  mean[3]=0.;
+  // same window [xa,xb] x [ya,yb] as the exact path: first row and column are not used
+  int xa = std::max(u-kernel, 1);
+  int ya = std::max(v-kernel, 1);
+  int xb = std::min(u+kernel, width-1);
+  int yb = std::min(v+kernel, height-1);
+  if (xb < xa || yb < ya)
+    return false;
+
+  int w1 = width+1;
+  const IntegralCell &a = integral[ya*w1 + xa];
+  const IntegralCell &b = integral[ya*w1 + xb+1];
+  const IntegralCell &c = integral[(yb+1)*w1 + xa];
+  const IntegralCell &d = integral[(yb+1)*w1 + xb+1];
+  double s[10];
+  for (unsigned i=0; i<10; i++)
+    s[i] = d.s[i] - b.s[i] - c.s[i] + a.s[i];
+
+  double n = s[0];
+  if (n < 4.)
+    return false;
+
+  double mx = s[1]/n, my = s[2]/n, mz = s[3]/n;
+
+  // mean squared distance to the center point
+  double px = pt.x, py = pt.y, pz = pt.z;
+  double sqr_dist = (s[4]+s[7]+s[9])/n - 2.*(px*mx + py*my + pz*mz) + px*px + py*py + pz*pz;
+  double max_dist = param.tolerance * (adaptive ? param.kappa*kernel*pz + param.d : param.radius);
+  if (sqr_dist > max_dist*max_dist)
+    return false;
 
   Eigen::Matrix3f cov;
-  ComputeCovarianceMatrix (cloud, indices, mean, cov);
+  cov(0,0) = s[4] - n*mx*mx;
+  cov(0,1) = s[5] - n*mx*my;
+  cov(0,2) = s[6] - n*mx*mz;
+  cov(1,1) = s[7] - n*my*my;
+  cov(1,2) = s[8] - n*my*mz;
+  cov(2,2) = s[9] - n*mz*mz;
+  cov(1,0) = cov(0,1);
+  cov(2,0) = cov(0,2);
+  cov(2,1) = cov(1,2);
 
   Eigen::Vector3f eigen_values;
   pcl::eigen33 (cov, eigen_vectors, eigen_values);
   float eigsum = eigen_values.sum();
-  if (eigsum != 0)
-    return fabs (eigen_values[0] / eigsum );
-  
-  return NaN;
+  curvature = (eigsum != 0 ? fabs (eigen_values[0] / eigsum) : NaN);
+  return true;
 }
 
 
 /**
- * EstimateNormals
+ * PrepareEstimation
+ * Coordinate arrays, kernel tables and integral image of the whole cloud: also
+ * a masked estimation may use points outside the mask as neighbours.
  */
-void ZAdaptiveNormals::EstimateNormals(pcl::PointCloud<pcl::PointXYZRGB> &cloud, 
-                                       pcl::PointCloud<pcl::Normal> &normals)
+void ZAdaptiveNormals::PrepareEstimation(pcl::PointCloud<pcl::PointXYZRGB> &cloud)
 {
-  EIGEN_ALIGN16 Eigen::Matrix3f eigen_vectors;
-  std::vector< int > indices;
-  bool havenan = false;
+  ComputeSoA(cloud);
+  invalid.assign(cloud.points.size(), 0);
+  ComputeKernelTable(param.kernel);
+  if (param.adaptive)                   // kernel_radius is not initialised otherwise
+    for (unsigned i=0; i<8; i++)
+      ComputeKernelTable(param.kernel_radius[i]);
+
+  if (param.integral)
+    ComputeIntegralImage(cloud);
+}
 
-  #pragma omp parallel for private(eigen_vectors,indices, havenan)
-  for (int v=0; v<height; v++) {
-    for (int u=0; u<width; u++) {
-      indices.clear();
-      int idx = GetIdx(u,v);
-      pcl::PointXYZRGB &pt = cloud.points[idx];
-      pcl::Normal &n = normals.points[idx];
-      if(!isnan(pt.x) && !isnan(pt.y) && !isnan(pt.z)) {      
-        if(param.adaptive) {
-          int dist = (int) (pt.z*2); // *2 => every 0.5 meter another kernel radius
-          GetIndices(cloud, u,v, param.kernel_radius[dist], indices);
-        }
-        else
-          GetIndices(cloud, u,v, param.kernel, indices);
-      }
+/**
+ * EstimateNormal
+ * Normal of point (u,v). Invalid points get a NaN normal and are marked as invalid
+ * (see MarkInvalid). Returns false for invalid points.
+ */
+template<bool adaptive>
+bool ZAdaptiveNormals::EstimateNormal(pcl::PointCloud<pcl::PointXYZRGB> &cloud, 
+                                      pcl::PointCloud<pcl::Normal> &normals,
+                                      int u, int v, std::vector<int> &mask, 
+                                      Eigen::Matrix3f &eigen_vectors)
+{
+  int idx = GetIdx(u,v);
+  pcl::PointXYZRGB &pt = cloud.points[idx];
+  pcl::Normal &n = normals.points[idx];
+  bool have_normal = false;
+  float curvature = NaN;
+  if(!isnan(pt.x) && !isnan(pt.y) && !isnan(pt.z)) {      
+    int kernel = param.kernel;
+    if(adaptive) {
+      // *2 => every 0.5 meter another kernel radius, points beyond 4m use the last one
+      float z2 = pt.z*2;
+      int dist = (z2 < 0.f ? 0 : (z2 >= 7.f ? 7 : (int) z2));
+      kernel = param.kernel_radius[dist];
+    }
+    if(param.integral)
+      have_normal = ComputeIntegralNormal<adaptive>(pt, u, v, kernel, eigen_vectors, curvature);
+    if(!have_normal)
+      have_normal = ComputeExactNormal<adaptive>(u, v, kernel, mask, eigen_vectors, curvature);
+  }
 
-      if (indices.size()<4) {
-        havenan = true;
-        n.normal[0] = NaN;
-        pt.x = NaN;
-        continue;
-      }
+  // the point is marked NaN after the loop: neighbouring windows read it meanwhile
+  if (!have_normal) {
+    SetNaN(n);
+    invalid[idx] = 1;
+    return false;
+  }
 
-      n.curvature = ComputeNormal(cloud, indices, eigen_vectors);
+  n.curvature = curvature;
 
-      n.normal[0] = eigen_vectors (0,0);
-      n.normal[1] = eigen_vectors (1,0);
-      n.normal[2] = eigen_vectors (2,0);
+  n.normal[0] = eigen_vectors (0,0);
+  n.normal[1] = eigen_vectors (1,0);
+  n.normal[2] = eigen_vectors (2,0);
+  n.normal[3] = 0.;
 
 
-      if (n.getNormalVector3fMap().dot(pt.getVector3fMap()) > 0) {
-        n.getNormalVector4fMap() *= -1;
-        n.getNormalVector4fMap()[3] = 0;
-        n.getNormalVector4fMap()[3] = -1 * n.getNormalVector4fMap().dot(pt.getVector4fMap());
-      }
-    }
+  if (n.getNormalVector3fMap().dot(pt.getVector3fMap()) > 0) {
+    n.getNormalVector4fMap() *= -1;
+    n.getNormalVector4fMap()[3] = 0;
+    n.getNormalVector4fMap()[3] = -1 * n.getNormalVector4fMap().dot(pt.getVector4fMap());
   }
+  return true;
+}
+
+/**
+ * NormalKernel
+ * EstimateNormal specialized for the parameters: the adaptive branches of the
+ * per-pixel kernels are resolved once per call instead of once per pixel.
+ */
+ZAdaptiveNormals::EstimateNormalFn ZAdaptiveNormals::NormalKernel() const
+{
+  if (param.adaptive)
+    return &ZAdaptiveNormals::EstimateNormal<true>;
+  return &ZAdaptiveNormals::EstimateNormal<false>;
+}
+
+/**
+ * EstimateNormals
+ */
+void ZAdaptiveNormals::EstimateNormals(pcl::PointCloud<pcl::PointXYZRGB> &cloud, 
+                                       pcl::PointCloud<pcl::Normal> &normals)
+{
+  EIGEN_ALIGN16 Eigen::Matrix3f eigen_vectors;
+  std::vector< int > mask;
+  EstimateNormalFn estimate = NormalKernel();
 
-  if (havenan)
+  PrepareEstimation(cloud);
+
+  #pragma omp parallel for private(eigen_vectors, mask)
+  for (int v=0; v<height; v++)
+    for (int u=0; u<width; u++)
+      (this->*estimate)(cloud, normals, u, v, mask, eigen_vectors);
+
+  if (MarkInvalid(cloud))
   {
     cloud.is_dense=false;
     normals.is_dense=false;
   }
 }
 
+/**
+ * EstimateNormals of the given point indices; all other normals are NaN.
+ */
+void ZAdaptiveNormals::EstimateNormals(pcl::PointCloud<pcl::PointXYZRGB> &cloud, 
+                                       pcl::PointCloud<pcl::Normal> &normals,
+                                       const std::vector<int> &indices)
+{
+  EIGEN_ALIGN16 Eigen::Matrix3f eigen_vectors;
+  std::vector< int > mask;
+  int size = width*height;
+  EstimateNormalFn estimate = NormalKernel();
+
+  PrepareEstimation(cloud);
+
+  #pragma omp parallel for
+  for (int i=0; i<size; i++)
+    SetNaN(normals.points[i]);
+
+  #pragma omp parallel for private(eigen_vectors, mask)
+  for (int i=0; i<(int)indices.size(); i++)
+    if (indices[i] >= 0 && indices[i] < size)
+      (this->*estimate)(cloud, normals, X(indices[i]), Y(indices[i]), mask, eigen_vectors);
+
+  MarkInvalid(cloud);
+  cloud.is_dense=false;
+  normals.is_dense=false;
+}
+
+/**
+ * EstimateNormals inside the rectangle [u0,u1) x [v0,v1); all other normals are NaN.
+ */
+void ZAdaptiveNormals::EstimateNormals(pcl::PointCloud<pcl::PointXYZRGB> &cloud, 
+                                       pcl::PointCloud<pcl::Normal> &normals,
+                                       int u0, int v0, int u1, int v1)
+{
+  EIGEN_ALIGN16 Eigen::Matrix3f eigen_vectors;
+  std::vector< int > mask;
+  int size = width*height;
+  EstimateNormalFn estimate = NormalKernel();
+
+  PrepareEstimation(cloud);
+
+  #pragma omp parallel for
+  for (int i=0; i<size; i++)
+    SetNaN(normals.points[i]);
+
+  #pragma omp parallel for private(eigen_vectors, mask)
+  for (int v=v0; v<v1; v++)
+    for (int u=u0; u<u1; u++)
+      (this->*estimate)(cloud, normals, u, v, mask, eigen_vectors);
+
+  MarkInvalid(cloud);
+  cloud.is_dense=false;
+  normals.is_dense=false;
+}
+
 
 
 
@@ -223,7 +570,9 @@ void ZAdaptiveNormals::setInputCloud(const pcl::PointCloud<pcl::PointXYZRGB>::Pt
   width = cloud->width;
   height = cloud->height;
 
-  normals.reset(new pcl::PointCloud<pcl::Normal>);
+  // reuse the normals of the last frame, if nobody else holds them
+  if (normals.get() == 0 || !normals.unique())
+    normals.reset(new pcl::PointCloud<pcl::Normal>);
   normals->points.resize(cloud->points.size());
   normals->width = cloud->width;
   normals->height = cloud->height;
@@ -241,14 +590,27 @@ void ZAdaptiveNormals::compute()
 }
 
 /**
- * compute the normals using a mask
+ * compute the normals of the given point indices only
+ */
+void ZAdaptiveNormals::compute(const std::vector<int> &indices)
+{
+  if (cloud.get() == 0)
+    throw std::runtime_error ("[ZAdaptiveNormals::compute] No point cloud available!");
+  EstimateNormals(*cloud, *normals, indices);
+}
+
+/**
+ * compute the normals inside a region of interest (clipped to the image)
  */
-void ZAdaptiveNormals::compute(const std::vector<int> &mask)
+void ZAdaptiveNormals::compute(int roi_x, int roi_y, int roi_width, int roi_height)
 {
   if (cloud.get() == 0)
     throw std::runtime_error ("[ZAdaptiveNormals::compute] No point cloud available!");
-  std::cout<<"[ZAdaptiveNormals::compute] Error: Not yet implemented."<<std::endl;
-  exit(0);
+  int u0 = std::max(roi_x, 0);
+  int v0 = std::max(roi_y, 0);
+  int u1 = std::min(roi_x + roi_width, width);
+  int v1 = std::min(roi_y + roi_height, height);
+  EstimateNormals(*cloud, *normals, u0, v0, std::max(u0, u1), std::max(v0, v1));
 }
 
 
@@ -0,0 +1,169 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file classifier_benchmark.cpp
+ * @brief Compare the RBF svm with its linear and random Fourier feature approximations.
+ * Usage: classifier_benchmark <model path> [<nr relations> [<repeats>]]
+ * Feature vectors are jittered support vectors of the svm model, unscaled with param.txt.
+ * svm_approx_model fits the approximations on the same jitter distribution: the agreement
+ * is measured on the training distribution, not on the relations of real frames.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include <unknown_objects_segmentation/SVMPredictorSingle.h>
+#include <unknown_objects_segmentation/LinearPredictor.h>
+
+/** Normal distributed random value (Box-Muller) **/
+static double randn ()
+{
+  double u1 = (rand () + 1.) / ((double) RAND_MAX + 2.);
+  double u2 = (rand () + 1.) / ((double) RAND_MAX + 2.);
+  return sqrt (-2. * log (u1)) * cos (2. * M_PI * u2);
+}
+
+/** Read the scaling file of svm-scale: lower, upper and the feature ranges **/
+static bool readScaling (const std::string &filename, double &lower, double &upper,
+                         std::vector<double> &fmin, std::vector<double> &fmax)
+{
+  FILE *fp = fopen (filename.c_str (), "r");
+  if (fp == NULL)
+    return false;
+  int idx;
+  double lo, hi;
+  bool ok = fscanf (fp, " x %lf %lf", &lower, &upper) == 2;
+  while (ok && fscanf (fp, "%d %lf %lf", &idx, &lo, &hi) == 3) {
+    if ((int) fmin.size () < idx) {
+      fmin.resize (idx, 0.);
+      fmax.resize (idx, 0.);
+    }
+    fmin[idx - 1] = lo;
+    fmax[idx - 1] = hi;
+  }
+  fclose (fp);
+  return ok && fmin.size () > 0;
+}
+
+/** Classify all relations of a copy of the view, returns seconds per repeat **/
+static double run (svm::RelationClassifier &classifier, const surface::View &view, int repeats, surface::View &result)
+{
+  double time = 0.;
+  for (int r = 0; r < repeats; r++) {
+    result = view;
+    double ticks = cv::getTickCount ();
+    classifier.classify (&result, 1);
+    time += (cv::getTickCount () - ticks) / cv::getTickFrequency ();
+  }
+  return time / repeats;
+}
+
+/** Compare predictions and probabilities with the reference (jittered support vectors: training distribution) **/
+static void report (const char *name, double time, const surface::View &reference, const surface::View &result)
+{
+  unsigned agree = 0;
+  double diff = 0.;
+  for (unsigned i = 0; i < result.relations.size (); i++) {
+    if (result.relations[i].prediction == reference.relations[i].prediction)
+      agree++;
+    diff += fabs (result.relations[i].rel_probability[1] - reference.relations[i].rel_probability[1]);
+  }
+  unsigned n = result.relations.size ();
+  printf ("[classifier_benchmark] %-6s time: %f ms training-distribution agreement: %5.2f%% mean |dp|: %f\n", name, time * 1000.,
+          100. * agree / n, diff / n);
+}
+
+int main (int argc, char **argv)
+{
+  if (argc < 2) {
+    printf ("Usage: %s <model path> [<nr relations> [<repeats>]]\n", argv[0]);
+    return 1;
+  }
+  std::string models[2] = {"/PP-Trainingsset.txt.scaled.model", "/PP-Trainingsset.txt.scaled.model.fast"};
+  std::string params[2] = {"/param.txt", "/param.txt.fast"};
+  int nr_relations = (argc > 2 ? atoi (argv[2]) : 1000);
+  int repeats = (argc > 3 ? atoi (argv[3]) : 20);
+  srand (1);
+
+  for (int m = 0; m < 2; m++) {
+    std::string model_file = argv[1] + models[m];
+    std::string param_file = argv[1] + params[m];
+    svm::svm_model *model = svm::svm_load_model (model_file.c_str ());
+    double lower, upper;
+    std::vector<double> fmin, fmax;
+    if (model == 0 || !readScaling (param_file, lower, upper, fmin, fmax)) {
+      printf ("[classifier_benchmark] Error: Can't read model or scaling file: %s\n", model_file.c_str ());
+      return 1;
+    }
+
+    // jittered support vectors (scaled space) unscaled to the original features
+    surface::View view;
+    int nr_patches = 50;
+    for (int i = 0; i < nr_patches; i++) {
+      surface::SurfaceModel::Ptr surf (new surface::SurfaceModel ());
+      surf->indices.resize (100);
+      view.surfaces.push_back (surf);
+    }
+    for (int i = 0; i < nr_relations; i++) {
+      surface::Relation rel;
+      rel.type = 1;
+      rel.id_0 = i % nr_patches;
+      rel.id_1 = (i * 7 + 1) % nr_patches;
+      rel.rel_value.assign (fmin.size (), 0.);
+      for (const svm::svm_node *n = model->SV[rand () % model->l]; n->index != -1; n++)
+        if (n->index <= (int) fmin.size ())
+          rel.rel_value[n->index - 1] = n->value;
+      for (unsigned k = 0; k < fmin.size (); k++) {
+        double x = std::min (upper, std::max (lower, rel.rel_value[k] + 0.1 * randn ()));
+        rel.rel_value[k] = fmin[k] + (x - lower) * (fmax[k] - fmin[k]) / (upper - lower);
+      }
+      view.relations.push_back (rel);
+    }
+    svm::svm_free_and_destroy_model (&model);
+
+    printf ("[classifier_benchmark] %s: %d relations\n", model_file.c_str (), nr_relations);
+    svm::SVMPredictorSingle rbf (model_file);
+    rbf.setScaling (true, param_file);
+    surface::View reference;
+    double time = run (rbf, view, repeats, reference);
+    report ("rbf", time, reference, reference);
+
+    const char *types[2] = {"linear", "rff"};
+    for (int t = 0; t < 2; t++) {
+      svm::LinearPredictor approx (model_file + "." + types[t]);
+      if (!approx.valid ())
+        continue;
+      approx.setScaling (true, param_file);
+      surface::View result;
+      time = run (approx, view, repeats, result);
+      report (types[t], time, reference, result);
+    }
+  }
+  return 0;
+}
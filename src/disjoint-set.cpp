@@ -43,7 +43,12 @@ int universe::find(int x) {
   while (y != elts[y].p) {
     y = elts[y].p;
   }
-  elts[x].p = y;
+  // path compression: all elements on the path point to the root
+  while (x != y) {
+    int p = elts[x].p;
+    elts[x].p = y;
+    x = p;
+  }
   return y;
 }
 
@@ -0,0 +1,295 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file segmenter_benchmark.cpp
+ * @brief Replay a directory of organized pcd files through SegmenterLight: per-stage latency
+ * percentiles, peak memory, allocations per frame and agreement with stored reference labels.
+ * Usage: segmenter_benchmark <model path> <pcd directory> [options]
+ *   -config <file>   parameters of all stages (SegmenterConfig::load), later options override them
+ *   -d <detail>      detail of the pre-segmentation (0, 1, 2; default 2)
+ *   -m               with model abstraction (default: fast)
+ *   -c <classifier>  relation classifier (0: rbf, 1: linear, 2: rff; default 0)
+ *   -p <levels>      pyramid levels of the pre-segmentation (-1: automatic; default 0)
+ *   -temporal        warm start from the last frame
+ *   -u               unsupervised fallback mode (the pixel graph is timed as clustering)
+ *   -t <threads>     number of OpenMP threads (default: all)
+ *   -r <repeats>     process each cloud repeatedly (default 1)
+ *   -save <dir>      write the label images as reference (<dir>/<name>.png, 16 bit)
+ *   -check <dir>     compare with the reference label images, fails below the tolerance
+ *   -tol <fraction>  minimum agreement with the reference (default 0.999)
+ * The agreement of two label images is invariant to the label ids: the fraction of pixels
+ * covered by the best matching segments, the minimum of both directions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <new>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <opencv2/opencv.hpp>
+#include <pcl/io/pcd_io.h>
+
+#include <unknown_objects_segmentation/SegmenterLight.h>
+
+/* --------------- allocation counter --------------- */
+
+static unsigned long nr_allocations = 0;
+
+void *operator new (size_t size)
+{
+  __sync_fetch_and_add (&nr_allocations, 1);
+  void *p = malloc (size == 0 ? 1 : size);
+  if (p == 0)
+    throw std::bad_alloc ();
+  return p;
+}
+
+void *operator new[] (size_t size)
+{
+  return operator new (size);
+}
+
+void operator delete (void *p)
+{
+  free (p);
+}
+
+void operator delete[] (void *p)
+{
+  free (p);
+}
+
+/* --------------- helpers --------------- */
+
+/** Sorted pcd files of a directory **/
+static std::vector<std::string> listPCDFiles (const std::string &dir)
+{
+  std::vector<std::string> files;
+  DIR *dp = opendir (dir.c_str ());
+  if (dp == 0)
+    return files;
+  struct dirent *entry;
+  while ((entry = readdir (dp)) != 0) {
+    std::string name = entry->d_name;
+    if (name.size () > 4 && name.compare (name.size () - 4, 4, ".pcd") == 0)
+      files.push_back (name);
+  }
+  closedir (dp);
+  std::sort (files.begin (), files.end ());
+  return files;
+}
+
+/** Peak resident set size [MB] **/
+static double peakRSS ()
+{
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.;
+}
+
+/** Fraction of pixels of the 16 bit label image a covered by the best matching segment of b (0 only matches 0) **/
+static double coverage (const cv::Mat &a, const cv::Mat &b)
+{
+  std::map<unsigned short, std::map<unsigned short, unsigned> > overlap;
+  const unsigned short *pa = (const unsigned short*) a.data, *pb = (const unsigned short*) b.data;
+  for (int i = 0; i < a.rows * a.cols; i++)
+    overlap[pa[i]][pb[i]]++;
+  unsigned covered = 0;
+  std::map<unsigned short, std::map<unsigned short, unsigned> >::const_iterator it;
+  for (it = overlap.begin (); it != overlap.end (); ++it) {
+    unsigned best = 0;
+    std::map<unsigned short, unsigned>::const_iterator jt;
+    for (jt = it->second.begin (); jt != it->second.end (); ++jt)
+      if ((it->first == 0) == (jt->first == 0))
+        best = std::max (best, jt->second);
+    covered += best;
+  }
+  return a.rows * a.cols == 0 ? 1. : (double) covered / (a.rows * a.cols);
+}
+
+/** Agreement of two label images, independent of the label ids **/
+static double agreement (const cv::Mat &a, const cv::Mat &b)
+{
+  if (a.rows != b.rows || a.cols != b.cols)
+    return 0.;
+  return std::min (coverage (a, b), coverage (b, a));
+}
+
+/** Print percentiles of the values **/
+static void printPercentiles (const char *name, std::vector<double> values, double scale)
+{
+  if (values.empty ())
+    return;
+  std::sort (values.begin (), values.end ());
+  unsigned n = values.size ();
+  printf ("[segmenter_benchmark] %-10s p50: %8.2f p90: %8.2f p99: %8.2f max: %8.2f\n", name,
+          scale * values[(n - 1) / 2], scale * values[(n - 1) * 9 / 10], scale * values[(n - 1) * 99 / 100],
+          scale * values[n - 1]);
+}
+
+int main (int argc, char **argv)
+{
+  if (argc < 3) {
+    printf ("Usage: %s <model path> <pcd directory> [-config <file>] [-d <detail>] [-m] [-c <classifier>] [-p <levels>] [-temporal]\n"
+            "         [-u] [-t <threads>] [-r <repeats>] [-save <dir>] [-check <dir>] [-tol <fraction>]\n", argv[0]);
+    return 1;
+  }
+  std::string model_path = argv[1];
+  std::string pcd_dir = argv[2];
+  segment::SegmenterConfig config;
+  int threads = 0, repeats = 1;
+  std::string save_dir, check_dir;
+  double tolerance = 0.999;
+  for (int i = 3; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = (i + 1 < argc);
+    if (arg == "-config" && has_value) {
+      if (!config.load (argv[++i]))
+        return 1;
+    }
+    else if (arg == "-d" && has_value)
+      config.setDetail (atoi (argv[++i]));
+    else if (arg == "-m")
+      config.fast = false;
+    else if (arg == "-c" && has_value)
+      config.classifier = atoi (argv[++i]);
+    else if (arg == "-p" && has_value)
+      config.pyramid = atoi (argv[++i]);
+    else if (arg == "-temporal")
+      config.temporal = true;
+    else if (arg == "-u")
+      config.unsupervised = true;
+    else if (arg == "-t" && has_value)
+      threads = atoi (argv[++i]);
+    else if (arg == "-r" && has_value)
+      repeats = std::max (atoi (argv[++i]), 1);
+    else if (arg == "-save" && has_value)
+      save_dir = argv[++i];
+    else if (arg == "-check" && has_value)
+      check_dir = argv[++i];
+    else if (arg == "-tol" && has_value)
+      tolerance = atof (argv[++i]);
+    else {
+      printf ("[segmenter_benchmark] Error: Unknown option %s\n", arg.c_str ());
+      return 1;
+    }
+  }
+#ifdef _OPENMP
+  if (threads > 0)
+    omp_set_num_threads (threads);
+  threads = omp_get_max_threads ();
+#else
+  if (threads > 1) {
+    printf ("[segmenter_benchmark] Error: Built without OpenMP, -t %d is not available\n", threads);
+    return 1;
+  }
+  threads = 1;
+#endif
+
+  std::vector<std::string> files = listPCDFiles (pcd_dir);
+  if (files.empty ()) {
+    printf ("[segmenter_benchmark] Error: No pcd files in %s\n", pcd_dir.c_str ());
+    return 1;
+  }
+
+  segment::SegmenterLight segmenter (model_path);
+  segmenter.setConfig (config);
+  printf ("[segmenter_benchmark] %lu clouds, detail: %d fast: %d classifier: %d pyramid: %d temporal: %d unsupervised: %d threads: %d repeats: %d\n",
+          files.size (), config.detail, config.fast, config.classifier, config.pyramid, config.temporal,
+          config.unsupervised, threads, repeats);
+
+  const char *stage_names[8] = {"normals", "clustering", "modeling", "contours", "relations", "svm", "graphcut", "total"};
+  std::vector<double> stage_times[8];
+  std::vector<double> allocations;
+  unsigned nr_failed = 0;
+  double min_agreement = 1.;
+
+  for (unsigned f = 0; f < files.size (); f++) {
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
+    std::string filename = pcd_dir + "/" + files[f];
+    if (pcl::io::loadPCDFile (filename, *cloud) < 0 || !cloud->isOrganized ()) {
+      printf ("[segmenter_benchmark] Warning: Can't read organized cloud %s\n", filename.c_str ());
+      continue;
+    }
+
+    cv::Mat_<unsigned short> labels (cloud->height, cloud->width);
+    unsigned nr_objects = 0;
+    for (int r = 0; r < repeats; r++) {
+      unsigned long allocations_before = nr_allocations;
+      nr_objects = segmenter.processPointCloudLabels (cloud, (unsigned short*) labels.data);
+      allocations.push_back (nr_allocations - allocations_before);
+
+      const segment::SegmenterStats &stats = segmenter.getStats ();
+      double times[8] = {stats.t_normals, stats.t_clustering, stats.t_modeling, stats.t_contours,
+                         stats.t_relations, stats.t_svm, stats.t_graphcut, stats.t_total};
+      for (unsigned s = 0; s < 8; s++)
+        stage_times[s].push_back (times[s]);
+    }
+
+    std::string name = files[f].substr (0, files[f].size () - 4);
+    printf ("[segmenter_benchmark] %s: %u objects, %f ms", name.c_str (), nr_objects,
+            1000. * stage_times[7].back ());
+    if (!check_dir.empty ()) {
+      cv::Mat reference = cv::imread (check_dir + "/" + name + ".png", -1);
+      double agree = 0.;
+      if (reference.empty () || reference.type () != CV_16UC1)
+        printf (", no reference");
+      else {
+        agree = agreement (labels, reference);
+        printf (", agreement: %6.2f%%", 100. * agree);
+      }
+      min_agreement = std::min (min_agreement, agree);
+      if (agree < tolerance) {
+        printf (" FAILED");
+        nr_failed++;
+      }
+    }
+    printf ("\n");
+    if (!save_dir.empty () && !cv::imwrite (save_dir + "/" + name + ".png", labels))
+      printf ("[segmenter_benchmark] Warning: Can't write reference %s/%s.png\n", save_dir.c_str (), name.c_str ());
+  }
+
+  printf ("[segmenter_benchmark] latencies [ms] of %lu runs:\n", stage_times[7].size ());
+  for (unsigned s = 0; s < 8; s++)
+    printPercentiles (stage_names[s], stage_times[s], 1000.);
+  printPercentiles ("allocs", allocations, 1.);
+  printf ("[segmenter_benchmark] peak rss: %.1f MB\n", peakRSS ());
+  if (!check_dir.empty ()) {
+    printf ("[segmenter_benchmark] reference check: %u failed, minimum agreement: %6.2f%% (tolerance %6.2f%%)\n",
+            nr_failed, 100. * min_agreement, 100. * tolerance);
+    if (nr_failed > 0)
+      return 2;
+  }
+  return 0;
+}
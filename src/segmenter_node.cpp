@@ -1,7 +1,14 @@
 #include <ros/ros.h>
 #include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/image_encodings.h>
 #include <pcl_conversions/pcl_conversions.h>
+#include <pcl/io/pcd_io.h>
+#include <sstream>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 
 #include <unknown_objects_segmentation/SegmenterLight.h>
 
@@ -12,12 +19,21 @@
 #define ROS_PINK_STREAM(x) ROS_INFO_STREAM("\033[1;35m" << x << "\033[0m")
 #define ROS_CYAN_STREAM(x) ROS_INFO_STREAM("\033[1;36m" << x << "\033[0m")
 
+/**
+ * Segmentation runs on a worker thread. The callback only converts the message and puts
+ * the cloud into a single slot: a frame that arrives while the worker is busy replaces the
+ * waiting one (latest frame wins), so slow frames do not pile up in the callback queue.
+ * The worker writes the 16-bit label image (0: no object, i+1: object i) directly into the
+ * sensor_msgs/Image of the "labels" topic. The labeled cloud ("extrudedCloud", label i for
+ * object i as before) is only assembled when it has subscribers or is dumped.
+ */
 class SegmenterNode
 {
 protected:
   ros::NodeHandle _nh;
   ros::Subscriber _sub;
   ros::Publisher _pub;
+  ros::Publisher _pubLabels;
 
   boost::shared_ptr<segment::SegmenterLight> segmenter;
 
@@ -27,16 +43,30 @@ protected:
   double _minHeight;
   double _maxRange;
   int _desiredNumPoints;
+  std::string _dumpPrefix;              ///< Prefix of the binary pcd dumps (empty: no dumps)
+  double _dumpInterval;                 ///< Minimum time between two dumps (s)
+
+  // latest frame slot
+  boost::mutex _mutex;
+  boost::condition_variable _frameReady;
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr _frame;
+  std_msgs::Header _frameHeader;
+  bool _running;
+  unsigned _nrDropped;
+  boost::thread _worker;
+  pcl::PointCloud<pcl::PointXYZRGBL> _labeledCloud;     ///< Result of the worker, reused between frames
+
+  ros::Time _lastDump;
+  unsigned _nrDumps;
 
 public:
 
   SegmenterNode()
     : _nh("~")
+    , _running(true)
+    , _nrDropped(0)
+    , _nrDumps(0)
   {
-//    _sub = _nh.subscribe("cloud_in", 10, &SegmenterNode::cloudCallback, this);
-    _sub = _nh.subscribe("/camera/depth_registered/points", 1, &SegmenterNode::cloudCallback, this);
-    _pub = _nh.advertise<sensor_msgs::PointCloud2>("extrudedCloud",10);
-
 //    std::string model_path;
 //    if(!_nh.getParam("model_path", model_path))
 //    {
@@ -44,43 +74,175 @@ public:
 //    }
 
     segmenter.reset(new segment::SegmenterLight("/home/bencemagyar/tiago_ws/src/unknown_objects_segmentation/config/model/"));
+
+    bool print_stats;
+    _nh.param("print_stats", print_stats, false);
+    segmenter->setPrintStats(print_stats);
+    _nh.param("dump_prefix", _dumpPrefix, std::string(""));
+    _nh.param("dump_interval", _dumpInterval, 1.0);
+
+    _worker = boost::thread(&SegmenterNode::processFrames, this);
+
+    _pub = _nh.advertise<sensor_msgs::PointCloud2>("extrudedCloud",10);
+    _pubLabels = _nh.advertise<sensor_msgs::Image>("labels",10);
+//    _sub = _nh.subscribe("cloud_in", 10, &SegmenterNode::cloudCallback, this);
+    _sub = _nh.subscribe("/camera/depth_registered/points", 1, &SegmenterNode::cloudCallback, this);
+  }
+
+  ~SegmenterNode()
+  {
+    _sub.shutdown();
+    {
+      boost::mutex::scoped_lock lock(_mutex);
+      _running = false;
+    }
+    _frameReady.notify_one();
+    _worker.join();
   }
 
 protected:
 
-  void cloudCallback(const sensor_msgs::PointCloud2& cloud)
+  void cloudCallback(const sensor_msgs::PointCloud2ConstPtr& cloud)
+  {
+    // convert directly into the cloud handed over to the worker
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_to_segment_ptr(new pcl::PointCloud<pcl::PointXYZRGB>);
+    pcl::fromROSMsg(*cloud, *cloud_to_segment_ptr);
+
+    {
+      boost::mutex::scoped_lock lock(_mutex);
+      if(_frame)
+        _nrDropped++;
+      _frame = cloud_to_segment_ptr;
+      _frameHeader = cloud->header;
+    }
+    _frameReady.notify_one();
+  }
+
+  void processFrames()
   {
-    ros::Time timeStart(ros::Time::now());
+    while(true)
+    {
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_to_segment_ptr;
+      std_msgs::Header header;
+      unsigned nr_dropped;
+      {
+        boost::mutex::scoped_lock lock(_mutex);
+        while(_running && !_frame)
+          _frameReady.wait(lock);
+        if(!_running)
+          return;
+        cloud_to_segment_ptr.swap(_frame);
+        header = _frameHeader;
+        nr_dropped = _nrDropped;
+      }
 
-    pcl::PointCloud<pcl::PointXYZRGB> cloud_to_segment;
-    pcl::fromROSMsg(cloud, cloud_to_segment);
+      ros::Time timeStart(ros::Time::now());
 
-    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_to_segment_ptr(
-                new pcl::PointCloud<pcl::PointXYZRGB>(cloud_to_segment));
+      // and now, MAGIC!!
+      ROS_CYAN_STREAM("Now calling processPointCloudLabels");
+      sensor_msgs::ImagePtr labels(new sensor_msgs::Image);
+      labels->header = header;
+      labels->width = cloud_to_segment_ptr->width;
+      labels->height = cloud_to_segment_ptr->height;
+      labels->encoding = sensor_msgs::image_encodings::MONO16;
+      labels->is_bigendian = isBigEndian();
+      labels->step = labels->width * sizeof(unsigned short);
+      labels->data.resize(labels->step * labels->height);
 
-    // and now, MAGIC!!
-    ROS_CYAN_STREAM("Now calling processPointCloud");
-    pcl::PointCloud<pcl::PointXYZRGBL>::Ptr labeled_cloud_ptr =
-            segmenter->processPointCloud(cloud_to_segment_ptr);
+      // the segmenter marks invalid points as NaN in place: take the coordinates before
+      bool dump = dueForDump(timeStart);
+      bool labeled = _pub.getNumSubscribers() || dump;
+      if(labeled)
+        copyLabeledCloud(*cloud_to_segment_ptr, _labeledCloud);
 
-    pcl::io::savePCDFileASCII("test_pcd.pcd", *labeled_cloud_ptr);
+      if(!labels->data.empty())
+        segmenter->processPointCloudLabels(cloud_to_segment_ptr, (unsigned short*) &labels->data[0]);
 
-    if(_pub.getNumSubscribers())
+      if(_pubLabels.getNumSubscribers())
+        _pubLabels.publish(labels);
+
+      if(labeled)
+      {
+        setLabels(*labels, _labeledCloud);
+        if(dump)
+          dumpCloud(_labeledCloud, timeStart);
+      }
+
+      if(labeled && _pub.getNumSubscribers())
+      {
+          if(_labeledCloud.empty())
+          {
+              ROS_PINK_STREAM("Labeled cloud is empty, won't publish.");
+              continue;
+          }
+          ROS_YELLOW_STREAM("Publish segmented cloud...");
+          sensor_msgs::PointCloud2 cloud_out;
+          pcl::toROSMsg(_labeledCloud, cloud_out);
+          cloud_out.header = header;
+          _pub.publish(cloud_out);
+      }
+
+      ROS_INFO_STREAM("Segmentation runtime (s): " <<
+                      ros::Duration(ros::Time::now() - timeStart) << " (dropped frames: " << nr_dropped << ")");
+    }
+  }
+
+  static bool isBigEndian()
+  {
+    unsigned short one = 1;
+    return *((unsigned char*) &one) == 0;
+  }
+
+  /** Points of the labeled cloud from the input cloud, all labels 0 **/
+  static void copyLabeledCloud(const pcl::PointCloud<pcl::PointXYZRGB> &cloud,
+                               pcl::PointCloud<pcl::PointXYZRGBL> &labeled_cloud)
+  {
+    labeled_cloud.header = cloud.header;
+    labeled_cloud.width = cloud.width;
+    labeled_cloud.height = cloud.height;
+    labeled_cloud.is_dense = cloud.is_dense;
+    labeled_cloud.points.resize(cloud.points.size());
+    for(size_t i = 0; i < cloud.points.size(); i++)
     {
-        if(labeled_cloud_ptr->empty())
-        {
-            ROS_PINK_STREAM("Labeled cloud is empty, won't publish.");
-            return;
-        }
-        ROS_YELLOW_STREAM("Publish segmented cloud...");
-        sensor_msgs::PointCloud2 cloud_out;
-        cloud_out.header.frame_id = cloud.header.frame_id;
-        pcl::toROSMsg(*labeled_cloud_ptr, cloud_out);
-        _pub.publish(cloud_out);
+      pcl::PointXYZRGBL &pt = labeled_cloud.points[i];
+      pt.x = cloud.points[i].x;
+      pt.y = cloud.points[i].y;
+      pt.z = cloud.points[i].z;
+      pt.rgba = cloud.points[i].rgba;
+      pt.label = 0;
     }
+  }
+
+  /** Labels of the labeled cloud from the label image (label i for object i, 0 without object) **/
+  static void setLabels(const sensor_msgs::Image &labels, pcl::PointCloud<pcl::PointXYZRGBL> &labeled_cloud)
+  {
+    if(labels.data.empty())
+      return;
+    const unsigned short *l = (const unsigned short*) &labels.data[0];
+    for(size_t i = 0; i < labeled_cloud.points.size(); i++)
+      labeled_cloud.points[i].label = (l[i] == 0 ? 0 : l[i] - 1);
+  }
+
+  /** Dump enabled and last dump older than the dump interval **/
+  bool dueForDump(const ros::Time &now) const
+  {
+    if(_dumpPrefix.empty())
+      return false;
+    return _nrDumps == 0 || (now - _lastDump).toSec() >= _dumpInterval;
+  }
+
+  /** Save binary pcd file **/
+  void dumpCloud(const pcl::PointCloud<pcl::PointXYZRGBL> &labeled_cloud, const ros::Time &now)
+  {
+    if(labeled_cloud.empty())
+      return;
 
-    ROS_INFO_STREAM("Callback runtime (s): " <<
-                    ros::Duration(ros::Time::now() - timeStart));
+    std::stringstream filename;
+    filename << _dumpPrefix << _nrDumps << ".pcd";
+    if(pcl::io::savePCDFileBinary(filename.str(), labeled_cloud) < 0)
+      ROS_RED_STREAM("Can't save " << filename.str());
+    _lastDump = now;
+    _nrDumps++;
   }
 
 };
@@ -89,18 +251,9 @@ protected:
 int main (int argc, char *argv[])
 {
   ros::init(argc, argv, "segmenter_node");
-  ros::Time::init();
-  ros::Rate rate(10);
 
   SegmenterNode node;
-
-  while(ros::ok())
-  {
-    ros::spinOnce();
-    rate.sleep();
-  }
+  ros::spin();
 
   return 0;
 }
-
-
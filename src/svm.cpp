@@ -2557,39 +2557,47 @@ double svm_predict_probability(
 	if ((model->param.svm_type == C_SVC || model->param.svm_type == NU_SVC) &&
 	    model->probA!=NULL && model->probB!=NULL)
 	{
-		int i;
 		int nr_class = model->nr_class;
 		double *dec_values = Malloc(double, nr_class*(nr_class-1)/2);
 		svm_predict_values(model, x, dec_values);
-
-		double min_prob=1e-7;
-		double **pairwise_prob=Malloc(double *,nr_class);
-		for(i=0;i<nr_class;i++)
-			pairwise_prob[i]=Malloc(double,nr_class);
-		int k=0;
-		for(i=0;i<nr_class;i++)
-			for(int j=i+1;j<nr_class;j++)
-			{
-				pairwise_prob[i][j]=min(max(sigmoid_predict(dec_values[k],model->probA[k],model->probB[k]),min_prob),1-min_prob);
-				pairwise_prob[j][i]=1-pairwise_prob[i][j];
-				k++;
-			}
-		multiclass_probability(nr_class,pairwise_prob,prob_estimates);
-
-		int prob_max_idx = 0;
-		for(i=1;i<nr_class;i++)
-			if(prob_estimates[i] > prob_estimates[prob_max_idx])
-				prob_max_idx = i;
-		for(i=0;i<nr_class;i++)
-			free(pairwise_prob[i]);
+		double label = svm_predict_probability_values(model, dec_values, prob_estimates);
 		free(dec_values);
-		free(pairwise_prob);	     
-		return model->label[prob_max_idx];
+		return label;
 	}
 	else 
 		return svm_predict(model, x);
 }
 
+double svm_predict_probability_values(
+	const svm_model *model, const double *dec_values, double *prob_estimates)
+{
+	int i;
+	int nr_class = model->nr_class;
+
+	double min_prob=1e-7;
+	double **pairwise_prob=Malloc(double *,nr_class);
+	for(i=0;i<nr_class;i++)
+		pairwise_prob[i]=Malloc(double,nr_class);
+	int k=0;
+	for(i=0;i<nr_class;i++)
+		for(int j=i+1;j<nr_class;j++)
+		{
+			pairwise_prob[i][j]=min(max(sigmoid_predict(dec_values[k],model->probA[k],model->probB[k]),min_prob),1-min_prob);
+			pairwise_prob[j][i]=1-pairwise_prob[i][j];
+			k++;
+		}
+	multiclass_probability(nr_class,pairwise_prob,prob_estimates);
+
+	int prob_max_idx = 0;
+	for(i=1;i<nr_class;i++)
+		if(prob_estimates[i] > prob_estimates[prob_max_idx])
+			prob_max_idx = i;
+	for(i=0;i<nr_class;i++)
+		free(pairwise_prob[i]);
+	free(pairwise_prob);	     
+	return model->label[prob_max_idx];
+}
+
 static const char *svm_type_table[] =
 {
 	"c_svc","nu_svc","one_class","epsilon_svr","nu_svr",NULL
@@ -0,0 +1,178 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file svm_approx_model.cpp
+ * @brief Approximate a two-class RBF SVM model with a model for the LinearPredictor.
+ * Usage: svm_approx_model linear|rff <model> <output> [<nr rff components> [<seed>]]
+ * The original training data is not available: the weights are a least squares fit of the
+ * svm decision values of the support vectors and jittered copies of them.
+ *   linear: features x
+ *   rff: random Fourier features sqrt(2/D) cos(omega x + phase) of the RBF kernel
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include <unknown_objects_segmentation/svm.h>
+
+/** Normal distributed random value (Box-Muller) **/
+static double randn ()
+{
+  double u1 = (rand () + 1.) / ((double) RAND_MAX + 2.);
+  double u2 = (rand () + 1.) / ((double) RAND_MAX + 2.);
+  return sqrt (-2. * log (u1)) * cos (2. * M_PI * u2);
+}
+
+/** Copy a dense vector to svm nodes **/
+static void toNodes (const Eigen::VectorXd &x, std::vector<svm::svm_node> &nodes)
+{
+  nodes.resize (x.size () + 1);
+  for (int i = 0; i < x.size (); i++) {
+    nodes[i].index = i + 1;
+    nodes[i].value = x[i];
+  }
+  nodes[x.size ()].index = -1;
+}
+
+int main (int argc, char **argv)
+{
+  if (argc < 4 || (strcmp (argv[1], "linear") != 0 && strcmp (argv[1], "rff") != 0)) {
+    printf ("Usage: %s linear|rff <model> <output> [<nr rff components> [<seed>]]\n", argv[0]);
+    return 1;
+  }
+  bool rff = strcmp (argv[1], "rff") == 0;
+  int nr_components = (argc > 4 ? atoi (argv[4]) : 64);
+  srand (argc > 5 ? atoi (argv[5]) : 1);
+
+  svm::svm_model *model = svm::svm_load_model (argv[2]);
+  if (model == 0) {
+    printf ("[svm_approx_model] Error: Can't open model file: %s\n", argv[2]);
+    return 1;
+  }
+  if (model->nr_class != 2 || model->param.kernel_type != svm::RBF || svm::svm_check_probability_model (model) == 0) {
+    printf ("[svm_approx_model] Error: Only two-class RBF models with probability estimates are supported.\n");
+    return 1;
+  }
+
+  // dense support vectors
+  int l = model->l;
+  int dim = 0;
+  for (int i = 0; i < l; i++)
+    for (const svm::svm_node *n = model->SV[i]; n->index != -1; n++)
+      dim = std::max (dim, n->index);
+  Eigen::MatrixXd sv = Eigen::MatrixXd::Zero (l, dim);
+  for (int i = 0; i < l; i++)
+    for (const svm::svm_node *n = model->SV[i]; n->index != -1; n++)
+      sv (i, n->index - 1) = n->value;
+
+  // samples: support vectors and jittered copies with the decision values of the svm
+  int nr_jitter = 20;
+  Eigen::MatrixXd X (l * (nr_jitter + 1), dim);
+  Eigen::VectorXd b (X.rows ());
+  std::vector<svm::svm_node> nodes;
+  for (int i = 0, r = 0; i < l; i++) {
+    for (int j = 0; j <= nr_jitter; j++, r++) {
+      Eigen::VectorXd x = sv.row (i).transpose ();
+      if (j > 0)
+        for (int k = 0; k < dim; k++)
+          x[k] += 0.1 * randn ();
+      toNodes (x, nodes);
+      svm::svm_predict_values (model, &nodes[0], &b[r]);
+      X.row (r) = x.transpose ();
+    }
+  }
+
+  // features: x (linear) or sqrt(2/D) cos(omega x + phase) with omega ~ N(0, 2 gamma) (rff)
+  Eigen::MatrixXd omega;
+  Eigen::VectorXd phase;
+  Eigen::MatrixXd A;
+  if (rff) {
+    double sigma = sqrt (2. * model->param.gamma);
+    omega.resize (nr_components, dim);
+    phase.resize (nr_components);
+    for (int j = 0; j < nr_components; j++) {
+      for (int k = 0; k < dim; k++)
+        omega (j, k) = sigma * randn ();
+      phase[j] = 2. * M_PI * rand () / ((double) RAND_MAX + 1.);
+    }
+    A = X * omega.transpose ();
+    double norm = sqrt (2. / nr_components);
+    for (int r = 0; r < A.rows (); r++)
+      for (int j = 0; j < nr_components; j++)
+        A (r, j) = norm * cos (A (r, j) + phase[j]);
+  }
+  else {
+    A = X;
+    nr_components = dim;
+  }
+
+  // ridge regression of the decision values: [w bias]
+  Eigen::MatrixXd Ab (A.rows (), nr_components + 1);
+  Ab.leftCols (nr_components) = A;
+  Ab.col (nr_components).setOnes ();
+  Eigen::MatrixXd AtA = Ab.transpose () * Ab + 1e-6 * Eigen::MatrixXd::Identity (nr_components + 1, nr_components + 1);
+  Eigen::VectorXd theta = AtA.ldlt ().solve (Ab.transpose () * b);
+  Eigen::VectorXd w = theta.head (nr_components);
+  double bias = theta[nr_components];
+
+  FILE *fp = fopen (argv[3], "w");
+  if (fp == NULL) {
+    printf ("[svm_approx_model] Error: Can't open file: %s\n", argv[3]);
+    return 1;
+  }
+  fprintf (fp, "model_type %s\n", rff ? "rff" : "linear");
+  fprintf (fp, "dim %d\n", dim);
+  fprintf (fp, "nr_components %d\n", nr_components);
+  fprintf (fp, "label %d %d\n", model->label[0], model->label[1]);
+  fprintf (fp, "probA %.17g\n", model->probA[0]);
+  fprintf (fp, "probB %.17g\n", model->probB[0]);
+  fprintf (fp, "bias %.17g\n", bias);
+  fprintf (fp, "w");
+  for (int j = 0; j < nr_components; j++)
+    fprintf (fp, " %.17g", w[j]);
+  fprintf (fp, "\n");
+  if (rff) {
+    fprintf (fp, "omega\n");
+    for (int j = 0; j < nr_components; j++) {
+      for (int k = 0; k < dim; k++)
+        fprintf (fp, "%.17g ", omega (j, k));
+      fprintf (fp, "\n");
+    }
+    fprintf (fp, "phase");
+    for (int j = 0; j < nr_components; j++)
+      fprintf (fp, " %.17g", phase[j]);
+    fprintf (fp, "\n");
+  }
+  fclose (fp);
+  svm::svm_free_and_destroy_model (&model);
+
+  printf ("[svm_approx_model] Saved %s model: %s\n", rff ? "rff" : "linear", argv[3]);
+  return 0;
+}
@@ -0,0 +1,53 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file svm_convert_model.cpp
+ * @brief Convert a libsvm text model and its scaling parameters to a binary model file.
+ * Usage: svm_convert_model <model> <scaling parameter> [<binary model>]
+ * The binary model defaults to <model>.bin, which is preferred by SegmenterLight.
+ */
+
+#include <stdio.h>
+#include <string>
+
+#include <unknown_objects_segmentation/SVMPredictorSingle.h>
+
+int main (int argc, char **argv)
+{
+  if (argc < 3) {
+    printf ("Usage: %s <model> <scaling parameter> [<binary model>]\n", argv[0]);
+    return 1;
+  }
+
+  std::string model_file (argv[1]);
+  std::string binary_file = (argc > 3 ? std::string (argv[3]) : model_file + ".bin");
+
+  svm::SVMPredictorSingle predictor (model_file);
+  predictor.setScaling (true, argv[2]);
+  if (!predictor.saveBinary (binary_file))
+    return 1;
+
+  printf ("[svm_convert_model] Saved binary model: %s\n", binary_file.c_str ());
+  return 0;
+}
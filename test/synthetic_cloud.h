@@ -0,0 +1,113 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file synthetic_cloud.h
+ * @brief Organized synthetic clouds of the regression tests (pinhole camera, f = 525).
+ */
+
+#ifndef UNKNOWN_OBJECTS_SEGMENTATION_TEST_SYNTHETIC_CLOUD_H
+#define UNKNOWN_OBJECTS_SEGMENTATION_TEST_SYNTHETIC_CLOUD_H
+
+#include <limits>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace test
+{
+
+typedef pcl::PointCloud<pcl::PointXYZRGB> Cloud;
+
+static const float FOCAL = 525.f;       ///< Focal length [px] of the synthetic camera
+
+/** Point of pixel (u,v) at depth z on the ray of the synthetic camera **/
+inline void
+setPoint (Cloud &cloud, int u, int v, float z, unsigned char r=128, unsigned char g=128, unsigned char b=128)
+{
+  pcl::PointXYZRGB &pt = cloud.points[v*cloud.width + u];
+  pt.z = z;
+  pt.x = (u - cloud.width/2.f) * z / FOCAL;
+  pt.y = (v - cloud.height/2.f) * z / FOCAL;
+  pt.r = r;
+  pt.g = g;
+  pt.b = b;
+}
+
+/** Invalid point at pixel (u,v) **/
+inline void
+setNaN (Cloud &cloud, int u, int v)
+{
+  pcl::PointXYZRGB &pt = cloud.points[v*cloud.width + u];
+  pt.x = pt.y = pt.z = std::numeric_limits<float>::quiet_NaN();
+}
+
+/** Depth of the plane z = z0 + slope*x on the ray of column u **/
+inline float
+planeDepth (const Cloud &cloud, int u, float z0, float slope)
+{
+  return z0 / (1.f - slope * (u - cloud.width/2.f) / FOCAL);
+}
+
+/** Plane z = z0 + slope*x over the whole image, depth noise of +-noise/2 (deterministic) **/
+inline Cloud::Ptr
+makePlane (int width, int height, float z0, float slope=0.f, float noise=0.f)
+{
+  Cloud::Ptr cloud (new Cloud);
+  cloud->width = width;
+  cloud->height = height;
+  cloud->is_dense = false;
+  cloud->points.resize (width*height);
+  unsigned seed = 1;
+  for (int v=0; v<height; v++) {
+    for (int u=0; u<width; u++) {
+      seed = seed*1103515245u + 12345u;
+      float n = noise * (((seed >> 16) % 1000) / 1000.f - 0.5f);
+      setPoint (*cloud, u, v, planeDepth (*cloud, u, z0, slope) + n);
+    }
+  }
+  return cloud;
+}
+
+/** Fronto-parallel box face at depth z in the pixel rectangle [u0,u1) x [v0,v1) **/
+inline void
+addBox (Cloud &cloud, int u0, int v0, int u1, int v1, float z,
+        unsigned char r=200, unsigned char g=60, unsigned char b=60)
+{
+  for (int v=v0; v<v1; v++)
+    for (int u=u0; u<u1; u++)
+      setPoint (cloud, u, v, z, r, g, b);
+}
+
+/** Scattered NaN pixels (every period-th pixel of a diagonal pattern) and a sparse block with single valid points **/
+inline void
+addHoles (Cloud &cloud, int period, int u0, int v0, int u1, int v1)
+{
+  for (int v=0; v<(int)cloud.height; v++)
+    for (int u=0; u<(int)cloud.width; u++)
+      if ((7*u + 13*v) % period == 0 || (u >= u0 && u < u1 && v >= v0 && v < v1 && (u % 4 != 0 || v % 4 != 0)))
+        setNaN (cloud, u, v);
+}
+
+}
+
+#endif
@@ -0,0 +1,112 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+/**
+ * @file test_coarse_to_fine.cpp
+ * @brief Upsampling of the coarse pre-segmentation (CoarseToFine).
+ */
+
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include <unknown_objects_segmentation/SegmenterLight.h>
+#include "synthetic_cloud.h"
+
+namespace
+{
+
+/** Coarse normals and patches of the cloud with the parameters of SegmenterLight **/
+void
+presegmentCoarse (surface::CoarseToFine &c2f, const test::Cloud::Ptr &cloud, surface::View &coarse_view)
+{
+  segment::SegmenterConfig config;
+  c2f.setLevel (1);
+  c2f.setInputCloud (cloud);
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr &coarse = c2f.getCoarseCloud ();
+  surface::ZAdaptiveNormals nor (config.normals);
+  nor.setParameter (config.normals);
+  nor.setInputCloud (coarse);
+  nor.compute ();
+  nor.getNormals (coarse_view.normals);
+
+  surface::ClusterNormalsToPlanes cluster (config.clustering);
+  cluster.setPixelCheck (config.pixelCheck, config.pixelCheckNeighbors);
+  cluster.setInputCloud (coarse);
+  cluster.setView (&coarse_view);
+  cluster.compute ();
+}
+
+}
+
+/** The coarse patches are left unchanged **/
+TEST (CoarseToFine, KeepsCoarseView)
+{
+  test::Cloud::Ptr cloud = test::makePlane (160, 120, 1.5f, 0.f, 0.001f);
+  test::addBox (*cloud, 50, 30, 110, 90, 1.f);
+  surface::CoarseToFine c2f;
+  surface::View coarse_view, view;
+  presegmentCoarse (c2f, cloud, coarse_view);
+  ASSERT_GT (coarse_view.surfaces.size (), 1u);
+  std::vector<std::vector<int> > indices;
+  std::vector<int> ids;
+  for (unsigned i=0; i<coarse_view.surfaces.size (); i++) {
+    indices.push_back (coarse_view.surfaces[i]->indices);
+    ids.push_back (coarse_view.surfaces[i]->idx);
+  }
+
+  c2f.setView (&view);
+  c2f.compute (*coarse_view.normals, coarse_view.surfaces);
+  ASSERT_EQ (indices.size (), coarse_view.surfaces.size ());
+  for (unsigned i=0; i<coarse_view.surfaces.size (); i++) {
+    EXPECT_EQ (indices[i], coarse_view.surfaces[i]->indices);
+    EXPECT_EQ (ids[i], coarse_view.surfaces[i]->idx);
+    for (unsigned j=0; j<view.surfaces.size (); j++)
+      EXPECT_NE (coarse_view.surfaces[i].get (), view.surfaces[j].get ());
+  }
+  ASSERT_FALSE (view.surfaces.empty ());
+  for (unsigned i=0; i<view.surfaces.size (); i++)
+    EXPECT_EQ (view.surfaces[i]->indices.size (), view.surfaces[i]->normals.size ());
+}
+
+/** Valid pixels beyond the last coarse column take a valid neighbour block **/
+TEST (CoarseToFine, ClampedBorder)
+{
+  // odd width: the last column is clamped to the last coarse block, which is invalid,
+  // and is too far from the wall plane for the border refinement
+  test::Cloud::Ptr cloud = test::makePlane (161, 120, 1.5f, 0.f, 0.001f);
+  for (int v=0; v<120; v++) {
+    for (int u=158; u<160; u++)
+      test::setNaN (*cloud, u, v);
+    test::setPoint (*cloud, 160, v, 1.45f);
+  }
+  surface::CoarseToFine c2f;
+  surface::View coarse_view, view;
+  presegmentCoarse (c2f, cloud, coarse_view);
+  c2f.setView (&view);
+  c2f.compute (*coarse_view.normals, coarse_view.surfaces);
+
+  for (int v=2; v<118; v++) {
+    const pcl::Normal &n = view.normals->points[v*161 + 160];
+    ASSERT_FALSE (isnan (n.normal_x)) << "row " << v;
+    EXPECT_LT (n.normal_z, -0.9f);
+  }
+}
@@ -0,0 +1,127 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file test_contour_detector.cpp
+ * @brief Edgels and corners of ContourDetector against the per-pixel construction of the original version.
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+
+#include <unknown_objects_segmentation/ContourDetector.h>
+#include "synthetic_cloud.h"
+
+namespace
+{
+
+/** Edgel of a pixel of the original per-pixel construction (index -1: no edgel) **/
+struct PixelEdgel
+{
+  int index, corner_idx;
+  bool horizontal, vertical;
+};
+
+/** Corners and edgels of the original version: each corner also writes the edgels below and right of it **/
+void
+referenceEdgels (const std::vector<int> &p, int w, int h, std::vector<PixelEdgel> &edgels, std::vector<int> &corners)
+{
+  PixelEdgel none = {-1, -1, false, false};
+  edgels.assign (w*h, none);
+  corners.clear ();
+  for (int row=0; row<h-1; row++) {
+    for (int col=0; col<w-1; col++) {
+      int idx = row*w + col;
+      unsigned found = (p[idx] != p[idx+1]) + (p[idx+1] != p[idx+w+1]) + (p[idx+w+1] != p[idx+w]) + (p[idx+w] != p[idx]);
+      PixelEdgel &e = edgels[idx];
+      if (found >= 3) {
+        corners.push_back (idx);
+        if (p[idx] != p[idx+1]) {e.corner_idx = e.index = idx; e.horizontal = true;}
+        if (p[idx+w] != p[idx+w+1]) {PixelEdgel &e2 = edgels[idx+w]; e2.corner_idx = e2.index = idx; e2.horizontal = true;}
+        if (p[idx] != p[idx+w]) {e.corner_idx = e.index = idx; e.vertical = true;}
+        if (p[idx+1] != p[idx+w+1]) {PixelEdgel &e2 = edgels[idx+1]; e2.corner_idx = e2.index = idx; e2.vertical = true;}
+      }
+      else {
+        if (p[idx] != p[idx+1]) {e.index = idx; e.horizontal = true;}
+        if (p[idx] != p[idx+w]) {e.index = idx; e.vertical = true;}
+      }
+    }
+  }
+}
+
+}
+
+/** Same edgels (corner, direction) and corners as the original version, also in the last row and column **/
+TEST (ContourDetector, EdgelsMatchOriginal)
+{
+  const int w = 24, h = 18;
+  test::Cloud::Ptr cloud = test::makePlane (w, h, 1.f);
+  surface::View view;
+  std::vector<int> p (w*h, -1);
+  unsigned seed = 7;
+  for (int i=0; i<w*h; i++) {
+    seed = seed*1103515245u + 12345u;
+    int block = ((i % w) / 3 + 5 * ((i / w) / 3)) % 7;            // 3x3 blocks, some pixels changed
+    int id = ((seed >> 16) % 5 == 0 ? (int) ((seed >> 20) % 4) : block % 4);
+    if (block == 6)
+      id = -1;                                                    // pixels without patch
+    p[i] = id;
+  }
+  for (int k=0; k<4; k++)
+    view.surfaces.push_back (surface::SurfaceModel::Ptr (new surface::SurfaceModel ()));
+  for (int i=0; i<w*h; i++)
+    if (p[i] >= 0)
+      view.surfaces[p[i]]->indices.push_back (i);
+
+  surface::ContourDetector detector;
+  detector.setInputCloud (cloud);
+  detector.setView (&view);
+  detector.computeEdgels ();
+
+  std::vector<PixelEdgel> ref;
+  std::vector<int> ref_corners;
+  referenceEdgels (p, w, h, ref, ref_corners);
+
+  const std::vector<surface::aCorner> &corners = detector.getCorners ();
+  ASSERT_EQ (ref_corners.size (), corners.size ());
+  for (unsigned i=0; i<corners.size (); i++)
+    EXPECT_EQ (ref_corners[i], corners[i].index);
+
+  const std::vector<surface::aEdgel> &edgels = detector.getEdgels ();
+  unsigned nr_ref = 0, nr_border = 0;
+  for (int i=0; i<w*h; i++) {
+    if (ref[i].index == -1)
+      continue;
+    ASSERT_LT (nr_ref, edgels.size ());
+    const surface::aEdgel &e = edgels[nr_ref++];
+    ASSERT_EQ (i, e.index);
+    EXPECT_EQ (ref[i].corner_idx, e.corner_idx) << "pixel " << i;
+    EXPECT_EQ (ref[i].horizontal, e.horizontal) << "pixel " << i;
+    EXPECT_EQ (ref[i].vertical, e.vertical) << "pixel " << i;
+    if (i % w == w-1 || i / w == h-1)
+      nr_border++;
+  }
+  EXPECT_EQ (nr_ref, edgels.size ());
+  EXPECT_EQ (edgels.size (), view.edgels.size ());
+  EXPECT_GT (nr_border, 0u);              // the image contains edgels of the last row or column
+}
@@ -0,0 +1,163 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file test_graph.cpp
+ * @brief Pixel graph of the unsupervised mode (Graph::BuildFromPointCloud).
+ */
+
+#include <gtest/gtest.h>
+#include <set>
+#include <utility>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <unknown_objects_segmentation/Graph.h>
+#include "synthetic_cloud.h"
+
+namespace
+{
+
+/** Normals facing the camera **/
+pcl::PointCloud<pcl::Normal>::Ptr
+frontNormals (const test::Cloud &cloud)
+{
+  pcl::PointCloud<pcl::Normal>::Ptr normals (new pcl::PointCloud<pcl::Normal>);
+  normals->width = cloud.width;
+  normals->height = cloud.height;
+  normals->points.resize (cloud.points.size ());
+  for (size_t i=0; i<normals->points.size (); i++) {
+    pcl::Normal &n = normals->points[i];
+    n.normal[0] = 0.f;
+    n.normal[1] = 0.f;
+    n.normal[2] = -1.f;
+    n.curvature = 0.f;
+  }
+  return normals;
+}
+
+void
+buildGraph (test::Cloud::Ptr &cloud, pcl::PointCloud<pcl::Normal>::Ptr &normals, std::vector<gc::Edge> &edges)
+{
+  gc::Graph graph;
+  unsigned num_edges = 0;
+  ASSERT_TRUE (graph.BuildFromPointCloud (cloud, normals, edges, num_edges));
+  ASSERT_EQ (edges.size (), num_edges);
+}
+
+}
+
+/** Right, bottom, bottom-right and bottom-left edges of all pixels but the last row and column, once each **/
+TEST (PixelGraph, EdgesOfValidCloud)
+{
+  const int width = 32, height = 24;
+  test::Cloud::Ptr cloud = test::makePlane (width, height, 1.f);
+  pcl::PointCloud<pcl::Normal>::Ptr normals = frontNormals (*cloud);
+  std::vector<gc::Edge> edges;
+  buildGraph (cloud, normals, edges);
+
+  EXPECT_EQ ((size_t) (height-1)*(4*(width-1)-1), edges.size ());
+  std::set<std::pair<int, int> > pairs;
+  for (size_t i=0; i<edges.size (); i++) {
+    const gc::Edge &e = edges[i];
+    ASSERT_GE (e.a, 0);
+    ASSERT_LT (e.b, width*height);
+    EXPECT_TRUE (pairs.insert (std::make_pair (e.a, e.b)).second) << "duplicate edge " << e.a << " " << e.b;
+    EXPECT_EQ (0.f, e.w);                       // uniform colour
+    EXPECT_NEAR (0.f, e.w2, 1e-3);              // parallel normals
+  }
+}
+
+/** Depth gaps and invalid points cut the graph, colour distances are normalised to the maximum **/
+TEST (PixelGraph, DepthGapsAndColour)
+{
+  const int width = 40, height = 30;
+  test::Cloud::Ptr cloud = test::makePlane (width, height, 1.5f);
+  test::addBox (*cloud, 10, 8, 20, 18, 1.f);
+  test::setNaN (*cloud, 30, 20);
+  pcl::PointCloud<pcl::Normal>::Ptr normals = frontNormals (*cloud);
+  std::vector<gc::Edge> edges;
+  buildGraph (cloud, normals, edges);
+
+  float max_w = 0.f;
+  for (size_t i=0; i<edges.size (); i++) {
+    const gc::Edge &e = edges[i];
+    bool in_a = (e.a % width >= 10 && e.a % width < 20 && e.a / width >= 8 && e.a / width < 18);
+    bool in_b = (e.b % width >= 10 && e.b % width < 20 && e.b / width >= 8 && e.b / width < 18);
+    EXPECT_EQ (in_a, in_b) << "edge across the depth gap " << e.a << " " << e.b;
+    EXPECT_NE (30 + 20*width, e.a);
+    EXPECT_NE (30 + 20*width, e.b);
+    EXPECT_GE (e.w, 0.f);
+    EXPECT_LE (e.w, 1.f);
+    max_w = std::max (max_w, e.w);
+  }
+  EXPECT_FLOAT_EQ (0.f, max_w);                 // box edges are inside one colour
+}
+
+/** Edges and weights do not depend on the number of threads **/
+TEST (PixelGraph, ThreadInvariant)
+{
+  const int width = 64, height = 48;
+  test::Cloud::Ptr cloud = test::makePlane (width, height, 1.2f, 0.5f, 0.002f);
+  for (size_t i=0; i<cloud->points.size (); i++)
+    cloud->points[i].r = (unsigned char) ((i * 37) % 256);
+  pcl::PointCloud<pcl::Normal>::Ptr normals = frontNormals (*cloud);
+
+  std::vector<gc::Edge> ref, edges;
+#ifdef _OPENMP
+  int threads = omp_get_max_threads ();
+  omp_set_num_threads (1);
+  buildGraph (cloud, normals, ref);
+  omp_set_num_threads (std::max (threads, 3));
+  buildGraph (cloud, normals, edges);
+  omp_set_num_threads (threads);
+#else
+  buildGraph (cloud, normals, ref);
+  buildGraph (cloud, normals, edges);
+#endif
+
+  ASSERT_EQ (ref.size (), edges.size ());
+  float max_w = 0.f;
+  for (size_t i=0; i<ref.size (); i++) {
+    EXPECT_EQ (ref[i].a, edges[i].a);
+    EXPECT_EQ (ref[i].b, edges[i].b);
+    EXPECT_EQ (ref[i].w, edges[i].w);
+    max_w = std::max (max_w, edges[i].w);
+  }
+  EXPECT_FLOAT_EQ (1.f, max_w);
+}
+
+/** Normals of another cloud are rejected without edges **/
+TEST (PixelGraph, NormalsMismatch)
+{
+  test::Cloud::Ptr cloud = test::makePlane (32, 24, 1.f);
+  test::Cloud::Ptr other = test::makePlane (16, 12, 1.f);
+  pcl::PointCloud<pcl::Normal>::Ptr normals = frontNormals (*other);
+  gc::Graph graph;
+  std::vector<gc::Edge> edges (3);
+  unsigned num_edges = 3;
+  EXPECT_FALSE (graph.BuildFromPointCloud (cloud, normals, edges, num_edges));
+  EXPECT_EQ (0u, edges.size ());
+  EXPECT_EQ (0u, num_edges);
+}
@@ -0,0 +1,188 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+/**
+ * @file test_normals.cpp
+ * @brief Normals of ZAdaptiveNormals: summed-area table against the exact neighbourhood.
+ */
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <unknown_objects_segmentation/ZAdaptiveNormals.hh>
+#include "synthetic_cloud.h"
+
+namespace
+{
+
+/** Paraboloid z = z0 + c*(x^2+y^2): the normal changes from pixel to pixel **/
+test::Cloud::Ptr
+makeBowl (int width, int height, float z0, float c)
+{
+  test::Cloud::Ptr cloud = test::makePlane (width, height, z0);
+  for (int v=0; v<height; v++) {
+    for (int u=0; u<width; u++) {
+      float xn = (u - width/2.f) / test::FOCAL, yn = (v - height/2.f) / test::FOCAL;
+      // z = z0 + c*z^2*(xn^2+yn^2), nearer root
+      float a = c * (xn*xn + yn*yn);
+      float z = (a > 0.f ? (1.f - sqrt (1.f - 4.f*a*z0)) / (2.f*a) : z0);
+      test::setPoint (*cloud, u, v, z);
+    }
+  }
+  return cloud;
+}
+
+/** Normals of a copy of the input, the copy (invalid points marked NaN) is returned in cloud **/
+pcl::PointCloud<pcl::Normal>::Ptr
+estimate (const test::Cloud &input, const surface::ZAdaptiveNormals::Parameter &param, test::Cloud::Ptr &cloud)
+{
+  cloud.reset (new test::Cloud (input));
+  surface::ZAdaptiveNormals nor (param);
+  nor.setParameter (param);
+  nor.setInputCloud (cloud);
+  nor.compute ();
+  pcl::PointCloud<pcl::Normal>::Ptr normals;
+  nor.getNormals (normals);
+  return normals;
+}
+
+pcl::PointCloud<pcl::Normal>::Ptr
+estimate (const test::Cloud &input, const surface::ZAdaptiveNormals::Parameter &param)
+{
+  test::Cloud::Ptr cloud;
+  return estimate (input, param, cloud);
+}
+
+/** Integral and exact normals agree on every pixel, border pixels included **/
+void
+expectSameNormals (const test::Cloud &cloud, surface::ZAdaptiveNormals::Parameter param)
+{
+  param.integral = false;
+  pcl::PointCloud<pcl::Normal>::Ptr exact = estimate (cloud, param);
+  param.integral = true;
+  param.tolerance = 100.f;              // never fall back to the exact path
+  pcl::PointCloud<pcl::Normal>::Ptr integral = estimate (cloud, param);
+
+  ASSERT_EQ (exact->points.size (), integral->points.size ());
+  unsigned nr_valid = 0;
+  for (size_t i=0; i<exact->points.size (); i++) {
+    const pcl::Normal &e = exact->points[i], &n = integral->points[i];
+    ASSERT_EQ (isnan (e.normal[0]), isnan (n.normal[0])) << "pixel " << i;
+    if (isnan (e.normal[0]))
+      continue;
+    nr_valid++;
+    float dot = e.normal[0]*n.normal[0] + e.normal[1]*n.normal[1] + e.normal[2]*n.normal[2];
+    EXPECT_GT (dot, 1.f - 1e-5f) << "pixel " << i;
+  }
+  EXPECT_GT (nr_valid, cloud.points.size () / 2);
+}
+
+}
+
+TEST (ZAdaptiveNormals, IntegralMatchesExact)
+{
+  test::Cloud::Ptr cloud = makeBowl (80, 60, 1.f, 20.f);
+  surface::ZAdaptiveNormals::Parameter param;
+  param.radius = 0.5;                   // every window point is an inlier
+  param.kernel = 4;
+  expectSameNormals (*cloud, param);
+}
+
+TEST (ZAdaptiveNormals, IntegralMatchesExactAdaptive)
+{
+  test::Cloud::Ptr cloud = makeBowl (80, 60, 1.f, 20.f);
+  surface::ZAdaptiveNormals::Parameter param;
+  param.adaptive = true;
+  param.kappa = 1.f;
+  param.d = 0.5f;
+  for (unsigned i=0; i<8; i++)
+    param.kernel_radius[i] = 3 + i%2;
+  expectSameNormals (*cloud, param);
+}
+
+/** Points beyond 4m use the kernel radius of the last interval **/
+TEST (ZAdaptiveNormals, FarPoints)
+{
+  test::Cloud::Ptr cloud = test::makePlane (80, 60, 5.f, 0.5f);
+  for (unsigned integral=0; integral<2; integral++) {
+    surface::ZAdaptiveNormals::Parameter param;
+    param.adaptive = true;
+    param.integral = integral;
+    for (unsigned i=0; i<8; i++)
+      param.kernel_radius[i] = 2 + i/2;
+    pcl::PointCloud<pcl::Normal>::Ptr normals = estimate (*cloud, param);
+    for (int v=1; v<59; v++) {
+      for (int u=1; u<79; u++) {
+        const pcl::Normal &n = normals->points[v*80 + u];
+        ASSERT_FALSE (isnan (n.normal[0])) << "pixel " << u << " " << v;
+        EXPECT_LT (n.normal[2], 0.f);
+      }
+    }
+  }
+}
+
+/** Normals and the points marked invalid do not depend on the number of threads **/
+TEST (ZAdaptiveNormals, ThreadInvariant)
+{
+  test::Cloud::Ptr input = makeBowl (160, 120, 1.f, 20.f);
+  test::addHoles (*input, 11, 40, 30, 80, 70);
+  for (unsigned integral=0; integral<2; integral++) {
+    surface::ZAdaptiveNormals::Parameter param;
+    param.adaptive = true;
+    param.integral = integral;
+    for (unsigned i=0; i<8; i++)
+      param.kernel_radius[i] = 3 + i%2;
+    test::Cloud::Ptr ref_cloud, cloud;
+#ifdef _OPENMP
+    int threads = omp_get_max_threads ();
+    omp_set_num_threads (1);
+    pcl::PointCloud<pcl::Normal>::Ptr ref = estimate (*input, param, ref_cloud);
+    omp_set_num_threads (std::max (threads, 3));
+    pcl::PointCloud<pcl::Normal>::Ptr normals = estimate (*input, param, cloud);
+    omp_set_num_threads (threads);
+#else
+    pcl::PointCloud<pcl::Normal>::Ptr ref = estimate (*input, param, ref_cloud);
+    pcl::PointCloud<pcl::Normal>::Ptr normals = estimate (*input, param, cloud);
+#endif
+
+    ASSERT_EQ (ref->points.size (), normals->points.size ());
+    unsigned nr_invalid = 0;
+    for (size_t i=0; i<ref->points.size (); i++) {
+      const pcl::Normal &r = ref->points[i], &n = normals->points[i];
+      ASSERT_EQ (isnan (r.normal[0]), isnan (n.normal[0])) << "pixel " << i;
+      ASSERT_EQ (isnan (ref_cloud->points[i].x), isnan (cloud->points[i].x)) << "pixel " << i;
+      if (isnan (r.normal[0])) {
+        nr_invalid += !isnan (input->points[i].z);
+        continue;
+      }
+      EXPECT_EQ (r.normal[0], n.normal[0]) << "pixel " << i;
+      EXPECT_EQ (r.normal[1], n.normal[1]) << "pixel " << i;
+      EXPECT_EQ (r.normal[2], n.normal[2]) << "pixel " << i;
+      EXPECT_EQ (r.curvature, n.curvature) << "pixel " << i;
+    }
+    EXPECT_GT (nr_invalid, 0u);         // the sparse block has points without normal
+  }
+}
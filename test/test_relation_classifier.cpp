@@ -0,0 +1,306 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file test_relation_classifier.cpp
+ * @brief Decision values and probabilities of the linear, random Fourier feature and RBF predictors.
+ */
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <utime.h>
+
+#include <unknown_objects_segmentation/LinearPredictor.h>
+#include <unknown_objects_segmentation/SVMPredictorSingle.h>
+
+namespace
+{
+
+/** libsvm couples the pairwise probabilities iteratively (stops at 0.005/nr_class) **/
+const double PROB_EPS = 1e-3;
+
+/** Write a model file to a temporary path, returns the path **/
+std::string
+writeModel (const char *content)
+{
+  char path[] = "/tmp/uos_test_modelXXXXXX";
+  int fd = mkstemp (path);
+  if (fd < 0)
+    return std::string ();
+  FILE *fp = fdopen (fd, "w");
+  fputs (content, fp);
+  fclose (fp);
+  return path;
+}
+
+/** Relation of type 1 between patch 0 and 1 with the feature vector (x0, x1) **/
+surface::Relation
+makeRelation (double x0, double x1)
+{
+  surface::Relation rel;
+  rel.type = 1;
+  rel.id_0 = 0;
+  rel.id_1 = 1;
+  rel.rel_value.push_back (x0);
+  rel.rel_value.push_back (x1);
+  rel.groundTruth = 0;
+  rel.prediction = 0;
+  rel.valid = true;
+  return rel;
+}
+
+/** Three class RBF probability model of libsvm (gamma as given) **/
+std::string
+writeRBFModel (const char *gamma)
+{
+  std::string content = std::string ("svm_type c_svc\nkernel_type rbf\ngamma ") + gamma + "\n"
+    "nr_class 3\ntotal_sv 5\nrho 0.1 -0.2 0.3\nlabel 1 0 2\n"
+    "probA -1.5 -2 -1\nprobB 0.1 -0.1 0.2\nnr_sv 2 1 2\nSV\n"
+    "1 0.5 1:0.5 2:0.2\n0.7 0.2 1:-0.3 3:0.8\n-1 0.9 1:0.1 2:-0.6 3:0.3\n"
+    "-0.4 -0.8 2:0.4 3:-0.2\n-0.3 -0.6 1:0.9 2:0.1\n";
+  return writeModel (content.c_str ());
+}
+
+/** Relations of type 1 with three features, rel_value is scaled in place by the predictors **/
+void
+makeRelations (surface::View &view)
+{
+  const double x[4][3] = {{0.3, 0.1, -0.2}, {-1., 0.5, 0.4}, {0.6, -0.4, 0.9}, {0., 0., 0.}};
+  view.relations.clear ();
+  for (unsigned i=0; i<4; i++) {
+    view.relations.push_back (makeRelation (x[i][0], x[i][1]));
+    view.relations.back ().rel_value.push_back (x[i][2]);
+  }
+}
+
+/** Probabilities of the relations of the predictor **/
+void
+expectSameProbabilities (svm::RelationClassifier &predictor, const surface::View &ref, double eps)
+{
+  surface::View view;
+  makeRelations (view);
+  ASSERT_TRUE (predictor.classify (&view, 1));
+  ASSERT_EQ (ref.relations.size (), view.relations.size ());
+  for (unsigned i=0; i<view.relations.size (); i++) {
+    ASSERT_EQ (ref.relations[i].rel_probability.size (), view.relations[i].rel_probability.size ());
+    for (unsigned j=0; j<view.relations[i].rel_probability.size (); j++)
+      EXPECT_NEAR (ref.relations[i].rel_probability[j], view.relations[i].rel_probability[j], eps) << "relation " << i;
+    EXPECT_EQ (ref.relations[i].prediction, view.relations[i].prediction) << "relation " << i;
+  }
+}
+
+/** Set the modification time of a file (seconds from now) **/
+void
+touch (const std::string &file, int dt)
+{
+  struct utimbuf t;
+  t.actime = t.modtime = time (NULL) + dt;
+  utime (file.c_str (), &t);
+}
+
+/** Probability of class label_0 of libsvm's two class sigmoid **/
+double
+sigmoid (double dec, double probA, double probB)
+{
+  double p = 1. / (1. + exp (dec * probA + probB));
+  return std::min (std::max (p, 1e-7), 1. - 1e-7);
+}
+
+}
+
+TEST (LinearPredictor, LinearDecision)
+{
+  std::string file = writeModel ("model_type linear\ndim 2\nnr_components 2\nlabel 1 0\n"
+                                 "probA -2\nprobB 0.1\nbias 0.5\nw 1 -2\n");
+  ASSERT_FALSE (file.empty ());
+  svm::LinearPredictor predictor (file);
+  unlink (file.c_str ());
+  ASSERT_TRUE (predictor.valid ());
+
+  surface::View view;
+  view.relations.push_back (makeRelation (0.3, 0.1));
+  view.relations.push_back (makeRelation (-1., 0.5));
+  ASSERT_TRUE (predictor.classify (&view, 1));
+
+  const double dec[2] = {0.3 - 0.2 + 0.5, -1. - 1. + 0.5};
+  for (unsigned i=0; i<2; i++) {
+    const surface::Relation &rel = view.relations[i];
+    ASSERT_EQ (2u, rel.rel_probability.size ());
+    double p = sigmoid (dec[i], -2., 0.1);
+    EXPECT_NEAR (p, rel.rel_probability[0], PROB_EPS);
+    EXPECT_NEAR (1. - p, rel.rel_probability[1], PROB_EPS);
+    EXPECT_EQ (p > 0.5 ? 1u : 0u, rel.prediction);
+  }
+}
+
+TEST (LinearPredictor, RandomFourierFeatures)
+{
+  std::string file = writeModel ("model_type rff\ndim 2\nnr_components 3\nlabel 1 0\n"
+                                 "probA -1\nprobB 0\nbias -0.2\nw 0.5 -1 2\n"
+                                 "omega 1 0  0 2  -1 1\nphase 0 0.5 1\n");
+  ASSERT_FALSE (file.empty ());
+  svm::LinearPredictor predictor (file);
+  unlink (file.c_str ());
+  ASSERT_TRUE (predictor.valid ());
+
+  surface::View view;
+  view.relations.push_back (makeRelation (0.4, -0.3));
+  ASSERT_TRUE (predictor.classify (&view, 1));
+
+  double x0 = 0.4, x1 = -0.3, norm = sqrt (2. / 3.);
+  double dec = norm * (0.5 * cos (x0) - 1. * cos (2. * x1 + 0.5) + 2. * cos (-x0 + x1 + 1.)) - 0.2;
+  EXPECT_NEAR (sigmoid (dec, -1., 0.), view.relations[0].rel_probability[0], PROB_EPS);
+}
+
+/** Relations of another type are left alone, broken model files are rejected **/
+TEST (LinearPredictor, TypesAndInvalidModels)
+{
+  std::string file = writeModel ("model_type linear\ndim 2\nnr_components 2\nlabel 1 0\n"
+                                 "probA -1\nprobB 0\nbias 0\nw 1 1\n");
+  ASSERT_FALSE (file.empty ());
+  svm::LinearPredictor predictor (file);
+  unlink (file.c_str ());
+
+  surface::View view;
+  view.relations.push_back (makeRelation (1., 1.));
+  view.relations[0].type = 2;
+  ASSERT_TRUE (predictor.classify (&view, 1));
+  EXPECT_EQ (0u, view.relations[0].rel_probability.size ());
+
+  std::string broken = writeModel ("model_type rff\ndim 2\nnr_components 2\nw 1 1\n");
+  ASSERT_FALSE (broken.empty ());
+  svm::LinearPredictor invalid (broken);
+  unlink (broken.c_str ());
+  EXPECT_FALSE (invalid.valid ());
+  EXPECT_FALSE (invalid.classify (&view, 2));
+}
+
+/** The batched dense RBF kernel gives the probabilities of svm_predict_probability **/
+TEST (SVMPredictorSingle, DenseMatchesLibsvm)
+{
+  std::string file = writeRBFModel ("0.8");
+  ASSERT_FALSE (file.empty ());
+  svm::SVMPredictorSingle predictor (file);
+  svm::svm_model *model = svm::svm_load_model (file.c_str ());
+  unlink (file.c_str ());
+  ASSERT_TRUE (model != NULL);
+
+  surface::View view;
+  makeRelations (view);
+  ASSERT_TRUE (predictor.classify (&view, 1));
+  for (unsigned i=0; i<view.relations.size (); i++) {
+    svm::svm_node node[4];
+    for (int k=0; k<3; k++) {
+      node[k].index = k+1;
+      node[k].value = view.relations[i].rel_value[k];
+    }
+    node[3].index = -1;
+    double prob[3];
+    double label = svm::svm_predict_probability (model, node, prob);
+    const surface::Relation &rel = view.relations[i];
+    ASSERT_EQ (3u, rel.rel_probability.size ());
+    for (int j=0; j<3; j++)
+      EXPECT_NEAR (prob[j], rel.rel_probability[j], 1e-9) << "relation " << i;
+    EXPECT_EQ ((bool) label, rel.prediction) << "relation " << i;
+  }
+  svm::svm_free_and_destroy_model (&model);
+}
+
+/** The binary model (mapped support vectors, with scaling) predicts like the text model **/
+TEST (SVMPredictorSingle, BinaryModel)
+{
+  std::string file = writeRBFModel ("0.8");
+  std::string param = writeModel ("x\n-1 1\n1 -2 2\n2 -1 1\n3 -1 2\n");
+  ASSERT_FALSE (file.empty ());
+  ASSERT_FALSE (param.empty ());
+  svm::SVMPredictorSingle text (file);
+  text.setScaling (true, param);
+  std::string binary_file = file + ".bin";
+  ASSERT_TRUE (text.saveBinary (binary_file));
+  svm::SVMPredictorSingle binary (binary_file);
+  unlink (file.c_str ());
+  unlink (param.c_str ());
+  unlink (binary_file.c_str ());
+
+  surface::View ref;
+  makeRelations (ref);
+  ASSERT_TRUE (text.classify (&ref, 1));
+  expectSameProbabilities (binary, ref, 1e-12);
+
+  std::string broken = writeModel ("SVMBIN01 truncated");
+  ASSERT_FALSE (broken.empty ());
+  svm::SVMPredictorSingle invalid (broken);
+  unlink (broken.c_str ());
+  surface::View view;
+  EXPECT_FALSE (invalid.classify (&view, 1));
+}
+
+/** load prefers the binary model, unless it is older than the model or the scaling parameters **/
+TEST (SVMPredictorSingle, LoadPrefersFreshBinary)
+{
+  std::string file = writeRBFModel ("0.8");
+  std::string other = writeRBFModel ("3");
+  std::string param = writeModel ("x\n-1 1\n1 -2 2\n2 -1 1\n3 -1 2\n");
+  ASSERT_FALSE (file.empty ());
+  ASSERT_FALSE (other.empty ());
+  ASSERT_FALSE (param.empty ());
+
+  // binary model of the other model next to the model file
+  surface::View ref_file, ref_other;
+  makeRelations (ref_file);
+  makeRelations (ref_other);
+  svm::SVMPredictorSingle text (file), text_other (other);
+  text.setScaling (true, param);
+  text_other.setScaling (true, param);
+  ASSERT_TRUE (text.classify (&ref_file, 1));
+  ASSERT_TRUE (text_other.classify (&ref_other, 1));
+  std::string binary_file = file + ".bin";
+  ASSERT_TRUE (text_other.saveBinary (binary_file));
+  ASSERT_NE (ref_file.relations[0].rel_probability[0], ref_other.relations[0].rel_probability[0]);
+
+  touch (file, -100);
+  touch (param, -100);
+  touch (binary_file, 0);
+  svm::SVMPredictorSingle *predictor = svm::SVMPredictorSingle::load (file, param);
+  expectSameProbabilities (*predictor, ref_other, 1e-12);
+  delete predictor;
+
+  touch (file, 100);              // stale binary model
+  predictor = svm::SVMPredictorSingle::load (file, param);
+  expectSameProbabilities (*predictor, ref_file, 1e-12);
+  delete predictor;
+
+  touch (file, -100);
+  touch (param, 100);
+  predictor = svm::SVMPredictorSingle::load (file, param);
+  expectSameProbabilities (*predictor, ref_file, 1e-12);
+  delete predictor;
+
+  unlink (file.c_str ());
+  unlink (other.c_str ());
+  unlink (param.c_str ());
+  unlink (binary_file.c_str ());
+}
@@ -0,0 +1,210 @@
+/**
+ *  Copyright (C) 2012  
+ *    Andreas Richtsfeld, Johann Prankl, Thomas Mörwald
+ *    Automation and Control Institute
+ *    Vienna University of Technology
+ *    Gusshausstraße 25-29
+ *    1170 Vienn, Austria
+ *    ari(at)acin.tuwien.ac.at
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/**
+ * @file test_surface_modeling.cpp
+ * @brief Model selection of SurfaceModeling (merge queue) on pre-segmented synthetic clouds.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <unknown_objects_segmentation/SegmenterLight.h>
+#include "synthetic_cloud.h"
+
+namespace
+{
+
+/** Normals and planes with the parameters of SegmenterLight **/
+void
+presegment (test::Cloud::Ptr &cloud, surface::View &view)
+{
+  segment::SegmenterConfig config;
+  surface::ZAdaptiveNormals nor (config.normals);
+  nor.setParameter (config.normals);
+  nor.setInputCloud (cloud);
+  nor.compute ();
+  nor.getNormals (view.normals);
+
+  surface::ClusterNormalsToPlanes cluster (config.clustering);
+  cluster.setPixelCheck (config.pixelCheck, config.pixelCheckNeighbors);
+  cluster.setInputCloud (cloud);
+  cluster.setView (&view);
+  cluster.compute ();
+}
+
+/** Model selection with the parameters of SegmenterLight **/
+void
+model (test::Cloud::Ptr &cloud, surface::View &view)
+{
+  segment::SegmenterConfig config;
+  surface::SurfaceModeling modeling (config.modeling);
+  Eigen::Matrix4d pose = Eigen::Matrix4d::Identity ();
+  modeling.setIntrinsic (test::FOCAL, test::FOCAL, cloud->width/2., cloud->height/2.);
+  modeling.setExtrinsic (pose);
+  modeling.setInputCloud (cloud);
+  modeling.setView (&view);
+  modeling.compute ();
+}
+
+/** Split the largest surface into its left and right half (same plane) **/
+void
+splitLargest (const test::Cloud &cloud, surface::View &view)
+{
+  unsigned largest = 0;
+  for (unsigned i=1; i<view.surfaces.size (); i++)
+    if (view.surfaces[i]->indices.size () > view.surfaces[largest]->indices.size ())
+      largest = i;
+  surface::SurfaceModel::Ptr left = view.surfaces[largest];
+  surface::SurfaceModel::Ptr right (new surface::SurfaceModel (*left));
+  std::vector<int> all = left->indices;
+  std::vector<Eigen::Vector3d> normals = left->normals;
+  left->indices.clear ();
+  left->normals.clear ();
+  right->indices.clear ();
+  right->normals.clear ();
+  for (unsigned i=0; i<all.size (); i++) {
+    surface::SurfaceModel::Ptr &half = (int) (all[i] % cloud.width) < (int) cloud.width/2 ? left : right;
+    half->indices.push_back (all[i]);
+    half->normals.push_back (normals[i]);
+  }
+  view.surfaces.push_back (right);
+  view.InvalidatePatchTable ();
+}
+
+/** Surface of a pixel (-1: none) **/
+int
+surfaceOf (const surface::View &view, int idx)
+{
+  for (unsigned i=0; i<view.surfaces.size (); i++)
+    if (std::find (view.surfaces[i]->indices.begin (), view.surfaces[i]->indices.end (), idx) != view.surfaces[i]->indices.end ())
+      return i;
+  return -1;
+}
+
+}
+
+/** Merging keeps every pixel in at most one surface and never adds surfaces **/
+TEST (SurfaceModeling, MergesKeepPixelsUnique)
+{
+  test::Cloud::Ptr cloud = test::makePlane (160, 120, 1.f, 0.3f, 0.001f);
+  surface::View view;
+  presegment (cloud, view);
+  splitLargest (*cloud, view);
+  unsigned nr_before = view.surfaces.size ();
+  std::vector<int> covered (cloud->points.size (), 0);
+  for (unsigned i=0; i<view.surfaces.size (); i++)
+    for (unsigned j=0; j<view.surfaces[i]->indices.size (); j++)
+      covered[view.surfaces[i]->indices[j]]++;
+
+  model (cloud, view);
+  ASSERT_GT (view.surfaces.size (), 0u);
+  EXPECT_LE (view.surfaces.size (), nr_before);
+  std::vector<int> count (cloud->points.size (), 0);
+  for (unsigned i=0; i<view.surfaces.size (); i++) {
+    EXPECT_EQ (view.surfaces[i]->indices.size (), view.surfaces[i]->normals.size ());
+    for (unsigned j=0; j<view.surfaces[i]->indices.size (); j++)
+      count[view.surfaces[i]->indices[j]]++;
+  }
+  for (unsigned i=0; i<count.size (); i++) {
+    EXPECT_LE (count[i], 1) << "pixel " << i;
+    EXPECT_LE (count[i], covered[i]) << "pixel " << i;
+  }
+}
+
+/** A box in front of a wall is not merged with the wall **/
+TEST (SurfaceModeling, KeepsSeparatedPlanes)
+{
+  test::Cloud::Ptr cloud = test::makePlane (160, 120, 1.5f, 0.f, 0.001f);
+  test::addBox (*cloud, 50, 30, 110, 90, 1.f);
+  surface::View view;
+  presegment (cloud, view);
+  model (cloud, view);
+
+  int wall = 10*160 + 10, box = 60*160 + 80;
+  ASSERT_NE (-1, surfaceOf (view, wall));
+  ASSERT_NE (-1, surfaceOf (view, box));
+  EXPECT_NE (surfaceOf (view, wall), surfaceOf (view, box));
+}
+
+/** The merges do not depend on the number of threads **/
+TEST (SurfaceModeling, ThreadInvariant)
+{
+  test::Cloud::Ptr cloud = test::makePlane (160, 120, 1.2f, 0.4f, 0.001f);
+  test::addBox (*cloud, 20, 20, 70, 70, 0.9f);
+  test::addBox (*cloud, 90, 40, 150, 100, 1.f, 60, 200, 60);
+
+  surface::View ref, view;
+  presegment (cloud, ref);
+  presegment (cloud, view);
+#ifdef _OPENMP
+  int threads = omp_get_max_threads ();
+  omp_set_num_threads (1);
+  model (cloud, ref);
+  omp_set_num_threads (std::max (threads, 3));
+  model (cloud, view);
+  omp_set_num_threads (threads);
+#else
+  model (cloud, ref);
+  model (cloud, view);
+#endif
+
+  ASSERT_EQ (ref.surfaces.size (), view.surfaces.size ());
+  for (unsigned i=0; i<ref.surfaces.size (); i++) {
+    EXPECT_EQ (ref.surfaces[i]->type, view.surfaces[i]->type);
+    EXPECT_EQ (ref.surfaces[i]->indices, view.surfaces[i]->indices);
+  }
+}
+
+/** Normals and planes of the pre-segmentation on a cloud with holes do not depend on the number of threads **/
+TEST (SurfaceModeling, PresegmentThreadInvariant)
+{
+  test::Cloud::Ptr cloud = test::makePlane (160, 120, 1.2f, 0.4f, 0.001f);
+  test::addBox (*cloud, 20, 20, 70, 70, 0.9f);
+  test::addBox (*cloud, 90, 40, 150, 100, 1.f, 60, 200, 60);
+  test::addHoles (*cloud, 11, 60, 50, 110, 90);
+
+  test::Cloud::Ptr ref_cloud (new test::Cloud (*cloud));
+  surface::View ref, view;
+#ifdef _OPENMP
+  int threads = omp_get_max_threads ();
+  omp_set_num_threads (1);
+  presegment (ref_cloud, ref);
+  omp_set_num_threads (std::max (threads, 3));
+  presegment (cloud, view);
+  omp_set_num_threads (threads);
+#else
+  presegment (ref_cloud, ref);
+  presegment (cloud, view);
+#endif
+
+  for (unsigned i=0; i<cloud->points.size (); i++)
+    ASSERT_EQ (isnan (ref_cloud->points[i].x), isnan (cloud->points[i].x)) << "pixel " << i;
+  ASSERT_GT (ref.surfaces.size (), 2u);
+  ASSERT_EQ (ref.surfaces.size (), view.surfaces.size ());
+  for (unsigned i=0; i<ref.surfaces.size (); i++)
+    EXPECT_EQ (ref.surfaces[i]->indices, view.surfaces[i]->indices) << "surface " << i;
+}